@@ -19,6 +19,10 @@ if (MOS_PORT_E9_ENABLED)
     list(APPEND MOS_KERNEL_GCC_DEFINITIONS PORT_E9_ENABLED)
 endif()
 
+if (MOS_PMM_BUDDY_ALLOCATOR)
+    list(APPEND MOS_KERNEL_GCC_DEFINITIONS PMM_BUDDY_ALLOCATOR)
+endif()
+
 set(MOS_KERNEL_GCC_INCLUDE_DIRS
     ${PROJECT_SOURCE_DIR}/include
 )
@@ -53,6 +57,10 @@ if (MOS_BUILD_MODE STREQUAL "DEBUG")
     list(APPEND MOS_KERNEL_NASM_ELF_MODE_FLAGS -g)
 endif()
 
+# Files the bootloader can load (10 Ramdisks + 1 Kernel file). Bootloader and kernel must agree.
+list(APPEND MOS_KERNEL_GCC_DEFINITIONS BOOT_MAX_FILES_COUNT=11)
+list(APPEND MOS_KERNEL_NASM_DEFINITIONS BOOT_MAX_FILES_COUNT=11)
+
 If (MOS_GRAPHICS_ENABLED)
     list(APPEND MOS_KERNEL_GCC_DEFINITIONS
         GRAPHICS_MODE_ENABLED
@@ -0,0 +1,60 @@
+/*
+ * ---------------------------------------------------------------------------
+ * Megha Operating System V2 - Allocator statistics
+ * ---------------------------------------------------------------------------
+ * Counters are updated in the allocation and free paths of an allocator, so that reading them is
+ * O(1). Used by both the kernel and the CM library allocators.
+ */
+#pragma once
+
+#include <types.h>
+#include <cm/osif.h>
+
+static inline UINT allocstats_bucket (SIZE units)
+{
+    if (units == 0) {
+        return 0;
+    }
+
+    UINT bucket = 31U - (UINT)__builtin_clz ((U32)units);
+    return (bucket < OSIF_ALLOCATOR_STATS_HISTOGRAM_BUCKETS)
+               ? bucket
+               : OSIF_ALLOCATOR_STATS_HISTOGRAM_BUCKETS - 1;
+}
+
+/***************************************************************************************************
+ * Records a successful allocation.
+ *
+ * @Input   stats       Statistics of the allocator.
+ * @Input   units       Requested size. Bytes for heaps, page frames for the PMM.
+ * @Input   usedBytes   Bytes taken out of the allocator by this allocation, overhead included.
+ * @return              Nothing
+ **************************************************************************************************/
+static inline void allocstats_recordAlloc (OSIF_AllocatorStats* stats, SIZE units, SIZE usedBytes)
+{
+    stats->allocCount++;
+    stats->usedBytes += usedBytes;
+    if (stats->usedBytes > stats->peakUsedBytes) {
+        stats->peakUsedBytes = stats->usedBytes;
+    }
+    stats->sizeHistogram[allocstats_bucket (units)]++;
+}
+
+/***************************************************************************************************
+ * Records a free. Memory which was not allocated through the allocator (for example, memory marked
+ * used before the allocator was ready) can be freed, so used bytes do not go below zero.
+ *
+ * @Input   stats       Statistics of the allocator.
+ * @Input   usedBytes   Bytes given back to the allocator, overhead included.
+ * @return              Nothing
+ **************************************************************************************************/
+static inline void allocstats_recordFree (OSIF_AllocatorStats* stats, SIZE usedBytes)
+{
+    stats->freeCount++;
+    stats->usedBytes -= (usedBytes < stats->usedBytes) ? usedBytes : stats->usedBytes;
+}
+
+static inline void allocstats_recordFailure (OSIF_AllocatorStats* stats)
+{
+    stats->failedCount++;
+}
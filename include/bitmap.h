@@ -33,3 +33,6 @@ BitmapState bitmap_get (Bitmap *b, UINT index);
 bool bitmap_setContinous (Bitmap *b, UINT index, UINT len, BitmapState state);
 INT bitmap_findContinous (Bitmap *b, BitmapState state, UINT len);
 bool bitmap_findContinousAt (Bitmap *b, BitmapState state, UINT len, UINT indexAt);
+INT bitmap_findContinousInRange (Bitmap *b, BitmapState state, UINT len, UINT indexFrom,
+                                 UINT indexTo);
+UINT bitmap_countContinous (Bitmap *b, BitmapState state, UINT index, UINT maxLen);
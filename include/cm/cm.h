@@ -77,6 +77,7 @@ static inline void cm_get_bootloaded_file (const char* const filename,
  ***************************************************************************************************/
 INT cm_thread_create (void (*startLocation)(void), bool isKernelMode);
 INT cm_process_create (const char* const filename, bool isKernelMode);
+INT cm_process_clone (void (*startLocation)(void));
 
 static inline bool cm_process_pop_event (OSIF_ProcessEvent* e)
 {
@@ -112,6 +113,52 @@ static inline void* cm_process_get_datamem_start(void)
     return (void*)syscall (OSIF_SYSCALL_PROCESS_GET_DATAMEM_START, 0, 0, 0, 0, 0);
 }
 
+static inline void* cm_process_memmap (size_t bytes)
+{
+    return (void*)syscall (OSIF_SYSCALL_PROCESS_MEMMAP, (U32)bytes, 0, 0, 0, 0);
+}
+
+static inline size_t cm_process_memunmap (void* addr)
+{
+    return (size_t)syscall (OSIF_SYSCALL_PROCESS_MEMUNMAP, (U32)addr, 0, 0, 0, 0);
+}
+
+static inline bool cm_get_memory_stats (OSIF_Allocators allocator, OSIF_AllocatorStats* stats)
+{
+    return (bool)syscall (OSIF_SYSCALL_GET_MEMORY_STATS, allocator, (PTR)stats, 0, 0, 0);
+}
+
+static inline U32 cm_process_get_pagefault_count(void)
+{
+    return (U32)syscall (OSIF_SYSCALL_GET_PAGEFAULT_COUNT, 0, 0, 0, 0, 0);
+}
+
+/***************************************************************************************************
+ * Shared memory
+ *
+ * Pages of a shared memory region are the same in every process which maps it. Any process which
+ * knows the handle can map it.
+ ***************************************************************************************************/
+static inline Handle cm_shm_create (size_t bytes)
+{
+    return (Handle)syscall (OSIF_SYSCALL_SHM_CREATE, (U32)bytes, 0, 0, 0, 0);
+}
+
+static inline void* cm_shm_map (Handle h, bool isReadOnly)
+{
+    return (void*)syscall (OSIF_SYSCALL_SHM_MAP, (U32)h, (U32)isReadOnly, 0, 0, 0);
+}
+
+static inline bool cm_shm_unmap (void* addr)
+{
+    return (bool)syscall (OSIF_SYSCALL_SHM_UNMAP, (U32)addr, 0, 0, 0, 0);
+}
+
+static inline bool cm_shm_close (Handle h)
+{
+    return (bool)syscall (OSIF_SYSCALL_SHM_CLOSE, (U32)h, 0, 0, 0, 0);
+}
+
 /***************************************************************************************************
  * Handling of process events
 ***************************************************************************************************/
@@ -136,3 +183,4 @@ void cm_malloc_init(void);
 void* cm_malloc (size_t bytes);
 void* cm_calloc (size_t bytes);
 bool cm_free (void* addr);
+void cm_malloc_getStats (OSIF_AllocatorStats* const stats);
@@ -35,6 +35,14 @@ typedef enum OSIF_SYSCALLS {
     OSIF_SYSCALL_GET_BOOTLOADED_FILE       = 15,
     OSIF_SYSCALL_ABORT_PROCESS             = 16,
     OSIF_SYSCALL_TEST                      = 17,
+    OSIF_SYSCALL_PROCESS_MEMMAP            = 18,
+    OSIF_SYSCALL_PROCESS_MEMUNMAP          = 19,
+    OSIF_SYSCALL_GET_MEMORY_STATS          = 20,
+    OSIF_SYSCALL_GET_PAGEFAULT_COUNT       = 21,
+    OSIF_SYSCALL_SHM_CREATE                = 22,
+    OSIF_SYSCALL_SHM_MAP                   = 23,
+    OSIF_SYSCALL_SHM_UNMAP                 = 24,
+    OSIF_SYSCALL_SHM_CLOSE                 = 25,
 } OSIF_SYSCALLS;
 
 typedef enum OSIF_ProcessEvents {
@@ -53,3 +61,23 @@ typedef struct OSIF_BootLoadedFiles {
     void* startLocation;
     U16 length;
 } OSIF_BootLoadedFiles;
+
+typedef enum OSIF_Allocators {
+    OSIF_ALLOCATOR_PMM     = 0,
+    OSIF_ALLOCATOR_KMALLOC = 1,
+    OSIF_ALLOCATOR_SALLOC  = 2,
+    OSIF_ALLOCATORS_COUNT
+} OSIF_Allocators;
+
+/* Bucket 'n' counts requests of [2^n, 2^(n+1)) units, the last bucket counts all larger requests.
+ * Units are bytes for heaps and page frames for the PMM. */
+#define OSIF_ALLOCATOR_STATS_HISTOGRAM_BUCKETS 16
+
+typedef struct OSIF_AllocatorStats {
+    SIZE usedBytes;
+    SIZE peakUsedBytes;
+    U32 allocCount;
+    U32 freeCount;
+    U32 failedCount;
+    U32 sizeHistogram[OSIF_ALLOCATOR_STATS_HISTOGRAM_BUCKETS];
+} OSIF_AllocatorStats;
@@ -13,7 +13,20 @@
 
 #define INVALID_HANDLE KERNEL_EXIT_FAILURE
 
+typedef enum KernelObjectTypes {
+    KERNEL_OBJECT_TYPE_INVALID = 0,
+    KERNEL_OBJECT_TYPE_WINDOW  = 1,
+    KERNEL_OBJECT_TYPE_SHARE   = 2,
+} KernelObjectTypes;
+
+typedef struct HandleItem {
+    void* obj;
+    KernelObjectTypes type;
+    UINT ownerID; // Process which created the handle.
+} HandleItem;
+
 void khandle_init(void);
-Handle khandle_createHandle (void* obj);
+Handle khandle_createHandle (void* obj, KernelObjectTypes type, UINT ownerID);
 bool khandle_freeHandle (Handle h);
-void* khandle_getObject (Handle h);
+void* khandle_getObject (Handle h, KernelObjectTypes type);
+Handle khandle_findHandle (KernelObjectTypes type, UINT ownerID);
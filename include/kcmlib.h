@@ -10,15 +10,29 @@
 #include <intrusive_list.h>
 #include <memloc.h>
 
+#define CM_MALLOC_MAGIC 0x434D4C43U /* 'CMLC' */
+
+/* Free regions are kept in bins by size. Bin 'n' has regions of [2^n, 2^(n+1)) bytes. */
+#define CM_MALLOC_FREE_BIN_COUNT 32
+
+/* Allocations of this size or more get their own virtual pages instead of a region in the heap. */
+#define CM_MALLOC_LARGE_THRESHOLD_BYTES (4 * KB)
+
 typedef struct CM_MallocHeader
 {
-    size_t netNodeSize; /// Size of a region together with the header size.
+    U32 magic;          /// Always CM_MALLOC_MAGIC. Header is corrupt or not a header otherwise.
+    size_t netNodeSize; /// Size of a region together with the header and footer size.
     bool isAllocated;   /// Is the region allocated or free.
-    ListNode adjnode;   /// A node in the Adjacent list.
-    ListNode freenode;  /// A node in the Free list.
+    ListNode freenode;  /// A node in the Free list of a bin.
     ListNode allocnode; /// A node in the Allocation list
 } CM_MallocHeader;
 
+/* Boundary tag at the end of every region. Used to reach the previous region. */
+typedef struct CM_MallocFooter
+{
+    size_t netNodeSize; /// Same as the netNodeSize in the header.
+} CM_MallocFooter;
+
 #if defined(UNITTEST)
     #define CM_MALLOC_MEM_SIZE_BYTES MOCK_THIS_MACRO_USING (cm_arch_mem_len_bytes_malloc)
 #else
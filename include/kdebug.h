@@ -37,6 +37,12 @@ typedef enum KernelDebugLogType {
     #define WARN(...)       (void)0
 #endif
 
+#if defined(DEBUG) && defined(PORT_E9_ENABLED)
+    void kdebug_printMemoryStats (void);
+#else
+    #define kdebug_printMemoryStats() (void)0
+#endif
+
 #if defined(DEBUG)
     #if !defined(GRAPHICS_MODE_ENABLED)
         typedef enum DisplayControls {
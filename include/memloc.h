@@ -10,10 +10,16 @@
 
 #if defined(UNITTEST)
     #include <mosunittest.h>
-    #define ARCH_MEM_START_KERNEL_PAB  MOCK_THIS_MACRO_USING (arch_mem_start_kernel_pab)
     #define ARCH_MEM_START_SALLOC      MOCK_THIS_MACRO_USING (arch_mem_start_salloc)
     #define ARCH_MEM_LEN_BYTES_SALLOC  MOCK_THIS_MACRO_USING (arch_mem_len_bytes_salloc)
     #define ARCH_MEM_LEN_BYTES_KMALLOC MOCK_THIS_MACRO_USING (arch_mem_len_bytes_kmalloc)
+    #define ARCH_MEM_LEN_BYTES_SLAB    MOCK_THIS_MACRO_USING (arch_mem_len_bytes_slab)
+    #define ARCH_MEM_START_KERNEL_EARLY_ALLOC \
+        MOCK_THIS_MACRO_USING (arch_mem_start_kernel_early_alloc)
+    #define ARCH_MEM_LEN_BYTES_KERNEL_EARLY_ALLOC \
+        MOCK_THIS_MACRO_USING (arch_mem_len_bytes_kernel_early_alloc)
+    #define ARCH_MEM_END_PHYSICAL_KERNEL_IMAGE \
+        MOCK_THIS_MACRO_USING (arch_mem_end_physical_kernel_image)
 #else
     #if defined(__i386__) || (defined(UNITTEST) && ARCH == x86)
         #include <x86/memloc.h>
@@ -22,9 +28,11 @@
         #define ARCH_MEM_LEN_BYTES_SALLOC     X86_MEM_LEN_BYTES_SALLOC
 
         #define ARCH_MEM_LEN_BYTES_KMALLOC    X86_MEM_LEN_BYTES_KMALLOC
+        #define ARCH_MEM_LEN_BYTES_SLAB       X86_MEM_LEN_BYTES_SLAB
 
-        #define ARCH_MEM_START_KERNEL_PAB     X86_MEM_START_KERNEL_PAB
-        #define ARCH_MEM_LEN_BYTES_KERNEL_PAB X86_MEM_LEN_BYTES_KERNEL_PAB
+        #define ARCH_MEM_START_KERNEL_EARLY_ALLOC     X86_MEM_START_KERNEL_EARLY_ALLOC
+        #define ARCH_MEM_LEN_BYTES_KERNEL_EARLY_ALLOC X86_MEM_LEN_BYTES_KERNEL_EARLY_ALLOC
+        #define ARCH_MEM_END_PHYSICAL_KERNEL_IMAGE    X86_MEM_END_PHYSICAL_KERNEL_IMAGE
 
         #define ARCH_MEM_START_PROCESS_MEMORY    X86_MEM_START_PROCESS_MEMORY
         #define ARCH_MEM_END_PROCESS_MEMORY      X86_MEM_END_PROCESS_MEMORY
@@ -10,28 +10,57 @@
 #include <types.h>
 #include <utils.h>
 #include <intrusive_list.h>
+#include <cm/osif.h>
 
 #define SALLOC_GRANUALITY   (8 * Byte)
 #define KMALLOC_GRANULARITY (16 * bytes)
 
+#define KMALLOC_MAGIC       0x4B4D4C43U /* 'KMLC' */
+/* Old header of a region combined into its free neighbour. Freeing it again is a double free. */
+#define KMALLOC_MAGIC_COMBINED 0x4B4D4346U /* 'KMCF' */
+
+/* Free regions are kept in bins by size. Bin 'n' has regions of [2^n, 2^(n+1)) bytes. */
+#define KMALLOC_FREE_BIN_COUNT 32
+
+/* Allocations of this size or more get their own virtual pages instead of a region in the heap. */
+#define KMALLOC_LARGE_THRESHOLD_BYTES CONFIG_PAGE_FRAME_SIZE_BYTES
+
 typedef struct KMallocHeader
 {
-    size_t netNodeSize; /// Size of a region together with the header size.
+    U32 magic;          /// Always KMALLOC_MAGIC. Header is corrupt or not a header otherwise.
+    size_t netNodeSize; /// Size of a region together with the header and footer size.
     bool isAllocated;   /// Is the region allocated or free.
-    ListNode adjnode;   /// A node in the Adjacent list.
-    ListNode freenode;  /// A node in the Free list.
+    ListNode freenode;  /// A node in the Free list of a bin.
     ListNode allocnode; /// A node in the Allocation list
 } KMallocHeader;
 
+/* Boundary tag at the end of every region. Used to reach the previous region. */
+typedef struct KMallocFooter
+{
+    size_t netNodeSize; /// Same as the netNodeSize in the header.
+} KMallocFooter;
+
+typedef struct KMemCache KMemCache;
+
 void ksalloc_init(void);
 void* ksalloc (UINT bytes);
+void* ksalloc_aligned (UINT bytes, UINT align);
 void* kscalloc (UINT bytes);
 SIZE ksalloc_getUsedMemory(void);
+void ksalloc_getStats (OSIF_AllocatorStats* const stats);
 
 void* kmalloc (size_t bytes);
 void* kmallocz (size_t bytes);
+void* kmalloc_aligned (size_t bytes, size_t align);
 bool kfree (void* addr);
 void kmalloc_init(void);
 SIZE kmalloc_getUsedMemory(void);
+void kmalloc_getStats (OSIF_AllocatorStats* const stats);
+
+void kslab_init(void);
+KMemCache* kmem_cache_create (const CHAR* name, SIZE objectSize);
+void* kmem_cache_alloc (KMemCache* cache);
+void* kmem_cache_allocz (KMemCache* cache);
+bool kmem_cache_free (KMemCache* cache, void* obj);
 
 #endif // MEMMANAGE_H
@@ -9,6 +9,8 @@ DECLARE_FUNC(BitmapState, bitmap_get, Bitmap *, UINT);
 DECLARE_FUNC(bool, bitmap_setContinous, Bitmap *, UINT, UINT, BitmapState);
 DECLARE_FUNC(INT, bitmap_findContinous, Bitmap *, BitmapState, UINT);
 DECLARE_FUNC(bool, bitmap_findContinousAt, Bitmap *, BitmapState, UINT, UINT);
+DECLARE_FUNC(INT, bitmap_findContinousInRange, Bitmap *, BitmapState, UINT, UINT, UINT);
+DECLARE_FUNC(UINT, bitmap_countContinous, Bitmap *, BitmapState, UINT, UINT);
 
 void resetBitmapFake();
 #endif // BITMAP_FAKE_H
@@ -0,0 +1,14 @@
+#pragma once
+
+#define YUKTI_TEST_STRIP_PREFIX
+#include <unittest/yukti.h>
+#include <types.h>
+#include <memmanage.h>
+
+DECLARE_FUNC(void*, kmalloc, size_t);
+DECLARE_FUNC(bool, kfree, void*);
+DECLARE_FUNC(KMemCache*, kmem_cache_create, const CHAR*, SIZE);
+DECLARE_FUNC(void*, kmem_cache_allocz, KMemCache*);
+DECLARE_FUNC(bool, kmem_cache_free, KMemCache*, void*);
+
+void resetKmallocFake();
@@ -6,5 +6,17 @@
 
 DECLARE_FUNC (void *, kpg_temporaryMap, Physical);
 DECLARE_FUNC_VOID (kpg_temporaryUnmap);
+DECLARE_FUNC (bool, kpg_zeroPageFrame, Physical);
+DECLARE_FUNC (bool, kpg_copyPageFrame, Physical, Physical);
+DECLARE_FUNC (void *, kpg_getDirectMapAddress, Physical);
+DECLARE_FUNC (bool, kpg_mapContinous, PageDirectory, PTR, Physical, SIZE, PagingMapFlags);
+DECLARE_FUNC (PageDirectory, kpg_getcurrentpd);
+DECLARE_FUNC (SIZE, kpg_getLargePageSizeBytes);
+DECLARE_FUNC (bool, kpg_unmapRange, PageDirectory, PTR, SIZE, PagingOperationFlags);
+DECLARE_FUNC (bool, kpg_doesMappingExists, PageDirectory, PTR, Physical*);
+DECLARE_FUNC (bool, kpg_shareMappings, PageDirectory, PageDirectory, PTR, SIZE, PagingMapFlags);
+DECLARE_FUNC (bool, kpg_remap, PageDirectory, PTR, Physical, PagingMapFlags);
+DECLARE_FUNC (bool, kpg_mapUnmappedPages, PageDirectory, PTR, SIZE, Physical const*, SIZE, PagingMapFlags,
+              SIZE*);
 
 void resetPagingFake();
@@ -10,6 +10,12 @@ DECLARE_FUNC_VOID(kpmm_init);
 DECLARE_FUNC(bool, kpmm_free, Physical, UINT);
 DECLARE_FUNC(bool, kpmm_alloc, Physical*, UINT, KernelPhysicalMemoryRegions);
 DECLARE_FUNC(bool, kpmm_allocAt, Physical, UINT, KernelPhysicalMemoryRegions);
+DECLARE_FUNC(bool, kpmm_allocZeroed, Physical*, KernelPhysicalMemoryRegions);
+DECLARE_FUNC(bool, kpmm_freeZeroed, Physical);
+DECLARE_FUNC(bool, kpmm_share, Physical);
+DECLARE_FUNC(UINT, kpmm_getShareCount, Physical);
+DECLARE_FUNC(bool, kpmm_getZeroFrame, Physical*);
+DECLARE_FUNC(bool, kpmm_isZeroFrame, Physical);
 DECLARE_FUNC(size_t,  kpmm_getFreeMemorySize);
 DECLARE_FUNC(USYSINT, kpmm_getUsableMemorySize, KernelPhysicalMemoryRegions);
 
@@ -7,5 +7,8 @@
 
 DECLARE_FUNC(PTR, kvmm_memmap, VMemoryManager*, PTR, Physical const* const, SIZE,
                  VMemoryMemMapFlags, Physical* const );
+DECLARE_FUNC(bool, kvmm_decommit, VMemoryManager*, PTR, SIZE);
+DECLARE_FUNC(PTR, kvmm_allocGuarded, VMemoryManager*, SIZE, VMemoryMemMapFlags);
+DECLARE_FUNC(bool, kvmm_freeGuarded, VMemoryManager*, PTR, SIZE* const);
 
 void resetVMMFake();
@@ -6,7 +6,7 @@
 #include <paging.h>
 
 DECLARE_FUNC(ArchPageDirectoryEntry*, s_getPdeFromCurrentPd, UINT);
-DECLARE_FUNC(ArchPageTableEntry*, s_getPteFromCurrentPd, UINT);
+DECLARE_FUNC(ArchPageTableEntry*, s_getPteFromCurrentPd, UINT, UINT);
 DECLARE_FUNC (void *, s_getLinearAddress, UINT, UINT, UINT);
 
 void resetPagingFake();
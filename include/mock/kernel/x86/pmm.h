@@ -8,6 +8,8 @@
 
 DECLARE_FUNC_VOID(kpmm_arch_init, Bitmap *);
 DECLARE_FUNC(U64, kpmm_arch_getInstalledMemoryByteCount);
+DECLARE_FUNC(UINT, kpmm_arch_getPageFrameCount);
+DECLARE_FUNC(PTR, kpmm_arch_earlyAlloc, SIZE);
 
 void resetX86Pmm();
 
@@ -12,14 +12,20 @@
 
 typedef struct MockedMacro {
     // Add fields here corresponding to the macro you are mocking
-    int recursive_pde_index;
-    int kernel_pde_index;
-    int temporary_pte_index_extern;
-    int temporary_pte_index_internal;
-    uintptr_t arch_mem_start_kernel_pab;
+    unsigned int recursive_pde_index;
+    unsigned int kernel_pde_index;
+    unsigned int kmap_first_pte_index;
+    uintptr_t direct_map_start;
+    size_t direct_map_len_bytes;
+    int is_global_pages_supported;
+    int is_large_pages_supported;
     uintptr_t arch_mem_start_salloc;
+    uintptr_t arch_mem_start_kernel_early_alloc;
+    size_t arch_mem_len_bytes_kernel_early_alloc;
+    uintptr_t arch_mem_end_physical_kernel_image;
     size_t arch_mem_len_bytes_salloc;
     size_t arch_mem_len_bytes_kmalloc;
+    size_t arch_mem_len_bytes_slab;
     size_t config_handles_array_item_count;
     // LibCM
     size_t cm_arch_mem_len_bytes_malloc;
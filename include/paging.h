@@ -35,6 +35,7 @@ typedef enum PagingMapFlags {
     PG_MAP_FLAG_CACHE_ENABLED  = (1 << 1),
     PG_MAP_FLAG_WRITABLE       = (1 << 2),
     PG_MAP_FLAG_NOT_PRESENT    = (1 << 3),
+    PG_MAP_FLAG_LARGE_PAGES    = (1 << 4), // Range can be mapped with large pages, if allowed.
     PG_MAP_FLAG_DEFAULT        = (PG_MAP_FLAG_CACHE_ENABLED),
     PG_MAP_FLAG_KERNEL_DEFAULT = (PG_MAP_FLAG_DEFAULT | PG_MAP_FLAG_KERNEL),
 } PagingMapFlags;
@@ -44,6 +45,7 @@ typedef enum PagingOperationFlags {
     PG_NEWPD_FLAG_RECURSIVE_MAP     = (1 << 1),
     PG_DELPD_FLAG_KEEP_KERNEL_PAGES = (1 << 2),
     PG_NEWPD_FLAG_CREATE_NEW        = (1 << 3),
+    PG_UNMAP_FLAG_FREE_FRAMES       = (1 << 4),
 } PagingOperationFlags;
 
 // Physical start of the page frame 'pf'.
@@ -56,10 +58,25 @@ PageDirectory kpg_getcurrentpd(void);
 bool kpg_mapContinous (PageDirectory pd, PTR vaStart, Physical paStart, SIZE numPages,
                        PagingMapFlags flags);
 bool kpg_map (PageDirectory pd, PTR va, Physical pa, PagingMapFlags flags);
+bool kpg_mapUnmappedPages (PageDirectory pd, PTR vaStart, SIZE numPages,
+                           Physical const* const frames, SIZE frameCount, PagingMapFlags flags,
+                           SIZE* const framesUsed);
+bool kpg_shareMappings (PageDirectory srcPD, PageDirectory destPD, PTR vaStart, SIZE numPages,
+                        PagingMapFlags flags);
+bool kpg_remap (PageDirectory pd, PTR va, Physical pa, PagingMapFlags flags);
 bool kpg_unmapContinous (PageDirectory pd, PTR vaStart, SIZE numPages);
+bool kpg_unmapRange (PageDirectory pd, PTR vaStart, SIZE numPages, PagingOperationFlags flags);
 bool kpg_unmap (PageDirectory pd, PTR va);
 void* kpg_temporaryMap (Physical pa);
 void kpg_temporaryUnmap(void);
+bool kpg_zeroPageFrame (Physical pa);
+bool kpg_copyPageFrame (Physical dest, Physical src);
+bool kpg_setupDirectMap (void);
+void kpg_preallocateKernelPageTables (void);
+bool kpg_enableGlobalPages (void);
+bool kpg_enableLargePages (void);
+SIZE kpg_getLargePageSizeBytes (void);
+void* kpg_getDirectMapAddress (Physical pa);
 bool kpg_doesMappingExists (PageDirectory pd, PTR va, Physical* pa);
 bool kpg_setupPageDirectory (Physical* const pd, PagingOperationFlags flags,
                              Physical const* const kernelPD);
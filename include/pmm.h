@@ -13,6 +13,14 @@
 #include <utils.h>
 #include <config.h>
 #include <bitmap.h>
+#include <cm/osif.h>
+
+/* Page frames which are zeroed ahead of time, when the kernel is idle. Page tables, page directories
+ * and demand committed pages are taken from here, so that they are not zeroed when allocated. */
+#define PMM_ZERO_POOL_CAPACITY 32U
+
+/* Owners a page frame can have besides the first one. */
+#define PMM_MAX_SHARE_COUNT 255U
 
 typedef enum KernelPhysicalMemoryRegions
 {
@@ -28,12 +36,23 @@ typedef enum KernelPhysicalMemoryStates {
 
 void kpmm_init (void);
 void kpmm_arch_init (Bitmap *bitmap);
+UINT kpmm_arch_getPageFrameCount (void);
+PTR kpmm_arch_earlyAlloc (SIZE byteCount);
+SIZE kpmm_arch_getEarlyAllocatedBytes (void);
 
 bool kpmm_free (Physical startAddress, UINT pageCount);
 bool kpmm_alloc (Physical *address, UINT pageCount, KernelPhysicalMemoryRegions reg);
 bool kpmm_allocAt (Physical start, UINT pageCount, KernelPhysicalMemoryRegions reg);
+bool kpmm_allocZeroed (Physical *address, KernelPhysicalMemoryRegions reg);
+bool kpmm_freeZeroed (Physical address);
+UINT kpmm_refillZeroPool (UINT maxCount);
+bool kpmm_share (Physical phy);
+UINT kpmm_getShareCount (Physical phy);
+bool kpmm_getZeroFrame (Physical* address);
+bool kpmm_isZeroFrame (Physical phy);
 
 size_t kpmm_getFreeMemorySize (void);
+void kpmm_getStats (OSIF_AllocatorStats* const stats);
 U64 kpmm_arch_getInstalledMemoryByteCount (void);
 USYSINT kpmm_getUsableMemorySize (KernelPhysicalMemoryRegions reg);
 KernelPhysicalMemoryStates kpmm_getPageStatus(Physical phy);
@@ -0,0 +1,18 @@
+/*
+* ---------------------------------------------------------------------------
+* Megha Operating System V2 - Cross Platform Kernel - Buddy allocator for Physical pages
+*
+* Optional PMM backend, enabled with the PMM_BUDDY_ALLOCATOR build definition. It only keeps an
+* index of free page frames, PAB stays the source of truth for the state of every page frame.
+* ---------------------------------------------------------------------------
+*/
+
+#pragma once
+
+#include <types.h>
+
+SIZE kpmm_buddy_getMemorySize (UINT frameCount);
+void kpmm_buddy_init (void* memory, UINT frameCount);
+void kpmm_buddy_markFree (UINT startFrame, UINT frameCount);
+void kpmm_buddy_markUsed (UINT startFrame, UINT frameCount);
+INT kpmm_buddy_find (UINT frameCount);
@@ -26,10 +26,12 @@ typedef enum KProcessFlags {
     PROCESS_FLAGS_NONE           = 0,
     PROCESS_FLAGS_KERNEL_PROCESS = (1 << 0),
     PROCESS_FLAGS_THREAD         = (1 << 1),
+    PROCESS_FLAGS_CLONE          = (1 << 2), // Gets a copy on write clone of the parent's context.
 } KProcessFlags;
 
 __asm__(".equ PROCESS_FLAGS_KERNEL_PROCESS, (1 << 0);"
-        ".equ PROCESS_FLAGS_THREAD,         (1 << 1);");
+        ".equ PROCESS_FLAGS_THREAD,         (1 << 1);"
+        ".equ PROCESS_FLAGS_CLONE,          (1 << 2);");
 
 typedef struct KProcessRegisterState ProcessRegisterState;
 
@@ -76,4 +78,3 @@ UINT kprocess_getCurrentPID(void);
 bool kprocess_popEvent (UINT pid, KProcessEvent* ev);
 bool kprocess_pushEvent (UINT pid, UINT eventID, UINT eventData);
 KProcessSections* kprocess_getCurrentProcessDataSection(void);
-void kprocess_syncPD(void);
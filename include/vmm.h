@@ -18,9 +18,12 @@ typedef enum VMemoryMemMapFlags {
     VMM_MEMMAP_FLAG_NULLPAGE    = (1 << 2), // Never backed, page fault on access.
     VMM_MEMMAP_FLAG_IMMCOMMIT   = (1 << 3), // Commit physical pages (use provided input) now.
     VMM_MEMMAP_FLAG_COMMITTED   = (1 << 4), // VAs are already mapped outside VMM.
+    VMM_MEMMAP_FLAG_GUARDED     = (1 << 5), // Between two null pages. Set by kvmm_allocGuarded.
+    VMM_MEMMAP_FLAG_POPULATE    = (1 << 6), // Commit on access pages, but commit all of them now.
 } VMemoryMemMapFlags;
 
 typedef struct VMemoryManager VMemoryManager;
+typedef struct VMemoryShare VMemoryShare;
 
 VMemoryManager* kvmm_new (PTR start, PTR end, Physical pd,
                           KernelPhysicalMemoryRegions physicalRegion);
@@ -28,11 +31,23 @@ Physical kvmm_getPageDirectory (const VMemoryManager* vmm);
 bool kvmm_delete (VMemoryManager** vmm);
 bool kvmm_free (VMemoryManager* vmm, PTR start_va);
 bool kvmm_commitPage (VMemoryManager* vmm, PTR va);
+bool kvmm_decommit (VMemoryManager* vmm, PTR va, SIZE szPages);
+bool kvmm_setFaultAround (VMemoryManager* vmm, PTR va, SIZE szPages);
+U32 kvmm_getPageFaultCount (const VMemoryManager* vmm);
+PTR kvmm_allocGuarded (VMemoryManager* vmm, SIZE szPages, VMemoryMemMapFlags flags);
+bool kvmm_freeGuarded (VMemoryManager* vmm, PTR va, SIZE* const outPages);
 PTR kvmm_findFree (VMemoryManager* vmm, SIZE szPages);
 PTR kvmm_memmap (VMemoryManager* vmm, PTR va, Physical const* const pa, SIZE szPages,
                  VMemoryMemMapFlags flags, Physical* const outPA);
 bool kvmm_checkbounds (VMemoryManager* vmm, PTR addr);
-bool kvmm_isPageDirectoryDirty (VMemoryManager* const vmm);
+VMemoryShare* kvmm_newShare (SIZE szPages, KernelPhysicalMemoryRegions physicalRegion);
+void kvmm_releaseShare (VMemoryShare* share);
+PTR kvmm_mapShare (VMemoryManager* vmm, VMemoryShare* share, VMemoryMemMapFlags flags);
+bool kvmm_unmapShare (VMemoryManager* vmm, PTR va);
+PTR kvmm_mapSharePrivate (VMemoryManager* vmm, PTR va, VMemoryShare* share);
+VMemoryManager* kvmm_clone (VMemoryManager* vmm, Physical pd);
+bool kvmm_copyOnWrite (VMemoryManager* vmm, PTR va);
+bool kvmm_mapZeroPage (VMemoryManager* vmm, PTR va);
 
 #if defined(DEBUG) && defined(PORT_E9_ENABLED)
 void kvmm_printVASList (VMemoryManager* vmm);
@@ -11,20 +11,21 @@
 #include <vmm.h>
 #include <pmm.h>
 
-typedef struct VMemoryShare {
+struct VMemoryShare {
     Physical* pages;
     SIZE count;    // Number of pages added to the pages array
-    SIZE refcount; // Number of VirtualAddressSpace objects that share this Memory
-} VMemoryShare;
+    SIZE refcount; // Address spaces which map the pages, and the owner of the share (its handle).
+};
 
 struct VMemoryManager {
     PTR start;
     PTR end;
     bool isStaticAllocated;
     Physical parentProcessPD;
-    bool isPageDirectoryDirty; // Process's PageDirectory has changed. Will be reset once read.
     KernelPhysicalMemoryRegions physicalRegion;
-    ListNode head;
+    ListNode head;                      // Address spaces sorted by start address.
+    struct VMemoryAddressSpace* root;   // Root of the tree of address spaces.
+    U32 pageFaultCount;                 // Page faults handled by committing or copying pages.
 };
 
 typedef struct VMemoryAddressSpace {
@@ -33,7 +34,17 @@ typedef struct VMemoryAddressSpace {
     PTR start_vm;            // Address space starts from this Virtual address
     SIZE allocationSzBytes;  // Number of virtual pages reserved by this Address space
     VMemoryShare* share;     // MemoryShare associated with this mapping.
+    SIZE faultAroundPages;   // Pages around the faulting page which are committed with it.
+    bool isLargePageMapped;  // Kernel pages which may be mapped with large pages.
     ListNode adjMappingNode; // Adds to Virtual Address space list through this node.
+    // Address spaces are also kept in a red-black tree ordered by start_vm. Every node knows the
+    // largest free gap in its subtree, so both lookup and search for free range are O(log n).
+    struct VMemoryAddressSpace* treeParent;
+    struct VMemoryAddressSpace* treeLeft;
+    struct VMemoryAddressSpace* treeRight;
+    bool treeIsRed;
+    SIZE gapBytes;           // Free bytes between the previous address space (or VMM start) and this.
+    SIZE subtreeMaxGapBytes; // Largest gapBytes in the subtree rooted at this node.
     // These are debug specific properties/metadata and no operation in VMM depend on them.
 #ifdef DEBUG
     U32 processID;    // 0 - Associated with kernel, otherwise this is the process ID
@@ -19,7 +19,7 @@ struct BootLoaderInfo {
     const U8 font_data[BOOT_FONTS_GLYPH_COUNT * BOOT_FONTS_GLYPH_BYTES];
     const struct BootGraphicsModeInfo gxInfo;
     const U16 filecount;
-    const struct BootFileItem files[11];
+    const struct BootFileItem files[CONFIG_BOOT_MAX_FILES_COUNT];
     const U16 count;
     const struct BootMemoryMapItem items[];
 } __attribute__ ((packed));
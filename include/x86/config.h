@@ -23,7 +23,7 @@
     #define CONFIG_TXMODE_COLUMNS           80 // TODO: Replace MAX_VGA_ROWS, COLUMNS with these.
     #define CONFIG_TXMODE_ROWS              50
     #define CONFIG_MAX_CALL_TRACE_DEPTH     10
-    #define CONFIG_PAB_NUMBER_OF_PAGES      1 /* Must be 1. Limitations of current Physical Map */
+    #define CONFIG_PAB_NUMBER_OF_PAGES      64 /* Largest PAB. Enough to address 4 GB of RAM. */
     #define CONFIG_GXMODE_FONT_WIDTH        8
     #define CONFIG_GXMODE_FONT_HEIGHT       16
     #define CONFIG_GXMODE_XRESOLUTION       800
@@ -33,12 +33,17 @@
     #define CONFIG_INTERRUPT_CLOCK_FREQ_HZ  (1000U)
     #define CONFIG_PROCESS_PERIOD_US        (20000U) /* Processes should yield before this time */
     #define CONFIG_VIDEO_REFRESH_PERIOD_US  (20000U)
+    #define CONFIG_IDLE_ZEROED_PAGES        (4U) /* Pages zeroed every time a process yields */
+    #define CONFIG_VMM_FAULT_AROUND_PAGES   (16U) /* Pages committed together on a page fault */
+    #define CONFIG_KMAP_SLOT_COUNT          (8U)  /* Pages temporarily mapped at the same time */
 
     #define CONFIG_HANDLES_ARRAY_ITEM_COUNT (1000) /* Number of objects stored in handles array */
+    #define CONFIG_SHM_MAX_SIZE_BYTES       (4U * MB) /* Largest share a process can create */
 
     #define CONFIG_PS2_MOUSE_SAMPLE_RATE (40)
 
     #define CONFIG_BOOT_FILENAME_LEN_CHARS (12) /* Fat12. Zero terminated string */
+    #define CONFIG_BOOT_MAX_FILES_COUNT    BOOT_MAX_FILES_COUNT /* Same as the bootloader */
 
     /** Derived Configs
      * SHOULD NOT BE EDITTED MANUALLY */
@@ -19,9 +19,19 @@ typedef struct x86_CR3 {
 #define X86_EFLAGS_BIT1_ALWAYS_ONE (1 << 1)
 #define X86_EFLAGS_INTERRUPT_ENABLE (1 << 9)
 
+#define X86_CR4_PSE (1 << 4) // 4 MByte pages enabled
+#define X86_CR4_PGE (1 << 7) // Global pages enabled
+
+#define X86_CPUID_LEAF_FEATURES    1
+#define X86_CPUID_FEATURES_EDX_PSE (1 << 3)  // 4 MByte pages supported
+#define X86_CPUID_FEATURES_EDX_PGE (1 << 13) // Global pages supported
+
 #define x86_LOAD_REG(reg, source) __asm__ volatile("mov " #reg ", %0;" ::"r"(source))
 #define x86_READ_REG(reg, dest) __asm__ volatile("mov %0, " #reg :"=r"(dest))
 #define x86_READ_EFLAGS(dest) __asm__ volatile("pushfd\n pop %0" :"=r"(dest))
+#define x86_CPUID(leaf, a, b, c, d) \
+    __asm__ volatile("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "a"(leaf))
+#define x86_READ_TSC(dest) __asm__ volatile("rdtsc" : "=A"(dest))
 #define X86_PAUSE() __asm__ volatile("pause")
 #define X86_ENABLE_INTERRUPTS() __asm__ volatile("sti")
 #define X86_DISABLE_INTERRUPTS() __asm__ volatile("cli")
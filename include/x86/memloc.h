@@ -41,25 +41,30 @@
         #define MEM_START_KERNEL_PAGE_TABLE     0xC0024000
         #define MEM_LEN_BYTES_KERNEL_PAGE_TABLE (4 * KB)
 
-        #define X86_MEM_START_KERNEL_PAB        0xC0025000
-        #define X86_MEM_LEN_BYTES_KERNEL_PAB    PAB_SIZE_BYTES
-
-        #define X86_MEM_START_SALLOC            0xC0026000
+        #define X86_MEM_START_SALLOC            0xC0025000
         #define X86_MEM_LEN_BYTES_SALLOC        (128 * KB)
 
-        #define MEM_END_KERNEL_LOW_REGION       (0xC0046000 - 1)
+        #define MEM_END_KERNEL_LOW_REGION       (0xC0045000 - 1)
         #define MEM_LEN_BYTES_KERNEL_LOW_REGION \
             MEM_LEN_BYTES (MEM_START_KERNEL_LOW_REGION, MEM_END_KERNEL_LOW_REGION)
 
         #define MEM_START_KERNEL_HIGH_REGION    0xC0100000
-#ifdef GRAPHICS_MODE_ENABLED
-        #define X86_MEM_LEN_BYTES_KMALLOC       (128 * KB)
-#else
-        #define X86_MEM_LEN_BYTES_KMALLOC       (128 * KB)
-#endif // GRAPHICS_MODE_ENABLED
+        /* Kernel image is loaded at the start of the high region. Its end is set in kernel.ld. */
+        extern char __kernel_end[];
+        #define X86_MEM_END_PHYSICAL_KERNEL_IMAGE \
+            ((USYSINT)__kernel_end - MEM_START_HIGHER_HALF_MAP)
+        /* Reserved for the kmalloc arena, which grows on demand. Pages are committed on use. */
+        #define X86_MEM_LEN_BYTES_KMALLOC       (8 * MB)
+        #define X86_MEM_LEN_BYTES_SLAB          (512 * KB) /* Slab pages are committed on use */
 
         #define MEM_END_HIGHER_HALF_MAP         0xC0200000
 
+        /* Memory allocated before PMM is ready (PAB for example) is mapped here. Page table for this
+         * region already exists, so no allocation is required to map it. */
+        #define X86_MEM_START_KERNEL_EARLY_ALLOC     MEM_END_HIGHER_HALF_MAP
+        #define X86_MEM_LEN_BYTES_KERNEL_EARLY_ALLOC \
+            (MEM_START_PAGING_KMAP - X86_MEM_START_KERNEL_EARLY_ALLOC)
+
         #define X86_MEM_START_PROCESS_MEMORY    (4 * KB)  // 0000h -> 1000h being NULL page
         #define X86_MEM_START_PROCESS_TEXT      (64 * KB) // Not sure why I choose 64 KB here!
         #define X86_MEM_START_PROCESS_DATA      (2 * MB)
@@ -67,8 +72,15 @@
         #define X86_MEM_LEN_BYTES_PROCESS_DATA  (256 * KB)
         #define X86_MEM_END_PROCESS_MEMORY      (3 * GB - 1)
 
-        #define MEM_START_PAGING_EXT_TEMP_MAP   0xC03FE000U // Temporary map for external modules
-        #define MEM_START_PAGING_INT_TEMP_MAP   0xC03FF000U // Temporary map for Paging module
+        /* Physical memory from address 0 is mapped here, so physical to virtual is an addition.
+         * Only installed memory is mapped, memory beyond the window uses temporary maps. */
+        #define X86_MEM_START_DIRECT_MAP        0xE0000000U
+        #define X86_MEM_LEN_BYTES_DIRECT_MAP    (256 * MB)
+
+        /* Kmap slots. Physical pages beyond the direct map are temporarily mapped here. */
+        #define MEM_START_PAGING_KMAP           (0xC0400000U - MEM_LEN_BYTES_PAGING_KMAP)
+        #define MEM_LEN_BYTES_PAGING_KMAP       (CONFIG_KMAP_SLOT_COUNT * 4 * KB)
+
         #define MEM_START_PAGING_RECURSIVE_MAP  0xFFC00000U // Recursive map of PDs
 
         #define MEM_END_KERNEL_HIGH_REGION      (MEM_START_PAGING_RECURSIVE_MAP - 1)
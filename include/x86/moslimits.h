@@ -26,12 +26,14 @@
 #define MAX_GDT_DESC_COUNT 512U /* Number of GDT entries in memory */
 #define MAX_IDT_DESC_COUNT 256U /* Maximum number of IDT entries */
 
-/* PAB and addressable RAM */
+/* PAB and addressable RAM.
+ * Actual size of the PAB is determined at boot from the installed RAM, these are the upper limits.
+ * Addressable byte count is 4 GB, so it is U64. */
 #define PAB_BITS_PER_STATE 2U
-#define PAB_SIZE_BYTES     (CONFIG_PAGE_FRAME_SIZE_BYTES * CONFIG_PAB_NUMBER_OF_PAGES)
+#define MAX_PAB_SIZE_BYTES (CONFIG_PAGE_FRAME_SIZE_BYTES * CONFIG_PAB_NUMBER_OF_PAGES)
 
-#define MAX_PAB_ADDRESSABLE_PAGE_COUNT (PAB_SIZE_BYTES * 8 / PAB_BITS_PER_STATE)
-#define MAX_PAB_ADDRESSABLE_BYTE_COUNT (PAGEFRAME_TO_PHYSICAL (MAX_PAB_ADDRESSABLE_PAGE_COUNT))
+#define MAX_PAB_ADDRESSABLE_PAGE_COUNT (MAX_PAB_SIZE_BYTES * 8 / PAB_BITS_PER_STATE)
+#define MAX_PAB_ADDRESSABLE_BYTE_COUNT ((U64)MAX_PAB_ADDRESSABLE_PAGE_COUNT << CONFIG_PAGE_SIZE_BITS)
 #define MAX_PAB_ADDRESSABLE_BYTE       (MAX_PAB_ADDRESSABLE_BYTE_COUNT - 1)
 #define MAX_PAB_ADDRESSABLE_PAGE       (MAX_PAB_ADDRESSABLE_PAGE_COUNT - 1)
 
@@ -14,8 +14,11 @@
 #define PAGING_H_X86
 
 #include <types.h>
+#include <stdbool.h>
 #include <buildcheck.h>
+#include <config.h>
 #include <x86/memloc.h>
+#include <x86/cpu.h>
 
 #define PDE_SHIFT    22U
 #define PTE_SHIFT    12U
@@ -25,17 +28,23 @@
 #define PTE_MASK    0x003FF000U
 #define OFFSET_MASK 0x00000FFFU
 
+// A PDE can map a 4 MByte page (large page) instead of a page table.
+#define LARGE_PAGE_SIZE_BYTES (1U << PDE_SHIFT)
+#define LARGE_PAGE_PAGE_COUNT (LARGE_PAGE_SIZE_BYTES / CONFIG_PAGE_FRAME_SIZE_BYTES)
+
 #if !defined(UNITTEST)
     #define RECURSIVE_PDE_INDEX          ((MEM_START_PAGING_RECURSIVE_MAP & PDE_MASK) >> PDE_SHIFT)
     #define KERNEL_PDE_INDEX             ((MEM_START_KERNEL_LOW_REGION & PDE_MASK) >> PDE_SHIFT)
-    #define TEMPORARY_PTE_INDEX_EXTERN   ((MEM_START_PAGING_EXT_TEMP_MAP & PTE_MASK) >> PTE_SHIFT)
-    #define TEMPORARY_PTE_INDEX_INTERNAL ((MEM_START_PAGING_INT_TEMP_MAP & PTE_MASK) >> PTE_SHIFT)
+    #define KMAP_FIRST_PTE_INDEX         ((MEM_START_PAGING_KMAP & PTE_MASK) >> PTE_SHIFT)
+    #define DIRECT_MAP_START             X86_MEM_START_DIRECT_MAP
+    #define DIRECT_MAP_LEN_BYTES         X86_MEM_LEN_BYTES_DIRECT_MAP
 #else
     #include <mosunittest.h>
     #define RECURSIVE_PDE_INDEX          MOCK_THIS_MACRO_USING (recursive_pde_index)
     #define KERNEL_PDE_INDEX             MOCK_THIS_MACRO_USING (kernel_pde_index)
-    #define TEMPORARY_PTE_INDEX_EXTERN   MOCK_THIS_MACRO_USING (temporary_pte_index_extern)
-    #define TEMPORARY_PTE_INDEX_INTERNAL MOCK_THIS_MACRO_USING (temporary_pte_index_internal)
+    #define KMAP_FIRST_PTE_INDEX         MOCK_THIS_MACRO_USING (kmap_first_pte_index)
+    #define DIRECT_MAP_START             MOCK_THIS_MACRO_USING (direct_map_start)
+    #define DIRECT_MAP_LEN_BYTES         MOCK_THIS_MACRO_USING (direct_map_len_bytes)
 #endif
 
 #define x86_PG_DEFAULT_IS_CACHING_DISABLED 0 // 0 - Enabled cache, 1 - Disables cache
@@ -66,9 +75,81 @@
                              "mov cr3, %0;"           \
                              : "=r"(temp)::"memory"); \
         } while (0)
+
+    /***********************************************************************************************
+     * Invalidates complete TLB, including the entries of global pages. Turning CR4.PGE off and back
+     * on flushes them, reloading CR3 does not.
+     *
+     * @return          Nothing
+     **********************************************************************************************/
+    #define X86_TLB_INVAL_COMPLETE_GLOBAL()                  \
+        do                                                   \
+        {                                                    \
+            UINT cr4;                                        \
+            x86_READ_REG (CR4, cr4);                         \
+            x86_LOAD_REG (CR4, cr4 & (UINT)(~X86_CR4_PGE)); \
+            x86_LOAD_REG (CR4, cr4);                         \
+        } while (0)
+
+    /***********************************************************************************************
+     * Turns on global pages. TLB entries of global pages are kept when CR3 is loaded.
+     *
+     * @return          Nothing
+     **********************************************************************************************/
+    #define X86_ENABLE_GLOBAL_PAGES()                     \
+        do                                                \
+        {                                                 \
+            UINT cr4;                                     \
+            x86_READ_REG (CR4, cr4);                      \
+            x86_LOAD_REG (CR4, cr4 | (UINT)X86_CR4_PGE); \
+        } while (0)
+
+    /***********************************************************************************************
+     * Checks with CPUID, if the processor supports global pages.
+     *
+     * @return          True if supported, false otherwise.
+     **********************************************************************************************/
+    static inline bool X86_IS_GLOBAL_PAGES_SUPPORTED (void)
+    {
+        UINT eax, ebx, ecx, edx;
+        x86_CPUID (X86_CPUID_LEAF_FEATURES, eax, ebx, ecx, edx);
+        (void)eax, (void)ebx, (void)ecx;
+        return (edx & X86_CPUID_FEATURES_EDX_PGE) != 0;
+    }
+
+    /***********************************************************************************************
+     * Turns on 4 MByte pages. PDEs with the page size bit set then map a large page.
+     *
+     * @return          Nothing
+     **********************************************************************************************/
+    #define X86_ENABLE_LARGE_PAGES()                      \
+        do                                                \
+        {                                                 \
+            UINT cr4;                                     \
+            x86_READ_REG (CR4, cr4);                      \
+            x86_LOAD_REG (CR4, cr4 | (UINT)X86_CR4_PSE); \
+        } while (0)
+
+    /***********************************************************************************************
+     * Checks with CPUID, if the processor supports 4 MByte pages.
+     *
+     * @return          True if supported, false otherwise.
+     **********************************************************************************************/
+    static inline bool X86_IS_LARGE_PAGES_SUPPORTED (void)
+    {
+        UINT eax, ebx, ecx, edx;
+        x86_CPUID (X86_CPUID_LEAF_FEATURES, eax, ebx, ecx, edx);
+        (void)eax, (void)ebx, (void)ecx;
+        return (edx & X86_CPUID_FEATURES_EDX_PSE) != 0;
+    }
 #else
-    #define x86_TLB_INVAL_SINGLE(addr) (void)0
-    #define X86_TLB_INVAL_COMPLETE()   (void)0
+    #define x86_TLB_INVAL_SINGLE(addr)      (void)0
+    #define X86_TLB_INVAL_COMPLETE()        (void)0
+    #define X86_TLB_INVAL_COMPLETE_GLOBAL() (void)0
+    #define X86_ENABLE_GLOBAL_PAGES()       (void)0
+    #define X86_IS_GLOBAL_PAGES_SUPPORTED() MOCK_THIS_MACRO_USING (is_global_pages_supported)
+    #define X86_ENABLE_LARGE_PAGES()        (void)0
+    #define X86_IS_LARGE_PAGES_SUPPORTED()  MOCK_THIS_MACRO_USING (is_large_pages_supported)
 #endif
 
 static inline void* HIGHER_HALF_KERNEL_TO_VA (Physical a)
@@ -98,7 +179,9 @@ struct ArchPageTableEntry
             pageFrame            :20;
 } __attribute__ ((packed));
 
-/* 4 KByte Page Directory entry */
+/* Page Directory entry. It references a page table, or maps a 4 MByte page if 'page_size' is set.
+ * For a large page, 'pageTableFrame' is the frame of the 4 MByte aligned physical page, so its low
+ * 10 bits (PAT and reserved bits) are zero. 'dirty' and 'global_page' are ignored otherwise. */
 struct ArchPageDirectoryEntry
 {
     UINT    present              : 1,
@@ -107,10 +190,24 @@ struct ArchPageDirectoryEntry
             write_through_cache  : 1,
             cache_disabled       : 1,
             accessed             : 1,
-            ignore0              : 1,
-            ps_mustbe0           : 1,
-            ignore1              : 4,
+            dirty                : 1,
+            page_size            : 1,
+            global_page          : 1,
+            ignore               : 3,
             pageTableFrame       :20;
 } __attribute__ ((packed));
 
+/* Kmap slot. Physical page beyond the direct map is temporarily mapped in one. */
+typedef struct KmapSlot {
+    Physical pa;   // Page mapped in the slot. Valid only if 'isMapped' is set.
+    bool isMapped; // PTE of the slot is present. Stays so after the last unmap, until recycled.
+    UINT pinCount; // Number of temporary maps of the slot in use.
+} KmapSlot;
+
+typedef struct KmapCache {
+    KmapSlot slots[CONFIG_KMAP_SLOT_COUNT];
+    UINT stack[CONFIG_KMAP_SLOT_COUNT]; // Slot of every temporary map in use, latest at the top.
+    UINT depth;                         // Number of temporary maps in use.
+} KmapCache;
+
 #endif // PAGING_H_X86
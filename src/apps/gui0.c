@@ -25,6 +25,41 @@ static OSIF_WindowFrameBufferInfo createWindow (const char* const title)
     return fbi;
 }
 
+#if defined(DEBUG) && defined(PORT_E9_ENABLED)
+/* Writes every pixel of the buffer once and logs the page faults and ticks it took. */
+static void benchmark_fill (const char* name, U32* buffer, size_t bytes)
+{
+    U32 faults = cm_process_get_pagefault_count();
+    U32 ticks  = cm_get_tickcount();
+
+    for (size_t i = 0; i < bytes / sizeof (U32); i++) {
+        buffer[i] = (U32)i;
+    }
+
+    ticks  = cm_get_tickcount() - ticks;
+    faults = cm_process_get_pagefault_count() - faults;
+    CM_DBG_INFO ("Fill %s (%u bytes): %u page faults, %u ticks", name, bytes, faults, ticks);
+}
+
+/* Window frame buffers are populated when created, so filling it should not fault. Memory from
+ * memmap is committed on access, a window at a time. Other threads of the process can fault at the
+ * same time, so counts are approximate. */
+static void benchmark_window_fill (OSIF_WindowFrameBufferInfo const* const fbi)
+{
+    benchmark_fill ("window", (U32*)fbi->buffer, fbi->bufferSizeBytes);
+
+    U32* buffer = cm_process_memmap (fbi->bufferSizeBytes);
+    if (buffer == NULL) {
+        CM_DBG_ERROR ("Memmap failed");
+        return;
+    }
+    benchmark_fill ("memmap", buffer, fbi->bufferSizeBytes);
+    cm_process_memunmap (buffer);
+}
+#else
+    #define benchmark_window_fill(fbi) (void)0
+#endif // DEBUG && PORT_E9_ENABLED
+
 static void triangle_sum (int* now, int start, int end, int* incby)
 {
     int l_now = *now;
@@ -69,6 +104,8 @@ void thread0(void)
     OSIF_WindowFrameBufferInfo fbi = createWindow ("gui0 - Window 1");
     int value                      = 1;
     int incby                      = 1;
+
+    benchmark_window_fill (&fbi);
     while (1) {
         triangle_sum (&value, 1, 10, &incby);
 
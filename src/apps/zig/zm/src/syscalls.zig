@@ -21,6 +21,14 @@ pub const SysCalls = enum(c_uint) {
     GET_BOOTLOADED_FILE = osif.OSIF_SYSCALL_GET_BOOTLOADED_FILE,
     ABORT_PROCESS = osif.OSIF_SYSCALL_ABORT_PROCESS,
     TEST = osif.OSIF_SYSCALL_TEST,
+    PROCESS_MEMMAP = osif.OSIF_SYSCALL_PROCESS_MEMMAP,
+    PROCESS_MEMUNMAP = osif.OSIF_SYSCALL_PROCESS_MEMUNMAP,
+    GET_MEMORY_STATS = osif.OSIF_SYSCALL_GET_MEMORY_STATS,
+    GET_PAGEFAULT_COUNT = osif.OSIF_SYSCALL_GET_PAGEFAULT_COUNT,
+    SHM_CREATE = osif.OSIF_SYSCALL_SHM_CREATE,
+    SHM_MAP = osif.OSIF_SYSCALL_SHM_MAP,
+    SHM_UNMAP = osif.OSIF_SYSCALL_SHM_UNMAP,
+    SHM_CLOSE = osif.OSIF_SYSCALL_SHM_CLOSE,
 };
 
 pub const KERNEL_FAILURE: i32 = -1;
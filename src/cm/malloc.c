@@ -1,6 +1,13 @@
 /*
  * --------------------------------------------------------------------------------------------------
  * Megha Operating System V2 - App Library - malloc allocator
+ *
+ * Free regions are kept in segregated free lists. Bin 'n' holds free regions with net size in the
+ * range [2^n, 2^(n+1)) and a bitmap records which bins are non-empty. The smallest bin which can
+ * satisfy a request is found by a bit-scan on this bitmap.
+ *
+ * Allocations of CM_MALLOC_LARGE_THRESHOLD_BYTES or more do not use the heap. They get their own
+ * virtual pages from the OS, so that large buffers do not use up the fixed size data memory.
  * --------------------------------------------------------------------------------------------------
  */
 #include <intrusive_list.h>
@@ -10,25 +17,33 @@
 #include <cm/debug.h>
 #include <cm/cm.h>
 #include <kcmlib.h>
-
-typedef enum FindCriteria {
-    FIND_CRIT_NODE_SIZE,
-    FIND_CRIT_NODE_ADDRESS
-} FindCriteria;
+#include <allocstats.h>
 
 static CM_MallocHeader* s_createNewNode (void* at, size_t netSize);
-static CM_MallocHeader* s_findFirst (ListNode* head, FindCriteria criteria, PTR value);
-static CM_MallocHeader* s_getMallocHeaderFromList (ListNode* head, ListNode* node);
+static CM_MallocHeader* s_findFreeNode (size_t netSize);
+static void s_addToFreeBin (CM_MallocHeader* header);
+static void s_removeFromFreeBin (CM_MallocHeader* header);
 static void s_splitFreeNode (size_t bytes, CM_MallocHeader* freeNodeHdr);
-static void s_combineAdjFreeNodes (CM_MallocHeader* currentNode);
+static CM_MallocHeader* s_combineAdjFreeNodes (CM_MallocHeader* currentNode);
+static bool s_isValidHeader (CM_MallocHeader const* header);
 
-extern ListNode s_freeHead, s_allocHead, s_adjHead;
+extern ListNode s_freeBins[CM_MALLOC_FREE_BIN_COUNT], s_allocHead;
 static void* s_buffer;
+static U32 s_nonEmptyBins; // Bit 'n' is set if s_freeBins[n] is not empty.
+static OSIF_AllocatorStats s_stats;
+
+#define NODE_OVERHEAD_BYTES           (sizeof (CM_MallocHeader) + sizeof (CM_MallocFooter))
+#define NET_ALLOCATION_SIZE(sz_bytes) (sz_bytes + NODE_OVERHEAD_BYTES)
+#define BUFFER_END()                  ((PTR)s_buffer + CM_MALLOC_MEM_SIZE_BYTES)
+#define NODE_FOOTER(header) \
+    ((CM_MallocFooter*)((PTR)(header) + (header)->netNodeSize - sizeof (CM_MallocFooter)))
+#define BIN_INDEX(netSize) (31U - (UINT)__builtin_clz ((U32)(netSize)))
 
-#define NET_ALLOCATION_SIZE(sz_bytes) (sz_bytes + sizeof (CM_MallocHeader))
+// Number of regions looked at in the bin of the requested size, while searching for a best fit.
+#define BIN_BEST_FIT_SCAN_LIMIT 8
 
 #ifndef UNITTEST
-ListNode s_freeHead, s_allocHead, s_adjHead;
+ListNode s_freeBins[CM_MALLOC_FREE_BIN_COUNT], s_allocHead;
 #else
 // cm_malloc unit test must provide definitions for the list head variables
 #endif
@@ -42,15 +57,17 @@ void cm_malloc_init(void)
 {
     CM_DBG_FUNC_ENTRY();
 
-    list_init (&s_freeHead);
+    for (UINT i = 0; i < CM_MALLOC_FREE_BIN_COUNT; i++) {
+        list_init (&s_freeBins[i]);
+    }
     list_init (&s_allocHead);
-    list_init (&s_adjHead);
+    s_nonEmptyBins = 0;
+    s_stats        = (OSIF_AllocatorStats){ 0 };
 
     s_buffer = cm_process_get_datamem_start();
 
     CM_MallocHeader* newH = s_createNewNode (s_buffer, CM_MALLOC_MEM_SIZE_BYTES);
-    list_add_before (&s_freeHead, &newH->freenode);
-    list_add_before (&s_adjHead, &newH->adjnode);
+    s_addToFreeBin (newH);
 
     CM_DBG_INFO ("Size of CM_MallocHeader: %lu bytes", sizeof (CM_MallocHeader));
     CM_DBG_INFO ("Malloc buffer is at: %px", s_buffer);
@@ -89,85 +106,159 @@ void* cm_malloc (size_t bytes)
         CM_RETURN_ERROR (CM_ERR_INVALID_INPUT, NULL);
     }
 
+    if (bytes >= CM_MALLOC_LARGE_THRESHOLD_BYTES) {
+        void* addr = cm_process_memmap (bytes);
+        if (addr == NULL) {
+            allocstats_recordFailure (&s_stats);
+            CM_RETURN_ERROR (CM_ERR_OUT_OF_HEAP_MEM, NULL);
+        }
+        allocstats_recordAlloc (&s_stats, bytes, ALIGN_UP (bytes, CONFIG_PAGE_FRAME_SIZE_BYTES));
+        CM_DBG_INFO ("Large allocation at: %px", addr);
+        return addr;
+    }
+
     CM_DBG_INFO ("Requested net size of %lu bytes", NET_ALLOCATION_SIZE (bytes));
 
     // Search for suitable node
-    size_t searchAllocSize = NET_ALLOCATION_SIZE (bytes) + sizeof (CM_MallocHeader);
-    CM_MallocHeader* node  = s_findFirst (&s_freeHead, FIND_CRIT_NODE_SIZE, searchAllocSize);
+    size_t searchAllocSize = NET_ALLOCATION_SIZE (bytes) + NODE_OVERHEAD_BYTES;
+    CM_MallocHeader* node  = s_findFreeNode (searchAllocSize);
 
     if (node != NULL) {
         cm_assert (node->netNodeSize >= NET_ALLOCATION_SIZE (bytes)); // Found node too small
 
         // Split the free node into two.
         s_splitFreeNode (bytes, node);
+        allocstats_recordAlloc (&s_stats, bytes, node->netNodeSize);
         return (void*)((PTR)node + sizeof (CM_MallocHeader));
     }
 
+    allocstats_recordFailure (&s_stats);
     CM_RETURN_ERROR (CM_ERR_OUT_OF_HEAP_MEM, NULL);
 }
 
 /***************************************************************************************************
  * Marks previously allocated memory starting at 'addr' as free.
  *
+ * The header just before 'addr' is checked in place, so there is no search. Addresses outside the
+ * heap are large allocations, their virtual pages are given back to the OS.
+ *
  * @Input   addr    Pointer to start of a cm_malloc allocated memory.
  * @return          True on success. False otherwise.
- * @error           ERR_INVALID_ARGUMENT  - If the input address was not found.
  **************************************************************************************************/
 bool cm_free (void* addr)
 {
     CM_DBG_FUNC_ENTRY ("Address: %px", addr);
 
-    void* headerAddress       = (void*)((PTR)addr - sizeof (CM_MallocHeader));
-    CM_MallocHeader* allocHdr = s_findFirst (&s_allocHead, FIND_CRIT_NODE_ADDRESS,
-                                             (PTR)headerAddress);
-    if (allocHdr != NULL) {
-        CM_DBG_INFO ("Free at %px, Size = %lu", allocHdr, allocHdr->netNodeSize);
-        list_remove (&allocHdr->allocnode);
-        list_add_after (&s_freeHead, &allocHdr->freenode);
-        allocHdr->isAllocated = false;
-
-        s_combineAdjFreeNodes (allocHdr);
+    if ((PTR)addr < (PTR)s_buffer || (PTR)addr >= BUFFER_END()) {
+        // Not a large allocation either, which is a fatal error.
+        size_t pageCount = cm_process_memunmap (addr);
+        if (pageCount == 0) {
+            cm_panic();
+            return false;
+        }
+        allocstats_recordFree (&s_stats, pageCount * CONFIG_PAGE_FRAME_SIZE_BYTES);
         return true;
     }
 
-    // Could not find allocated node. Either double free or tatal error.
-    cm_panic();
-    return false;
+    CM_MallocHeader* allocHdr = (CM_MallocHeader*)((PTR)addr - sizeof (CM_MallocHeader));
+
+    // Either not an allocated node (double free) or a fatal error.
+    if (!s_isValidHeader (allocHdr) || !allocHdr->isAllocated) {
+        cm_panic();
+        return false;
+    }
+
+    CM_DBG_INFO ("Free at %px, Size = %lu", allocHdr, allocHdr->netNodeSize);
+    list_remove (&allocHdr->allocnode);
+    allocHdr->isAllocated = false;
+    allocstats_recordFree (&s_stats, allocHdr->netNodeSize);
+
+    s_addToFreeBin (s_combineAdjFreeNodes (allocHdr));
+    return true;
+}
+
+/***************************************************************************************************
+ * Gets allocation statistics of cm_malloc.
+ *
+ * @Output stats    Statistics are copied here.
+ * @return          Nothing
+ **************************************************************************************************/
+void cm_malloc_getStats (OSIF_AllocatorStats* const stats)
+{
+    CM_DBG_FUNC_ENTRY ("stats: %px", stats);
+
+    cm_assert (stats != NULL);
+    *stats = s_stats;
 }
 
-static void s_combineAdjFreeNodes (CM_MallocHeader* currentNode)
+/***************************************************************************************************
+ * Checks if there is a valid header at 'header'. Only reads memory within the cm_malloc buffer.
+ *
+ * @Input   header  Address of the header.
+ * @return          True if header is valid. False otherwise.
+ **************************************************************************************************/
+static bool s_isValidHeader (CM_MallocHeader const* header)
+{
+    if ((PTR)header < (PTR)s_buffer || (PTR)header > BUFFER_END() - NODE_OVERHEAD_BYTES) {
+        return false;
+    }
+
+    if (header->magic != CM_MALLOC_MAGIC || header->netNodeSize < NODE_OVERHEAD_BYTES ||
+        header->netNodeSize > BUFFER_END() - (PTR)header) {
+        return false;
+    }
+
+    // Boundary tag at the end must agree with the header.
+    return NODE_FOOTER (header)->netNodeSize == header->netNodeSize;
+}
+
+/***************************************************************************************************
+ * Combines a free node, which is not yet in a free bin, with its free neighbours.
+ *
+ * @Input   currentNode Free node.
+ * @return              Header of the combined node. It is not added to any free bin.
+ **************************************************************************************************/
+static CM_MallocHeader* s_combineAdjFreeNodes (CM_MallocHeader* currentNode)
 {
     CM_MallocHeader* next = NULL;
     CM_MallocHeader* prev = NULL;
 
     cm_assert (currentNode->isAllocated == false); // Cannot combine allocated node. Invalid input.
 
-    // Prev node could be the list head (which is not a CM_MallocHeader). That would mean beginning
-    // of list and is not taken into account.
-    if (currentNode->adjnode.prev != &s_adjHead) {
-        prev = LIST_ITEM (currentNode->adjnode.prev, CM_MallocHeader, adjnode);
+    // There is no node before the first node. Otherwise the footer of the previous node is just
+    // before the current node.
+    if ((PTR)currentNode != (PTR)s_buffer) {
+        CM_MallocFooter* prevFooter = (CM_MallocFooter*)((PTR)currentNode -
+                                                         sizeof (CM_MallocFooter));
+        prev = (CM_MallocHeader*)((PTR)currentNode - prevFooter->netNodeSize);
+        cm_assert (s_isValidHeader (prev)); // Invalid previous node
     }
 
-    // Next node could be the list head (which is not a CM_MallocHeader). That would mean end of
-    // list and is not taken into account (Practically this is not possible as there will always be
-    // one Free section at the end of cm_malloc buffer).
-    if (currentNode->adjnode.next != &s_adjHead) {
-        next = LIST_ITEM (currentNode->adjnode.next, CM_MallocHeader, adjnode);
+    // There is no node after the last node (Practically this is not possible as there will always
+    // be one Free section at the end of cm_malloc buffer).
+    if ((PTR)currentNode + currentNode->netNodeSize < BUFFER_END()) {
+        next = (CM_MallocHeader*)((PTR)currentNode + currentNode->netNodeSize);
+        cm_assert (s_isValidHeader (next)); // Invalid next node
     }
 
     if (next && !next->isAllocated) {
         CM_DBG_INFO ("Combining NEXT into CURRENT");
+        s_removeFromFreeBin (next);
         currentNode->netNodeSize += next->netNodeSize;
-        list_remove (&next->freenode);
-        list_remove (&next->adjnode);
+        NODE_FOOTER (currentNode)->netNodeSize = currentNode->netNodeSize;
+        next->magic = 0; // Not a header anymore.
     }
 
     if (prev && !prev->isAllocated) {
         CM_DBG_INFO ("Combining CURRENT into PREV");
+        s_removeFromFreeBin (prev);
         prev->netNodeSize += currentNode->netNodeSize;
-        list_remove (&currentNode->freenode);
-        list_remove (&currentNode->adjnode);
+        NODE_FOOTER (prev)->netNodeSize = prev->netNodeSize;
+        currentNode->magic = 0; // Not a header anymore.
+        currentNode        = prev;
     }
+
+    return currentNode;
 }
 
 static CM_MallocHeader* s_createNewNode (void* at, size_t netSize)
@@ -176,54 +267,82 @@ static CM_MallocHeader* s_createNewNode (void* at, size_t netSize)
     cm_assert (((PTR)at + netSize - 1) < ((PTR)s_buffer + CM_MALLOC_MEM_SIZE_BYTES));
 
     CM_MallocHeader* newH = at;
+    newH->magic           = CM_MALLOC_MAGIC;
     newH->netNodeSize     = netSize;
     newH->isAllocated     = false;
     list_init (&newH->freenode);
     list_init (&newH->allocnode);
-    list_init (&newH->adjnode);
+    NODE_FOOTER (newH)->netNodeSize = netSize;
     return newH;
 }
 
-static CM_MallocHeader* s_getMallocHeaderFromList (ListNode* head, ListNode* node)
+static void s_addToFreeBin (CM_MallocHeader* header)
 {
-    CM_MallocHeader* ret = NULL;
-    if (head == &s_allocHead) {
-        ret = LIST_ITEM (node, CM_MallocHeader, allocnode);
-    } else if (head == &s_freeHead) {
-        ret = LIST_ITEM (node, CM_MallocHeader, freenode);
-    }
+    UINT bin = BIN_INDEX (header->netNodeSize);
+    cm_assert (bin < CM_MALLOC_FREE_BIN_COUNT); // Invalid bin
 
-    return ret;
+    list_add_after (&s_freeBins[bin], &header->freenode);
+    s_nonEmptyBins |= (1U << bin);
 }
 
-static CM_MallocHeader* s_findFirst (ListNode* head, FindCriteria criteria, PTR value)
+static void s_removeFromFreeBin (CM_MallocHeader* header)
 {
-    bool found              = false;
-    ListNode* node          = NULL;
-    CM_MallocHeader* header = NULL;
+    // Must be called before the node size is changed, the bin depends on it.
+    UINT bin = BIN_INDEX (header->netNodeSize);
+    cm_assert (bin < CM_MALLOC_FREE_BIN_COUNT); // Invalid bin
 
-    CM_DBG_INFO ("Searching for value %lu (%lx)", value, value);
+    list_remove (&header->freenode);
+    if (list_is_empty (&s_freeBins[bin])) {
+        s_nonEmptyBins &= ~(1U << bin);
+    }
+}
 
-    list_for_each (head, node)
-    {
-        header = s_getMallocHeaderFromList (head, node);
-        CM_DBG_INFO ("  (%px) Size = %lu...", header, header->netNodeSize);
+/***************************************************************************************************
+ * Finds a free node of at least 'netSize' bytes.
+ *
+ * Regions in the bin of 'netSize' can be smaller than 'netSize', so a few of them are checked for
+ * a best fit. Every region in a higher bin is large enough, so the first region of the smallest
+ * non-empty higher bin is taken.
+ *
+ * @Input   netSize Minimum size of the node including the header and footer.
+ * @return          Header of the free node. NULL if there is no large enough free node.
+ **************************************************************************************************/
+static CM_MallocHeader* s_findFreeNode (size_t netSize)
+{
+    UINT bin              = BIN_INDEX (netSize);
+    CM_MallocHeader* best = NULL;
+    UINT scanned          = 0;
+    ListNode* node        = NULL;
 
-        switch (criteria) {
-        case FIND_CRIT_NODE_ADDRESS:
-            found = ((PTR)header == value);
-            break;
-        case FIND_CRIT_NODE_SIZE:
-            found = (header->netNodeSize >= value);
-            break;
+    CM_DBG_INFO ("Searching for size %lu in bin %u. Non-empty bins: %x", netSize, bin,
+                 s_nonEmptyBins);
+
+    list_for_each (&s_freeBins[bin], node)
+    {
+        CM_MallocHeader* header = LIST_ITEM (node, CM_MallocHeader, freenode);
+        if (header->netNodeSize >= netSize &&
+            (best == NULL || header->netNodeSize < best->netNodeSize)) {
+            best = header;
         }
 
-        if (found) {
-            CM_DBG_INFO ("Found.");
+        if ((best != NULL && best->netNodeSize == netSize) ||
+            ++scanned == BIN_BEST_FIT_SCAN_LIMIT) {
             break;
         }
     }
-    return (found) ? header : NULL;
+
+    if (best != NULL) {
+        return best;
+    }
+
+    // Non-empty bins higher than 'bin'. For the last bin (2U << bin) wraps to 0, leaving none.
+    U32 higherBins = s_nonEmptyBins & ~((2U << bin) - 1U);
+    if (higherBins == 0) {
+        return NULL;
+    }
+
+    UINT found = (UINT)__builtin_ctz (higherBins);
+    return LIST_ITEM (s_freeBins[found].next, CM_MallocHeader, freenode);
 }
 
 static void s_splitFreeNode (size_t bytes, CM_MallocHeader* freeNodeHdr)
@@ -231,14 +350,15 @@ static void s_splitFreeNode (size_t bytes, CM_MallocHeader* freeNodeHdr)
     size_t netAllocSize  = NET_ALLOCATION_SIZE (bytes);
     PTR splitAt          = (PTR)freeNodeHdr + netAllocSize;
     size_t remainingSize = freeNodeHdr->netNodeSize - netAllocSize;
-    cm_assert (remainingSize >= sizeof (CM_MallocHeader)); // Not enough space for cm_malloc header
+    cm_assert (remainingSize >= NODE_OVERHEAD_BYTES); // Not enough space for cm_malloc header
+
+    s_removeFromFreeBin (freeNodeHdr);
 
     CM_MallocHeader* newFreeNodeHdr = s_createNewNode ((void*)splitAt, remainingSize);
     freeNodeHdr->netNodeSize        = netAllocSize;
     freeNodeHdr->isAllocated        = true;
+    NODE_FOOTER (freeNodeHdr)->netNodeSize = netAllocSize;
 
-    list_add_after (&freeNodeHdr->freenode, &newFreeNodeHdr->freenode);
-    list_add_after (&freeNodeHdr->adjnode, &newFreeNodeHdr->adjnode);
-    list_remove (&freeNodeHdr->freenode);
+    s_addToFreeBin (newFreeNodeHdr);
     list_add_before (&s_allocHead, &freeNodeHdr->allocnode);
 }
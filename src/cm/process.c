@@ -108,3 +108,19 @@ INT cm_thread_create (void (*startLocation)(void), bool isKernelMode)
     }
     return pid;
 }
+
+INT cm_process_clone (void (*startLocation)(void))
+{
+    if (!startLocation) {
+        CM_RETURN_ERROR (CM_ERR_INVALID_INPUT, CM_FAILURE);
+    }
+
+    // New process gets a copy of the memory of this one, which is copied on write, and starts at
+    // startLocation.
+    INT pid = syscall (OSIF_SYSCALL_CREATE_PROCESS, (U32)startLocation, 0,
+                       (U32)PROCESS_FLAGS_CLONE, 0, 0);
+    if (pid < 0) {
+        CM_RETURN_ERROR (cm_get_os_error(), CM_FAILURE);
+    }
+    return pid;
+}
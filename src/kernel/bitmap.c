@@ -30,6 +30,118 @@
 #include <kerror.h>
 #include <bitmap.h>
 
+/* Number of states that fit in one 32 bit word of the bitmap. */
+#define BITMAP_STATES_PER_WORD(b) (32 / ((b)->bitsPerState))
+
+/* Number of 32 bit words (including a partially filled last word) in the bitmap. */
+#define BITMAP_WORD_COUNT(b) (((b)->size + 3) / 4)
+
+/***************************************************************************************************
+ * Loads the 32 bit word at `wordIndex` from the bitmap and returns a mask with all the bits of a
+ * state set if that state is equal to `state`. Bits of a state which does not match is cleared and
+ * so is every bit past the end of the bitmap, when the last word is only partially filled.
+ *
+ * For example, with 2 bits per state and `state` = 1, word 0x1B (states 3, 2, 1, 0 from left)
+ * gives the mask 0x0C.
+ *
+ * @Input b          Bitmap
+ * @Input wordIndex  Index of the 32 bit word in the bitmap. Must be < BITMAP_WORD_COUNT(b).
+ * @Input state      State to match.
+ * @return           Mask of matching states.
+ **************************************************************************************************/
+static U32 s_matchingStatesInWord (Bitmap* b, UINT wordIndex, BitmapState state)
+{
+    UINT byteIndex = wordIndex * 4;
+    UINT bytes     = MIN (4U, b->size - byteIndex);
+    U8* p          = &b->bitmap[byteIndex];
+
+    // Bytes are put together so that unaligned bitmaps and partially filled words can be read.
+    // For a complete word, this is a single load.
+    U32 word  = 0;
+    U32 valid = 0;
+    if (bytes == 4) {
+        word  = (U32)p[0] | ((U32)p[1] << 8) | ((U32)p[2] << 16) | ((U32)p[3] << 24);
+        valid = 0xFFFFFFFF;
+    } else {
+        for (UINT i = 0; i < bytes; i++) {
+            word |= (U32)p[i] << (i * 8);
+        }
+        valid = (1U << (bytes * 8)) - 1;
+    }
+
+    // Bit 0 of every state in `lsbs`. Ex: For 2 bits per state it is 0x55555555.
+    U32 lsbs = 0xFFFFFFFF / (U32)BITMAP_STATE_MASK (b);
+
+    // A state matches when all its bits are zero after the XOR. Its bits are ORed into bit 0 of
+    // the state, then that bit is copied back to the other bits of the state.
+    U32 diff = word ^ (lsbs * state);
+    U32 any  = diff;
+    for (UINT i = 1; i < b->bitsPerState; i++) {
+        any |= diff >> i;
+    }
+
+    U32 matches = ~any & lsbs;
+    return (matches * (U32)BITMAP_STATE_MASK (b)) & valid;
+}
+
+/***************************************************************************************************
+ * Number of consecutive states equal to `state`, starting at `index`. Counting stops at `maxLen`.
+ *
+ * @Input b          Bitmap
+ * @Input state      State to count.
+ * @Input index      Start index in the bitmap. Must be < BITMAP_CAPACITY(b).
+ * @Input maxLen     Stop counting after this many states. index + maxLen must be <=
+ *                   BITMAP_CAPACITY(b).
+ * @return           Number of consecutive states, at most maxLen.
+ **************************************************************************************************/
+static UINT s_runLength (Bitmap* b, BitmapState state, UINT index, UINT maxLen)
+{
+    UINT statesPerWord = BITMAP_STATES_PER_WORD (b);
+    UINT count         = 0;
+
+    while (count < maxLen) {
+        UINT stateInWord = index % statesPerWord;
+        U32 matches      = s_matchingStatesInWord (b, index / statesPerWord, state);
+        matches >>= stateInWord * b->bitsPerState;
+
+        // Trailing set bits are the states in the run. Bits past the end of the bitmap are always
+        // clear, so `~matches` is zero only when every state in the word matched.
+        UINT bits        = (~matches == 0) ? 32 : (UINT)__builtin_ctz (~matches);
+        UINT matched     = bits / b->bitsPerState;
+        UINT leftInWord  = statesPerWord - stateInWord;
+
+        count += matched;
+        index += matched;
+        if (matched < leftInWord) {
+            break; // Run ended inside this word.
+        }
+    }
+
+    return MIN (count, maxLen);
+}
+
+/***************************************************************************************************
+ * Counts the number of consecutive states with `state` value starting at index `index`. Counting
+ * stops at the end of the bitmap or after `maxLen` states, whichever is earlier.
+ * TODO: User must get lock on the bitmap before calling this function.
+ *
+ * @Input b          Bitmap
+ * @Input state      State to count.
+ * @Input index      Start index in the bitmap. First index is 0.
+ * @Input maxLen     Maximum number of states to count. Must be > 0.
+ * @return           Number of consecutive states. 0 if state at `index` is not `state`.
+ **************************************************************************************************/
+UINT bitmap_countContinous (Bitmap *b, BitmapState state, UINT index, UINT maxLen)
+{
+    k_assert(b != NULL, "Cannot be null");
+    k_assert(8 % b->bitsPerState == 0, "Must be a factor of 8.");
+    k_assert(state < BITMAP_MAX_STATE(b), "Invalid state");
+    k_assert(maxLen > 0, "Must be > zero");
+    k_assert (index < BITMAP_CAPACITY(b), "Index out of bounds.");
+
+    return s_runLength (b, state, index, MIN (maxLen, BITMAP_CAPACITY (b) - index));
+}
+
 /***************************************************************************************************
  * Checks if a section in the bitmap exists starting at index `indexAt` having at least `len`
  * number of states with value of `state`.
@@ -53,12 +165,7 @@ bool bitmap_findContinousAt (Bitmap *b, BitmapState state, UINT len, UINT indexA
     if ((indexAt + len) > BITMAP_CAPACITY(b))
         return false;
 
-    UINT i = 0;
-    for (; i < len && bitmap_get(b, i + indexAt) == state; i++);
-
-    // If the inner loop iterated `len` number of types, then we have
-    // found our continuous block.
-    return (i == len) ? true : false;
+    return (s_runLength (b, state, indexAt, len) == len) ? true : false;
 }
 
 /***************************************************************************************************
@@ -77,14 +184,97 @@ INT bitmap_findContinous (Bitmap *b, BitmapState state, UINT len)
 
     k_assert(b != NULL, "Cannot be null");
     k_assert(8 % b->bitsPerState == 0, "Must be a factor of 8.");
+
+    return bitmap_findContinousInRange (b, state, len, 0, BITMAP_CAPACITY (b));
+}
+
+/***************************************************************************************************
+ * Searches bitmap for a section with at least `len` number of continuous states with `state` value.
+ * The section must lie completely within indices `indexFrom` to `indexTo - 1`.
+ * TODO: User must get lock on the bitmap before calling this function.
+ *
+ * The bitmap is scanned 32 bits at a time and runs of matching states are found with bit scans.
+ * Words with no matching state are skipped and a run which turns out to be too short is never
+ * looked at again.
+ *
+ * @Input b          Bitmap
+ * @Input state      Searches for this state in the bitmap.
+ * @Input len        This many consecutive states. Must be > 0.
+ * @Input indexFrom  First index of the range to search.
+ * @Input indexTo    One past the last index of the range. Must be <= BITMAP_CAPACITY(b).
+ * @return           On success returns the first index in the section, otherwise returns
+ *                   KERNEL_EXIT_FAILURE.
+ **************************************************************************************************/
+INT bitmap_findContinousInRange (Bitmap *b, BitmapState state, UINT len, UINT indexFrom,
+                                 UINT indexTo)
+{
+    k_assert(b != NULL, "Cannot be null");
+    k_assert(8 % b->bitsPerState == 0, "Must be a factor of 8.");
     k_assert(state < BITMAP_MAX_STATE(b), "Invalid state");
     k_assert(len > 0, "Must be > zero");
+    k_assert(indexTo <= BITMAP_CAPACITY(b), "Index out of bounds.");
+
+    if (indexFrom >= indexTo || len > indexTo - indexFrom)
+        return KERNEL_EXIT_FAILURE;
+
+    UINT statesPerWord = BITMAP_STATES_PER_WORD (b);
+    UINT firstWord     = indexFrom / statesPerWord;
+    UINT lastWord      = (indexTo - 1) / statesPerWord;
+    UINT runStart      = 0;
+    UINT runLen        = 0; // Matching states seen so far, starting at `runStart`.
+
+    for (UINT wordIndex = firstWord; wordIndex <= lastWord; wordIndex++) {
+        U32 matches = s_matchingStatesInWord (b, wordIndex, state);
+
+        // States outside the range must not match.
+        if (wordIndex == firstWord)
+            matches &= 0xFFFFFFFF << ((indexFrom % statesPerWord) * b->bitsPerState);
 
-    UINT count = BITMAP_CAPACITY(b);
+        if (wordIndex == lastWord && (indexTo % statesPerWord) != 0)
+            matches &= ~(0xFFFFFFFF << ((indexTo % statesPerWord) * b->bitsPerState));
 
-    for (UINT index = 0; index < count; index++)
-        if (bitmap_findContinousAt(b, state, len, index))
-            return (INT)index;
+        // Fast path: Words where either no state or all the states match.
+        if (matches == 0) {
+            runLen = 0;
+            continue;
+        }
+
+        if (matches == 0xFFFFFFFF) {
+            if (runLen == 0)
+                runStart = wordIndex * statesPerWord;
+
+            if ((runLen += statesPerWord) >= len)
+                return (INT)runStart;
+            continue;
+        }
+
+        // Walk the runs in the word. Trailing clear bits are states which end the current run,
+        // trailing set bits are states which start or extend it.
+        for (UINT bit = 0; bit < 32;) {
+            U32 rest = matches >> bit;
+            if (rest == 0) {
+                runLen = 0;
+                break;
+            }
+
+            UINT mismatched = (UINT)__builtin_ctz (rest);
+            if (mismatched > 0) {
+                runLen = 0;
+                bit += mismatched;
+                rest >>= mismatched;
+            }
+
+            // `rest` cannot be all ones, as the word is not all ones and was shifted.
+            UINT matched = (UINT)__builtin_ctz (~rest);
+            if (runLen == 0)
+                runStart = wordIndex * statesPerWord + bit / b->bitsPerState;
+
+            if ((runLen += matched / b->bitsPerState) >= len)
+                return (INT)runStart;
+
+            bit += matched;
+        }
+    }
 
     // No contiguous block found
     return KERNEL_EXIT_FAILURE;
@@ -42,6 +42,7 @@ static SIZE getWindowAreaSizeBytes(void)
 
 static ListNode windowsListHead;
 static UINT window_count;
+static KMemCache* s_windowCache;
 
 static void destory_window (Window* win);
 
@@ -101,8 +102,9 @@ static Window* allocWindow (UINT processID, UINT screen_x, UINT screen_y)
     VMemoryManager* vmm        = kprocess_getCurrentContext();
     SIZE bufferSzPages         = BYTES_TO_PAGEFRAMES_CEILING (getWindowAreaSizeBytes());
     windowArea.bufferSizeBytes = PAGEFRAMES_TO_BYTES (bufferSzPages);
-    if (!(windowArea.buffer = (U8*)kvmm_memmap (vmm, 0, NULL, bufferSzPages, VMM_MEMMAP_FLAG_NONE,
-                                                NULL))) {
+    // Whole buffer is drawn right away, so it is committed now instead of on every page access.
+    if (!(windowArea.buffer = (U8*)kvmm_memmap (vmm, 0, NULL, bufferSzPages,
+                                                VMM_MEMMAP_FLAG_POPULATE, NULL))) {
         RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
     }
     kvmm_setAddressSpaceMetadata (vmm, (PTR)windowArea.buffer, "winfb", &processID);
@@ -118,7 +120,7 @@ static Window* allocWindow (UINT processID, UINT screen_x, UINT screen_y)
 
     // Create new associated window. The graphics areas will be part of and owned by this window.
     Window* newwin = NULL;
-    if (!(newwin = kmalloc (sizeof (Window)))) {
+    if (!(newwin = kmem_cache_alloc (s_windowCache))) {
         destory_window (newwin);
         RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
     }
@@ -142,7 +144,7 @@ static void destory_window (Window* win)
         BUG(); // Should be able to free.
     }
 
-    if (!kfree (win)) {
+    if (!kmem_cache_free (s_windowCache, win)) {
         BUG(); // Should be able to free.
     }
 }
@@ -155,6 +157,10 @@ void kcompose_init(void)
 
     list_init (&windowsListHead);
     window_count = 0;
+
+    if (!(s_windowCache = kmem_cache_create ("window", sizeof (Window)))) {
+        FATAL_BUG(); // Should not fail.
+    }
 }
 
 bool kcompose_destroyWindow (Window* win)
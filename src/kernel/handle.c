@@ -16,9 +16,9 @@
 #include <kerror.h>
 #include <kassert.h>
 
-static void** handles = NULL;
+static HandleItem* handles = NULL;
 
-static void** getObjectPtr (Handle h)
+static HandleItem* getHandleItem (Handle h)
 {
     k_assert (handles != NULL, "Handles not initialized");
 
@@ -26,7 +26,7 @@ static void** getObjectPtr (Handle h)
         RETURN_ERROR (ERR_INVALID_HANDLE, NULL);
     }
 
-    if (handles[h] == NULL) {
+    if (handles[h].obj == NULL) {
         RETURN_ERROR (ERR_INVALID_HANDLE, NULL);
     }
 
@@ -38,26 +38,26 @@ void khandle_init(void)
     FUNC_ENTRY();
 
     KERNEL_PHASE_VALIDATE (KERNEL_PHASE_STATE_SALLOC_READY);
-    if (!(handles = kscalloc (CONFIG_HANDLES_ARRAY_ITEM_COUNT * sizeof (handles)))) {
+    if (!(handles = kscalloc (CONFIG_HANDLES_ARRAY_ITEM_COUNT * sizeof (HandleItem)))) {
         FATAL_BUG(); // Should not fail.
     }
 }
 
-Handle khandle_createHandle (void* obj)
+Handle khandle_createHandle (void* obj, KernelObjectTypes type, UINT ownerID)
 {
-    FUNC_ENTRY ("Object ptr: %px", obj);
+    FUNC_ENTRY ("Object ptr: %px, type: %x, owner: %x", obj, type, ownerID);
 
     k_assert (handles != NULL, "Handles not initialized");
 
-    if (obj == NULL) {
+    if (obj == NULL || type == KERNEL_OBJECT_TYPE_INVALID) {
         RETURN_ERROR (ERR_INVALID_ARGUMENT, INVALID_HANDLE);
     }
 
     // Find free location
     for (INT i = 0; i < CONFIG_HANDLES_ARRAY_ITEM_COUNT; i++) {
-        if (handles[i] == NULL) {
+        if (handles[i].obj == NULL) {
             // Found a free slot in the handles array. Place the object ptr there.
-            handles[i] = obj;
+            handles[i] = (HandleItem){ .obj = obj, .type = type, .ownerID = ownerID };
             // The index into the Handles array where the object was put is the Handle for it.
             return i;
         }
@@ -71,21 +71,42 @@ bool khandle_freeHandle (Handle h)
 {
     FUNC_ENTRY ("Handle: %x", h);
 
-    void** objptr = getObjectPtr (h);
-    if (objptr == NULL) {
+    HandleItem* item = getHandleItem (h);
+    if (item == NULL) {
         RETURN_ERROR (ERROR_PASSTHROUGH, false);
     }
-    *objptr = NULL;
+    *item = (HandleItem){ 0 };
     return true;
 }
 
-void* khandle_getObject (Handle h)
+// Objects of other types are not returned, so a handle cannot be used in place of another kind.
+void* khandle_getObject (Handle h, KernelObjectTypes type)
 {
-    FUNC_ENTRY ("Handle: %x", h);
+    FUNC_ENTRY ("Handle: %x, type: %x", h, type);
 
-    void** objptr = getObjectPtr (h);
-    if (objptr == NULL) {
-        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    HandleItem* item = getHandleItem (h);
+    if (item == NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+    }
+
+    if (item->type != type) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, NULL);
+    }
+    return item->obj;
+}
+
+// Handles left open by a process are found this way when it exits. Returns INVALID_HANDLE if there
+// are none, which is not an error.
+Handle khandle_findHandle (KernelObjectTypes type, UINT ownerID)
+{
+    FUNC_ENTRY ("Type: %x, owner: %x", type, ownerID);
+
+    k_assert (handles != NULL, "Handles not initialized");
+
+    for (INT i = 0; i < CONFIG_HANDLES_ARRAY_ITEM_COUNT; i++) {
+        if (handles[i].obj != NULL && handles[i].type == type && handles[i].ownerID == ownerID) {
+            return i;
+        }
     }
-    return *objptr;
+    return INVALID_HANDLE;
 }
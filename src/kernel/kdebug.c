@@ -10,6 +10,8 @@
 #include <moslimits.h>
 #include <kdebug.h>
 #include <kernel.h>
+#include <pmm.h>
+#include <memmanage.h>
 #if ARCH == x86
     #include <x86/io.h>
 #endif
@@ -70,4 +72,42 @@ void kdebug_log_ndu (KernelDebugLogType type, const char* func, UINT line, char*
 
     s_qemu_debugPutString (buffer);
 }
+
+static void s_printAllocatorStats (const CHAR* name, const OSIF_AllocatorStats* stats)
+{
+    INFO ("%s: used: %x bytes, peak: %x bytes, allocs: %u, frees: %u, failed: %u", name,
+          stats->usedBytes, stats->peakUsedBytes, stats->allocCount, stats->freeCount,
+          stats->failedCount);
+
+    for (UINT i = 0; i < OSIF_ALLOCATOR_STATS_HISTOGRAM_BUCKETS; i++) {
+        if (stats->sizeHistogram[i] != 0) {
+            INFO ("* %s: size >= %x: %u", name, 1U << i, stats->sizeHistogram[i]);
+        }
+    }
+}
+
+/***************************************************************************************************
+ * Prints allocation statistics of kernel allocators which are ready, to the host console.
+ *
+ * @return      Nothing
+ **************************************************************************************************/
+void kdebug_printMemoryStats (void)
+{
+    OSIF_AllocatorStats stats;
+
+    if (KERNEL_PHASE_CHECK (KERNEL_PHASE_STATE_PMM_READY)) {
+        kpmm_getStats (&stats);
+        s_printAllocatorStats ("PMM (page frames)", &stats);
+    }
+
+    if (KERNEL_PHASE_CHECK (KERNEL_PHASE_STATE_SALLOC_READY)) {
+        ksalloc_getStats (&stats);
+        s_printAllocatorStats ("salloc", &stats);
+    }
+
+    if (KERNEL_PHASE_CHECK (KERNEL_PHASE_STATE_KMALLOC_READY)) {
+        kmalloc_getStats (&stats);
+        s_printAllocatorStats ("kmalloc", &stats);
+    }
+}
 #endif // DEBUG && PORT_E9_ENABLED
@@ -3,6 +3,18 @@
  * Megha Operating System V2 - Cross Platform Kernel - kmalloc allocator
  *
  * This is one of be basic Heap allocators in the kernel
+ *
+ * Free regions are kept in segregated free lists. Bin 'n' holds free regions with net size in the
+ * range [2^n, 2^(n+1)) and a bitmap records which bins are non-empty. The smallest bin which can
+ * satisfy a request is found by a bit-scan on this bitmap, so allocation time does not depend on
+ * the number of free regions.
+ *
+ * The heap is an arena at the start of a large reserved virtual range, whose pages are committed
+ * on first access. Arena grows when no free region is large enough and shrinks when a large free
+ * region is left at its end, giving physical pages back to the PMM.
+ *
+ * Allocations of KMALLOC_LARGE_THRESHOLD_BYTES or more do not use the heap. They get their own
+ * lazily committed virtual pages with null pages on either side.
  * --------------------------------------------------------------------------------------------------
  */
 #include <kassert.h>
@@ -16,32 +28,51 @@
 #include <memloc.h>
 #include <vmm.h>
 #include <kstdlib.h>
-
-typedef enum FindCriteria
-{
-    FIND_CRIT_NODE_SIZE,
-    FIND_CRIT_NODE_ADDRESS
-} FindCriteria;
+#include <allocstats.h>
 
 static KMallocHeader* s_createNewNode (void* at, size_t netSize);
-static KMallocHeader* s_findFirst (ListNode* head, FindCriteria criteria, PTR value);
-static KMallocHeader* s_getMallocHeaderFromList (ListNode* head, ListNode* node);
+static KMallocHeader* s_findFreeNode (size_t netSize);
+static void s_addToFreeBin (KMallocHeader* header);
+static void s_removeFromFreeBin (KMallocHeader* header);
 static void s_splitFreeNode (size_t bytes, KMallocHeader* freeNodeHdr);
-static void s_combineAdjFreeNodes (KMallocHeader* currentNode);
-
-extern ListNode s_freeHead, s_allocHead, s_adjHead;
+static KMallocHeader* s_alignFreeNode (KMallocHeader* freeNodeHdr, size_t align);
+static KMallocHeader* s_combineAdjFreeNodes (KMallocHeader* currentNode);
+static bool s_isValidHeader (KMallocHeader const* header);
+static bool s_isCombinedHeader (KMallocHeader const* header);
+static bool s_growArena (size_t netSize);
+static bool s_trimArena (KMallocHeader* lastNode);
+
+extern ListNode s_freeBins[KMALLOC_FREE_BIN_COUNT], s_allocHead;
 static void* s_buffer;
-
-#define NET_ALLOCATION_SIZE(sz_bytes) (sz_bytes + sizeof (KMallocHeader))
+static PTR s_arenaEnd; // Regions are only in [s_buffer, s_arenaEnd) of the reserved range.
+static U32 s_nonEmptyBins; // Bit 'n' is set if s_freeBins[n] is not empty.
+static OSIF_AllocatorStats s_stats;
+
+#define NODE_OVERHEAD_BYTES           (sizeof (KMallocHeader) + sizeof (KMallocFooter))
+#define NET_ALLOCATION_SIZE(sz_bytes) (sz_bytes + NODE_OVERHEAD_BYTES)
+#define BUFFER_END()                  (s_arenaEnd)
+#define RESERVED_END()                ((PTR)s_buffer + ARCH_MEM_LEN_BYTES_KMALLOC)
+#define NODE_FOOTER(header) \
+    ((KMallocFooter*)((PTR)(header) + (header)->netNodeSize - sizeof (KMallocFooter)))
+#define BIN_INDEX(netSize)  (31U - (UINT)__builtin_clz ((U32)(netSize)))
+
+// Number of regions looked at in the bin of the requested size, while searching for a best fit.
+#define BIN_BEST_FIT_SCAN_LIMIT 8
+
+// Arena grows by at least this many bytes at a time. It is also the initial arena size.
+#define ARENA_GROW_MIN_BYTES       (16 * KB)
+// Arena shrinks when the free region at its end is larger than this.
+#define ARENA_TRIM_THRESHOLD_BYTES (64 * KB)
 
 #ifndef UNITTEST
-ListNode s_freeHead, s_allocHead, s_adjHead;
+ListNode s_freeBins[KMALLOC_FREE_BIN_COUNT], s_allocHead;
 #else
 // kmalloc unit test must provide definitions for the list head variables
 #endif
 
 /***************************************************************************************************
- * Initializes virtual & physical memory for kmalloc.
+ * Initializes virtual & physical memory for kmalloc. Only virtual memory is reserved, physical
+ * pages are committed on access.
  *
  * @return    None
  **************************************************************************************************/
@@ -49,9 +80,12 @@ void kmalloc_init(void)
 {
     FUNC_ENTRY();
 
-    list_init (&s_freeHead);
+    for (UINT i = 0; i < KMALLOC_FREE_BIN_COUNT; i++) {
+        list_init (&s_freeBins[i]);
+    }
     list_init (&s_allocHead);
-    list_init (&s_adjHead);
+    s_nonEmptyBins = 0;
+    s_stats        = (OSIF_AllocatorStats){ 0 };
 
     KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_VMM_READY);
 
@@ -61,9 +95,9 @@ void kmalloc_init(void)
         FATAL_BUG(); // Should not fail.
     }
 
-    KMallocHeader* newH = s_createNewNode (s_buffer, ARCH_MEM_LEN_BYTES_KMALLOC);
-    list_add_before (&s_freeHead, &newH->freenode);
-    list_add_before (&s_adjHead, &newH->adjnode);
+    s_arenaEnd          = (PTR)s_buffer + MIN (ARCH_MEM_LEN_BYTES_KMALLOC, ARENA_GROW_MIN_BYTES);
+    KMallocHeader* newH = s_createNewNode (s_buffer, BUFFER_END() - (PTR)s_buffer);
+    s_addToFreeBin (newH);
 
     KERNEL_PHASE_SET(KERNEL_PHASE_STATE_KMALLOC_READY);
 
@@ -93,11 +127,10 @@ void* kmallocz (size_t bytes)
 /***************************************************************************************************
  * Allocates at least 'bytes' number of bytes from the kmalloc memory.
  *
- * TODO: kalloc may take flags for alignment requirements to meet various placement requirements.
- *
  * @Input   bytes   Number of bytes to allocate.
  * @return          Poiter to the start of the allocated memory. Or NULL on failure.
- * @error           ERR_OUT_OF_MEM    - There is less memory than requested.
+ * @error           ERR_OUT_OF_MEM    - There is less memory than requested and the arena cannot
+ *                                      grow.
  **************************************************************************************************/
 void* kmalloc (size_t bytes)
 {
@@ -105,11 +138,27 @@ void* kmalloc (size_t bytes)
 
     KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_KMALLOC_READY);
 
+    if (bytes >= KMALLOC_LARGE_THRESHOLD_BYTES) {
+        SIZE pageCount = BYTES_TO_PAGEFRAMES_CEILING (bytes);
+        PTR va = kvmm_allocGuarded (g_kstate.context, pageCount, VMM_MEMMAP_FLAG_KERNEL_PAGE);
+        if (va == (PTR)NULL) {
+            allocstats_recordFailure (&s_stats);
+            RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+        }
+        allocstats_recordAlloc (&s_stats, bytes, PAGEFRAMES_TO_BYTES (pageCount));
+        INFO ("Large allocation at: %px", va);
+        return (void*)va;
+    }
+
     INFO ("Requested net size of %lu bytes", NET_ALLOCATION_SIZE (bytes));
 
     // Search for suitable node
-    size_t searchAllocSize = NET_ALLOCATION_SIZE (bytes) + sizeof (KMallocHeader);
-    KMallocHeader* node     = s_findFirst (&s_freeHead, FIND_CRIT_NODE_SIZE, searchAllocSize);
+    size_t searchAllocSize = NET_ALLOCATION_SIZE (bytes) + NODE_OVERHEAD_BYTES;
+    KMallocHeader* node    = s_findFreeNode (searchAllocSize);
+
+    if (node == NULL && s_growArena (searchAllocSize)) {
+        node = s_findFreeNode (searchAllocSize);
+    }
 
     if (node != NULL)
     {
@@ -117,18 +166,81 @@ void* kmalloc (size_t bytes)
 
         // Split the free node into two.
         s_splitFreeNode (bytes, node);
+        allocstats_recordAlloc (&s_stats, bytes, node->netNodeSize);
         return (void*)((PTR)node + sizeof (KMallocHeader));
     }
 
+    allocstats_recordFailure (&s_stats);
     RETURN_ERROR (ERR_OUT_OF_MEM, NULL);
 }
 
+/***************************************************************************************************
+ * Allocates at least 'bytes' number of bytes from the kmalloc memory, starting at an address which
+ * is a multiple of 'align'.
+ *
+ * Free region is split in up to three parts. Part before the aligned address and part after the
+ * allocation remain free. Large allocations are always page aligned.
+ *
+ * @Input   bytes   Number of bytes to allocate.
+ * @Input   align   Alignment in bytes. Must be a power of two and at most a page.
+ * @return          Poiter to the start of the allocated memory. Or NULL on failure.
+ * @error           ERR_WRONG_ALIGNMENT - Alignment is not a power of two or is more than a page.
+ * @error           ERR_OUT_OF_MEM      - There is less memory than requested and the arena cannot
+ *                                        grow.
+ **************************************************************************************************/
+void* kmalloc_aligned (size_t bytes, size_t align)
+{
+    FUNC_ENTRY ("Bytes: %x, Align: %x", bytes, align);
+
+    KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_KMALLOC_READY);
+
+    if (align == 0 || (align & (align - 1)) != 0 || align > CONFIG_PAGE_FRAME_SIZE_BYTES) {
+        allocstats_recordFailure (&s_stats);
+        RETURN_ERROR (ERR_WRONG_ALIGNMENT, NULL);
+    }
+
+    if (bytes >= KMALLOC_LARGE_THRESHOLD_BYTES) {
+        return kmalloc (bytes);
+    }
+
+    // Aligned address can be up to 'align' bytes away from where a part of at least the header and
+    // footer size can be left before it.
+    size_t searchAllocSize = NET_ALLOCATION_SIZE (bytes) + 2 * NODE_OVERHEAD_BYTES + align;
+    KMallocHeader* node    = s_findFreeNode (searchAllocSize);
+
+    if (node == NULL && s_growArena (searchAllocSize)) {
+        node = s_findFreeNode (searchAllocSize);
+    }
+
+    if (node == NULL) {
+        allocstats_recordFailure (&s_stats);
+        RETURN_ERROR (ERR_OUT_OF_MEM, NULL);
+    }
+
+    node = s_alignFreeNode (node, align);
+    k_assert (node->netNodeSize >= NET_ALLOCATION_SIZE (bytes) + NODE_OVERHEAD_BYTES,
+              "Aligned node too small");
+
+    s_splitFreeNode (bytes, node);
+    allocstats_recordAlloc (&s_stats, bytes, node->netNodeSize);
+
+    void* addr = (void*)((PTR)node + sizeof (KMallocHeader));
+    k_assert (IS_ALIGNED ((PTR)addr, align), "Wrong alignment");
+    return addr;
+}
+
 /***************************************************************************************************
  * Marks previously allocated memory starting at 'addr' as free.
  *
+ * The header just before 'addr' is checked in place, so there is no search. Addresses outside the
+ * heap are large allocations, their virtual pages are freed.
+ *
  * @Input   addr    Pointer to start of a kmalloc allocated memory.
  * @return          True on success. False otherwise.
- * @error           ERR_INVALID_ARGUMENT  - If the input address was not found.
+ * @error           ERR_INVALID_ARGUMENT  - If there is no valid header for the input address and
+ *                                          it is not a large allocation either.
+ * @error           ERR_DOUBLE_FREE       - If the input address is already free, also when it was
+ *                                          combined with a free neighbour since.
  **************************************************************************************************/
 bool kfree (void* addr)
 {
@@ -136,25 +248,47 @@ bool kfree (void* addr)
 
     KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_KMALLOC_READY);
 
-    void* headerAddress    = (void*)((PTR)addr - sizeof (KMallocHeader));
-    KMallocHeader* allocHdr = s_findFirst (&s_allocHead, FIND_CRIT_NODE_ADDRESS, (PTR)headerAddress);
-    if (allocHdr != NULL)
-    {
-        INFO ("Free at %px, Size = %lu", allocHdr, allocHdr->netNodeSize);
-        list_remove (&allocHdr->allocnode);
-        list_add_after (&s_freeHead, &allocHdr->freenode);
-        allocHdr->isAllocated = false;
-
-        s_combineAdjFreeNodes (allocHdr);
+    if ((PTR)addr < (PTR)s_buffer || (PTR)addr >= RESERVED_END()) {
+        SIZE pageCount = 0;
+        if (!kvmm_freeGuarded (g_kstate.context, (PTR)addr, &pageCount)) {
+            BUG();
+            RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+        }
+        allocstats_recordFree (&s_stats, PAGEFRAMES_TO_BYTES (pageCount));
         return true;
     }
 
-    BUG();
-    RETURN_ERROR (ERR_DOUBLE_FREE, false);
+    KMallocHeader* allocHdr = (KMallocHeader*)((PTR)addr - sizeof (KMallocHeader));
+    if (s_isCombinedHeader (allocHdr)) {
+        BUG();
+        RETURN_ERROR (ERR_DOUBLE_FREE, false);
+    }
+
+    if (!s_isValidHeader (allocHdr)) {
+        BUG();
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+    }
+
+    if (!allocHdr->isAllocated) {
+        BUG();
+        RETURN_ERROR (ERR_DOUBLE_FREE, false);
+    }
+
+    INFO ("Free at %px, Size = %lu", allocHdr, allocHdr->netNodeSize);
+    list_remove (&allocHdr->allocnode);
+    allocHdr->isAllocated = false;
+    allocstats_recordFree (&s_stats, allocHdr->netNodeSize);
+
+    KMallocHeader* freeHdr = s_combineAdjFreeNodes (allocHdr);
+    if (!s_trimArena (freeHdr)) {
+        s_addToFreeBin (freeHdr);
+    }
+    return true;
 }
 
 /***************************************************************************************************
- * Gets the amount of memory allocated by kmalloc
+ * Gets the amount of memory allocated by kmalloc. Includes the header and footer of every region
+ * and the whole pages of large allocations.
  *
  * @return          Amount of allocated memory in bytes.
  **************************************************************************************************/
@@ -164,121 +298,285 @@ SIZE kmalloc_getUsedMemory(void)
 
     KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_KMALLOC_READY);
 
-    SIZE usedSz = 0U;
-    ListNode* node;
+    return s_stats.usedBytes;
+}
+
+/***************************************************************************************************
+ * Gets allocation statistics of kmalloc.
+ *
+ * @Output stats    Statistics are copied here.
+ * @return          Nothing
+ **************************************************************************************************/
+void kmalloc_getStats (OSIF_AllocatorStats* const stats)
+{
+    FUNC_ENTRY ("stats: %px", stats);
+
+    KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_KMALLOC_READY);
+
+    k_assert (stats != NULL, "Stats not provided");
+    *stats = s_stats;
+}
 
-    INFO ("Kmalloc buffer size: %u bytes", ARCH_MEM_LEN_BYTES_KMALLOC);
+/***************************************************************************************************
+ * Checks if there is a valid header at 'header'. Only reads memory within the kmalloc buffer.
+ *
+ * @Input   header  Address of the header.
+ * @return          True if header is valid. False otherwise.
+ **************************************************************************************************/
+static bool s_isValidHeader (KMallocHeader const* header)
+{
+    if ((PTR)header < (PTR)s_buffer || (PTR)header > BUFFER_END() - NODE_OVERHEAD_BYTES) {
+        return false;
+    }
 
-    list_for_each (&s_allocHead, node)
-    {
-        KMallocHeader* header = LIST_ITEM (node, KMallocHeader, allocnode);
-        INFO ("Node size: %u bytes", header->netNodeSize);
-        k_assert (header && (header->netNodeSize < ARCH_MEM_LEN_BYTES_KMALLOC),
-                  "Invalid state of kmalloc data");
-        usedSz += header->netNodeSize;
+    if (header->magic != KMALLOC_MAGIC || header->netNodeSize < NODE_OVERHEAD_BYTES ||
+        header->netNodeSize > BUFFER_END() - (PTR)header) {
+        return false;
     }
 
-    return usedSz;
+    // Boundary tag at the end must agree with the header.
+    return NODE_FOOTER (header)->netNodeSize == header->netNodeSize;
+}
+
+/***************************************************************************************************
+ * Checks if there is the header of a region at 'header', which was combined into its free
+ * neighbour. Such a header stays until the memory is allocated again. Only reads memory within the
+ * kmalloc buffer.
+ *
+ * @Input   header  Address of the header.
+ * @return          True if the header was combined. False otherwise.
+ **************************************************************************************************/
+static bool s_isCombinedHeader (KMallocHeader const* header)
+{
+    if ((PTR)header < (PTR)s_buffer || (PTR)header > BUFFER_END() - NODE_OVERHEAD_BYTES) {
+        return false;
+    }
+    return header->magic == KMALLOC_MAGIC_COMBINED;
 }
 
-static void s_combineAdjFreeNodes (KMallocHeader* currentNode)
+/***************************************************************************************************
+ * Combines a free node, which is not yet in a free bin, with its free neighbours.
+ *
+ * @Input   currentNode Free node.
+ * @return              Header of the combined node. It is not added to any free bin.
+ **************************************************************************************************/
+static KMallocHeader* s_combineAdjFreeNodes (KMallocHeader* currentNode)
 {
     KMallocHeader* next = NULL;
     KMallocHeader* prev = NULL;
 
     k_assert (currentNode->isAllocated == false, "Cannot combine allocated node. Invalid input.");
 
-    // Prev node could be the list head (which is not a KMallocHeader). That would mean beginning of
-    // list and is not taken into account.
-    if (currentNode->adjnode.prev != &s_adjHead)
-    {
-        prev = LIST_ITEM (currentNode->adjnode.prev, KMallocHeader, adjnode);
+    // There is no node before the first node. Otherwise the footer of the previous node is just
+    // before the current node.
+    if ((PTR)currentNode != (PTR)s_buffer) {
+        KMallocFooter* prevFooter = (KMallocFooter*)((PTR)currentNode - sizeof (KMallocFooter));
+        prev = (KMallocHeader*)((PTR)currentNode - prevFooter->netNodeSize);
+        k_assert (s_isValidHeader (prev), "Invalid previous node");
     }
 
-    // Next node could be the list head (which is not a KMallocHeader). That would mean end of list
-    // and is not taken into account (Practically this is not possible as there will always be
-    // one Free section at the end of kmalloc buffer).
-    if (currentNode->adjnode.next != &s_adjHead)
-    {
-        next = LIST_ITEM (currentNode->adjnode.next, KMallocHeader, adjnode);
+    // There is no node after the last node (Practically this is not possible as there will always
+    // be one Free section at the end of kmalloc buffer).
+    if ((PTR)currentNode + currentNode->netNodeSize < BUFFER_END()) {
+        next = (KMallocHeader*)((PTR)currentNode + currentNode->netNodeSize);
+        k_assert (s_isValidHeader (next), "Invalid next node");
     }
 
     if (next && !next->isAllocated)
     {
         INFO ("Combining NEXT into CURRENT");
+        s_removeFromFreeBin (next);
         currentNode->netNodeSize += next->netNodeSize;
-        list_remove (&next->freenode);
-        list_remove (&next->adjnode);
+        NODE_FOOTER (currentNode)->netNodeSize = currentNode->netNodeSize;
+        next->magic = KMALLOC_MAGIC_COMBINED; // Not a header anymore.
     }
 
     if (prev && !prev->isAllocated)
     {
         INFO ("Combining CURRENT into PREV");
+        s_removeFromFreeBin (prev);
         prev->netNodeSize += currentNode->netNodeSize;
-        list_remove (&currentNode->freenode);
-        list_remove (&currentNode->adjnode);
+        NODE_FOOTER (prev)->netNodeSize = prev->netNodeSize;
+        currentNode->magic = KMALLOC_MAGIC_COMBINED; // Not a header anymore.
+        currentNode        = prev;
+    }
+
+    return currentNode;
+}
+
+/***************************************************************************************************
+ * Extends the arena so that there is a free region of at least 'netSize' bytes. Free region at the
+ * end of the arena, if any, is combined with the new part.
+ *
+ * @Input   netSize Size of the required free region including the header and footer.
+ * @return          True if the arena was extended. False if the reserved range is used up.
+ **************************************************************************************************/
+static bool s_growArena (size_t netSize)
+{
+    size_t growBytes = ALIGN_UP (MAX (netSize, ARENA_GROW_MIN_BYTES), CONFIG_PAGE_FRAME_SIZE_BYTES);
+    growBytes        = MIN (growBytes, RESERVED_END() - BUFFER_END());
+
+    if (growBytes < NODE_OVERHEAD_BYTES) {
+        return false;
     }
+
+    INFO ("Growing arena at %px by %lu bytes", BUFFER_END(), growBytes);
+
+    PTR oldEnd = BUFFER_END();
+    s_arenaEnd += growBytes;
+    s_addToFreeBin (s_combineAdjFreeNodes (s_createNewNode ((void*)oldEnd, growBytes)));
+    return true;
+}
+
+/***************************************************************************************************
+ * Shrinks the arena if 'lastNode' is at the end of the arena and is larger than the threshold.
+ * Some free bytes are kept, so that the next few allocations do not grow the arena again. Physical
+ * pages after the new end are given back to the PMM.
+ *
+ * @Input   lastNode    Free node which is not in any free bin.
+ * @return              True if the arena was shrunk, the node is then added to a free bin. False
+ *                      otherwise.
+ **************************************************************************************************/
+static bool s_trimArena (KMallocHeader* lastNode)
+{
+    if ((PTR)lastNode + lastNode->netNodeSize != BUFFER_END() ||
+        lastNode->netNodeSize <= ARENA_TRIM_THRESHOLD_BYTES) {
+        return false;
+    }
+
+    // Threshold is larger than the kept bytes, so new end is always less than the current end.
+    PTR newEnd = ALIGN_UP ((PTR)lastNode + NODE_OVERHEAD_BYTES + ARENA_GROW_MIN_BYTES,
+                           CONFIG_PAGE_FRAME_SIZE_BYTES);
+    k_assert (newEnd < BUFFER_END(), "Invalid arena end");
+
+    SIZE pageCount = BYTES_TO_PAGEFRAMES_FLOOR (BUFFER_END() - newEnd);
+    if (!kvmm_decommit (g_kstate.context, newEnd, pageCount)) {
+        BUG(); // Arena is still usable, just that physical pages are not given back.
+        return false;
+    }
+
+    INFO ("Shrinking arena from %px to %px", BUFFER_END(), newEnd);
+
+    s_arenaEnd            = newEnd;
+    lastNode->netNodeSize = newEnd - (PTR)lastNode;
+    NODE_FOOTER (lastNode)->netNodeSize = lastNode->netNodeSize;
+    s_addToFreeBin (lastNode);
+    return true;
 }
 
 static KMallocHeader* s_createNewNode (void* at, size_t netSize)
 {
-    k_assert (((PTR)at + netSize - 1) < ((PTR)s_buffer + ARCH_MEM_LEN_BYTES_KMALLOC),
-              "Node netSize too large");
+    k_assert (((PTR)at + netSize - 1) < BUFFER_END(), "Node netSize too large");
 
     KMallocHeader* newH = at;
-    newH->netNodeSize  = netSize;
-    newH->isAllocated  = false;
+    newH->magic         = KMALLOC_MAGIC;
+    newH->netNodeSize   = netSize;
+    newH->isAllocated   = false;
     list_init (&newH->freenode);
     list_init (&newH->allocnode);
-    list_init (&newH->adjnode);
+    NODE_FOOTER (newH)->netNodeSize = netSize;
     return newH;
 }
 
-static KMallocHeader* s_getMallocHeaderFromList (ListNode* head, ListNode* node)
+static void s_addToFreeBin (KMallocHeader* header)
 {
-    KMallocHeader* ret = NULL;
-    if (head == &s_allocHead)
-    {
-        ret = LIST_ITEM (node, KMallocHeader, allocnode);
-    }
-    else if (head == &s_freeHead)
-    {
-        ret = LIST_ITEM (node, KMallocHeader, freenode);
-    }
+    UINT bin = BIN_INDEX (header->netNodeSize);
+    k_assert (bin < KMALLOC_FREE_BIN_COUNT, "Invalid bin");
 
-    return ret;
+    list_add_after (&s_freeBins[bin], &header->freenode);
+    s_nonEmptyBins |= (1U << bin);
 }
 
-static KMallocHeader* s_findFirst (ListNode* head, FindCriteria criteria, PTR value)
+static void s_removeFromFreeBin (KMallocHeader* header)
 {
-    bool found           = false;
-    ListNode* node       = NULL;
-    KMallocHeader* header = NULL;
+    // Must be called before the node size is changed, the bin depends on it.
+    UINT bin = BIN_INDEX (header->netNodeSize);
+    k_assert (bin < KMALLOC_FREE_BIN_COUNT, "Invalid bin");
 
-    INFO ("Searching for value %lu (%lx)", value, value);
+    list_remove (&header->freenode);
+    if (list_is_empty (&s_freeBins[bin])) {
+        s_nonEmptyBins &= ~(1U << bin);
+    }
+}
 
-    list_for_each (head, node)
-    {
-        header = s_getMallocHeaderFromList (head, node);
-        INFO ("  (%px) Size = %lu...", header, header->netNodeSize);
+/***************************************************************************************************
+ * Finds a free node of at least 'netSize' bytes.
+ *
+ * Regions in the bin of 'netSize' can be smaller than 'netSize', so a few of them are checked for
+ * a best fit. Every region in a higher bin is large enough, so the first region of the smallest
+ * non-empty higher bin is taken.
+ *
+ * @Input   netSize Minimum size of the node including the header and footer.
+ * @return          Header of the free node. NULL if there is no large enough free node.
+ **************************************************************************************************/
+static KMallocHeader* s_findFreeNode (size_t netSize)
+{
+    UINT bin            = BIN_INDEX (netSize);
+    KMallocHeader* best = NULL;
+    UINT scanned        = 0;
+    ListNode* node      = NULL;
 
-        switch (criteria)
-        {
-        case FIND_CRIT_NODE_ADDRESS:
-            found = ((PTR)header == value);
-            break;
-        case FIND_CRIT_NODE_SIZE:
-            found = (header->netNodeSize >= value);
-            break;
+    INFO ("Searching for size %lu in bin %u. Non-empty bins: %x", netSize, bin, s_nonEmptyBins);
+
+    list_for_each (&s_freeBins[bin], node)
+    {
+        KMallocHeader* header = LIST_ITEM (node, KMallocHeader, freenode);
+        if (header->netNodeSize >= netSize &&
+            (best == NULL || header->netNodeSize < best->netNodeSize)) {
+            best = header;
         }
 
-        if (found)
-        {
-            INFO ("Found.");
+        if ((best != NULL && best->netNodeSize == netSize) ||
+            ++scanned == BIN_BEST_FIT_SCAN_LIMIT) {
             break;
         }
     }
-    return (found) ? header : NULL;
+
+    if (best != NULL) {
+        return best;
+    }
+
+    // Non-empty bins higher than 'bin'. For the last bin (2U << bin) wraps to 0, leaving none.
+    U32 higherBins = s_nonEmptyBins & ~((2U << bin) - 1U);
+    if (higherBins == 0) {
+        return NULL;
+    }
+
+    UINT found = (UINT)__builtin_ctz (higherBins);
+    return LIST_ITEM (s_freeBins[found].next, KMallocHeader, freenode);
+}
+
+/***************************************************************************************************
+ * Splits a free node, so that the memory after the header of the second part is aligned. First
+ * part, if any, is at least the size of the header and footer and remains free.
+ *
+ * @Input   freeNodeHdr Free node in a free bin.
+ * @Input   align       Alignment in bytes. Must be a power of two.
+ * @return              Header of the free node with aligned memory. It is in a free bin.
+ **************************************************************************************************/
+static KMallocHeader* s_alignFreeNode (KMallocHeader* freeNodeHdr, size_t align)
+{
+    PTR start  = (PTR)freeNodeHdr + sizeof (KMallocHeader);
+    size_t gap = ALIGN_UP (start, align) - start;
+
+    // Space before the aligned address must be able to hold a free node.
+    while (gap != 0 && gap < NODE_OVERHEAD_BYTES) {
+        gap += align;
+    }
+
+    if (gap == 0) {
+        return freeNodeHdr;
+    }
+
+    k_assert (freeNodeHdr->netNodeSize > gap, "Free node too small to align");
+
+    size_t netSize = freeNodeHdr->netNodeSize;
+    s_removeFromFreeBin (freeNodeHdr);
+
+    KMallocHeader* alignedHdr = s_createNewNode ((void*)((PTR)freeNodeHdr + gap), netSize - gap);
+    s_addToFreeBin (s_createNewNode (freeNodeHdr, gap));
+    s_addToFreeBin (alignedHdr);
+    return alignedHdr;
 }
 
 static void s_splitFreeNode (size_t bytes, KMallocHeader* freeNodeHdr)
@@ -286,14 +584,15 @@ static void s_splitFreeNode (size_t bytes, KMallocHeader* freeNodeHdr)
     size_t netAllocSize  = NET_ALLOCATION_SIZE (bytes);
     PTR splitAt          = (PTR)freeNodeHdr + netAllocSize;
     size_t remainingSize = freeNodeHdr->netNodeSize - netAllocSize;
-    k_assert (remainingSize >= sizeof (KMallocHeader), "Not enough space for kmalloc header");
+    k_assert (remainingSize >= NODE_OVERHEAD_BYTES, "Not enough space for kmalloc header");
+
+    s_removeFromFreeBin (freeNodeHdr);
 
     KMallocHeader* newFreeNodeHdr = s_createNewNode ((void*)splitAt, remainingSize);
     freeNodeHdr->netNodeSize     = netAllocSize;
     freeNodeHdr->isAllocated     = true;
+    NODE_FOOTER (freeNodeHdr)->netNodeSize = netAllocSize;
 
-    list_add_after (&freeNodeHdr->freenode, &newFreeNodeHdr->freenode);
-    list_add_after (&freeNodeHdr->adjnode, &newFreeNodeHdr->adjnode);
-    list_remove (&freeNodeHdr->freenode);
+    s_addToFreeBin (newFreeNodeHdr);
     list_add_before (&s_allocHead, &freeNodeHdr->allocnode);
 }
@@ -123,6 +123,14 @@ void k_memcpyToPhyMem (Physical dest, PTR src, UINT destOffset, UINT srcOffset,
     PTR l_src       = src + srcOffset;
     SIZE remBytes   = n;
 
+    // Destination completely within the direct map is copied in one go, without temporary maps.
+    U8* dest_direct        = kpg_getDirectMapAddress (dest);
+    Physical dest_lastByte = PHYSICAL (dest.val + destOffset + n - 1);
+    if (n > 0 && dest_direct != NULL && kpg_getDirectMapAddress (dest_lastByte) != NULL) {
+        k_memcpy (dest_direct + destOffset, (void*)l_src, n);
+        return;
+    }
+
     // Copy whole pages worth of bytes
     while (remBytes >= CONFIG_PAGE_FRAME_SIZE_BYTES) {
         PTR dest_va = (PTR)kpg_temporaryMap (l_dest) + destOffset;
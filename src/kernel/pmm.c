@@ -17,17 +17,63 @@
 #include <utils.h>
 #include <kernel.h>
 #include <memloc.h>
+#include <allocstats.h>
+#include <paging.h>
+#include <memmanage.h>
+#include <kstdlib.h>
+#ifdef PMM_BUDDY_ALLOCATOR
+    #include <pmm_buddy.h>
+#endif
+
+/* Page frames in the PAB are grouped, and for every group the summary tells if any or all of its
+ * page frames are free. Summary words are searched first, so that PAB is read only for groups which
+ * are known to have free page frames. Summary is large enough for the largest PAB. */
+#define PMM_SUMMARY_GROUP_PAGES     64U
+#define PMM_SUMMARY_MAX_GROUP_COUNT (MAX_PAB_ADDRESSABLE_PAGE_COUNT / PMM_SUMMARY_GROUP_PAGES)
+#define PMM_SUMMARY_MAX_WORD_COUNT  ((PMM_SUMMARY_MAX_GROUP_COUNT + 31U) / 32U)
+
+typedef struct PhysicalMemorySummary
+{
+    U32 anyFree[PMM_SUMMARY_MAX_WORD_COUNT]; /* Bit set if at least one page frame in group is free */
+    U32 allFree[PMM_SUMMARY_MAX_WORD_COUNT]; /* Bit set if every page frame in group is free. */
+    UINT groupCount;                         /* Number of groups in the PAB. */
+    UINT nextFitFrame;                       /* Allocation search starts from this page frame. */
+} PhysicalMemorySummary;
 
 typedef struct PhysicalMemoryRegion
 {
     Bitmap bitmap;
     Physical start;
-    USYSINT length;
+    U64 length;
+    PhysicalMemorySummary summary;
 } PhysicalMemoryRegion;
 
 static PhysicalMemoryRegion s_pmm_completeRegion = {0};
-static U8 *s_pab = NULL;
+static UINT s_freeFrameCount = 0;       // Free page frames within the usable memory.
+static OSIF_AllocatorStats s_stats = {0};
+/* Zeroed page frames. These are used in the PAB, but counted as free memory. */
+static Physical s_zeroPool[PMM_ZERO_POOL_CAPACITY];
+static UINT s_zeroPoolCount = 0;
+/* Number of owners of each page frame, other than the first one. Page frames shared after cloning
+ * an address space are freed only when the last owner frees them. Counts are kept in chunks, which
+ * are allocated when a page frame in them is first shared. A missing chunk means a count of zero.
+ * Allocating all the counts early would not fit the early allocation region with 4 GB of RAM. */
+#define PMM_SHARE_CHUNK_FRAMES (CONFIG_PAGE_FRAME_SIZE_BYTES / sizeof (U8))
+#define PMM_SHARE_CHUNK_COUNT  (MAX_PAB_ADDRESSABLE_PAGE_COUNT / PMM_SHARE_CHUNK_FRAMES)
+static U8* s_shareCounts[PMM_SHARE_CHUNK_COUNT];
+/* Page frame of zeros which is mapped read-only for pages which are read before written. It has
+ * any number of owners and is never freed. */
+static Physical s_zeroFrame = {0};
+static bool s_isZeroFrameAllocated = false;
 static UINT kpmm_getUsableMemoryPagesCount(KernelPhysicalMemoryRegions reg);
+static void s_updateSummary (PhysicalMemoryRegion* region, UINT startFrame, UINT frameCount);
+#ifdef PMM_BUDDY_ALLOCATOR
+static void s_updateBuddy (PhysicalMemoryRegion* region, UINT startFrame, UINT frameCount);
+#endif
+static INT s_findFreeFrames (PhysicalMemoryRegion* region, UINT pageCount, UINT fromFrame,
+                             UINT toFrame);
+static INT s_takeFreeFrames (PhysicalMemoryRegion* region, UINT pageCount, UINT firstFrame);
+static void s_drainZeroPool (PhysicalMemoryRegion* region);
 
 static PhysicalMemoryRegion *s_getBitmapFromRegion (KernelPhysicalMemoryRegions reg)
 {
@@ -38,6 +84,18 @@ static PhysicalMemoryRegion *s_getBitmapFromRegion (KernelPhysicalMemoryRegions
     return NULL;
 }
 
+/***************************************************************************************************
+ * Number of owners of a page frame other than the first one.
+ *
+ * @Input pageFrame     Page frame index.
+ * @return              Share count. Zero if the chunk of share counts is not yet allocated.
+***************************************************************************************************/
+static UINT s_getShareCount (UINT pageFrame)
+{
+    U8* chunk = s_shareCounts[pageFrame / PMM_SHARE_CHUNK_FRAMES];
+    return (chunk == NULL) ? 0 : chunk[pageFrame % PMM_SHARE_CHUNK_FRAMES];
+}
+
 /***************************************************************************************************
  * Called when setting a bitmap state. It returns true if the change is allowed.
  * Any invalid condition here is unlikely so panic is justified.
@@ -67,6 +125,195 @@ static bool s_verifyChange(UINT pageFrame, BitmapState old, BitmapState new)
     return true;
 }
 
+/***************************************************************************************************
+ * Recalculates the summary bits of every group which has at least one page frame within the range.
+ * Must be called after every change to the PAB.
+ *
+ * @Input region        Physical memory region.
+ * @Input startFrame    First page frame which was changed.
+ * @Input frameCount    Number of page frames changed.
+ * @return              Nothing
+ **************************************************************************************************/
+static void s_updateSummary (PhysicalMemoryRegion* region, UINT startFrame, UINT frameCount)
+{
+    Bitmap* b     = &region->bitmap;
+    UINT capacity = BITMAP_CAPACITY (b);
+
+    UINT firstGroup = startFrame / PMM_SUMMARY_GROUP_PAGES;
+    UINT lastGroup  = MIN (startFrame + frameCount, capacity) - 1;
+    lastGroup /= PMM_SUMMARY_GROUP_PAGES;
+
+    for (UINT group = firstGroup; group <= lastGroup; group++) {
+        UINT groupStart = group * PMM_SUMMARY_GROUP_PAGES;
+        UINT groupLen   = MIN (PMM_SUMMARY_GROUP_PAGES, capacity - groupStart);
+        U32 bit         = 1U << (group % 32);
+        U32* anyFree    = &region->summary.anyFree[group / 32];
+        U32* allFree    = &region->summary.allFree[group / 32];
+
+        bool isAnyFree = bitmap_findContinousInRange (b, PMM_STATE_FREE, 1, groupStart,
+                                                      groupStart + groupLen) != KERNEL_EXIT_FAILURE;
+        bool isAllFree = isAnyFree &&
+                         bitmap_countContinous (b, PMM_STATE_FREE, groupStart, groupLen) == groupLen;
+
+        *anyFree = (isAnyFree) ? (*anyFree | bit) : (*anyFree & ~bit);
+        *allFree = (isAllFree) ? (*allFree | bit) : (*allFree & ~bit);
+    }
+
+#ifdef PMM_BUDDY_ALLOCATOR
+    s_updateBuddy (region, startFrame, frameCount);
+#endif
+}
+
+#ifdef PMM_BUDDY_ALLOCATOR
+/***************************************************************************************************
+ * Makes the buddy allocator agree with the PAB for the page frames which were changed. Page frames
+ * are marked used and then every free run within the range is marked free again.
+ *
+ * @Input region        Physical memory region.
+ * @Input startFrame    First page frame which was changed.
+ * @Input frameCount    Number of page frames changed.
+ * @return              Nothing
+ **************************************************************************************************/
+static void s_updateBuddy (PhysicalMemoryRegion* region, UINT startFrame, UINT frameCount)
+{
+    Bitmap* b     = &region->bitmap;
+    UINT endFrame = MIN (startFrame + frameCount, BITMAP_CAPACITY (b));
+
+    if (startFrame >= endFrame)
+        return;
+
+    kpmm_buddy_markUsed (startFrame, endFrame - startFrame);
+
+    for (UINT frame = startFrame; frame < endFrame;) {
+        INT runStart = bitmap_findContinousInRange (b, PMM_STATE_FREE, 1, frame, endFrame);
+        if (runStart == KERNEL_EXIT_FAILURE)
+            break;
+
+        UINT runLength = bitmap_countContinous (b, PMM_STATE_FREE, (UINT)runStart,
+                                                endFrame - (UINT)runStart);
+        kpmm_buddy_markFree ((UINT)runStart, runLength);
+        frame = (UINT)runStart + runLength;
+    }
+}
+#endif
+
+/***************************************************************************************************
+ * Finds the first group, at or after `group`, which has at least one free page frame.
+ *
+ * @Input region        Physical memory region.
+ * @Input group         Search starts at this group.
+ * @return              Group index if found, otherwise number of groups in the PAB.
+ **************************************************************************************************/
+static UINT s_nextGroupWithFreeFrames (PhysicalMemoryRegion* region, UINT group)
+{
+    UINT groupCount = region->summary.groupCount;
+    UINT wordCount  = (groupCount + 31U) / 32U;
+
+    if (group >= groupCount)
+        return groupCount;
+
+    UINT wordIndex = group / 32;
+    U32 word       = region->summary.anyFree[wordIndex] & (0xFFFFFFFF << (group % 32));
+
+    while (word == 0) {
+        if (++wordIndex >= wordCount)
+            return groupCount;
+        word = region->summary.anyFree[wordIndex];
+    }
+
+    return MIN (wordIndex * 32 + (UINT)__builtin_ctz (word), groupCount);
+}
+
+/***************************************************************************************************
+ * Counts consecutive free page frames starting at `frame`. Groups which are completely free are
+ * counted from the summary without reading the PAB.
+ *
+ * @Input region        Physical memory region.
+ * @Input frame         Page frame to start counting from.
+ * @Input maxCount      Counting stops after this many page frames.
+ * @return              Number of consecutive free page frames, at most `maxCount`.
+ **************************************************************************************************/
+static UINT s_countFreeFrames (PhysicalMemoryRegion* region, UINT frame, UINT maxCount)
+{
+    Bitmap* b     = &region->bitmap;
+    UINT capacity = BITMAP_CAPACITY (b);
+    UINT count    = 0;
+
+    while (count < maxCount && frame < capacity) {
+        UINT group = frame / PMM_SUMMARY_GROUP_PAGES;
+        UINT left  = MIN (maxCount - count, capacity - frame);
+
+        if (IS_ALIGNED (frame, PMM_SUMMARY_GROUP_PAGES) && left >= PMM_SUMMARY_GROUP_PAGES &&
+            BIT_ISSET (region->summary.allFree[group / 32], 1U << (group % 32))) {
+            count += PMM_SUMMARY_GROUP_PAGES;
+            frame += PMM_SUMMARY_GROUP_PAGES;
+            continue;
+        }
+
+        // Count till the end of the group, a free run which reaches it may continue further.
+        UINT groupLeft = (group + 1) * PMM_SUMMARY_GROUP_PAGES - frame;
+        UINT len       = MIN (left, groupLeft);
+        UINT run       = bitmap_countContinous (b, PMM_STATE_FREE, frame, len);
+
+        count += run;
+        frame += run;
+        if (run < len)
+            break;
+    }
+
+    return count;
+}
+
+/***************************************************************************************************
+ * Searches the PAB for `pageCount` consecutive free page frames, where the first one is within
+ * `fromFrame` and `toFrame - 1`. The last of the page frames can be beyond `toFrame`.
+ * Groups without any free page frame are skipped using the summary.
+ *
+ * @Input region        Physical memory region.
+ * @Input pageCount     Number of consecutive free page frames to find.
+ * @Input fromFrame     First page frame of the search range.
+ * @Input toFrame       One past the last page frame of the search range.
+ * @return              Index of the first page frame found, otherwise KERNEL_EXIT_FAILURE.
+ **************************************************************************************************/
+static INT s_findFreeFrames (PhysicalMemoryRegion* region, UINT pageCount, UINT fromFrame,
+                             UINT toFrame)
+{
+    Bitmap* b     = &region->bitmap;
+    UINT capacity = BITMAP_CAPACITY (b);
+    UINT frame    = fromFrame;
+
+    while (frame < toFrame && pageCount <= capacity - frame) {
+        UINT group = s_nextGroupWithFreeFrames (region, frame / PMM_SUMMARY_GROUP_PAGES);
+        if (group >= region->summary.groupCount)
+            break;
+
+        frame = MAX (frame, group * PMM_SUMMARY_GROUP_PAGES);
+        if (frame >= toFrame)
+            break;
+
+        // First free page frame in the group, at or after `frame`.
+        UINT groupEnd = MIN ((group + 1) * PMM_SUMMARY_GROUP_PAGES, capacity);
+        INT freeFrame = bitmap_findContinousInRange (b, PMM_STATE_FREE, 1, frame, groupEnd);
+        if (freeFrame == KERNEL_EXIT_FAILURE) {
+            frame = groupEnd;
+            continue;
+        }
+
+        frame = (UINT)freeFrame;
+        if (frame >= toFrame || pageCount > capacity - frame)
+            break;
+
+        UINT run = s_countFreeFrames (region, frame, pageCount);
+        if (run == pageCount)
+            return (INT)frame;
+
+        // Page frame at `frame + run` is not free, no suitable section can start before it.
+        frame += run + 1;
+    }
+
+    return KERNEL_EXIT_FAILURE;
+}
+
 /***************************************************************************************************
  * Total number of usable page frames in a memory region.
  * Returns 0 if region is outside the installed physical memory range.
@@ -83,6 +330,8 @@ static UINT kpmm_getUsableMemoryPagesCount(KernelPhysicalMemoryRegions reg)
 
 /***************************************************************************************************
  * Initializes PAB array.
+ * PAB is only as large as required to address the installed RAM. It is allocated from the early
+ * memory, before the PMM is ready.
  *
  * @return nothing
  * @error   Panics if called after initialization.
@@ -91,17 +340,52 @@ void kpmm_init (void)
 {
     FUNC_ENTRY();
 
-    s_pab = (U8 *)ARCH_MEM_START_KERNEL_PAB;
+    // PAB size is rounded up to whole summary groups. Extra page frames are left reserved.
+    UINT pageFrameCount = kpmm_arch_getPageFrameCount();
+    k_assert (pageFrameCount > 0 && pageFrameCount <= MAX_PAB_ADDRESSABLE_PAGE_COUNT,
+              "Invalid page frame count");
+
+    pageFrameCount   = ALIGN_UP (pageFrameCount, PMM_SUMMARY_GROUP_PAGES);
+    SIZE pabSizeBytes = pageFrameCount * PAB_BITS_PER_STATE / 8U;
 
     s_pmm_completeRegion.bitmap.allow = s_verifyChange;
-    s_pmm_completeRegion.bitmap.bitmap = s_pab;
+    s_pmm_completeRegion.bitmap.bitmap = (U8 *)kpmm_arch_earlyAlloc (pabSizeBytes);
     s_pmm_completeRegion.bitmap.bitsPerState = PAB_BITS_PER_STATE;
-    s_pmm_completeRegion.bitmap.size = PAB_SIZE_BYTES;
-    s_pmm_completeRegion.length = MAX_PAB_ADDRESSABLE_BYTE_COUNT;
+    s_pmm_completeRegion.bitmap.size = pabSizeBytes;
+    s_pmm_completeRegion.length = (U64)pageFrameCount * CONFIG_PAGE_FRAME_SIZE_BYTES;
     s_pmm_completeRegion.start = createPhysical(0);
+    s_pmm_completeRegion.summary.groupCount = pageFrameCount / PMM_SUMMARY_GROUP_PAGES;
+
+    // Page frames are not shared to begin with.
+    k_memset (s_shareCounts, 0, sizeof (s_shareCounts));
 
+#ifdef PMM_BUDDY_ALLOCATOR
+    SIZE buddySizeBytes = kpmm_buddy_getMemorySize (pageFrameCount);
+    kpmm_buddy_init ((void *)kpmm_arch_earlyAlloc (buddySizeBytes), pageFrameCount);
+#endif
+
+    // Marks the early memory allocated above as used as well.
     kpmm_arch_init(&s_pmm_completeRegion.bitmap);
 
+    // PAB was filled directly, so summary (and the buddy allocator) is built from it in one go.
+    s_pmm_completeRegion.summary.nextFitFrame = 0;
+    s_updateSummary (&s_pmm_completeRegion, 0, BITMAP_CAPACITY (&s_pmm_completeRegion.bitmap));
+
+    // Only time the PAB is scanned for free page frames. Afterwards the count is kept up to date by
+    // alloc and free. Page frames which are not free now are counted as used.
+    UINT usablePageCount = kpmm_getUsableMemoryPagesCount (PMM_REGION_ANY);
+    s_freeFrameCount     = 0;
+    for (UINT frame = 0; frame < usablePageCount; frame++) {
+        if (bitmap_get (&s_pmm_completeRegion.bitmap, frame) == PMM_STATE_FREE)
+            s_freeFrameCount++;
+    }
+
+    s_zeroPoolCount        = 0;
+    s_isZeroFrameAllocated = false;
+    s_stats                = (OSIF_AllocatorStats){ 0 };
+    s_stats.usedBytes      = PAGEFRAMES_TO_BYTES (usablePageCount - s_freeFrameCount);
+    s_stats.peakUsedBytes  = s_stats.usedBytes;
+
     // PMM is now initialized
     KERNEL_PHASE_SET(KERNEL_PHASE_STATE_PMM_READY);
 }
@@ -113,6 +397,9 @@ void kpmm_init (void)
  * problem where to initialize PAB one needs to at least call free or alloc functions. May be there
  * is a better solution.
  *
+ * A page frame shared by kpmm_share is only freed by its last owner, others just give up their
+ * ownership. Shared page frames must be freed one at a time. Freeing the zero frame does nothing.
+ *
  * @Input startAddress  Physical memory location of the first page. Must be page aligned.
  * @Input pageCount     Number of pages to deallocate.
  * @return              If successful returns true, otherwise false and error code is set.
@@ -138,12 +425,28 @@ bool kpmm_free (Physical startAddress, UINT pageCount)
     // Note: As startAddress is already aligned, both floor or ceiling are same here.
     UINT startPageFrame = BYTES_TO_PAGEFRAMES_FLOOR (startAddress.val);
 
+    if (pageCount == 1 && kpmm_isZeroFrame (startAddress)) {
+        return true; // Zero frame is never freed.
+    }
+
+    if (pageCount == 1 && s_getShareCount (startPageFrame) > 0) {
+        U8* chunk = s_shareCounts[startPageFrame / PMM_SHARE_CHUNK_FRAMES];
+        chunk[startPageFrame % PMM_SHARE_CHUNK_FRAMES]--;
+        return true; // Page frame still has other owners.
+    }
+
     PhysicalMemoryRegion *region = s_getBitmapFromRegion(PMM_REGION_ANY);
     bool success = bitmap_setContinous(&region->bitmap,
                                        startPageFrame,
                                        pageCount,
                                        PMM_STATE_FREE);
 
+    s_updateSummary (region, startPageFrame, pageCount);
+    if (success) {
+        // Changing a free page frame to free panics, so every page frame was in use before.
+        s_freeFrameCount += pageCount;
+        allocstats_recordFree (&s_stats, PAGEFRAMES_TO_BYTES (pageCount));
+    }
     return success;
 }
 
@@ -188,14 +491,22 @@ bool kpmm_allocAt (Physical start, UINT pageCount, KernelPhysicalMemoryRegions r
                                         startPageFrame);
 
     // Free pages were not found. But there was no error.
-    if (found == false)
+    if (found == false) {
+        allocstats_recordFailure (&s_stats);
         RETURN_ERROR (ERR_DOUBLE_ALLOC, false);
+    }
 
     // Free pages found. Now Allocate them.
     bool success = bitmap_setContinous (&region->bitmap,
                                         startPageFrame,
                                         pageCount,
                                         PMM_STATE_USED);
+
+    s_updateSummary (region, startPageFrame, pageCount);
+    if (success) {
+        s_freeFrameCount -= pageCount;
+        allocstats_recordAlloc (&s_stats, pageCount, PAGEFRAMES_TO_BYTES (pageCount));
+    }
     return success;
 }
 
@@ -222,31 +533,190 @@ bool kpmm_alloc (Physical *address, UINT pageCount, KernelPhysicalMemoryRegions
 
     PhysicalMemoryRegion *region = s_getBitmapFromRegion(reg);
 
-    // Search PAB for a suitable location.
-    INT pageFrame = bitmap_findContinous(&region->bitmap, PMM_STATE_FREE, pageCount);
-    if (pageFrame == KERNEL_EXIT_FAILURE)
+    INT pageFrame = s_takeFreeFrames (region, pageCount, 0);
+
+    // Zeroed page frames are only kept while there is free memory. These are given back before
+    // failing the allocation.
+    if (pageFrame == KERNEL_EXIT_FAILURE && s_zeroPoolCount > 0) {
+        s_drainZeroPool (region);
+        pageFrame = s_takeFreeFrames (region, pageCount, 0);
+    }
+
+    if (pageFrame == KERNEL_EXIT_FAILURE) {
+        allocstats_recordFailure (&s_stats);
         RETURN_ERROR (ERR_OUT_OF_MEM, false);
+    }
 
-    k_assert((UINT)pageFrame < kpmm_getUsableMemoryPagesCount(reg), "Out of range");
+    allocstats_recordAlloc (&s_stats, pageCount, PAGEFRAMES_TO_BYTES (pageCount));
 
-    // Free pages found. Now Allocate them.
-    if (bitmap_setContinous(&region->bitmap,
-                                (UINT)pageFrame,
-                                pageCount,
-                                PMM_STATE_USED))
-    {
-        *address = createPhysical(PAGEFRAME_TO_PHYSICAL((UINT) pageFrame));
-        INFO("Allocated address = %x", address->val);
-        k_assert (IS_ALIGNED (address->val, CONFIG_PAGE_FRAME_SIZE_BYTES), "Wrong alignment");
+    *address = createPhysical(PAGEFRAME_TO_PHYSICAL((UINT) pageFrame));
+    INFO("Allocated address = %x", address->val);
+    k_assert (IS_ALIGNED (address->val, CONFIG_PAGE_FRAME_SIZE_BYTES), "Wrong alignment");
+    return true;
+}
+
+/***************************************************************************************************
+ * Allocates one page frame which is filled with zeros. Page frame is taken from the zeroed pool, if
+ * it is empty, a page frame is allocated and zeroed now.
+ *
+ * @Output address      Allocated physical address. Is always page aligned.
+ * @Input  reg          Physical memory region.
+ * @return              If successful returns true, otherwise returns false and error code is set.
+ * @error               ERR_OUT_OF_MEM  - No free page frame.
+ **************************************************************************************************/
+bool kpmm_allocZeroed (Physical *address, KernelPhysicalMemoryRegions reg)
+{
+    FUNC_ENTRY("region = %u", reg);
+
+    KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_PMM_READY);
+
+    k_assert (address != NULL, "Address not provided");
+
+    if (s_zeroPoolCount > 0) {
+        *address = s_zeroPool[--s_zeroPoolCount];
+        allocstats_recordAlloc (&s_stats, 1, CONFIG_PAGE_FRAME_SIZE_BYTES);
+        INFO("Allocated zeroed address = %x", address->val);
         return true;
     }
 
-    UNREACHABLE();
-    NORETURN();
+    if (!kpmm_alloc (address, 1, reg)) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+
+    if (!kpg_zeroPageFrame (*address)) {
+        FATAL_BUG(); // Should not fail. Page frame is aligned.
+    }
+    return true;
+}
+
+/***************************************************************************************************
+ * Frees a page frame which is known to be filled with zeros, for example one which was allocated by
+ * kpmm_allocZeroed but never used. It goes back to the zeroed pool if there is space.
+ *
+ * @Input address       Physical address of the page frame. Must be page aligned.
+ * @return              If successful returns true, otherwise false and error code is set.
+ **************************************************************************************************/
+bool kpmm_freeZeroed (Physical address)
+{
+    FUNC_ENTRY("address = %x", address.val);
+
+    KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_PMM_READY);
+
+    if (s_zeroPoolCount == PMM_ZERO_POOL_CAPACITY || address.val == 0 ||
+        !IS_ALIGNED (address.val, CONFIG_PAGE_FRAME_SIZE_BYTES)) {
+        return kpmm_free (address, 1);
+    }
+
+    k_assert (bitmap_get (&s_getBitmapFromRegion(PMM_REGION_ANY)->bitmap,
+                          (UINT)PHYSICAL_TO_PAGEFRAME (address.val)) == PMM_STATE_USED,
+              "Page frame is not allocated");
+
+    s_zeroPool[s_zeroPoolCount++] = address;
+    allocstats_recordFree (&s_stats, CONFIG_PAGE_FRAME_SIZE_BYTES);
+    return true;
+}
+
+/***************************************************************************************************
+ * Zeros free page frames and adds them to the zeroed pool. Meant to be called when the kernel has
+ * nothing else to do, so the number of page frames zeroed in one call is limited.
+ *
+ * @Input  maxCount     Maximum number of page frames to zero.
+ * @return              Number of page frames added to the pool.
+ **************************************************************************************************/
+UINT kpmm_refillZeroPool (UINT maxCount)
+{
+    FUNC_ENTRY("maxCount = %u", maxCount);
+
+    // Zeroing requires temporary mapping.
+    if (!KERNEL_PHASE_CHECK (KERNEL_PHASE_STATE_VMM_READY)) {
+        return 0;
+    }
+
+    PhysicalMemoryRegion *region = s_getBitmapFromRegion(PMM_REGION_ANY);
+
+    UINT count = 0;
+    for (; count < maxCount && s_zeroPoolCount < PMM_ZERO_POOL_CAPACITY; count++) {
+        // Page frame 0 is not counted as free memory. It is kept out of the pool, so that filling
+        // the pool does not change the free memory size.
+        INT pageFrame = s_takeFreeFrames (region, 1, 1);
+        if (pageFrame == KERNEL_EXIT_FAILURE) {
+            break;
+        }
+
+        Physical pa = createPhysical (PAGEFRAME_TO_PHYSICAL ((UINT)pageFrame));
+        if (!kpg_zeroPageFrame (pa)) {
+            FATAL_BUG(); // Should not fail. Page frame is aligned.
+        }
+        s_zeroPool[s_zeroPoolCount++] = pa;
+    }
+
+    INFO("Zeroed %u page frames. Pool has %u", count, s_zeroPoolCount);
+    return count;
+}
+
+/***************************************************************************************************
+ * Searches for free page frames and marks them used. Statistics are not updated.
+ *
+ * @Input  region       Physical memory region.
+ * @Input  pageCount    Number of page frames to take.
+ * @Input  firstFrame   Page frames before this one are not taken.
+ * @return              First page frame. KERNEL_EXIT_FAILURE if enough free frames were not found.
+ **************************************************************************************************/
+static INT s_takeFreeFrames (PhysicalMemoryRegion* region, UINT pageCount, UINT firstFrame)
+{
+    UINT capacity  = BITMAP_CAPACITY (&region->bitmap);
+    UINT nextFit   = MAX (region->summary.nextFitFrame, firstFrame);
+    INT pageFrame  = KERNEL_EXIT_FAILURE;
+
+#ifdef PMM_BUDDY_ALLOCATOR
+    // Buddy allocator only finds free page frames which make an aligned block. If there is none,
+    // PAB is searched.
+    pageFrame = kpmm_buddy_find (pageCount);
+    if (pageFrame != KERNEL_EXIT_FAILURE && (UINT)pageFrame < firstFrame)
+        pageFrame = KERNEL_EXIT_FAILURE;
+#endif
+
+    // Search PAB for a suitable location. Next fit: Search starts where the last allocation ended
+    // and wraps around to the start of the PAB.
+    if (pageFrame == KERNEL_EXIT_FAILURE)
+        pageFrame = s_findFreeFrames (region, pageCount, nextFit, capacity);
+    if (pageFrame == KERNEL_EXIT_FAILURE && nextFit > firstFrame)
+        pageFrame = s_findFreeFrames (region, pageCount, firstFrame, nextFit);
+
+    if (pageFrame == KERNEL_EXIT_FAILURE)
+        return KERNEL_EXIT_FAILURE;
+
+    k_assert((UINT)pageFrame < kpmm_getUsableMemoryPagesCount(PMM_REGION_ANY), "Out of range");
+
+    // Free pages found. Now Allocate them.
+    if (!bitmap_setContinous(&region->bitmap, (UINT)pageFrame, pageCount, PMM_STATE_USED)) {
+        UNREACHABLE();
+    }
+
+    s_updateSummary (region, (UINT)pageFrame, pageCount);
+    region->summary.nextFitFrame = ((UINT)pageFrame + pageCount) % capacity;
+    s_freeFrameCount -= pageCount;
+    return pageFrame;
+}
+
+static void s_drainZeroPool (PhysicalMemoryRegion* region)
+{
+    INFO("Giving back %u zeroed page frames", s_zeroPoolCount);
+
+    for (; s_zeroPoolCount > 0; s_zeroPoolCount--) {
+        UINT pageFrame = (UINT)PHYSICAL_TO_PAGEFRAME (s_zeroPool[s_zeroPoolCount - 1].val);
+        if (!bitmap_setContinous (&region->bitmap, pageFrame, 1, PMM_STATE_FREE)) {
+            UNREACHABLE();
+        }
+        s_updateSummary (region, pageFrame, 1);
+        s_freeFrameCount++;
+    }
 }
 
 /***************************************************************************************************
- * Calculates the size of free system memory based on PAB
+ * Size of free system memory, page frames in the zeroed pool included. Page frame 0 is never
+ * counted. It is read from a counter which is updated on every alloc and free, so the PAB is not
+ * scanned.
  *
  * @return      Free memory size in bytes.
  * @error       Panics if called before initialization.
@@ -257,19 +727,37 @@ size_t kpmm_getFreeMemorySize (void)
 
     KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_PMM_READY);
 
-    UINT usablePageCount = kpmm_getUsableMemoryPagesCount(PMM_REGION_ANY);
     PhysicalMemoryRegion *region = s_getBitmapFromRegion(PMM_REGION_ANY);
 
-    size_t freePages = 0;
-    for (UINT frame = 1; frame < usablePageCount; frame++) {
-        if (bitmap_get (&region->bitmap, frame) == PMM_STATE_FREE)
-            freePages++;
-    }
+    size_t freePages = s_freeFrameCount;
+    if (freePages > 0 && bitmap_get (&region->bitmap, 0) == PMM_STATE_FREE)
+        freePages--;
+
+    // Zeroed page frames are given back when needed, so are free as well.
+    freePages += s_zeroPoolCount;
 
     k_assert(freePages <= kpmm_getUsableMemoryPagesCount(PMM_REGION_ANY), "Invalid frames");
     return PAGEFRAME_TO_PHYSICAL(freePages);
 }
 
+/***************************************************************************************************
+ * Gets allocation statistics of the PMM. Used bytes are the usable page frames which are not free,
+ * this includes page frames which were in use before the PMM was initialized.
+ *
+ * @Output stats    Statistics are copied here.
+ * @return          Nothing
+ * @error           Panics if called before initialization.
+ **************************************************************************************************/
+void kpmm_getStats (OSIF_AllocatorStats* const stats)
+{
+    FUNC_ENTRY ("stats: %px", stats);
+
+    KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_PMM_READY);
+
+    k_assert (stats != NULL, "Stats not provided");
+    *stats = s_stats;
+}
+
 /***************************************************************************************************
  * Total amount of usable bytes in the memory region.
  * If region completely falls outsize the installed RAM, then the usable size of the region is zero.
@@ -296,6 +784,9 @@ USYSINT kpmm_getUsableMemorySize (KernelPhysicalMemoryRegions reg)
         S64 earliestMemoryEnd = (S64)MIN(installedRamBytes, region->start.val + region->length);
         regionLength = earliestMemoryEnd - region->start.val;
         if (regionLength < 0) regionLength = 0;
+
+        // PAB can address 4 GB, which USYSINT cannot hold. The last byte is thus left out.
+        if (regionLength > (S64)(USYSINT)~0U) regionLength = (S64)(USYSINT)~0U;
     }
 
  //   INFO ("Region length = %px bytes", regionLength);
@@ -325,3 +816,109 @@ KernelPhysicalMemoryStates kpmm_getPageStatus (Physical phy)
     PhysicalMemoryRegion* reg = s_getBitmapFromRegion (PMM_REGION_ANY);
     return bitmap_get (&reg->bitmap, pageFrame);
 }
+
+/***************************************************************************************************
+ * Adds one more owner to a page frame which is in use. The page frame is freed when kpmm_free was
+ * called once for each owner.
+ *
+ * @Input   phy     Physical address of the page frame. Must be page aligned.
+ * @return          If successful returns true, otherwise false and error code is set.
+ * @error           ERR_WRONG_ALIGNMENT             - Address is not page aligned.
+ *                  ERR_OUTSIDE_ADDRESSABLE_RANGE   - Address is outside usable memory.
+ *                  ERR_INVALID_ARGUMENT            - Page frame is not in use.
+ *                  ERR_OVERFLOW                    - Page frame has too many owners.
+ *                  ERR_OUT_OF_MEM                  - Could not allocate memory for share counts.
+ **************************************************************************************************/
+bool kpmm_share (Physical phy)
+{
+    FUNC_ENTRY ("Physical address = %x", phy.val);
+
+    KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_PMM_READY);
+
+    if (IS_ALIGNED (phy.val, CONFIG_PAGE_FRAME_SIZE_BYTES) == false)
+        RETURN_ERROR (ERR_WRONG_ALIGNMENT, false);
+
+    if (phy.val >= kpmm_getUsableMemorySize (PMM_REGION_ANY))
+        RETURN_ERROR (ERR_OUTSIDE_ADDRESSABLE_RANGE, false);
+
+    UINT pageFrame = BYTES_TO_PAGEFRAMES_FLOOR (phy.val);
+    if (bitmap_get (&s_getBitmapFromRegion (PMM_REGION_ANY)->bitmap, pageFrame) != PMM_STATE_USED)
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+
+    // Zero frame is never freed, so its owners are not counted.
+    if (kpmm_isZeroFrame (phy))
+        return true;
+
+    if (s_getShareCount (pageFrame) == PMM_MAX_SHARE_COUNT)
+        RETURN_ERROR (ERR_OVERFLOW, false);
+
+    U8** chunk = &s_shareCounts[pageFrame / PMM_SHARE_CHUNK_FRAMES];
+    if (*chunk == NULL) {
+        if ((*chunk = kmalloc (PMM_SHARE_CHUNK_FRAMES * sizeof (U8))) == NULL)
+            RETURN_ERROR (ERR_OUT_OF_MEM, false);
+
+        k_memset (*chunk, 0, PMM_SHARE_CHUNK_FRAMES * sizeof (U8));
+    }
+
+    (*chunk)[pageFrame % PMM_SHARE_CHUNK_FRAMES]++;
+    return true;
+}
+
+/***************************************************************************************************
+ * Number of owners of a page frame other than the first one. Zero if the page frame is not shared.
+ *
+ * @Input   phy     Physical address of the page frame. Must be page aligned.
+ * @return          Number of other owners.
+ **************************************************************************************************/
+UINT kpmm_getShareCount (Physical phy)
+{
+    FUNC_ENTRY ("Physical address = %x", phy.val);
+
+    KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_PMM_READY);
+
+    k_assert (IS_ALIGNED (phy.val, CONFIG_PAGE_FRAME_SIZE_BYTES), "Wrong alignment");
+    k_assert (phy.val < kpmm_getUsableMemorySize (PMM_REGION_ANY), "Outside usable memory");
+
+    return s_getShareCount (BYTES_TO_PAGEFRAMES_FLOOR (phy.val));
+}
+
+/***************************************************************************************************
+ * Gets the page frame of zeros which is shared by every page that was read but not yet written. It
+ * is allocated on the first call.
+ *
+ * Zero frame must only be mapped read-only. It can be shared (kpmm_share) and freed (kpmm_free) any
+ * number of times, it is never freed.
+ *
+ * @Output address      Physical address of the zero frame.
+ * @return              If successful returns true, otherwise false and error code is set.
+ * @error               ERR_OUT_OF_MEM  - No free page frame for the first call.
+ **************************************************************************************************/
+bool kpmm_getZeroFrame (Physical* address)
+{
+    FUNC_ENTRY();
+
+    KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_PMM_READY);
+
+    k_assert (address != NULL, "Address not provided");
+
+    if (!s_isZeroFrameAllocated) {
+        if (!kpmm_allocZeroed (&s_zeroFrame, PMM_REGION_ANY)) {
+            RETURN_ERROR (ERROR_PASSTHROUGH, false);
+        }
+        s_isZeroFrameAllocated = true;
+    }
+
+    *address = s_zeroFrame;
+    return true;
+}
+
+/***************************************************************************************************
+ * Checks if a page frame is the zero frame.
+ *
+ * @Input   phy     Physical address of the page frame.
+ * @return          True if it is the zero frame, false otherwise.
+ **************************************************************************************************/
+bool kpmm_isZeroFrame (Physical phy)
+{
+    return s_isZeroFrameAllocated && phy.val == s_zeroFrame.val;
+}
@@ -0,0 +1,282 @@
+/*
+* --------------------------------------------------------------------------------------------------
+* Megha Operating System V2 - Cross Platform Kernel - Buddy allocator for Physical pages
+*
+* Free page frames are indexed in a complete binary tree. Leaves are page frames and a node of
+* height h covers the 2^h page frames of its aligned block. Every node stores (order + 1) of the
+* largest completely free aligned block within it, 0 if there is no free page frame in it.
+*
+*                            [3] Frames 0 - 7 (node 1)
+*                          /                          \
+*             [3] Frames 0 - 3 (node 2)        [1] Frames 4 - 7 (node 3)
+*              /            \                   /            \
+*        [2] 0 - 1      [2] 2 - 3         [1] 4 - 5      [0] 6 - 7
+*
+* Above, frames 0 to 4 are free. Marking frames 5 to 7 free makes node 3 completely free [3], then
+* both children of the root are completely free and root becomes [4]. This is how buddies coalesce.
+*
+* Marking a range free/used and finding a free block are both O(log n). When a node becomes
+* completely free or used, its subtree is not updated. Its children are made to agree with it
+* only when an operation has to go below that node.
+*
+* Leaves only need to tell if a page frame is free, so they are kept as bits. For N page frames
+* the tree takes N bytes for the nodes and N/8 bytes for the leaves.
+*
+* NOTE: This is only an index, PMM is responsible for keeping it in sync with the PAB.
+* TODO: Make allocation and deallocation atomic.
+* --------------------------------------------------------------------------------------------------
+*/
+
+#include <pmm_buddy.h>
+#include <moslimits.h>
+#include <types.h>
+#include <utils.h>
+#include <kdebug.h>
+#include <kerror.h>
+#include <kassert.h>
+
+/* Value of a completely free node of height h */
+#define BUDDY_FULL(h) ((U8)((h) + 1))
+
+/* Node 0 is not used. Root is node 1 and children of node n are nodes 2n and 2n + 1. Nodes from
+ * s_leafCount onwards are leaves. */
+static U8* s_nodes       = NULL; // Nodes which are not leaves.
+static U8* s_leaves      = NULL; // One bit per leaf, set if page frame is free.
+static UINT s_leafCount  = 0;    // Power of two. Leaves beyond s_frameCount are always used.
+static UINT s_frameCount = 0;
+static UINT s_maxOrder   = 0;    // Height of the root.
+
+/***************************************************************************************************
+ * Number of leaves for `frameCount` page frames. Must be a power of two.
+ **************************************************************************************************/
+static UINT s_getLeafCount (UINT frameCount)
+{
+    return (frameCount <= 1) ? 1 : 1U << (32 - (UINT)__builtin_clz (frameCount - 1));
+}
+
+/***************************************************************************************************
+ * Value of a node.
+ *
+ * @Input node      Node index.
+ * @Input h         Height of the node.
+ * @return          (order + 1) of the largest free block in the node, 0 if nothing is free.
+ **************************************************************************************************/
+static U8 s_get (UINT node, UINT h)
+{
+    if (h > 0) {
+        return s_nodes[node];
+    }
+
+    UINT leaf = node - s_leafCount;
+    return (s_leaves[leaf / 8] >> (leaf % 8)) & 1U;
+}
+
+/***************************************************************************************************
+ * Changes value of a node.
+ *
+ * @Input node      Node index.
+ * @Input h         Height of the node.
+ * @Input value     (order + 1) of the largest free block in the node, 0 if nothing is free.
+ * @return          Nothing
+ **************************************************************************************************/
+static void s_set (UINT node, UINT h, U8 value)
+{
+    if (h > 0) {
+        s_nodes[node] = value;
+        return;
+    }
+
+    UINT leaf = node - s_leafCount;
+    U8 bit    = (U8)(1U << (leaf % 8));
+    s_leaves[leaf / 8] = (value) ? (U8)(s_leaves[leaf / 8] | bit) : (U8)(s_leaves[leaf / 8] & ~bit);
+}
+
+/***************************************************************************************************
+ * Children of a node, which is either completely free or completely used, are made to agree with it.
+ * Nothing is done to a node which is partially used, its children are already correct.
+ *
+ * @Input node      Node index. Must not be a leaf.
+ * @Input h         Height of the node.
+ * @return          Nothing
+ **************************************************************************************************/
+static void s_pushDown (UINT node, UINT h)
+{
+    U8 value = s_get (node, h);
+
+    if (value == 0 || value == BUDDY_FULL (h)) {
+        U8 childValue = (value == 0) ? 0 : BUDDY_FULL (h - 1);
+        s_set (2 * node, h - 1, childValue);
+        s_set (2 * node + 1, h - 1, childValue);
+    }
+}
+
+/***************************************************************************************************
+ * Recalculates a node from its children. If both the children are completely free, so is the node
+ * (coalescing), otherwise it is as good as the better child.
+ *
+ * @Input node      Node index. Must not be a leaf.
+ * @Input h         Height of the node.
+ * @return          Nothing
+ **************************************************************************************************/
+static void s_pullUp (UINT node, UINT h)
+{
+    U8 left  = s_get (2 * node, h - 1);
+    U8 right = s_get (2 * node + 1, h - 1);
+
+    if (left == BUDDY_FULL (h - 1) && right == BUDDY_FULL (h - 1)) {
+        s_set (node, h, BUDDY_FULL (h));
+    } else {
+        s_set (node, h, MAX (left, right));
+    }
+}
+
+/***************************************************************************************************
+ * Marks page frames, within [start, end), covered by a node and its children, as free or used.
+ *
+ * @Input node       Node index.
+ * @Input h          Height of the node.
+ * @Input nodeStart  First page frame covered by the node.
+ * @Input start      First page frame to mark.
+ * @Input end        One past the last page frame to mark.
+ * @Input isFree     Marks free if true, otherwise used.
+ * @return           Nothing
+ **************************************************************************************************/
+static void s_mark (UINT node, UINT h, UINT nodeStart, UINT start, UINT end, bool isFree)
+{
+    UINT nodeEnd = nodeStart + (1U << h);
+
+    if (end <= nodeStart || start >= nodeEnd) {
+        return; // No overlap
+    }
+
+    if (start <= nodeStart && nodeEnd <= end) {
+        s_set (node, h, (isFree) ? BUDDY_FULL (h) : 0); // Complete overlap. Children are left as is.
+        return;
+    }
+
+    s_pushDown (node, h);
+    UINT half = 1U << (h - 1);
+    s_mark (2 * node, h - 1, nodeStart, start, end, isFree);
+    s_mark (2 * node + 1, h - 1, nodeStart + half, start, end, isFree);
+    s_pullUp (node, h);
+}
+
+/***************************************************************************************************
+ * Amount of memory required by the buddy allocator to index `frameCount` page frames.
+ *
+ * @Input frameCount    Number of page frames. Must be > 0.
+ * @return              Number of bytes.
+ **************************************************************************************************/
+SIZE kpmm_buddy_getMemorySize (UINT frameCount)
+{
+    FUNC_ENTRY ("frameCount: %x", frameCount);
+
+    k_assert (frameCount > 0, "Must be > zero");
+
+    UINT leafCount = s_getLeafCount (frameCount);
+    return leafCount + ALIGN_UP (leafCount, 8U) / 8U;
+}
+
+/***************************************************************************************************
+ * Initializes the buddy allocator with every page frame marked used. Page frames are made
+ * available by calling kpmm_buddy_markFree.
+ *
+ * @Input memory        Memory for the tree. Must be kpmm_buddy_getMemorySize bytes in size.
+ * @Input frameCount    Number of page frames to index. Must be > 0.
+ * @return              Nothing
+ **************************************************************************************************/
+void kpmm_buddy_init (void* memory, UINT frameCount)
+{
+    FUNC_ENTRY ("memory: %px, frameCount: %x", memory, frameCount);
+
+    k_assert (memory != NULL, "Memory not provided");
+    k_assert (frameCount > 0, "Must be > zero");
+
+    s_frameCount = frameCount;
+    s_leafCount  = s_getLeafCount (frameCount);
+    s_maxOrder   = (UINT)__builtin_ctz (s_leafCount);
+    s_nodes      = memory;
+    s_leaves     = (U8*)memory + s_leafCount;
+
+    // Setting the root is enough, children agree with it when required.
+    s_set (1, s_maxOrder, 0);
+}
+
+/***************************************************************************************************
+ * Marks page frames free. Free buddies are coalesced into larger blocks.
+ *
+ * @Input startFrame    First page frame.
+ * @Input frameCount    Number of page frames. Must be > 0.
+ * @return              Nothing
+ **************************************************************************************************/
+void kpmm_buddy_markFree (UINT startFrame, UINT frameCount)
+{
+    FUNC_ENTRY ("startFrame: %x, frameCount: %x", startFrame, frameCount);
+
+    k_assert (frameCount > 0, "Must be > zero");
+    k_assert (startFrame + frameCount <= s_frameCount, "Outside range");
+
+    s_mark (1, s_maxOrder, 0, startFrame, startFrame + frameCount, true);
+}
+
+/***************************************************************************************************
+ * Marks page frames used. Blocks are split as required.
+ *
+ * @Input startFrame    First page frame.
+ * @Input frameCount    Number of page frames. Must be > 0.
+ * @return              Nothing
+ **************************************************************************************************/
+void kpmm_buddy_markUsed (UINT startFrame, UINT frameCount)
+{
+    FUNC_ENTRY ("startFrame: %x, frameCount: %x", startFrame, frameCount);
+
+    k_assert (frameCount > 0, "Must be > zero");
+    k_assert (startFrame + frameCount <= s_frameCount, "Outside range");
+
+    s_mark (1, s_maxOrder, 0, startFrame, startFrame + frameCount, false);
+}
+
+/***************************************************************************************************
+ * Finds the lowest completely free block of the smallest order which can hold `frameCount` page
+ * frames. Nothing is marked used.
+ *
+ * NOTE: Free page frames which do not make an aligned block are not found. For example 4 free page
+ * frames from frame 2 to 5 does not satisfy a request for 4 page frames.
+ *
+ * @Input frameCount    Number of page frames. Must be > 0.
+ * @return              First page frame of the block. If no free block was found, returns
+ *                      KERNEL_EXIT_FAILURE.
+ **************************************************************************************************/
+INT kpmm_buddy_find (UINT frameCount)
+{
+    FUNC_ENTRY ("frameCount: %x", frameCount);
+
+    k_assert (frameCount > 0, "Must be > zero");
+
+    if (frameCount > s_leafCount) {
+        return KERNEL_EXIT_FAILURE;
+    }
+
+    // Order of the smallest block which can hold frameCount page frames.
+    UINT order = (frameCount == 1) ? 0 : 32 - (UINT)__builtin_clz (frameCount - 1);
+    U8 needed  = BUDDY_FULL (order);
+
+    if (s_get (1, s_maxOrder) < needed) {
+        return KERNEL_EXIT_FAILURE;
+    }
+
+    // Lower child is taken when it has a large enough block, so the lowest block is found.
+    UINT node  = 1;
+    UINT start = 0;
+    for (UINT h = s_maxOrder; h > order; h--) {
+        s_pushDown (node, h);
+        node = 2 * node;
+        if (s_get (node, h - 1) < needed) {
+            node++;
+            start += 1U << (h - 1);
+        }
+    }
+
+    k_assert (s_get (node, order) == needed, "Block must be completely free");
+    return (INT)start;
+}
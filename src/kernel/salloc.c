@@ -5,6 +5,7 @@
  * Static memories are for permanent allocations.
  * --------------------------------------------------------------------------------------------------
  */
+#include <kassert.h>
 #include <kdebug.h>
 #include <kerror.h>
 #include <utils.h>
@@ -13,12 +14,16 @@
 #include <memmanage.h>
 #include <kernel.h>
 #include <memloc.h>
+#include <allocstats.h>
 
 #define SPACE_USED()                 ((PTR)s_next - s_start)
 #define IS_SPACE_AVAILABLE(sz_bytes) ((SPACE_USED() + (sz_bytes)-1) < ARCH_MEM_LEN_BYTES_SALLOC)
 
-static void* s_next = NULL; // Points to the start of next allocation.
-static PTR s_start  = 0;    // Points to the start salloc buffer.
+static void* s_next     = NULL; // Points to the start of next allocation.
+static PTR s_start      = 0;    // Points to the start salloc buffer.
+static PTR s_holeStart  = 0;    // Space skipped to align an allocation. Used by later allocations.
+static UINT s_holeBytes = 0;
+static OSIF_AllocatorStats s_stats;
 
 /***************************************************************************************************
  * Initializes virtual & physical memory for salloc.
@@ -30,6 +35,10 @@ void ksalloc_init(void)
     FUNC_ENTRY();
     s_start = (PTR)ARCH_MEM_START_SALLOC;
     s_next  = (void*)s_start;
+    s_stats = (OSIF_AllocatorStats){ 0 };
+
+    s_holeStart = 0;
+    s_holeBytes = 0;
     KERNEL_PHASE_SET (KERNEL_PHASE_STATE_SALLOC_READY);
 
     INFO ("salloc starts at: %px", s_start);
@@ -38,9 +47,6 @@ void ksalloc_init(void)
 /***************************************************************************************************
  * Allocates at least 'bytes' number of bytes from the salloc memory.
  *
- * TODO: salloc should take flags for alignment requirements to meet various placement requirements.
- * For example: Page boundary must not ocour within TSS.
- *
  * @Input   bytes   Number of bytes to allocate.
  * @return          Poiter to the start of the allocated memory. Or NULL on failure.
  * @error           ERR_INVALID_RANGE - Input is outside valid range.
@@ -50,30 +56,80 @@ void* ksalloc (UINT bytes)
 {
     FUNC_ENTRY ("Bytes: %px", bytes);
 
+    return ksalloc_aligned (bytes, SALLOC_GRANUALITY);
+}
+
+/***************************************************************************************************
+ * Allocates at least 'bytes' number of bytes from the salloc memory, starting at an address which
+ * is a multiple of 'align'.
+ *
+ * Space skipped to reach the alignment is remembered and later allocations which fit in it are
+ * placed there, instead of moving the end of the salloc memory.
+ *
+ * @Input   bytes   Number of bytes to allocate.
+ * @Input   align   Alignment in bytes. Must be a power of two. Alignment less than
+ *                  SALLOC_GRANUALITY is increased to it.
+ * @return          Poiter to the start of the allocated memory. Or NULL on failure.
+ * @error           ERR_INVALID_RANGE   - Input is outside valid range.
+ * @error           ERR_WRONG_ALIGNMENT - Alignment is not a power of two.
+ * @error           ERR_OUT_OF_MEM      - There is less memory than requested.
+ **************************************************************************************************/
+void* ksalloc_aligned (UINT bytes, UINT align)
+{
+    FUNC_ENTRY ("Bytes: %px, Align: %px", bytes, align);
+
     KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_SALLOC_READY);
 
-    if (bytes == 0 || bytes > ARCH_MEM_LEN_BYTES_SALLOC)
+    if (bytes == 0 || bytes > ARCH_MEM_LEN_BYTES_SALLOC) {
+        allocstats_recordFailure (&s_stats);
         RETURN_ERROR (ERR_INVALID_RANGE, NULL);
+    }
 
+    if (align == 0 || (align & (align - 1)) != 0 || align > ARCH_MEM_LEN_BYTES_SALLOC) {
+        allocstats_recordFailure (&s_stats);
+        RETURN_ERROR (ERR_WRONG_ALIGNMENT, NULL);
+    }
+
+    align          = MAX (align, SALLOC_GRANUALITY);
     UINT allocSize = ALIGN_UP (bytes, SALLOC_GRANUALITY);
     INFO ("Size after aligning: %px", allocSize);
 
-    if (!IS_SPACE_AVAILABLE (allocSize))
+    // Skipped space is tried first. Space before the aligned address in it is not used anymore.
+    PTR holeEnd = s_holeStart + s_holeBytes;
+    PTR at      = ALIGN_UP (s_holeStart, align);
+    if (s_holeBytes > 0 && at < holeEnd && allocSize <= holeEnd - at) {
+        s_holeStart = at + allocSize;
+        s_holeBytes = holeEnd - s_holeStart;
+
+        INFO ("Allocated at: %x", at);
+        allocstats_recordAlloc (&s_stats, bytes, allocSize);
+        return (void*)at;
+    }
+
+    at       = ALIGN_UP ((PTR)s_next, align);
+    UINT gap = at - (PTR)s_next;
+    if (gap > ARCH_MEM_LEN_BYTES_SALLOC || !IS_SPACE_AVAILABLE (gap + allocSize)) {
+        allocstats_recordFailure (&s_stats);
         RETURN_ERROR (ERR_OUT_OF_MEM, NULL);
+    }
+
+    // Only the largest skipped space is kept.
+    if (gap > s_holeBytes) {
+        s_holeStart = (PTR)s_next;
+        s_holeBytes = gap;
+    }
 
-    INFO ("Allocated at: %x", s_next);
+    INFO ("Allocated at: %x", at);
+    allocstats_recordAlloc (&s_stats, bytes, allocSize);
 
-    s_next = (void*)((PTR)s_next + allocSize);
-    return (void*)((PTR)s_next - allocSize);
+    s_next = (void*)(at + allocSize);
+    return (void*)at;
 }
 
 /***************************************************************************************************
  * Allocates at least 'bytes' number of bytes from the salloc memory. Then initializes the memory
  * with zeros.
  *
- * TODO: salloc should take flags for alignment requirements to meet various placement requirements.
- * For example: Page boundary must not ocour within TSS.
- *
  * @Input   bytes   Number of bytes to allocate.
  * @return          Poiter to the start of the allocated memory. Or NULL on failure.
  * @error           ERR_INVALID_RANGE - Input is outside valid range.
@@ -113,3 +169,19 @@ SIZE ksalloc_getUsedMemory(void)
 
     return usedSz;
 }
+
+/***************************************************************************************************
+ * Gets allocation statistics of salloc. Memory is never freed, so there are no frees.
+ *
+ * @Output stats    Statistics are copied here.
+ * @return          Nothing
+ **************************************************************************************************/
+void ksalloc_getStats (OSIF_AllocatorStats* const stats)
+{
+    FUNC_ENTRY ("stats: %px", stats);
+
+    KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_SALLOC_READY);
+
+    k_assert (stats != NULL, "Stats not provided");
+    *stats = s_stats;
+}
@@ -0,0 +1,269 @@
+/*
+ * --------------------------------------------------------------------------------------------------
+ * Megha Operating System V2 - Cross Platform Kernel - Slab allocator (object caches)
+ *
+ * A cache hands out objects of one fixed size. Objects are packed in slabs, each slab being one
+ * page taken from the slab region, with a small KMemSlab header at its start. Free objects are
+ * linked through their first word, so there is no header per object and both allocation and free
+ * are O(1). The slab of an object is found by rounding its address down to the page boundary.
+ *
+ *   | KMemSlab | Object 0 | Object 1 | ... | Object n - 1 | Unused |
+ *   ^ Page boundary
+ *
+ * Slabs with at least one free object are in the partial list, completely free slabs at its tail.
+ * A cache keeps at most one completely free slab, other pages go back to the slab region so that
+ * they can be used by other caches.
+ *
+ * NOTE: Pages of the slab region are never returned to the PMM.
+ * --------------------------------------------------------------------------------------------------
+ */
+#include <kassert.h>
+#include <intrusive_list.h>
+#include <kdebug.h>
+#include <kerror.h>
+#include <memmanage.h>
+#include <types.h>
+#include <utils.h>
+#include <kernel.h>
+#include <memloc.h>
+#include <vmm.h>
+#include <kstdlib.h>
+
+#define SLAB_OBJECT_ALIGNMENT       (8 * Byte)
+#define SLAB_HEADER_SIZE            ALIGN_UP (sizeof (KMemSlab), SLAB_OBJECT_ALIGNMENT)
+#define SLAB_CAPACITY_BYTES         (CONFIG_PAGE_FRAME_SIZE_BYTES - SLAB_HEADER_SIZE)
+#define SLAB_FIRST_OBJECT(slab)     ((PTR)(slab) + SLAB_HEADER_SIZE)
+#define SLAB_MAX_FREE_SLAB_COUNT    1
+
+struct KMemCache {
+    const CHAR* name;
+    SIZE objectSize;      // Size of an object together with padding for alignment.
+    UINT objectsPerSlab;
+    UINT freeSlabCount;   // Number of slabs with no object allocated.
+    ListNode partialHead; // Slabs with at least one free object. Completely free ones at the tail.
+    ListNode fullHead;    // Slabs with no free object.
+};
+
+typedef struct KMemSlab {
+    KMemCache* cache; // Cache this slab belongs to.
+    void* freeHead;   // First free object. Free objects are linked through their first word.
+    UINT inUseCount;  // Number of allocated objects.
+    ListNode slabNode;
+} KMemSlab;
+
+static PTR s_start       = 0;    // Start of the slab region.
+static PTR s_next        = 0;    // Next page in the slab region which was never used.
+static void* s_freePages = NULL; // Pages given back by caches. Linked through their first word.
+
+static KMemSlab* s_createSlab (KMemCache* cache);
+static void s_destroySlab (KMemSlab* slab);
+
+/***************************************************************************************************
+ * Reserves virtual memory for the slab region.
+ *
+ * @return    None
+ **************************************************************************************************/
+void kslab_init(void)
+{
+    FUNC_ENTRY();
+
+    KERNEL_PHASE_VALIDATE(KERNEL_PHASE_STATE_VMM_READY);
+
+    s_freePages = NULL;
+    if (!(s_start = kvmm_memmap (g_kstate.context, (PTR)NULL, NULL,
+                                 BYTES_TO_PAGEFRAMES_CEILING (ARCH_MEM_LEN_BYTES_SLAB),
+                                 VMM_MEMMAP_FLAG_KERNEL_PAGE, NULL))) {
+        FATAL_BUG(); // Should not fail.
+    }
+    s_next = s_start;
+
+    INFO ("Size of KMemSlab: %lu bytes", sizeof (KMemSlab));
+    INFO ("Slab region is at: %px", s_start);
+}
+
+/***************************************************************************************************
+ * Creates a cache for objects of 'objectSize' bytes. Caches are permanent, they cannot be destroyed.
+ *
+ * @Input   name        Name of the cache. Only used for debugging.
+ * @Input   objectSize  Size of one object in bytes.
+ * @return              Pointer to the new cache. Or NULL on failure.
+ * @error               ERR_INVALID_RANGE - Object size is zero or too large for a slab.
+ * @error               ERR_OUT_OF_MEM    - No memory for the cache structure.
+ **************************************************************************************************/
+KMemCache* kmem_cache_create (const CHAR* name, SIZE objectSize)
+{
+    FUNC_ENTRY ("Name: %s, Object size: %x", name, objectSize);
+
+    if (objectSize == 0 || objectSize > SLAB_CAPACITY_BYTES) {
+        RETURN_ERROR (ERR_INVALID_RANGE, NULL);
+    }
+
+    KMemCache* cache = kscalloc (sizeof (KMemCache));
+    if (cache == NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+    }
+
+    // Free objects must be able to hold the pointer to the next free object.
+    cache->name           = name;
+    cache->objectSize     = ALIGN_UP (MAX (objectSize, sizeof (void*)), SLAB_OBJECT_ALIGNMENT);
+    cache->objectsPerSlab = (UINT)(SLAB_CAPACITY_BYTES / cache->objectSize);
+    cache->freeSlabCount  = 0;
+    list_init (&cache->partialHead);
+    list_init (&cache->fullHead);
+
+    INFO ("Cache '%s': object size: %u bytes, objects per slab: %u", name, cache->objectSize,
+          cache->objectsPerSlab);
+    return cache;
+}
+
+/***************************************************************************************************
+ * Allocates one object from the cache.
+ *
+ * @Input   cache   Cache to allocate from.
+ * @return          Pointer to the object. Or NULL on failure.
+ * @error           ERR_OUT_OF_MEM    - No free object and the slab region is full.
+ **************************************************************************************************/
+void* kmem_cache_alloc (KMemCache* cache)
+{
+    FUNC_ENTRY ("Cache: %px", cache);
+
+    k_assert (cache != NULL, "Cache not provided");
+
+    if (list_is_empty (&cache->partialHead)) {
+        KMemSlab* newSlab = s_createSlab (cache);
+        if (newSlab == NULL) {
+            RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+        }
+        list_add_after (&cache->partialHead, &newSlab->slabNode);
+        cache->freeSlabCount++;
+    }
+
+    KMemSlab* slab = LIST_ITEM (cache->partialHead.next, KMemSlab, slabNode);
+    k_assert (slab->freeHead != NULL, "Slab in partial list is full");
+
+    if (slab->inUseCount == 0) {
+        cache->freeSlabCount--;
+    }
+
+    void* obj      = slab->freeHead;
+    slab->freeHead = *(void**)obj;
+    slab->inUseCount++;
+
+    if (slab->freeHead == NULL) {
+        list_remove (&slab->slabNode);
+        list_add_after (&cache->fullHead, &slab->slabNode);
+    }
+
+    INFO ("Allocated at: %px", obj);
+    return obj;
+}
+
+/***************************************************************************************************
+ * Allocates one object from the cache. If successful then zeros the object before returning.
+ *
+ * @Input   cache   Cache to allocate from.
+ * @return          Pointer to the object. Or NULL on failure.
+ **************************************************************************************************/
+void* kmem_cache_allocz (KMemCache* cache)
+{
+    FUNC_ENTRY ("Cache: %px", cache);
+
+    void* obj = kmem_cache_alloc (cache);
+    if (obj != NULL) {
+        k_memset (obj, 0, cache->objectSize);
+    }
+    return obj;
+}
+
+/***************************************************************************************************
+ * Returns an object back to its cache.
+ *
+ * @Input   cache   Cache the object was allocated from.
+ * @Input   obj     Pointer to the object.
+ * @return          True on success. False otherwise.
+ * @error           ERR_INVALID_ARGUMENT  - Object is not from this cache.
+ * @error           ERR_DOUBLE_FREE       - No object of the slab is allocated.
+ **************************************************************************************************/
+bool kmem_cache_free (KMemCache* cache, void* obj)
+{
+    FUNC_ENTRY ("Cache: %px, Object: %px", cache, obj);
+
+    k_assert (cache != NULL, "Cache not provided");
+
+    KMemSlab* slab = (KMemSlab*)ALIGN_DOWN ((PTR)obj, CONFIG_PAGE_FRAME_SIZE_BYTES);
+    PTR offset     = (PTR)obj - SLAB_FIRST_OBJECT (slab);
+
+    // Slab header is read only after the object is known to be within the slab region.
+    if ((PTR)slab < s_start || (PTR)slab >= s_next || (PTR)obj < SLAB_FIRST_OBJECT (slab) ||
+        slab->cache != cache || (offset % cache->objectSize) != 0 ||
+        (offset / cache->objectSize) >= cache->objectsPerSlab) {
+        BUG();
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+    }
+
+    if (slab->inUseCount == 0) {
+        BUG();
+        RETURN_ERROR (ERR_DOUBLE_FREE, false);
+    }
+
+    bool wasFull   = (slab->freeHead == NULL);
+    *(void**)obj   = slab->freeHead;
+    slab->freeHead = obj;
+    slab->inUseCount--;
+
+    if (slab->inUseCount == 0) {
+        list_remove (&slab->slabNode);
+        if (cache->freeSlabCount >= SLAB_MAX_FREE_SLAB_COUNT) {
+            s_destroySlab (slab);
+        } else {
+            list_add_before (&cache->partialHead, &slab->slabNode);
+            cache->freeSlabCount++;
+        }
+    } else if (wasFull) {
+        // Partially used slabs are kept at the front so that they get filled first.
+        list_remove (&slab->slabNode);
+        list_add_after (&cache->partialHead, &slab->slabNode);
+    }
+
+    return true;
+}
+
+static KMemSlab* s_createSlab (KMemCache* cache)
+{
+    KMemSlab* slab = NULL;
+
+    if (s_freePages != NULL) {
+        slab        = s_freePages;
+        s_freePages = *(void**)s_freePages;
+    } else if ((s_next - s_start) + CONFIG_PAGE_FRAME_SIZE_BYTES <= ARCH_MEM_LEN_BYTES_SLAB) {
+        slab = (KMemSlab*)s_next;
+        s_next += CONFIG_PAGE_FRAME_SIZE_BYTES;
+    } else {
+        RETURN_ERROR (ERR_OUT_OF_MEM, NULL);
+    }
+
+    INFO ("New slab for cache '%s' at %px", cache->name, slab);
+
+    slab->cache      = cache;
+    slab->freeHead   = NULL;
+    slab->inUseCount = 0;
+    list_init (&slab->slabNode);
+
+    // Link objects so that they are allocated in increasing order of addresses.
+    for (UINT i = cache->objectsPerSlab; i > 0; i--) {
+        void** obj     = (void**)(SLAB_FIRST_OBJECT (slab) + (i - 1) * cache->objectSize);
+        *obj           = slab->freeHead;
+        slab->freeHead = obj;
+    }
+
+    return slab;
+}
+
+static void s_destroySlab (KMemSlab* slab)
+{
+    INFO ("Releasing slab at %px", slab);
+
+    // Page link overwrites the cache field, so a late free of an object from this slab fails.
+    *(void**)slab = s_freePages;
+    s_freePages   = slab;
+}
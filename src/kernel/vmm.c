@@ -21,6 +21,10 @@
     #include <process.h>
 #endif // DEBUG
 
+#define VMM_COMMIT_BATCH_PAGES 16 // Page frames allocated and mapped together.
+
+static KMemCache* s_vasCache = NULL;
+
 static VMemoryAddressSpace* createNewVirtAddrSpace (PTR start_vm, SIZE allocatedBytes,
                                                     VMemoryMemMapFlags flags)
 {
@@ -28,7 +32,13 @@ static VMemoryAddressSpace* createNewVirtAddrSpace (PTR start_vm, SIZE allocated
     bool isStaticAllocated   = false;
 
     if (KERNEL_PHASE_CHECK (KERNEL_PHASE_STATE_KMALLOC_READY)) {
-        if ((new = kmallocz (sizeof (VMemoryAddressSpace))) == NULL) {
+        // Address spaces created before this point are never freed, so the cache is created on
+        // first use.
+        if (s_vasCache == NULL &&
+            (s_vasCache = kmem_cache_create ("vas", sizeof (VMemoryAddressSpace))) == NULL) {
+            RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+        }
+        if ((new = kmem_cache_allocz (s_vasCache)) == NULL) {
             RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
         }
     } else {
@@ -46,6 +56,8 @@ static VMemoryAddressSpace* createNewVirtAddrSpace (PTR start_vm, SIZE allocated
     new->flags             = flags;
     new->isStaticAllocated = isStaticAllocated;
     new->share             = NULL;
+    new->faultAroundPages  = CONFIG_VMM_FAULT_AROUND_PAGES;
+    new->isLargePageMapped = false;
 #ifdef DEBUG
     new->processID = kprocess_getCurrentPID();
 #endif // DEBUG
@@ -53,6 +65,307 @@ static VMemoryAddressSpace* createNewVirtAddrSpace (PTR start_vm, SIZE allocated
     return new;
 }
 
+/* -------------------------------------------------------------------------------------------------
+ * Address space tree
+ *
+ * Address spaces are in a red-black tree ordered by their start address, in addition to the sorted
+ * list. Each node holds the free gap before it and the largest such gap in its subtree, which is
+ * kept up to date when the tree changes. Free gap after the last address space is not in the tree.
+ * -------------------------------------------------------------------------------------------------
+ */
+#define VAS_END(vas) ((vas)->start_vm + (vas)->allocationSzBytes)
+
+static VMemoryAddressSpace* s_prevVas (VMemoryManager const* const vmm,
+                                       VMemoryAddressSpace const* const vas)
+{
+    ListNode* node = vas->adjMappingNode.prev;
+    return (node == &vmm->head) ? NULL : LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
+}
+
+static VMemoryAddressSpace* s_nextVas (VMemoryManager const* const vmm,
+                                       VMemoryAddressSpace const* const vas)
+{
+    ListNode* node = vas->adjMappingNode.next;
+    return (node == &vmm->head) ? NULL : LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
+}
+
+static VMemoryAddressSpace* s_firstVas (VMemoryManager const* const vmm)
+{
+    ListNode* node = vmm->head.next;
+    return (node == &vmm->head) ? NULL : LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
+}
+
+static VMemoryAddressSpace* s_lastVas (VMemoryManager const* const vmm)
+{
+    ListNode* node = vmm->head.prev;
+    return (node == &vmm->head) ? NULL : LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
+}
+
+static void s_treeUpdate (VMemoryAddressSpace* vas)
+{
+    SIZE max = vas->gapBytes;
+    if (vas->treeLeft != NULL && vas->treeLeft->subtreeMaxGapBytes > max) {
+        max = vas->treeLeft->subtreeMaxGapBytes;
+    }
+    if (vas->treeRight != NULL && vas->treeRight->subtreeMaxGapBytes > max) {
+        max = vas->treeRight->subtreeMaxGapBytes;
+    }
+    vas->subtreeMaxGapBytes = max;
+}
+
+// Updates gap of the address space from its previous one, and largest gaps up to the root.
+static void s_treeUpdateGap (VMemoryManager const* const vmm, VMemoryAddressSpace* vas)
+{
+    VMemoryAddressSpace* prev = s_prevVas (vmm, vas);
+    vas->gapBytes = vas->start_vm - ((prev != NULL) ? VAS_END (prev) : vmm->start);
+
+    for (; vas != NULL; vas = vas->treeParent) {
+        s_treeUpdate (vas);
+    }
+}
+
+static void s_treeReplaceChild (VMemoryManager* vmm, VMemoryAddressSpace* parent,
+                                VMemoryAddressSpace* old, VMemoryAddressSpace* new)
+{
+    if (parent == NULL) {
+        vmm->root = new;
+    } else if (parent->treeLeft == old) {
+        parent->treeLeft = new;
+    } else {
+        parent->treeRight = new;
+    }
+
+    if (new != NULL) {
+        new->treeParent = parent;
+    }
+}
+
+static void s_treeRotateLeft (VMemoryManager* vmm, VMemoryAddressSpace* x)
+{
+    VMemoryAddressSpace* y = x->treeRight;
+
+    x->treeRight = y->treeLeft;
+    if (y->treeLeft != NULL) {
+        y->treeLeft->treeParent = x;
+    }
+
+    s_treeReplaceChild (vmm, x->treeParent, x, y);
+    y->treeLeft   = x;
+    x->treeParent = y;
+
+    // x is now below y.
+    s_treeUpdate (x);
+    s_treeUpdate (y);
+}
+
+static void s_treeRotateRight (VMemoryManager* vmm, VMemoryAddressSpace* x)
+{
+    VMemoryAddressSpace* y = x->treeLeft;
+
+    x->treeLeft = y->treeRight;
+    if (y->treeRight != NULL) {
+        y->treeRight->treeParent = x;
+    }
+
+    s_treeReplaceChild (vmm, x->treeParent, x, y);
+    y->treeRight  = x;
+    x->treeParent = y;
+
+    // x is now below y.
+    s_treeUpdate (x);
+    s_treeUpdate (y);
+}
+
+#define TREE_IS_RED(vas) ((vas) != NULL && (vas)->treeIsRed)
+
+static void s_treeInsertFixup (VMemoryManager* vmm, VMemoryAddressSpace* vas)
+{
+    VMemoryAddressSpace* parent = NULL;
+    while ((parent = vas->treeParent) != NULL && parent->treeIsRed) {
+        // Parent is red, so it is not the root.
+        VMemoryAddressSpace* grandParent = parent->treeParent;
+
+        if (parent == grandParent->treeLeft) {
+            VMemoryAddressSpace* uncle = grandParent->treeRight;
+            if (TREE_IS_RED (uncle)) {
+                parent->treeIsRed      = false;
+                uncle->treeIsRed       = false;
+                grandParent->treeIsRed = true;
+                vas                    = grandParent;
+                continue;
+            }
+            if (vas == parent->treeRight) {
+                s_treeRotateLeft (vmm, parent);
+                vas    = parent;
+                parent = vas->treeParent;
+            }
+            parent->treeIsRed      = false;
+            grandParent->treeIsRed = true;
+            s_treeRotateRight (vmm, grandParent);
+        } else {
+            VMemoryAddressSpace* uncle = grandParent->treeLeft;
+            if (TREE_IS_RED (uncle)) {
+                parent->treeIsRed      = false;
+                uncle->treeIsRed       = false;
+                grandParent->treeIsRed = true;
+                vas                    = grandParent;
+                continue;
+            }
+            if (vas == parent->treeLeft) {
+                s_treeRotateRight (vmm, parent);
+                vas    = parent;
+                parent = vas->treeParent;
+            }
+            parent->treeIsRed      = false;
+            grandParent->treeIsRed = true;
+            s_treeRotateLeft (vmm, grandParent);
+        }
+    }
+    vmm->root->treeIsRed = false;
+}
+
+/* 'vas' took the place of the removed black node and is 'doubly black'. It can be NULL, so its
+ * parent is passed in separately. */
+static void s_treeRemoveFixup (VMemoryManager* vmm, VMemoryAddressSpace* vas,
+                               VMemoryAddressSpace* parent)
+{
+    while (vas != vmm->root && !TREE_IS_RED (vas)) {
+        if (vas == parent->treeLeft) {
+            VMemoryAddressSpace* sibling = parent->treeRight;
+            if (sibling->treeIsRed) {
+                sibling->treeIsRed = false;
+                parent->treeIsRed  = true;
+                s_treeRotateLeft (vmm, parent);
+                sibling = parent->treeRight;
+            }
+            if (!TREE_IS_RED (sibling->treeLeft) && !TREE_IS_RED (sibling->treeRight)) {
+                sibling->treeIsRed = true;
+                vas                = parent;
+                parent             = vas->treeParent;
+                continue;
+            }
+            if (!TREE_IS_RED (sibling->treeRight)) {
+                sibling->treeLeft->treeIsRed = false;
+                sibling->treeIsRed           = true;
+                s_treeRotateRight (vmm, sibling);
+                sibling = parent->treeRight;
+            }
+            sibling->treeIsRed            = parent->treeIsRed;
+            parent->treeIsRed             = false;
+            sibling->treeRight->treeIsRed = false;
+            s_treeRotateLeft (vmm, parent);
+        } else {
+            VMemoryAddressSpace* sibling = parent->treeLeft;
+            if (sibling->treeIsRed) {
+                sibling->treeIsRed = false;
+                parent->treeIsRed  = true;
+                s_treeRotateRight (vmm, parent);
+                sibling = parent->treeLeft;
+            }
+            if (!TREE_IS_RED (sibling->treeLeft) && !TREE_IS_RED (sibling->treeRight)) {
+                sibling->treeIsRed = true;
+                vas                = parent;
+                parent             = vas->treeParent;
+                continue;
+            }
+            if (!TREE_IS_RED (sibling->treeLeft)) {
+                sibling->treeRight->treeIsRed = false;
+                sibling->treeIsRed            = true;
+                s_treeRotateLeft (vmm, sibling);
+                sibling = parent->treeLeft;
+            }
+            sibling->treeIsRed           = parent->treeIsRed;
+            parent->treeIsRed            = false;
+            sibling->treeLeft->treeIsRed = false;
+            s_treeRotateRight (vmm, parent);
+        }
+        vas = vmm->root;
+    }
+
+    if (vas != NULL) {
+        vas->treeIsRed = false;
+    }
+}
+
+/* Adds the address space to the tree and after 'prev' in the list. 'prev' is NULL if it is the
+ * first address space. Caller makes sure it does not overlap others. */
+static void s_insertVas (VMemoryManager* vmm, VMemoryAddressSpace* newVas,
+                         VMemoryAddressSpace* prev)
+{
+    list_add_after ((prev != NULL) ? &prev->adjMappingNode : &vmm->head, &newVas->adjMappingNode);
+
+    VMemoryAddressSpace* parent = NULL;
+    VMemoryAddressSpace** link  = &vmm->root;
+    while (*link != NULL) {
+        parent = *link;
+        link   = (newVas->start_vm < parent->start_vm) ? &parent->treeLeft : &parent->treeRight;
+    }
+
+    newVas->treeParent = parent;
+    newVas->treeLeft   = NULL;
+    newVas->treeRight  = NULL;
+    newVas->treeIsRed  = true;
+    *link              = newVas;
+
+    // Gap of the next address space is now up to the new one.
+    s_treeUpdateGap (vmm, newVas);
+    VMemoryAddressSpace* next = s_nextVas (vmm, newVas);
+    if (next != NULL) {
+        s_treeUpdateGap (vmm, next);
+    }
+
+    s_treeInsertFixup (vmm, newVas);
+}
+
+static void s_removeVas (VMemoryManager* vmm, VMemoryAddressSpace* vas)
+{
+    VMemoryAddressSpace* next   = s_nextVas (vmm, vas);
+    VMemoryAddressSpace* child  = NULL;
+    VMemoryAddressSpace* parent = NULL;
+    bool removedRed             = vas->treeIsRed;
+
+    if (vas->treeLeft == NULL || vas->treeRight == NULL) {
+        child  = (vas->treeLeft != NULL) ? vas->treeLeft : vas->treeRight;
+        parent = vas->treeParent;
+        s_treeReplaceChild (vmm, parent, vas, child);
+    } else {
+        // Node has two children. Its successor, which has no left child, takes its place.
+        VMemoryAddressSpace* successor = next;
+        removedRed                     = successor->treeIsRed;
+        child                          = successor->treeRight;
+
+        if (successor->treeParent == vas) {
+            parent = successor;
+        } else {
+            parent = successor->treeParent;
+            s_treeReplaceChild (vmm, parent, successor, child);
+            successor->treeRight             = vas->treeRight;
+            successor->treeRight->treeParent = successor;
+        }
+
+        s_treeReplaceChild (vmm, vas->treeParent, vas, successor);
+        successor->treeLeft             = vas->treeLeft;
+        successor->treeLeft->treeParent = successor;
+        successor->treeIsRed            = vas->treeIsRed;
+    }
+
+    // Largest gaps are updated from the lowest node which changed.
+    for (VMemoryAddressSpace* node = parent; node != NULL; node = node->treeParent) {
+        s_treeUpdate (node);
+    }
+
+    if (!removedRed) {
+        s_treeRemoveFixup (vmm, child, parent);
+    }
+
+    list_remove (&vas->adjMappingNode);
+
+    // Gap before the removed address space joins the one after.
+    if (next != NULL) {
+        s_treeUpdateGap (vmm, next);
+    }
+}
+
 static VMemoryAddressSpace* addNewVirtualAddressSpace (VMemoryManager* vmm, PTR start_va,
                                                        SIZE szPages, VMemoryMemMapFlags flags)
 {
@@ -70,127 +383,205 @@ static VMemoryAddressSpace* addNewVirtualAddressSpace (VMemoryManager* vmm, PTR
         RETURN_ERROR (ERR_INVALID_RANGE, NULL);
     }
 
-    VMemoryAddressSpace* newVas = createNewVirtAddrSpace (start_va, szBytes, flags);
-    if (newVas == NULL) {
-        // TODO: May be we should panic.
-        RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+    // The new address space goes after the last one which starts before it. It must end before the
+    // new one starts, and the one after must start after the new one ends.
+    VMemoryAddressSpace* prev = NULL;
+    for (VMemoryAddressSpace* node = vmm->root; node != NULL;) {
+        if (start_va < node->start_vm) {
+            node = node->treeLeft;
+        } else {
+            prev = node;
+            node = node->treeRight;
+        }
     }
 
-    // If virtual address space list is empty, just add a new address space at the head
-    if (list_is_empty (&vmm->head)) {
-        list_add_after (&vmm->head, &newVas->adjMappingNode);
-        return newVas;
+    VMemoryAddressSpace* next = (prev != NULL) ? s_nextVas (vmm, prev) : s_firstVas (vmm);
+    if ((prev != NULL && VAS_END (prev) > start_va) ||
+        (next != NULL && next->start_vm < start_va + szBytes)) {
+        // Cannot add, new VAS is overlapping existing VAS.
+        INFO ("Overlap detected. new vas (%x, %x)", start_va, start_va + szBytes - 1);
+        RETURN_ERROR (ERR_VMM_OVERLAPING_VAS, NULL);
     }
 
-    // If there are already some items in the list, we find a suitable spot such that the list
-    // remains sorted (by start_va) in increasing order
-    ListNode* node;
-    VMemoryAddressSpace* vas = NULL;
-
-    PTR newvas_startvm = newVas->start_vm;
-    PTR newvas_endvm   = newvas_startvm + newVas->allocationSzBytes - 1;
-    list_for_each (&vmm->head, node)
-    {
-        vas = LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
-        k_assert (vas != NULL, "Virtual Address space object in the list cannot be NULL");
-
-        // Address space overlap/duplication detection
-        PTR vas_startvm = vas->start_vm;
-        PTR vas_endvm   = vas_startvm + vas->allocationSzBytes - 1;
-
-        if ((newvas_startvm >= vas_startvm && newvas_startvm <= vas_endvm) ||
-            (newvas_endvm >= vas_startvm && newvas_endvm <= vas_endvm)) {
-            // Cannot add, new VAS is overlapping existing VAS.
-            INFO ("Overlap detected.new vas (%x, %x), vas (%x, %x)", newvas_startvm, newvas_endvm,
-                  vas_startvm, vas_endvm);
-            RETURN_ERROR (ERR_VMM_OVERLAPING_VAS, NULL);
-        }
-
-        if (vas->start_vm > newVas->start_vm) {
-            // Add before the found VAS if there is gap
-            list_add_before (&vas->adjMappingNode, &newVas->adjMappingNode);
-            return newVas;
-        }
+    VMemoryAddressSpace* newVas = createNewVirtAddrSpace (start_va, szBytes, flags);
+    if (newVas == NULL) {
+        // TODO: May be we should panic.
+        RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
     }
 
-    // The new VAS has the largest VA, so add it at the end, which is before head.
-    list_add_before (&vmm->head, &newVas->adjMappingNode);
-
+    s_insertVas (vmm, newVas, prev);
     return newVas;
 }
 
+/* Lowest virtual address with 'szPages' free pages after it. Returns 0 if there is none. */
 static PTR find_next_va (VMemoryManager* vmm, SIZE szPages)
 {
     SIZE szBytes = PAGEFRAMES_TO_BYTES (szPages);
 
-    // Check if address space list is empty. If so then return the 'start' address.
-    if (list_is_empty (&vmm->head)) {
-        return vmm->start;
+    // Gaps before address spaces. Subtrees where every gap is smaller are skipped, and the left one
+    // is tried first so that the lowest gap is found.
+    VMemoryAddressSpace* node = vmm->root;
+    while (node != NULL && node->subtreeMaxGapBytes >= szBytes) {
+        if (node->treeLeft != NULL && node->treeLeft->subtreeMaxGapBytes >= szBytes) {
+            node = node->treeLeft;
+        } else if (node->gapBytes >= szBytes) {
+            return node->start_vm - node->gapBytes;
+        } else {
+            node = node->treeRight;
+        }
     }
 
-    // Address space contains some items, so we traverse the list to find a large enough gap in the
-    // address space
-    ListNode* node                = NULL;
-    VMemoryAddressSpace* vas_prev = NULL;
-    PTR new_va                    = 0;
+    // Gap after the last address space.
+    VMemoryAddressSpace* last = s_lastVas (vmm);
+    PTR new_va                = (last != NULL) ? VAS_END (last) : vmm->start;
+    if (vmm->end - new_va >= szBytes) {
+        return new_va;
+    }
 
-    list_for_each (&vmm->head, node)
-    {
-        VMemoryAddressSpace* vas = LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
-        k_assert (vas != NULL, "Virtual Address space object in the list cannot be NULL");
+    // Suitable free address space not found
+    return 0;
+}
+
+/* Lowest virtual address with 'szPages' free pages after it, which is at the same offset within a
+ * large page as 'pa'. Parts of the range which are aligned to large pages can then be mapped with
+ * them. Returns 0 if there is none. */
+static PTR s_findNextVaForLargePages (VMemoryManager* vmm, Physical pa, SIZE szPages,
+                                      SIZE largePageBytes)
+{
+    PTR va = find_next_va (vmm, szPages + BYTES_TO_PAGEFRAMES_FLOOR (largePageBytes) - 1);
+    if (va == 0) {
+        return 0;
+    }
 
-        SIZE addr_space_gap = 0;
-        if (vas_prev != NULL) {
-            k_assert (vas->start_vm > vas_prev->start_vm,
-                      "Address space list must be in sorted order");
+    PTR alignedVA = ALIGN_DOWN (va, largePageBytes) + (PTR)(pa.val & (largePageBytes - 1));
+    return (alignedVA < va) ? alignedVA + largePageBytes : alignedVA;
+}
 
-            new_va         = (vas_prev->start_vm + vas_prev->allocationSzBytes);
-            addr_space_gap = vas->start_vm - new_va;
+static VMemoryAddressSpace* find_vas (VMemoryManager const* const vmm, PTR startVA)
+{
+    // Address space which starts last at or before the address, is the only one which can have it.
+    VMemoryAddressSpace* found = NULL;
+    for (VMemoryAddressSpace* node = vmm->root; node != NULL;) {
+        if (startVA < node->start_vm) {
+            node = node->treeLeft;
         } else {
-            new_va         = vmm->start;
-            addr_space_gap = vas->start_vm - new_va;
+            found = node;
+            node  = node->treeRight;
         }
+    }
 
-        if (addr_space_gap >= szBytes) {
-            return new_va;
-        }
-        vas_prev = vas;
+    if (found != NULL && startVA < VAS_END (found)) {
+        return found;
     }
 
-    k_assert (vas_prev != NULL, "There must have been a single VAS");
+    // Did not find a VAS that matches criteria
+    return NULL;
+}
 
-    // Since new address space is at the end, check that we are not exceeding the 'end'
-    SIZE addr_space_gap = vmm->end - (vas_prev->start_vm + vas_prev->allocationSzBytes);
-    if (addr_space_gap >= szBytes) {
-        new_va = vas_prev->start_vm + vas_prev->allocationSzBytes;
-        return new_va;
+static PagingMapFlags s_getPagingFlags (const VMemoryAddressSpace* const vas)
+{
+    PagingMapFlags pgFlags = PG_MAP_FLAG_DEFAULT;
+    pgFlags |= BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_KERNEL_PAGE) ? PG_MAP_FLAG_KERNEL : 0;
+    pgFlags |= BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_READONLY) ? 0 : PG_MAP_FLAG_WRITABLE;
+    return pgFlags;
+}
+
+/***************************************************************************************************
+ * Are pages of the address space mapped to the zero frame on read and committed on write. Kernel
+ * pages are always committed and populated address spaces are written completely, in order.
+ *
+ * @Input   vas     Address space.
+ * @return          True if pages are demand-zero, false otherwise.
+ **************************************************************************************************/
+static bool s_isDemandZero (const VMemoryAddressSpace* const vas)
+{
+    return BIT_ISUNSET (vas->flags, VMM_MEMMAP_FLAG_KERNEL_PAGE) &&
+           BIT_ISUNSET (vas->flags, VMM_MEMMAP_FLAG_POPULATE);
+}
+
+/***************************************************************************************************
+ * Is the page before the given page, within the same address space, mapped. Either to a page frame
+ * or to the zero frame.
+ *
+ * @Input   vmm         VMM of the address space.
+ * @Input   vas         Address space which contains the page.
+ * @Input   pageStart   Start of the page. Must be page aligned.
+ * @return              True if the previous page is mapped, false otherwise.
+ **************************************************************************************************/
+static bool s_isPreviousPageMapped (VMemoryManager* const vmm,
+                                    const VMemoryAddressSpace* const vas, PTR pageStart)
+{
+    if (pageStart == vas->start_vm) {
+        return false;
     }
 
-    // Suitable free address space not found
-    return 0;
+    Physical pa;
+    PageDirectory pd = kpg_temporaryMap (vmm->parentProcessPD);
+    bool isMapped    = kpg_doesMappingExists (pd, pageStart - CONFIG_PAGE_FRAME_SIZE_BYTES, &pa);
+    kpg_temporaryUnmap();
+    return isMapped;
 }
 
-static VMemoryAddressSpace* find_vas (VMemoryManager const* const vmm, PTR startVA)
+/***************************************************************************************************
+ * Commits zeroed page frames to the virtual pages of a range which are not committed yet. Page
+ * frames are allocated in batches, and each batch is mapped with one walk of the page tables.
+ *
+ * @Input   vmm       VMM of the address space.
+ * @Input   vas       Address space which contains the range.
+ * @Input   va        Start of the range. Must be page aligned.
+ * @Input   szPages   Number of pages in the range.
+ * @Output  committed Number of pages committed. Pages are committed in the order of address.
+ * @return            True if every page of the range is now committed. False otherwise.
+ * @error             ERR_OUT_OF_MEM  - Ran out of page frames before the end of the range.
+ **************************************************************************************************/
+static bool s_commitZeroedPages (VMemoryManager* const vmm, const VMemoryAddressSpace* const vas,
+                                 PTR va, SIZE szPages, SIZE* const committed)
 {
-    ListNode* node = NULL;
-    list_for_each (&vmm->head, node)
-    {
-        VMemoryAddressSpace* vas = LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
-        PTR start_vm             = vas->start_vm;
-        PTR end_vm               = start_vm + vas->allocationSzBytes;
+    FUNC_ENTRY ("va: %px, num pages: %x", va, szPages);
+
+    Physical frames[VMM_COMMIT_BATCH_PAGES];
+    PagingMapFlags pgFlags = s_getPagingFlags (vas);
+    bool success           = true;
+
+    *committed       = 0;
+    PageDirectory pd = kpg_temporaryMap (vmm->parentProcessPD);
+    while (szPages > 0 && success) {
+        SIZE batchPages = MIN (szPages, VMM_COMMIT_BATCH_PAGES);
+
+        SIZE frameCount = 0;
+        for (; frameCount < batchPages; frameCount++) {
+            if (!kpmm_allocZeroed (&frames[frameCount], vmm->physicalRegion)) {
+                success = false;
+                break;
+            }
+        }
 
-        if (startVA >= start_vm && startVA < end_vm) {
-            return vas;
+        SIZE framesUsed = 0;
+        if (!kpg_mapUnmappedPages (pd, va, batchPages, frames, frameCount, pgFlags, &framesUsed)) {
+            k_panicOnError(); // Should not fail. Address is aligned.
         }
+
+        // Pages which were already committed did not use their page frame. These are still zeroed.
+        for (SIZE i = framesUsed; i < frameCount; i++) {
+            if (!kpmm_freeZeroed (frames[i])) {
+                k_panicOnError();
+            }
+        }
+
+        *committed += framesUsed;
+        va += PAGEFRAMES_TO_BYTES (batchPages);
+        szPages -= batchPages;
     }
+    kpg_temporaryUnmap();
 
-    // Did not find a VAS that matches criteria
-    return NULL;
+    INFO ("Committed %x pages. Free physical memory: %x bytes", *committed,
+          kpmm_getFreeMemorySize());
+    return success;
 }
 
 static bool commitVirtualPages (VMemoryManager* const vmm, PTR vaStart,
                                 Physical const* const paStart, SIZE numPages,
-                                const VMemoryAddressSpace* const vas, Physical* const outPA)
+                                VMemoryAddressSpace* const vas, Physical* const outPA)
 {
     FUNC_ENTRY ("va start: %px, pa start: %px, num pages: %x", vaStart, paStart, numPages);
 
@@ -211,11 +602,15 @@ static bool commitVirtualPages (VMemoryManager* const vmm, PTR vaStart,
         *outPA = l_paStart;
     }
 
-    // Map all the physical pages with the virtual ones
-    PagingMapFlags pgFlags = PG_MAP_FLAG_DEFAULT;
-    pgFlags |= BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_KERNEL_PAGE) ? PG_MAP_FLAG_KERNEL : 0;
-    pgFlags |= BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_READONLY) ? 0 : PG_MAP_FLAG_WRITABLE;
+    // Physical memory given by the caller, like the frame buffer, can be mapped with large pages in
+    // the kernel address space.
+    PagingMapFlags pgFlags = s_getPagingFlags (vas);
+    if (paStart != NULL && BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_KERNEL_PAGE)) {
+        pgFlags |= PG_MAP_FLAG_LARGE_PAGES;
+        vas->isLargePageMapped = (kpg_getLargePageSizeBytes() != 0);
+    }
 
+    // Map all the physical pages with the virtual ones
     PageDirectory pd = kpg_temporaryMap (vmm->parentProcessPD);
     if (!kpg_mapContinous (pd, vaStart, l_paStart, numPages, pgFlags)) {
         kpg_temporaryUnmap();
@@ -223,7 +618,6 @@ static bool commitVirtualPages (VMemoryManager* const vmm, PTR vaStart,
     }
 
     kpg_temporaryUnmap();
-    vmm->isPageDirectoryDirty = true; // PD has changed.
     INFO("Free physical memory: %x bytes", kpmm_getFreeMemorySize());
     return true;
 }
@@ -294,6 +688,8 @@ VMemoryManager* kvmm_new (PTR start, PTR end, Physical pd,
     new_vmm->parentProcessPD   = pd;
     new_vmm->physicalRegion    = physicalRegion;
     list_init (&new_vmm->head);
+    new_vmm->root           = NULL;
+    new_vmm->pageFaultCount = 0;
 
     return new_vmm;
 }
@@ -322,7 +718,11 @@ PTR kvmm_findFree (VMemoryManager* vmm, SIZE szPages)
  * null      null      Allocates new VAS of szPages pages. No physical backing.
  * null      non-null  Allocates new VAS of szPages pages. Physical mapping pa -> pa + szPages.
  * non-null  null      Allocates new VAS of szPages pages starting 'va'. No physical backing.
- * non-null  non-null  Allocates new VAS of szPages pages starting 'va'. Physically backed. */
+ * non-null  non-null  Allocates new VAS of szPages pages starting 'va'. Physically backed.
+ *
+ * Kernel mapping of given physical memory can use large pages. Large pages cannot be unmapped once
+ * kernel page tables are shared with processes, so after that such a mapping is permanent and
+ * kvmm_free fails for it. */
 PTR kvmm_memmap (VMemoryManager* vmm, PTR va, Physical const* const pa, SIZE szPages,
                  VMemoryMemMapFlags flags, Physical* const outPA)
 {
@@ -347,17 +747,42 @@ PTR kvmm_memmap (VMemoryManager* vmm, PTR va, Physical const* const pa, SIZE szP
         BUG(); // 'pa' is provided, but IMMCOMMIT flag is unset.
     }
 
-    // Find start of the next VA if none was provided.
+    // Only pages committed on access can be populated.
+    if (BIT_ISSET (flags, VMM_MEMMAP_FLAG_POPULATE) &&
+        (BIT_ISSET (flags, VMM_MEMMAP_FLAG_IMMCOMMIT) ||
+         BIT_ISSET (flags, VMM_MEMMAP_FLAG_COMMITTED))) {
+        BUG();
+    }
+
+    // Find start of the next VA if none was provided. Kernel mapping of given physical memory, which
+    // has a whole large page in it, is placed so that the large page can be used.
+    if (va == (PTR)NULL && pa != NULL && BIT_ISSET (flags, VMM_MEMMAP_FLAG_KERNEL_PAGE)) {
+        SIZE largePageBytes = kpg_getLargePageSizeBytes();
+        if (largePageBytes != 0 && ALIGN_UP (pa->val, largePageBytes) + largePageBytes <=
+                                       pa->val + PAGEFRAMES_TO_BYTES (szPages)) {
+            va = s_findNextVaForLargePages (vmm, *pa, szPages, largePageBytes);
+        }
+    }
+
     if (va == (PTR)NULL) {
         va = find_next_va (vmm, szPages);
     }
 
     // Create a new Virtual Address Space object starting at 'va'
-    const VMemoryAddressSpace* newVas = NULL;
+    VMemoryAddressSpace* newVas = NULL;
     if ((newVas = addNewVirtualAddressSpace (vmm, va, szPages, flags)) == NULL) {
         RETURN_ERROR (ERROR_PASSTHROUGH, (PTR)NULL);
     }
 
+    // Populated pages are still committed on access, so running out of memory here is not an
+    // error. Pages which could not be committed now are committed on access.
+    if (BIT_ISSET (flags, VMM_MEMMAP_FLAG_POPULATE)) {
+        SIZE committed = 0;
+        if (!s_commitZeroedPages (vmm, newVas, va, szPages, &committed)) {
+            WARN ("Populated %x of %x pages at %px", committed, szPages, va);
+        }
+    }
+
     // There is nothing to done for already backed, never backed or lazy backed virtual pages.
     if (BIT_ISUNSET (flags, VMM_MEMMAP_FLAG_IMMCOMMIT)) {
         return va; // Success
@@ -413,40 +838,461 @@ bool kvmm_free (VMemoryManager* vmm, PTR start_va)
         RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
     }
 
-    // Can we unreserve if address space is shared?
-    // Yes, just decrease the refcount
-    if (vas->share != NULL) {
-        vas->share->refcount--;
+    // Large pages can no longer be unmapped once processes share the kernel page tables.
+    if (vas->isLargePageMapped && kpg_getLargePageSizeBytes() == 0) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
     }
 
     // We can continue and unmap virtual addresses from the physical onces and also free the
     // physical page.
-    PTR va       = start_va;
     SIZE szPages = BYTES_TO_PAGEFRAMES_CEILING (vas->allocationSzBytes);
 
+    // Page frames of a shared address space belong to the share. They are freed when its last
+    // reference is released.
+    PagingOperationFlags unmapFlags = (vas->share == NULL) ? PG_UNMAP_FLAG_FREE_FRAMES : 0;
+
     // TODO: Since we are operating on a VMM, and a VMM is linked to a process, we store PD of the
     // process in the VMManager struct and use that whereever PD is required in VMM.
     PageDirectory pd = kpg_temporaryMap (vmm->parentProcessPD);
-    for (SIZE pgIndex = 0; pgIndex < szPages; pgIndex++, va += CONFIG_PAGE_FRAME_SIZE_BYTES) {
-        Physical pa;
-        if (kpg_doesMappingExists (pd, va, &pa)) {
-            if (!kpg_unmap (pd, va)) {
-                k_panicOnError();
+    if (!kpg_unmapRange (pd, start_va, szPages, unmapFlags)) {
+        k_panicOnError();
+    }
+    kpg_temporaryUnmap();
+
+    if (vas->share != NULL) {
+        kvmm_releaseShare (vas->share);
+    }
+
+    // We now know that node allocation was done through the slab cache, so it can be freed.
+    s_removeVas (vmm, vas);
+    kmem_cache_free (s_vasCache, vas);
+
+    return true;
+}
+
+/***************************************************************************************************
+ * Creates a share of zeroed page frames, which can be mapped in many VMMs. Every mapping sees the
+ * same physical pages.
+ *
+ * The caller owns the first reference, and releases it with kvmm_releaseShare. Every mapping holds
+ * one more, which it releases when freed.
+ *
+ * @Input   szPages         Number of pages in the share.
+ * @Input   physicalRegion  Physical memory region from where the page frames are allocated.
+ * @return                  Share if successful, NULL otherwise. Error number is set.
+ * @error                   ERR_INVALID_ARGUMENT  - Number of pages is zero.
+ *                          ERR_OUT_OF_MEM        - Not enough memory for page frames.
+ **************************************************************************************************/
+VMemoryShare* kvmm_newShare (SIZE szPages, KernelPhysicalMemoryRegions physicalRegion)
+{
+    FUNC_ENTRY ("szPages: %x, physical region: %x", szPages, physicalRegion);
+
+    if (szPages == 0) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, NULL);
+    }
+
+    VMemoryShare* share = kmalloc (sizeof (VMemoryShare));
+    if (share == NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+    }
+
+    if ((share->pages = kmalloc (szPages * sizeof (Physical))) == NULL) {
+        kfree (share);
+        RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+    }
+
+    // Pages are seen by other processes, so must not carry old data.
+    share->refcount = 1;
+    for (share->count = 0; share->count < szPages; share->count++) {
+        if (!kpmm_allocZeroed (&share->pages[share->count], physicalRegion)) {
+            kvmm_releaseShare (share);
+            RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+        }
+    }
+
+    return share;
+}
+
+/***************************************************************************************************
+ * Releases one reference to a share. The share and its page frames are freed with the last one.
+ *
+ * @Input   share   Share to release.
+ * @return          Nothing
+ **************************************************************************************************/
+void kvmm_releaseShare (VMemoryShare* share)
+{
+    FUNC_ENTRY ("share: %px", share);
+
+    k_assert (share != NULL && share->refcount > 0, "Invalid share");
+
+    if (--share->refcount > 0) {
+        return;
+    }
+
+    for (SIZE i = 0; i < share->count; i++) {
+        if (!kpmm_free (share->pages[i], 1)) {
+            BUG(); // Page frames of the share were allocated by it.
+        }
+    }
+
+    kfree (share->pages);
+    kfree (share);
+}
+
+/***************************************************************************************************
+ * Maps every page of a share in a new address space of the VMM. Pages are committed at once.
+ *
+ * @Input   vmm     VMM where the share is mapped.
+ * @Input   share   Share to map.
+ * @Input   flags   Memmap flags. Only VMM_MEMMAP_FLAG_KERNEL_PAGE and VMM_MEMMAP_FLAG_READONLY
+ *                  are allowed.
+ * @return          Start of the new address space. Or 0 on failure.
+ * @error           ERR_INVALID_ARGUMENT  - Flags are not allowed.
+ *                  ERR_OUT_OF_MEM        - No free virtual address range large enough.
+ **************************************************************************************************/
+PTR kvmm_mapShare (VMemoryManager* vmm, VMemoryShare* share, VMemoryMemMapFlags flags)
+{
+    FUNC_ENTRY ("vmm: %px, share: %px, flags: %x", vmm, share, flags);
+
+    k_assert (vmm != NULL, "VMM not provided");
+    k_assert (share != NULL && share->refcount > 0, "Invalid share");
+
+    if ((flags & ~(UINT)(VMM_MEMMAP_FLAG_KERNEL_PAGE | VMM_MEMMAP_FLAG_READONLY)) != 0) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, (PTR)NULL);
+    }
+
+    PTR va = find_next_va (vmm, share->count);
+    if (va == 0) {
+        RETURN_ERROR (ERR_OUT_OF_MEM, (PTR)NULL);
+    }
+
+    // Page frames are mapped here, so the address space is never committed on access.
+    VMemoryAddressSpace* vas = NULL;
+    if ((vas = addNewVirtualAddressSpace (vmm, va, share->count,
+                                          flags | VMM_MEMMAP_FLAG_COMMITTED)) == NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, (PTR)NULL);
+    }
+    vas->share = share;
+    share->refcount++;
+
+    SIZE framesUsed  = 0;
+    PageDirectory pd = kpg_temporaryMap (vmm->parentProcessPD);
+    if (!kpg_mapUnmappedPages (pd, va, share->count, share->pages, share->count,
+                               s_getPagingFlags (vas), &framesUsed)) {
+        k_panicOnError(); // Should not fail. Address is aligned.
+    }
+    kpg_temporaryUnmap();
+
+    k_assert (framesUsed == share->count, "Pages of a new address space were already mapped");
+    return va;
+}
+
+/***************************************************************************************************
+ * Frees an address space which maps a share. Other mappings of the share are not affected.
+ *
+ * @Input   vmm     VMM of the address space.
+ * @Input   va      Start of the address space, as returned by kvmm_mapShare.
+ * @return          True on success, false otherwise.
+ * @error           ERR_VMM_NOT_ALLOCATED - No address space starts at the address.
+ *                  ERR_INVALID_ARGUMENT  - Address space does not map a share.
+ **************************************************************************************************/
+bool kvmm_unmapShare (VMemoryManager* vmm, PTR va)
+{
+    FUNC_ENTRY ("vmm: %px, va: %px", vmm, va);
+
+    k_assert (vmm != NULL, "VMM not provided");
+
+    VMemoryAddressSpace const* vas = find_vas (vmm, va);
+    if (vas == NULL || vas->start_vm != va) {
+        RETURN_ERROR (ERR_VMM_NOT_ALLOCATED, false);
+    }
+
+    if (vas->share == NULL) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+    }
+
+    return kvmm_free (vmm, va);
+}
+
+/***************************************************************************************************
+ * Maps every page of a share as a private copy of it in a new address space of the VMM. Page frames
+ * of the share are mapped read-only and copied on the first write (see kvmm_copyOnWrite), so writes
+ * are never seen by the share or by other private copies of it.
+ *
+ * Unlike kvmm_mapShare, the VMM takes no reference to the share. It owns the page frames it mapped,
+ * and the caller must keep its reference while the share is mapped so that the share is not
+ * changed.
+ *
+ * @Input   vmm     VMM where the share is mapped.
+ * @Input   va      Start of the new address space. If 0, any free range is used.
+ * @Input   share   Share to map.
+ * @return          Start of the new address space. Or 0 on failure.
+ * @error           ERR_OUT_OF_MEM        - No free virtual address range large enough.
+ *                  ERR_OVERFLOW          - A page frame of the share has too many owners.
+ **************************************************************************************************/
+PTR kvmm_mapSharePrivate (VMemoryManager* vmm, PTR va, VMemoryShare* share)
+{
+    FUNC_ENTRY ("vmm: %px, va: %px, share: %px", vmm, va, share);
+
+    k_assert (vmm != NULL, "VMM not provided");
+    k_assert (share != NULL && share->refcount > 0, "Invalid share");
+
+    if (va == (PTR)NULL && (va = find_next_va (vmm, share->count)) == 0) {
+        RETURN_ERROR (ERR_OUT_OF_MEM, (PTR)NULL);
+    }
+
+    // Pages are mapped here, so the address space is never committed on access. It is not a share
+    // address space, its page frames are freed (their owner given up) with it.
+    VMemoryAddressSpace* vas = NULL;
+    if ((vas = addNewVirtualAddressSpace (vmm, va, share->count, VMM_MEMMAP_FLAG_IMMCOMMIT)) ==
+        NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, (PTR)NULL);
+    }
+
+    SIZE sharedCount = 0;
+    for (; sharedCount < share->count; sharedCount++) {
+        if (!kpmm_share (share->pages[sharedCount])) {
+            break;
+        }
+    }
+
+    if (sharedCount < share->count) {
+        for (SIZE i = 0; i < sharedCount; i++) {
+            if (!kpmm_free (share->pages[i], 1)) {
+                BUG(); // Owner was added just above.
             }
-            // We cannot unallocate physical pages if the address space is being shared.
-            if (vas->share == NULL || (vas->share != NULL && vas->share->refcount == 1)) {
-                if (!kpmm_free (pa, 1)) {
-                    k_panicOnError();
-                }
+        }
+        s_removeVas (vmm, vas);
+        kmem_cache_free (s_vasCache, vas);
+        RETURN_ERROR (ERROR_PASSTHROUGH, (PTR)NULL);
+    }
+
+    SIZE framesUsed        = 0;
+    PagingMapFlags pgFlags = s_getPagingFlags (vas) & ~(UINT)PG_MAP_FLAG_WRITABLE;
+    PageDirectory pd       = kpg_temporaryMap (vmm->parentProcessPD);
+    if (!kpg_mapUnmappedPages (pd, va, share->count, share->pages, share->count, pgFlags,
+                               &framesUsed)) {
+        k_panicOnError(); // Should not fail. Address is aligned.
+    }
+    kpg_temporaryUnmap();
+
+    k_assert (framesUsed == share->count, "Pages of a new address space were already mapped");
+    return va;
+}
+
+/***************************************************************************************************
+ * Creates a VMM with the same address spaces as another one. Committed pages are not copied, their
+ * page frames are mapped read-only in both VMMs and copied on the first write to either one (see
+ * kvmm_copyOnWrite). Shares are mapped in the new VMM as they are. Cost is a walk of the page
+ * tables, not a copy of the memory.
+ *
+ * @Input   vmm     VMM to clone. Must not have kernel pages or pages committed outside the VMM,
+ *                  other than shares.
+ * @Input   pd      Page directory of the new VMM. Range of the VMM must not be mapped in it.
+ * @return          New VMM if successful, NULL otherwise. Error number is set.
+ * @error           ERR_INVALID_ARGUMENT  - VMM has address spaces which cannot be cloned.
+ *                  ERR_OVERFLOW          - A page frame has too many owners.
+ **************************************************************************************************/
+VMemoryManager* kvmm_clone (VMemoryManager* vmm, Physical pd)
+{
+    FUNC_ENTRY ("vmm: %px, PD: %px", vmm, pd.val);
+
+    k_assert (vmm != NULL, "VMM not provided");
+
+    // Kernel pages are written without a page fault being allowed (kernel stacks for example) and
+    // page frames committed outside the VMM are not owned by it. These cannot be copied on write.
+    ListNode* node = NULL;
+    list_for_each (&vmm->head, node)
+    {
+        VMemoryAddressSpace* vas = LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
+        if (BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_KERNEL_PAGE) ||
+            (BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_COMMITTED) && vas->share == NULL)) {
+            RETURN_ERROR (ERR_INVALID_ARGUMENT, NULL);
+        }
+    }
+
+    VMemoryManager* clone = kvmm_new (vmm->start, vmm->end, pd, vmm->physicalRegion);
+    if (clone == NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+    }
+
+    bool success         = true;
+    PageDirectory srcPD  = kpg_temporaryMap (vmm->parentProcessPD);
+    PageDirectory destPD = kpg_temporaryMap (pd);
+    list_for_each (&vmm->head, node)
+    {
+        VMemoryAddressSpace* vas = LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
+        SIZE szPages             = BYTES_TO_PAGEFRAMES_FLOOR (vas->allocationSzBytes);
+
+        VMemoryAddressSpace* newVas = NULL;
+        if ((newVas = addNewVirtualAddressSpace (clone, vas->start_vm, szPages, vas->flags)) ==
+            NULL) {
+            success = false;
+            break;
+        }
+        newVas->faultAroundPages = vas->faultAroundPages;
+#ifdef DEBUG
+        newVas->processID = vas->processID;
+        k_memcpy (newVas->purpose, vas->purpose, sizeof (vas->purpose));
+#endif // DEBUG
+
+        if (vas->share != NULL) {
+            newVas->share = vas->share;
+            vas->share->refcount++;
+
+            SIZE framesUsed = 0;
+            if (!kpg_mapUnmappedPages (destPD, vas->start_vm, szPages, vas->share->pages,
+                                       vas->share->count, s_getPagingFlags (vas), &framesUsed)) {
+                k_panicOnError(); // Should not fail. Address is aligned.
             }
+        } else if (BIT_ISUNSET (vas->flags, VMM_MEMMAP_FLAG_NULLPAGE) &&
+                   !kpg_shareMappings (srcPD, destPD, vas->start_vm, szPages,
+                                       s_getPagingFlags (vas))) {
+            success = false;
+            break;
         }
     }
     kpg_temporaryUnmap();
+    kpg_temporaryUnmap();
 
-    // We now know that node allocation was done through kmalloc, so it can be freed.
-    list_remove (&vas->adjMappingNode);
-    kfree (vas);
+    if (!success) {
+        // Pages shared so far are owned by the clone as well. These go with it.
+        if (!kvmm_delete (&clone)) {
+            BUG(); // Cannot fail. Every address space of the clone was allocated above.
+        }
+        RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+    }
+
+    return clone;
+}
+
+/***************************************************************************************************
+ * Handles a write to a page which is mapped read-only after kvmm_clone, kvmm_mapSharePrivate or
+ * kvmm_mapZeroPage. Page frame is copied if it is still shared with another owner, otherwise it is
+ * made writable as it is. The zero page is never copied, it is replaced by a zeroed page frame.
+ *
+ * @Input   vmm     VMM of the address space.
+ * @Input   va      Address which was written.
+ * @return          True if the page is now writable, false otherwise. Error number is set.
+ * @error           ERR_VMM_NOT_ALLOCATED - Address is not within any address space.
+ *                  ERR_INVALID_ARGUMENT  - Address space is never written or is not owned by the
+ *                                          VMM. Write to it is a real fault.
+ *                  ERR_PAGE_WRONG_STATE  - Page is not committed.
+ *                  ERR_OUT_OF_MEM        - No page frame for the copy.
+ **************************************************************************************************/
+bool kvmm_copyOnWrite (VMemoryManager* vmm, PTR va)
+{
+    FUNC_ENTRY ("vmm: %x, va: %px", vmm, va);
+
+    k_assert (vmm != NULL, "VMM not provided");
+
+    VMemoryAddressSpace* vas = NULL;
+    if ((vas = find_vas (vmm, va)) == NULL) {
+        RETURN_ERROR (ERR_VMM_NOT_ALLOCATED, false);
+    }
+
+    // Only address spaces whose page frames are shared page by page (kvmm_clone,
+    // kvmm_mapSharePrivate) are copied on write.
+    if (BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_READONLY) ||
+        BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_NULLPAGE) ||
+        BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_KERNEL_PAGE) ||
+        BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_COMMITTED) || vas->share != NULL) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+    }
+
+    PTR pageStart    = ALIGN_DOWN (va, CONFIG_PAGE_FRAME_SIZE_BYTES);
+    PageDirectory pd = kpg_temporaryMap (vmm->parentProcessPD);
+
+    Physical pa;
+    if (!kpg_doesMappingExists (pd, pageStart, &pa)) {
+        kpg_temporaryUnmap();
+        RETURN_ERROR (ERR_PAGE_WRONG_STATE, false);
+    }
+
+    // Page which was only read so far gets a page frame of its own, zeroed just like the zero page.
+    // Other VMMs which shared the page frame have copied it already, so it is not copied again.
+    Physical newPA = pa;
+    if (kpmm_isZeroFrame (pa)) {
+        if (!kpmm_allocZeroed (&newPA, vmm->physicalRegion)) {
+            kpg_temporaryUnmap();
+            RETURN_ERROR (ERROR_PASSTHROUGH, false);
+        }
+    } else if (kpmm_getShareCount (pa) > 0) {
+        if (!kpmm_alloc (&newPA, 1, vmm->physicalRegion)) {
+            kpg_temporaryUnmap();
+            RETURN_ERROR (ERROR_PASSTHROUGH, false);
+        }
 
+        if (!kpg_copyPageFrame (newPA, pa)) {
+            k_panicOnError(); // Should not fail. Page frames are aligned.
+        }
+    }
+
+    if (!kpg_remap (pd, pageStart, newPA, s_getPagingFlags (vas))) {
+        k_panicOnError(); // Should not fail. Page is mapped.
+    }
+    kpg_temporaryUnmap();
+
+    // This VMM is no longer an owner of the page frame it copied.
+    if (newPA.val != pa.val && !kpmm_free (pa, 1)) {
+        k_panicOnError();
+    }
+
+    vmm->pageFaultCount++;
+    INFO ("Copy on write for VA: %px. PA %px -> %px", va, pa.val, newPA.val);
+    return true;
+}
+
+/***************************************************************************************************
+ * Handles a read of a page which is committed on access, but is not committed yet. Page is mapped
+ * read-only to the zero frame, which is shared by every such page. A page frame is committed on the
+ * first write to the page (see kvmm_copyOnWrite), so memory which is only read costs nothing. A
+ * write to a page which was never read commits just that page (see kvmm_commitPage).
+ *
+ * @Input   vmm     VMM of the address space.
+ * @Input   va      Address which was read.
+ * @return          True if the page is now mapped, false otherwise. Error number is set.
+ * @error           ERR_VMM_NOT_ALLOCATED - Address is not within any address space.
+ *                  ERR_INVALID_ARGUMENT  - Address space is not committed on access, or is kernel
+ *                                          pages which must be committed (see kvmm_commitPage).
+ *                  ERR_OUT_OF_MEM        - No page frame for the zero frame.
+ **************************************************************************************************/
+bool kvmm_mapZeroPage (VMemoryManager* vmm, PTR va)
+{
+    FUNC_ENTRY ("vmm: %x, va: %px", vmm, va);
+
+    k_assert (vmm != NULL, "VMM not provided");
+
+    VMemoryAddressSpace* vas = NULL;
+    if ((vas = find_vas (vmm, va)) == NULL) {
+        RETURN_ERROR (ERR_VMM_NOT_ALLOCATED, false);
+    }
+
+    // Kernel pages are written where a page fault is not allowed, so they are never copied on write.
+    if (BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_KERNEL_PAGE) ||
+        BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_NULLPAGE) ||
+        BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_IMMCOMMIT) ||
+        BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_COMMITTED)) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+    }
+
+    Physical zeroFrame;
+    if (!kpmm_getZeroFrame (&zeroFrame)) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+
+    // Page frame is not owned by the VMM, freeing it later does nothing.
+    SIZE framesUsed        = 0;
+    PTR pageStart          = ALIGN_DOWN (va, CONFIG_PAGE_FRAME_SIZE_BYTES);
+    PagingMapFlags pgFlags = s_getPagingFlags (vas) & ~(UINT)PG_MAP_FLAG_WRITABLE;
+    PageDirectory pd       = kpg_temporaryMap (vmm->parentProcessPD);
+    if (!kpg_mapUnmappedPages (pd, pageStart, 1, &zeroFrame, 1, pgFlags, &framesUsed)) {
+        k_panicOnError(); // Should not fail. Address is aligned.
+    }
+    kpg_temporaryUnmap();
+
+    vmm->pageFaultCount++;
+    INFO ("Zero page mapped for VA: %px", va);
     return true;
 }
 
@@ -496,30 +1342,219 @@ bool kvmm_commitPage (VMemoryManager* vmm, PTR va)
         RETURN_ERROR (ERR_VMM_NULL_PAGE_ACCESS, false);
     }
 
-    PTR pageStart = ALIGN_DOWN (va, CONFIG_PAGE_FRAME_SIZE_BYTES);
-    if (!commitVirtualPages (vmm, pageStart, NULL, 1, vas, NULL)) {
+    // Fault around: Pages of the window around the faulting page are committed together, so that
+    // sequential access does not fault on every page. Windows are aligned to their size from the
+    // start of the address space.
+    // Demand-zero pages (see kvmm_mapZeroPage) must cost nothing until written, so a write to one
+    // commits only that page. Unless the page before it is mapped, then the buffer is most likely
+    // being filled in order.
+    PTR pageStart    = ALIGN_DOWN (va, CONFIG_PAGE_FRAME_SIZE_BYTES);
+    SIZE faultAround = vas->faultAroundPages;
+    if (s_isDemandZero (vas) && !s_isPreviousPageMapped (vmm, vas, pageStart)) {
+        faultAround = 1;
+    }
+
+    SIZE windowBytes = PAGEFRAMES_TO_BYTES (faultAround);
+    PTR windowStart  = vas->start_vm + ((pageStart - vas->start_vm) / windowBytes) * windowBytes;
+    PTR windowEnd    = windowStart + MIN (windowBytes, VAS_END (vas) - windowStart);
+
+    // Pages committed on access start zeroed. Zeroed page frames are usually ready in the pool, so
+    // they are not zeroed in the page fault. Faulting page is not committed, so it is the first page
+    // committed. Pages after it and then pages before it are committed as long as memory allows.
+    SIZE committed = 0;
+    if (!s_commitZeroedPages (vmm, vas, pageStart,
+                              BYTES_TO_PAGEFRAMES_FLOOR (windowEnd - pageStart), &committed) &&
+        committed == 0) {
         RETURN_ERROR (ERROR_PASSTHROUGH, false);
     }
 
+    if (windowStart < pageStart) {
+        (void)s_commitZeroedPages (vmm, vas, windowStart,
+                                   BYTES_TO_PAGEFRAMES_FLOOR (pageStart - windowStart), &committed);
+    }
+
+    vmm->pageFaultCount++;
     INFO ("Commit successful for VA: %px", va);
     return true;
 }
 
-Physical kvmm_getPageDirectory (const VMemoryManager* const vmm)
+/***************************************************************************************************
+ * Sets the number of pages committed together when a page of an address space is accessed for the
+ * first time. Demand-zero pages use the window only when the page before is mapped.
+ *
+ * @Input   vmm     VMM of the address space.
+ * @Input   va      Any address within the address space.
+ * @Input   szPages Number of pages. 1 commits only the page which is accessed.
+ * @return          True on success, false otherwise.
+ * @error           ERR_VMM_NOT_ALLOCATED - Address is not within any address space.
+ * @error           ERR_INVALID_ARGUMENT  - Number of pages is zero.
+ **************************************************************************************************/
+bool kvmm_setFaultAround (VMemoryManager* vmm, PTR va, SIZE szPages)
+{
+    FUNC_ENTRY ("vmm: %x, va: %px, szPages: %x", vmm, va, szPages);
+
+    k_assert (vmm != NULL, "VMM not provided");
+
+    if (szPages == 0) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+    }
+
+    VMemoryAddressSpace* vas = NULL;
+    if ((vas = find_vas (vmm, va)) == NULL) {
+        RETURN_ERROR (ERR_VMM_NOT_ALLOCATED, false);
+    }
+
+    vas->faultAroundPages = szPages;
+    return true;
+}
+
+/***************************************************************************************************
+ * Number of page faults which were handled by committing pages.
+ *
+ * @Input   vmm     VMM of the address spaces.
+ * @return          Page fault count.
+ **************************************************************************************************/
+U32 kvmm_getPageFaultCount (const VMemoryManager* vmm)
 {
     FUNC_ENTRY ("vmm: %x", vmm);
 
     k_assert (vmm != NULL, "VMM not provided");
+    return vmm->pageFaultCount;
+}
 
-    return vmm->parentProcessPD;
+/***************************************************************************************************
+ * Gives back physical pages of lazily committed virtual pages. Virtual pages remain reserved and
+ * get committed again on the next access.
+ *
+ * @Input   vmm     VMM of the address space.
+ * @Input   va      Start virtual address. Must be page aligned.
+ * @Input   szPages Number of virtual pages. Pages which are not committed are skipped.
+ * @return          True on success, false otherwise.
+ * @error           ERR_VMM_NOT_ALLOCATED - Range is not within one address space.
+ * @error           ERR_INVALID_ARGUMENT  - Address space is not lazily committed or is shared.
+ * @error           ERR_WRONG_ALIGNMENT   - Input is not page aligned.
+ **************************************************************************************************/
+bool kvmm_decommit (VMemoryManager* vmm, PTR va, SIZE szPages)
+{
+    FUNC_ENTRY ("vmm: %x, va: %px, szPages: %x", vmm, va, szPages);
+
+    k_assert (vmm != NULL, "VMM not provided");
+
+    if (!IS_ALIGNED (va, CONFIG_PAGE_FRAME_SIZE_BYTES)) {
+        RETURN_ERROR (ERR_WRONG_ALIGNMENT, false);
+    }
+
+    VMemoryAddressSpace* vas = NULL;
+    if ((vas = find_vas (vmm, va)) == NULL ||
+        va + PAGEFRAMES_TO_BYTES (szPages) > vas->start_vm + vas->allocationSzBytes) {
+        RETURN_ERROR (ERR_VMM_NOT_ALLOCATED, false);
+    }
+
+    // Only pages which were committed on page fault can be committed again that way.
+    if (BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_IMMCOMMIT) ||
+        BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_COMMITTED) ||
+        BIT_ISSET (vas->flags, VMM_MEMMAP_FLAG_NULLPAGE) || vas->share != NULL) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+    }
+
+    PageDirectory pd = kpg_temporaryMap (vmm->parentProcessPD);
+    if (!kpg_unmapRange (pd, va, szPages, PG_UNMAP_FLAG_FREE_FRAMES)) {
+        k_panicOnError();
+    }
+    kpg_temporaryUnmap();
+
+    INFO ("Free physical memory: %x bytes", kpmm_getFreeMemorySize());
+    return true;
+}
+
+/***************************************************************************************************
+ * Reserves lazily committed virtual pages with a null page on either side, so that an access just
+ * outside the range causes a page fault.
+ *
+ * @Input   vmm     VMM of the address space.
+ * @Input   szPages Number of usable virtual pages.
+ * @Input   flags   Memmap flags. Pages cannot be committed or null pages.
+ * @return          Start of the usable virtual pages. Or 0 on failure.
+ * @error           ERR_INVALID_ARGUMENT  - Size is zero or flags are not allowed.
+ * @error           ERR_OUT_OF_MEM        - No free virtual address range large enough.
+ **************************************************************************************************/
+PTR kvmm_allocGuarded (VMemoryManager* vmm, SIZE szPages, VMemoryMemMapFlags flags)
+{
+    FUNC_ENTRY ("vmm: %x, szPages: %x, flags: %x", vmm, szPages, flags);
+
+    k_assert (vmm != NULL, "VMM not provided");
+
+    if (szPages == 0 || BIT_ISSET (flags, VMM_MEMMAP_FLAG_IMMCOMMIT) ||
+        BIT_ISSET (flags, VMM_MEMMAP_FLAG_COMMITTED) ||
+        BIT_ISSET (flags, VMM_MEMMAP_FLAG_NULLPAGE)) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, (PTR)NULL);
+    }
+
+    PTR guardVA = find_next_va (vmm, szPages + 2);
+    if (guardVA == 0) {
+        RETURN_ERROR (ERR_OUT_OF_MEM, (PTR)NULL);
+    }
+
+    PTR va    = guardVA + CONFIG_PAGE_FRAME_SIZE_BYTES;
+    PTR endVA = va + PAGEFRAMES_TO_BYTES (szPages);
+
+    if (!kvmm_memmap (vmm, guardVA, NULL, 1, VMM_MEMMAP_FLAG_NULLPAGE, NULL)) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, (PTR)NULL);
+    }
+
+    if (!kvmm_memmap (vmm, va, NULL, szPages, flags | VMM_MEMMAP_FLAG_GUARDED, NULL)) {
+        kvmm_free (vmm, guardVA);
+        RETURN_ERROR (ERROR_PASSTHROUGH, (PTR)NULL);
+    }
+
+    if (!kvmm_memmap (vmm, endVA, NULL, 1, VMM_MEMMAP_FLAG_NULLPAGE, NULL)) {
+        kvmm_free (vmm, va);
+        kvmm_free (vmm, guardVA);
+        RETURN_ERROR (ERROR_PASSTHROUGH, (PTR)NULL);
+    }
+
+    return va;
 }
 
-bool kvmm_isPageDirectoryDirty (VMemoryManager* const vmm)
+/***************************************************************************************************
+ * Frees virtual pages reserved by kvmm_allocGuarded together with its null pages. Committed pages
+ * are given back to the PMM.
+ *
+ * @Input   vmm         VMM of the address space.
+ * @Input   va          Virtual address returned by kvmm_allocGuarded.
+ * @Output  outPages    Number of pages freed, null pages excluded. Can be NULL.
+ * @return              True on success, false otherwise.
+ * @error               ERR_INVALID_ARGUMENT  - Address was not returned by kvmm_allocGuarded.
+ **************************************************************************************************/
+bool kvmm_freeGuarded (VMemoryManager* vmm, PTR va, SIZE* const outPages)
+{
+    FUNC_ENTRY ("vmm: %x, va: %px", vmm, va);
+
+    k_assert (vmm != NULL, "VMM not provided");
+
+    VMemoryAddressSpace* vas = find_vas (vmm, va);
+    if (vas == NULL || vas->start_vm != va || BIT_ISUNSET (vas->flags, VMM_MEMMAP_FLAG_GUARDED)) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+    }
+
+    PTR endVA    = va + vas->allocationSzBytes;
+    SIZE szPages = BYTES_TO_PAGEFRAMES_FLOOR (vas->allocationSzBytes);
+    if (!kvmm_free (vmm, va) || !kvmm_free (vmm, va - CONFIG_PAGE_FRAME_SIZE_BYTES) ||
+        !kvmm_free (vmm, endVA)) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+
+    if (outPages != NULL) {
+        *outPages = szPages;
+    }
+    return true;
+}
+
+Physical kvmm_getPageDirectory (const VMemoryManager* const vmm)
 {
     FUNC_ENTRY ("vmm: %x", vmm);
+
     k_assert (vmm != NULL, "VMM not provided");
 
-    bool isDirty   = vmm->isPageDirectoryDirty;
-    vmm->isPageDirectoryDirty = false;
-    return isDirty;
+    return vmm->parentProcessPD;
 }
@@ -65,7 +65,8 @@ g_kernel_entry:
     and eax, 0b11111111_11111111_11110000_00000000
     mov cr3, eax
     
-    ; Page size extension and page address extension is disabled
+    ; Page size extension and page address extension is disabled. Large pages are turned on later
+    ; by kpg_enableLargePages.
     mov eax, cr4
     and eax, 0b11111111_11111111_11111111_11001111
     mov cr4, eax
@@ -139,25 +139,27 @@ void page_fault_handler (InterruptFrame *frame, UINT errorcode)
 
     // Page faults can occur for various reasons, it could be permissions or if page frame is not
     // present. Commit a physical page only it there is not one already allocated.
+    // Kernel page tables are shared by every page directory, so pages committed in the kernel
+    // address space are seen by all processes.
     VMemoryManager* context = kprocess_getCurrentContext();
     if (kvmm_checkbounds (g_kstate.context, fault_addr)) {
         context = g_kstate.context;
+    }
 
-        // Attempt 1: Check if Kernel PD has changed and a sync is pending.
-        if (kvmm_isPageDirectoryDirty (context)) {
-            INFO ("Kernel and Process PD out of sync. Syncing..");
-            kprocess_syncPD();
-            return; // then retry.
-        }
+    // Read of a page committed on access maps the zero page. A page frame is committed only when the
+    // page is written, which is then a write fault on a present page.
+    if (err->Present == false && err->WriteFault == false &&
+        kvmm_mapZeroPage (context, fault_addr)) {
+        return; // then retry
     }
 
-    // Attempt 2 : Process PD is sync with the Kernel PD. Actually commit the faulting virtual
-    // address.
     if (err->Present == false && kvmm_commitPage (context, fault_addr)) {
-        // Kernel PD has changed. Sync all Page Directories to it.
-        if (context == g_kstate.context) {
-            kprocess_syncPD();
-        }
+        return; // then retry
+    }
+
+    // Pages shared after cloning an address space, or mapped to the zero page, are read-only until
+    // written. Write to such a page, from user or kernel mode (CR0.WP is set), gets its own copy.
+    if (err->Present && err->WriteFault && kvmm_copyOnWrite (context, fault_addr)) {
         return; // then retry
     }
 
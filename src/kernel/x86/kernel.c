@@ -48,9 +48,17 @@
 #include <handle.h>
 
 #define MPDEMO
+#define TLB_BENCHMARK_ROUNDS 16
+#define FLUSH_BENCHMARK_ROUNDS 16
 
 static void display_system_info (void);
 static void s_initializeMemoryManagers (void);
+#if defined(DEBUG) && defined(PORT_E9_ENABLED)
+static void s_benchmarkLargePages (void);
+    #ifdef GRAPHICS_MODE_ENABLED
+static void s_benchmarkFlush (void);
+    #endif // GRAPHICS_MODE_ENABLED
+#endif // DEBUG && PORT_E9_ENABLED
 static SIZE s_getPhysicalBlockPageCount (Physical pa, Physical end);
 static void run_root_process(void);
 
@@ -88,6 +96,7 @@ void kernel_main (void)
     // Mark memory already occupied by the modules and unmap unused Virutal pages.
     s_initializeMemoryManagers();
     kvmm_printVASList(g_kstate.context);
+    kdebug_printMemoryStats();
 
     kearly_printf ("\r[OK]");
 
@@ -135,6 +144,7 @@ void kernel_main (void)
     kearly_printf ("\r[OK]");
 
     kearly_println ("[  ]\tKernel memory management.");
+    kslab_init();
     kmalloc_init();
     kearly_printf ("\r[OK]");
 
@@ -142,6 +152,9 @@ void kernel_main (void)
     if (!kgraphics_init()) {
         FATAL_BUG();
     }
+    #if defined(DEBUG) && defined(PORT_E9_ENABLED)
+    s_benchmarkFlush();
+    #endif // DEBUG && PORT_E9_ENABLED
     kcompose_init();
 #endif
 
@@ -184,6 +197,9 @@ void kernel_main (void)
     if (!ps2_mouse_init()) {
         k_panic ("PS2 Mouse initialization falied");
     }
+    // Page tables and page directory of the first process are taken from the zeroed pool.
+    kpmm_refillZeroPool (PMM_ZERO_POOL_CAPACITY);
+
     run_root_process();
     k_halt();
 }
@@ -216,8 +232,9 @@ void k_delay (UINT ms)
     U32 start_tick = g_kstate.tick_count;
     U32 end_tick   = start_tick + KERNEL_MICRODEC_TO_TICK_COUNT (us);
 
+    // Zero free page frames while waiting. Once the pool is full, nothing is zeroed.
     while (g_kstate.tick_count < end_tick)
-        ;
+        kpmm_refillZeroPool (1);
 }
 
 static void run_root_process(void)
@@ -280,10 +297,106 @@ void display_system_info(void)
     INFO ("Installed RAM bytes: %llx bytes", installed_memory);
     UINT installed_memory_pageCount = (UINT)BYTES_TO_PAGEFRAMES_CEILING (installed_memory);
     INFO ("Installed RAM Pages: %u", installed_memory_pageCount);
+    INFO ("Usable RAM bytes: %x bytes", kpmm_getUsableMemorySize (PMM_REGION_ANY));
     INFO ("Free RAM bytes: %x bytes", kpmm_getFreeMemorySize());
 #endif
 }
 
+#if defined(DEBUG) && defined(PORT_E9_ENABLED)
+/* Reads a word from every page of the range, right after flushing the TLB if asked. Returns the
+ * average number of cycles per page. */
+static U32 s_readPages (PTR va, SIZE pageCount, bool flushTLB)
+{
+    if (flushTLB) {
+        x86_CR3 cr3;
+        x86_READ_REG (CR3, cr3);
+        x86_LOAD_REG (CR3, cr3);
+    }
+
+    U64 start, end;
+    volatile U32 sum = 0;
+    x86_READ_TSC (start);
+    for (SIZE i = 0; i < pageCount; i++) {
+        sum += *(volatile U32*)(va + PAGEFRAMES_TO_BYTES (i));
+    }
+    x86_READ_TSC (end);
+    return (U32)((end - start) / pageCount);
+}
+
+/* Reads the same 4 MB of physical memory through the direct map, which is a 4 MB page, and through
+ * a mapping made of 4 KB pages. Each is read after a TLB flush (misses) and read again (hits). It
+ * is memory at 4 MB, so that low memory, like the VGA buffer, is not read. */
+static void s_benchmarkLargePages (void)
+{
+    const Physical pa = PHYSICAL (4 * MB);
+    const SIZE pageCount = BYTES_TO_PAGEFRAMES_FLOOR (4 * MB);
+
+    if (kpmm_getUsableMemorySize (PMM_REGION_ANY) < pa.val + 4 * MB) {
+        INFO ("TLB benchmark skipped. Needs 8 MB of memory.");
+        return;
+    }
+
+    // Address space is only reserved, so that the pages can be mapped here without the large page
+    // flag and unmapped without freeing the page frames.
+    PTR smallVA = kvmm_memmap (g_kstate.context, 0, NULL, pageCount, VMM_MEMMAP_FLAG_KERNEL_PAGE,
+                               NULL);
+    if (smallVA == 0 || !kpg_mapContinous (kpg_getcurrentpd(), smallVA, pa, pageCount,
+                                           PG_MAP_FLAG_KERNEL_DEFAULT)) {
+        k_panicOnError();
+    }
+    PTR largeVA = X86_MEM_START_DIRECT_MAP + pa.val;
+
+    // Memory is brought in the data cache first, so that only the TLB differs.
+    s_readPages (largeVA, pageCount, false);
+
+    U64 smallMiss = 0, smallHit = 0, largeMiss = 0, largeHit = 0;
+    for (UINT i = 0; i < TLB_BENCHMARK_ROUNDS; i++) {
+        smallMiss += s_readPages (smallVA, pageCount, true);
+        smallHit += s_readPages (smallVA, pageCount, false);
+        largeMiss += s_readPages (largeVA, pageCount, true);
+        largeHit += s_readPages (largeVA, pageCount, false);
+    }
+
+    INFO ("TLB benchmark (cycles/page, %u pages, large pages: %s):", pageCount,
+          kpg_getLargePageSizeBytes() ? "Yes" : "No");
+    INFO ("* 4 KB pages: after flush: %u, again: %u", (U32)(smallMiss / TLB_BENCHMARK_ROUNDS),
+          (U32)(smallHit / TLB_BENCHMARK_ROUNDS));
+    INFO ("* 4 MB page : after flush: %u, again: %u", (U32)(largeMiss / TLB_BENCHMARK_ROUNDS),
+          (U32)(largeHit / TLB_BENCHMARK_ROUNDS));
+
+    if (!kpg_unmapRange (kpg_getcurrentpd(), smallVA, pageCount, 0) ||
+        !kvmm_free (g_kstate.context, smallVA)) {
+        k_panicOnError();
+    }
+}
+
+    #ifdef GRAPHICS_MODE_ENABLED
+/* Copies the back buffer to the frame buffer, which is what kgraphis_flush does without waiting for
+ * the vertical retrace. The two buffers together are more pages than the TLB holds, so each copy
+ * misses the TLB for every 4 KB page, unless the frame buffer is mapped with large pages. */
+static void s_benchmarkFlush (void)
+{
+    const KGraphicsArea* back = (const KGraphicsArea*)&g_kstate.gx_backfb;
+    const KGraphicsArea* hw   = (const KGraphicsArea*)&g_kstate.gx_hwfb;
+    SIZE largePageBytes       = kpg_getLargePageSizeBytes();
+
+    U64 start, end;
+    x86_READ_TSC (start);
+    for (UINT i = 0; i < FLUSH_BENCHMARK_ROUNDS; i++) {
+        k_memcpy (hw->buffer, back->buffer, back->bufferSizeBytes);
+    }
+    x86_READ_TSC (end);
+
+    SIZE pageCount = BYTES_TO_PAGEFRAMES_CEILING (back->bufferSizeBytes);
+    U32 perFlush   = (U32)((end - start) / FLUSH_BENCHMARK_ROUNDS);
+    INFO ("Flush benchmark (%u pages, frame buffer over a large page: %s): %u cycles/flush, "
+          "%u cycles/page",
+          pageCount, (largePageBytes && back->bufferSizeBytes >= largePageBytes) ? "Yes" : "No",
+          perFlush, (U32)(perFlush / pageCount));
+}
+    #endif // GRAPHICS_MODE_ENABLED
+#endif // DEBUG && PORT_E9_ENABLED
+
 /***************************************************************************************************
  * Returns the number of consecutive pages from 'pa' which have the same state in PAB as the state
  * of 'pa'. The search ends when physical memory address reaches 'end'.
@@ -299,10 +412,11 @@ static SIZE s_getPhysicalBlockPageCount (Physical pa, Physical end)
 
     while (initialState == state && pa.val < end.val) {
         pa.val += CONFIG_PAGE_FRAME_SIZE_BYTES;
-        if ((state = kpmm_getPageStatus (pa)) == PMM_STATE_INVALID) {
+        szPages += 1;
+        // Page at 'end' can be outside the PMM, so its status is not read.
+        if (pa.val < end.val && (state = kpmm_getPageStatus (pa)) == PMM_STATE_INVALID) {
             k_panicOnError();
         }
-        szPages += 1;
     }
 
     return szPages;
@@ -368,14 +482,14 @@ static void s_initializeMemoryManagers(void)
     while (pa.val < paRegionEnd.val) {
         const KernelPhysicalMemoryStates state = kpmm_getPageStatus (pa);
         const PTR va                           = (PTR)HIGHER_HALF_KERNEL_TO_VA (pa);
+        const SIZE szPages                     = s_getPhysicalBlockPageCount (pa, paRegionEnd);
 
         if (state == PMM_STATE_FREE) {
-            if (kpg_unmap (pd, va) == false) {
+            if (kpg_unmapRange (pd, va, szPages, 0) == false) {
                 FATAL_BUG(); // Should not fail.
             }
-            pa.val += CONFIG_PAGE_FRAME_SIZE_BYTES;
+            pa.val += PAGEFRAMES_TO_BYTES (szPages);
         } else if (state == PMM_STATE_USED || state == PMM_STATE_RESERVED) {
-            const SIZE szPages = s_getPhysicalBlockPageCount (pa, paRegionEnd);
             if (!kvmm_memmap (g_kstate.context, va, NULL, szPages,
                               VMM_MEMMAP_FLAG_KERNEL_PAGE | VMM_MEMMAP_FLAG_COMMITTED, NULL)) {
                 FATAL_BUG(); // Should not fail.
@@ -389,13 +503,48 @@ static void s_initializeMemoryManagers(void)
     // ---------------------------------------------------------------------------------------------
     // There are certain virutal addresses that are reserved for Kernel use. These are reserved
     // here.
-    if (!kvmm_memmap (g_kstate.context, MEM_START_PAGING_EXT_TEMP_MAP, NULL, 1,
+    if (!kvmm_memmap (g_kstate.context, MEM_START_PAGING_KMAP, NULL, CONFIG_KMAP_SLOT_COUNT,
+                      VMM_MEMMAP_FLAG_KERNEL_PAGE | VMM_MEMMAP_FLAG_COMMITTED, NULL)) {
+        FATAL_BUG(); // Should not fail.
+    }
+
+    // Memory allocated before PMM was ready (PAB for example) is already mapped.
+    SIZE earlyPageCount = BYTES_TO_PAGEFRAMES_CEILING (kpmm_arch_getEarlyAllocatedBytes());
+    if (earlyPageCount > 0 &&
+        !kvmm_memmap (g_kstate.context, X86_MEM_START_KERNEL_EARLY_ALLOC, NULL, earlyPageCount,
                       VMM_MEMMAP_FLAG_KERNEL_PAGE | VMM_MEMMAP_FLAG_COMMITTED, NULL)) {
         FATAL_BUG(); // Should not fail.
     }
 
-    if (!kvmm_memmap (g_kstate.context, MEM_START_PAGING_INT_TEMP_MAP, NULL, 1,
+    // ---------------------------------------------------------------------------------------------
+    // Direct map of physical memory. It is set up in the kernel page directory before any process
+    // is created, so its page tables are in every page directory.
+    if (!kvmm_memmap (g_kstate.context, X86_MEM_START_DIRECT_MAP, NULL,
+                      BYTES_TO_PAGEFRAMES_CEILING (X86_MEM_LEN_BYTES_DIRECT_MAP),
                       VMM_MEMMAP_FLAG_KERNEL_PAGE | VMM_MEMMAP_FLAG_COMMITTED, NULL)) {
         FATAL_BUG(); // Should not fail.
     }
+
+    // Direct map starts at a 4 MByte boundary and physical address 0, so it is mapped with large
+    // pages when the processor supports them.
+    kpg_enableLargePages();
+
+    if (!kpg_setupDirectMap()) {
+        k_panicOnError();
+    }
+
+#if defined(DEBUG) && defined(PORT_E9_ENABLED)
+    // Kernel pages are not global yet, so reloading CR3 flushes all of them.
+    s_benchmarkLargePages();
+#endif // DEBUG && PORT_E9_ENABLED
+
+    // ---------------------------------------------------------------------------------------------
+    // Every page table of the kernel address space is created now, before any process is created.
+    // Page directories copy these PDEs when created, and as kernel PDEs never change after this,
+    // kernel mappings are seen by every process without syncing the page directories.
+    kpg_preallocateKernelPageTables();
+
+    // Kernel mappings are then the same in every address space, so can be global and stay in the
+    // TLB across process switches.
+    kpg_enableGlobalPages();
 }
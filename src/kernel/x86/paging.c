@@ -20,6 +20,10 @@
 #include <kdebug.h>
 #include <x86/cpu.h>
 
+// Ranges of more pages than this are flushed from the TLB by reloading CR3, instead of invalidating
+// one page at a time.
+#define PG_TLB_FLUSH_ALL_THRESHOLD_PAGES 32
+
 typedef struct IndexInfo {
     UINT pdeIndex;
     UINT pteIndex;
@@ -30,14 +34,53 @@ static IndexInfo s_getTableIndices (PTR va);
 static ArchPageDirectoryEntry* s_getPdeFromCurrentPd (UINT pdeIndex);
 static ArchPageTableEntry* s_getPteFromCurrentPd (UINT pdeIndex, UINT pteIndex);
 static void* s_getLinearAddress (UINT pdeIndex, UINT pteIndex, UINT offset);
+static void s_writePTE (ArchPageTableEntry* pte, Physical pa, PagingMapFlags flags, bool isGlobal);
 static void s_setupPTE (PTR associatedVA, ArchPageTableEntry* pte, Physical pa,
-                        PagingMapFlags flags);
+                        PagingMapFlags flags, bool isGlobal);
+static bool s_isGlobalPde (UINT pdeIndex);
+static void s_flushTLBRange (PTR vaStart, SIZE numPages);
+static bool s_isLoadedPD (PageDirectory pd);
+static bool s_isPageTableEmpty (PageTable pt);
+static bool s_createPageTable (PTR associatedVA, ArchPageDirectoryEntry* pde, PagingMapFlags flags);
 static void s_setupPDE (PTR associatedVA, ArchPageDirectoryEntry* pde, Physical pa,
                         PagingMapFlags flags);
-static void* s_temporaryMap (Physical pa, U32 pte_index);
-static void* s_internal_temporaryMap (Physical pa);
-static void s_temporaryUnmap (U32 pte_index);
-static void s_internal_temporaryUnmap(void);
+static void s_writeLargePDE (ArchPageDirectoryEntry* pde, Physical pa, PagingMapFlags flags,
+                             bool isGlobal);
+static bool s_isLargePageAllowed (UINT pdeIndex);
+static bool s_freeEmptyPageTable (ArchPageDirectoryEntry* pde);
+static bool s_removeLargePage (PTR va, ArchPageDirectoryEntry* pde, PagingOperationFlags flags);
+static void* s_temporaryMap (Physical pa);
+static void s_temporaryUnmap(void);
+static void* s_getDirectMapAddress (Physical pa);
+static UINT s_kmapFindSlot (Physical pa);
+static UINT s_kmapFindFreeSlot(void);
+static void s_kmapRecycleSlots(void);
+
+// Marks a temporary map which was given an address in the direct map, in the kmap stack.
+#define KMAP_SLOT_DIRECT_MAP CONFIG_KMAP_SLOT_COUNT
+// Returned when no slot is found.
+#define KMAP_SLOT_NONE       (CONFIG_KMAP_SLOT_COUNT + 1)
+
+static SIZE s_directMapLengthBytes = 0; // Physical memory, from address 0, in the direct map.
+
+// Every page table of the kernel address space exists and is shared by all the page directories.
+static bool s_isKernelPageTablesPreallocated = false;
+
+// Kernel address space mappings are global, so stay in the TLB when CR3 is loaded.
+static bool s_isGlobalPagesEnabled = false;
+
+// PDEs of the kernel address space can map 4 MByte pages.
+static bool s_isLargePagesEnabled = false;
+
+// Kernel PDEs are copied in a page directory of a process. They must not change after this.
+static bool s_isKernelPdeShared = false;
+
+#ifndef UNITTEST
+static KmapCache s_kmap;
+#else
+// Paging unit test provides the kmap cache, so that it can be reset between tests.
+extern KmapCache s_kmap;
+#endif
 
 #ifndef UNITTEST
 // TODO: Functions whose both declaration and its implementation are arch dependent can be named
@@ -80,8 +123,7 @@ static IndexInfo s_getTableIndices (PTR va)
     return info;
 }
 
-static void s_setupPTE (PTR associatedVA, ArchPageTableEntry* pte, Physical pa,
-                        PagingMapFlags flags)
+static void s_writePTE (ArchPageTableEntry* pte, Physical pa, PagingMapFlags flags, bool isGlobal)
 {
     k_assert (IS_ALIGNED (pa.val, CONFIG_PAGE_FRAME_SIZE_BYTES), "Wrong alignment");
 
@@ -89,16 +131,66 @@ static void s_setupPTE (PTR associatedVA, ArchPageTableEntry* pte, Physical pa,
     newPTE.pageFrame            = PHYSICAL_TO_PAGEFRAME (pa.val);
     newPTE.present              = BIT_ISUNSET (flags, PG_MAP_FLAG_NOT_PRESENT);
     newPTE.page_attribute_table = 0;
-    newPTE.global_page          = 0;
+    newPTE.global_page          = isGlobal;
     newPTE.cache_disabled       = BIT_ISUNSET (flags, PG_MAP_FLAG_CACHE_ENABLED);
     newPTE.write_through_cache  = 0;
     newPTE.write_allowed        = BIT_ISSET (flags, PG_MAP_FLAG_WRITABLE);
     newPTE.user_accessable      = BIT_ISUNSET (flags, PG_MAP_FLAG_KERNEL);
 
     k_memcpy (pte, &newPTE, sizeof (ArchPageTableEntry));
+}
+
+static void s_setupPTE (PTR associatedVA, ArchPageTableEntry* pte, Physical pa,
+                        PagingMapFlags flags, bool isGlobal)
+{
+    s_writePTE (pte, pa, flags, isGlobal);
     x86_TLB_INVAL_SINGLE (associatedVA);
 }
 
+static bool s_isGlobalPde (UINT pdeIndex)
+{
+    // Page tables of the kernel address space are shared by every page directory, except the
+    // recursive map.
+    return s_isGlobalPagesEnabled && pdeIndex >= KERNEL_PDE_INDEX &&
+           pdeIndex != RECURSIVE_PDE_INDEX;
+}
+
+static void s_flushTLBRange (PTR vaStart, SIZE numPages)
+{
+    if (numPages > PG_TLB_FLUSH_ALL_THRESHOLD_PAGES) {
+        // Reloading CR3 keeps global pages, which are in the kernel address space, the higher end.
+        PTR vaLast = vaStart + PAGEFRAMES_TO_BYTES (numPages - 1);
+        if (s_isGlobalPde (s_getTableIndices (vaLast).pdeIndex)) {
+            X86_TLB_INVAL_COMPLETE_GLOBAL();
+        } else {
+            X86_TLB_INVAL_COMPLETE();
+        }
+    } else {
+        PTR va = vaStart;
+        for (SIZE pgIndex = 0; pgIndex < numPages; pgIndex++, va += CONFIG_PAGE_FRAME_SIZE_BYTES) {
+            x86_TLB_INVAL_SINGLE (va);
+        }
+    }
+}
+
+/* Is the page directory the one in CR3. Every page directory maps itself at the recursive PDE, so it
+ * is compared with that of the current page directory. */
+static bool s_isLoadedPD (PageDirectory pd)
+{
+    return pd[RECURSIVE_PDE_INDEX].pageTableFrame ==
+           s_getPdeFromCurrentPd (RECURSIVE_PDE_INDEX)->pageTableFrame;
+}
+
+static bool s_isPageTableEmpty (PageTable pt)
+{
+    for (UINT pteIndex = 0; pteIndex < 1024; pteIndex++) {
+        if (pt[pteIndex].present) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static void s_setupPDE (PTR associatedVA, ArchPageDirectoryEntry* pde, Physical pa,
                         PagingMapFlags flags)
 {
@@ -116,71 +208,223 @@ static void s_setupPDE (PTR associatedVA, ArchPageDirectoryEntry* pde, Physical
     x86_TLB_INVAL_SINGLE (associatedVA);
 }
 
-static inline void* s_internal_temporaryMap (Physical pa)
+static void s_writeLargePDE (ArchPageDirectoryEntry* pde, Physical pa, PagingMapFlags flags,
+                             bool isGlobal)
+{
+    k_assert (IS_ALIGNED (pa.val, LARGE_PAGE_SIZE_BYTES), "Wrong alignment");
+
+    ArchPageDirectoryEntry newPDE = { 0 };
+    newPDE.pageTableFrame         = PHYSICAL_TO_PAGEFRAME (pa.val);
+    newPDE.page_size              = 1;
+    newPDE.global_page            = isGlobal;
+    newPDE.present                = BIT_ISUNSET (flags, PG_MAP_FLAG_NOT_PRESENT);
+    newPDE.user_accessable        = BIT_ISUNSET (flags, PG_MAP_FLAG_KERNEL);
+    newPDE.write_allowed          = BIT_ISSET (flags, PG_MAP_FLAG_WRITABLE);
+    newPDE.write_through_cache    = 0;
+    newPDE.cache_disabled         = BIT_ISUNSET (flags, PG_MAP_FLAG_CACHE_ENABLED);
+
+    k_memcpy (pde, &newPDE, sizeof (ArchPageDirectoryEntry));
+}
+
+static bool s_isLargePageAllowed (UINT pdeIndex)
 {
-    return s_temporaryMap (pa, TEMPORARY_PTE_INDEX_INTERNAL);
+    // Large pages are only in the kernel address space, so are never shared with or copied to a
+    // process. They are added or removed only until kernel PDEs are copied to a process.
+    return s_isLargePagesEnabled && !s_isKernelPdeShared && pdeIndex >= KERNEL_PDE_INDEX &&
+           pdeIndex != RECURSIVE_PDE_INDEX;
 }
 
-static inline void s_internal_temporaryUnmap(void)
+/* Frees the page table of a PDE which has no mapping, so that the PDE can map a large page. Returns
+ * true if the PDE is not present after this. */
+static bool s_freeEmptyPageTable (ArchPageDirectoryEntry* pde)
 {
-    s_temporaryUnmap (TEMPORARY_PTE_INDEX_INTERNAL);
+    if (!pde->present) {
+        return true;
+    }
+    if (pde->page_size) {
+        return false;
+    }
+
+    Physical ptaddr = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pde->pageTableFrame));
+    PageTable pt    = (PageTable)s_temporaryMap (ptaddr);
+    bool isEmpty    = s_isPageTableEmpty (pt);
+    s_temporaryUnmap();
+
+    if (!isEmpty || !kpmm_free (ptaddr, 1)) {
+        return false;
+    }
+    pde->present = 0;
+    return true;
+}
+
+/* Removes the mapping of a large page. Kernel page tables are preallocated, so an empty page table
+ * takes its place after that. On failure the large page stays mapped, so that a kernel PDE is never
+ * left without a page table. */
+static bool s_removeLargePage (PTR va, ArchPageDirectoryEntry* pde, PagingOperationFlags flags)
+{
+    INFO ("Removing large page at address %px", va);
+
+    Physical pa     = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pde->pageTableFrame));
+    Physical ptaddr = PHYSICAL (0);
+    if (s_isKernelPageTablesPreallocated && !kpmm_allocZeroed (&ptaddr, PMM_REGION_ANY)) {
+        return false;
+    }
+
+    if (BIT_ISSET (flags, PG_UNMAP_FLAG_FREE_FRAMES) && !kpmm_free (pa, LARGE_PAGE_PAGE_COUNT)) {
+        if (s_isKernelPageTablesPreallocated && !kpmm_free (ptaddr, 1)) {
+            k_panicOnError(); // Should not fail. Page frame was just allocated.
+        }
+        return false;
+    }
+
+    if (s_isKernelPageTablesPreallocated) {
+        s_setupPDE (va, pde, ptaddr,
+                    PG_MAP_FLAG_KERNEL | PG_MAP_FLAG_WRITABLE | PG_MAP_FLAG_CACHE_ENABLED);
+    } else {
+        pde->present = 0;
+    }
+    return true;
+}
+
+static bool s_createPageTable (PTR associatedVA, ArchPageDirectoryEntry* pde, PagingMapFlags flags)
+{
+    INFO ("Creating new page table for address %px", associatedVA);
+
+    // A new kernel page table would only be in this page directory. Others would not see it.
+    k_assert (!s_isKernelPageTablesPreallocated ||
+                  s_getTableIndices (associatedVA).pdeIndex < KERNEL_PDE_INDEX,
+              "Kernel page table missing");
+
+    // Allocate phy mem for new page table. It is already zeroed, so has no entry present.
+    Physical pa_new;
+    if (kpmm_allocZeroed (&pa_new, PMM_REGION_ANY) == false) {
+        return false;
+    }
+
+    // Reference the page table in the PDE.
+    s_setupPDE (associatedVA, pde, pa_new, flags);
+    return true;
+}
+
+static void* s_getDirectMapAddress (Physical pa)
+{
+    if (pa.val >= s_directMapLengthBytes) {
+        return NULL;
+    }
+    return (void*)(DIRECT_MAP_START + (PTR)pa.val);
+}
+
+static UINT s_kmapFindSlot (Physical pa)
+{
+    for (UINT slot = 0; slot < CONFIG_KMAP_SLOT_COUNT; slot++) {
+        if (s_kmap.slots[slot].isMapped && s_kmap.slots[slot].pa.val == pa.val) {
+            return slot;
+        }
+    }
+    return KMAP_SLOT_NONE;
+}
+
+static UINT s_kmapFindFreeSlot(void)
+{
+    for (UINT slot = 0; slot < CONFIG_KMAP_SLOT_COUNT; slot++) {
+        if (!s_kmap.slots[slot].isMapped) {
+            return slot;
+        }
+    }
+    return KMAP_SLOT_NONE;
+}
+
+static void s_kmapRecycleSlots(void)
+{
+    INFO ("Recycling kmap slots");
+
+    // PTEs of every slot not in use are removed, and the TLB is flushed once for all of them.
+    for (UINT slot = 0; slot < CONFIG_KMAP_SLOT_COUNT; slot++) {
+        KmapSlot* kslot = &s_kmap.slots[slot];
+        if (kslot->isMapped && kslot->pinCount == 0) {
+            s_getPteFromCurrentPd (KERNEL_PDE_INDEX, KMAP_FIRST_PTE_INDEX + slot)->present = 0;
+            kslot->isMapped = false;
+        }
+    }
+    s_flushTLBRange ((PTR)s_getLinearAddress (KERNEL_PDE_INDEX, KMAP_FIRST_PTE_INDEX, 0),
+                     CONFIG_KMAP_SLOT_COUNT);
 }
 
 /***************************************************************************************************
- * Associates mapping between a physical page and fixed virtual page using the page directory of the
- * current process. The fixed virtual page is determined by the PTE index passed in.
+ * Temporarily maps a physical page in the kernel address space, so it is available in every
+ * process. Temporary maps can be nested, but must be removed in the reverse order.
+ *
+ * Physical pages in the direct map are not mapped again, their address in the direct map is
+ * returned. Other pages are mapped in one of the kmap slots. The PTE of a slot stays after its last
+ * temporary map is removed, so mapping the same page again needs no PTE change. When no slot is
+ * free, every slot not in use is recycled with one TLB flush.
  *
  * @Input  pa        Physical page which will be mapped. Must be page aligned.
- * @Input  pte_index Physical page will be mapped within KERNEL_PDE_INDEX at this PTE index.
- * @return           True if mapping was successful, false otherwise. Error number is set.
- * @error            Kernel panic  - When temporary map already exists (to some physical page)
+ * @return           Virtual address of the page if successful, NULL otherwise. Error number is set.
+ * @error            Kernel panic  - When temporary maps are nested too deep.
  *                   ERR_WRONG_ALIGNMENT - Input is not page aligned.
  **************************************************************************************************/
-static void* s_temporaryMap (Physical pa, U32 pte_index)
+static void* s_temporaryMap (Physical pa)
 {
-    // TODO: As KERNEL_PDE will always be present, recursive mapping is not really required. That is
-    // to say the address of the PTE used for temporary mapping is constant.
     if (!IS_ALIGNED (pa.val, CONFIG_PAGE_FRAME_SIZE_BYTES)) {
         RETURN_ERROR (ERR_WRONG_ALIGNMENT, NULL);
     }
 
-    void* temporaryAddress  = s_getLinearAddress (KERNEL_PDE_INDEX, pte_index, 0);
-    ArchPageTableEntry* pte = s_getPteFromCurrentPd (KERNEL_PDE_INDEX, pte_index);
-    if (pte->present) {
-        k_panic ("Temporary mapping already present");
+    if (s_kmap.depth == ARRAY_LENGTH (s_kmap.stack)) {
+        k_panic ("Temporary maps nested too deep");
     }
 
-    s_setupPTE ((PTR)temporaryAddress, pte, pa,
-                PG_MAP_FLAG_KERNEL | PG_MAP_FLAG_WRITABLE | PG_MAP_FLAG_CACHE_ENABLED);
+    void* directAddress = s_getDirectMapAddress (pa);
+    if (directAddress != NULL) {
+        s_kmap.stack[s_kmap.depth++] = KMAP_SLOT_DIRECT_MAP;
+        return directAddress;
+    }
+
+    UINT slot = s_kmapFindSlot (pa);
+    if (slot == KMAP_SLOT_NONE) {
+        if ((slot = s_kmapFindFreeSlot()) == KMAP_SLOT_NONE) {
+            s_kmapRecycleSlots();
+            slot = s_kmapFindFreeSlot();
+        }
+        // Every slot in use has an entry in the stack, and the stack is not full.
+        k_assert (slot != KMAP_SLOT_NONE, "No free kmap slot");
+
+        // PTE of a free slot is not present, so there is no TLB entry to invalidate. Slots are not
+        // global, so reloading CR3 flushes them as well.
+        ArchPageTableEntry* pte = s_getPteFromCurrentPd (KERNEL_PDE_INDEX,
+                                                         KMAP_FIRST_PTE_INDEX + slot);
+        s_writePTE (pte, pa, PG_MAP_FLAG_KERNEL | PG_MAP_FLAG_WRITABLE | PG_MAP_FLAG_CACHE_ENABLED,
+                    false);
+        s_kmap.slots[slot].pa       = pa;
+        s_kmap.slots[slot].isMapped = true;
+    }
 
-    return temporaryAddress;
+    s_kmap.slots[slot].pinCount++;
+    s_kmap.stack[s_kmap.depth++] = slot;
+    return s_getLinearAddress (KERNEL_PDE_INDEX, KMAP_FIRST_PTE_INDEX + slot, 0);
 }
 
 /***************************************************************************************************
- * Disassociates mapping between a physical page and the fixed virtual page used for temporary
- * mapping. The fixed virtual page is determined by the PTE index passed in.
+ * Removes the latest temporary map. Its kmap slot keeps the PTE until the slot is recycled.
  *
- * @Input  pte_index Mapping which exists at KERNEL_PDE_INDEX and the provided PTE index is removed.
- * @error            Kernel panic  - When temporary map does not exist.
+ * @return           Nothing
+ * @error            Kernel panic  - When there is no temporary map.
  **************************************************************************************************/
-static void s_temporaryUnmap (U32 pte_index)
+static void s_temporaryUnmap(void)
 {
-    // TODO: As KERNEL_PDE will always be present and same across every process, recursive mapping
-    // is not really required. That is to say the address of the PTE used for temporary mapping is
-    // constant.
-    ArchPageTableEntry* pte = s_getPteFromCurrentPd (KERNEL_PDE_INDEX, pte_index);
-    if (!pte->present) {
+    if (s_kmap.depth == 0) {
         k_panic ("Temporary mapping not present");
     }
 
-    pte->present = 0;
-
-    x86_TLB_INVAL_SINGLE (s_getLinearAddress (KERNEL_PDE_INDEX, pte_index, 0));
+    UINT slot = s_kmap.stack[--s_kmap.depth];
+    if (slot != KMAP_SLOT_DIRECT_MAP) {
+        k_assert (s_kmap.slots[slot].pinCount > 0, "Kmap slot not in use");
+        s_kmap.slots[slot].pinCount--;
+    }
 }
 
 /***************************************************************************************************
- * Disassociates mapping between a physical page and the fixed virtual page used for temporary
- * mapping.
+ * Removes the latest temporary map.
  *
  * @return          Nothing
  * @error           See internal implementation.
@@ -188,23 +432,254 @@ static void s_temporaryUnmap (U32 pte_index)
 void kpg_temporaryUnmap(void)
 {
     FUNC_ENTRY();
-    s_temporaryUnmap (TEMPORARY_PTE_INDEX_EXTERN);
+    s_temporaryUnmap();
 }
 
 /***************************************************************************************************
- * Associates mapping between a physical page and fixed virtual page using the page directory of the
- * current process. If the fixed virtual page is in the kernel address space, it will be available
- * in every process so care must be taken when using temporary mapped addresses.
+ * Temporarily maps a physical page in the kernel address space. It will be available in every
+ * process so care must be taken when using temporary mapped addresses. Temporary maps can be
+ * nested, but must be removed in the reverse order.
  *
  * @Input   pa      Physical page which will be mapped. Must be page aligned.
- * @return          True if mapping was successful, false otherwise. Error number is set.
+ * @return          Virtual address if mapping was successful, NULL otherwise. Error number is set.
  * @error           See internal implementation.
  **************************************************************************************************/
 void* kpg_temporaryMap (Physical pa)
 {
     FUNC_ENTRY ("Physical address: %px", pa.val);
 
-    return s_temporaryMap (pa, TEMPORARY_PTE_INDEX_EXTERN);
+    return s_temporaryMap (pa);
+}
+
+/***************************************************************************************************
+ * Fills a physical page with zeros. It can be called while a temporary map returned by
+ * kpg_temporaryMap is in use.
+ *
+ * @Input   pa      Physical page to zero. Must be page aligned.
+ * @return          True if successful, false otherwise. Error number is set.
+ * @error           ERR_WRONG_ALIGNMENT - Input is not page aligned.
+ **************************************************************************************************/
+bool kpg_zeroPageFrame (Physical pa)
+{
+    FUNC_ENTRY ("Physical address: %px", pa.val);
+
+    void* tempva = s_temporaryMap (pa);
+    if (tempva == NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+
+    k_memset (tempva, 0, CONFIG_PAGE_FRAME_SIZE_BYTES);
+    s_temporaryUnmap();
+    return true;
+}
+
+/***************************************************************************************************
+ * Copies the contents of a physical page to another one. It can be called while a temporary map
+ * returned by kpg_temporaryMap is in use.
+ *
+ * @Input   dest    Physical page which is written. Must be page aligned.
+ * @Input   src     Physical page which is read. Must be page aligned.
+ * @return          True if successful, false otherwise. Error number is set.
+ * @error           ERR_WRONG_ALIGNMENT - Input is not page aligned.
+ **************************************************************************************************/
+bool kpg_copyPageFrame (Physical dest, Physical src)
+{
+    FUNC_ENTRY ("Destination: %px, source: %px", dest.val, src.val);
+
+    void* srcva = s_temporaryMap (src);
+    if (srcva == NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+
+    void* destva = s_temporaryMap (dest);
+    if (destva == NULL) {
+        s_temporaryUnmap();
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+
+    k_memcpy (destva, srcva, CONFIG_PAGE_FRAME_SIZE_BYTES);
+    s_temporaryUnmap();
+    s_temporaryUnmap();
+    return true;
+}
+
+/***************************************************************************************************
+ * Maps physical memory, from address 0, at a fixed virtual address in the current page directory.
+ * After this, temporary maps of physical pages within the direct map need no PTE change or TLB
+ * flush. Physical memory beyond the direct map window is still reached with temporary maps. Large
+ * pages are used, if turned on.
+ *
+ * Must be called with the kernel page directory, before any process is created, so that every page
+ * directory gets the page tables of the direct map.
+ *
+ * @return          True if successful, false otherwise. Error number is set.
+ * @error           See kpg_mapContinous.
+ **************************************************************************************************/
+bool kpg_setupDirectMap (void)
+{
+    FUNC_ENTRY();
+
+    k_assert (s_directMapLengthBytes == 0, "Direct map is already set up");
+
+    SIZE lengthBytes = (SIZE)MIN (kpmm_getUsableMemorySize (PMM_REGION_ANY),
+                                  (USYSINT)DIRECT_MAP_LEN_BYTES);
+    SIZE numPages    = BYTES_TO_PAGEFRAMES_FLOOR (lengthBytes);
+    if (numPages == 0) {
+        return true; // Nothing to map.
+    }
+
+    if (!kpg_mapContinous (kpg_getcurrentpd(), DIRECT_MAP_START, createPhysical (0), numPages,
+                           PG_MAP_FLAG_KERNEL | PG_MAP_FLAG_WRITABLE | PG_MAP_FLAG_CACHE_ENABLED |
+                               PG_MAP_FLAG_LARGE_PAGES)) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+
+    s_directMapLengthBytes = PAGEFRAMES_TO_BYTES (numPages);
+    INFO ("Direct map: VA %px -> PA 0 to %px", DIRECT_MAP_START, s_directMapLengthBytes - 1);
+    return true;
+}
+
+/***************************************************************************************************
+ * Creates every missing page table of the kernel address space in the current page directory.
+ * Page directories get these page tables when created, so later kernel mappings are seen in every
+ * address space without copying kernel PDEs into them.
+ *
+ * Must be called with the kernel page directory, before any process is created.
+ *
+ * @return          Nothing
+ * @error           Kernel panic - When there is no memory for a page table.
+ **************************************************************************************************/
+void kpg_preallocateKernelPageTables (void)
+{
+    FUNC_ENTRY();
+
+    k_assert (!s_isKernelPageTablesPreallocated, "Kernel page tables are already preallocated");
+
+    UINT created = 0;
+    for (UINT pdeIndex = KERNEL_PDE_INDEX; pdeIndex < RECURSIVE_PDE_INDEX; pdeIndex++) {
+        ArchPageDirectoryEntry* pde = s_getPdeFromCurrentPd (pdeIndex);
+        if (pde->present) {
+            continue;
+        }
+
+        if (!s_createPageTable ((PTR)s_getLinearAddress (pdeIndex, 0, 0), pde,
+                                PG_MAP_FLAG_KERNEL | PG_MAP_FLAG_WRITABLE |
+                                    PG_MAP_FLAG_CACHE_ENABLED)) {
+            k_panic ("Memory allocation failed");
+        }
+        created++;
+    }
+
+    s_isKernelPageTablesPreallocated = true;
+    INFO ("Kernel page tables preallocated: %u", created);
+}
+
+/***************************************************************************************************
+ * Turns on global pages, if the processor supports them. Mappings of the kernel address space, old
+ * and new, are then global, so their TLB entries are kept when switching address spaces. Kmap slots
+ * are not global.
+ *
+ * Must be called after kpg_preallocateKernelPageTables, as a global page must be the same in every
+ * address space.
+ *
+ * @return          True if global pages are turned on, false if the processor does not support
+ *                  them.
+ **************************************************************************************************/
+bool kpg_enableGlobalPages (void)
+{
+    FUNC_ENTRY();
+
+    k_assert (s_isKernelPageTablesPreallocated, "Kernel page tables are not preallocated");
+
+    if (!X86_IS_GLOBAL_PAGES_SUPPORTED()) {
+        INFO ("Global pages are not supported");
+        return false;
+    }
+
+    X86_ENABLE_GLOBAL_PAGES();
+    s_isGlobalPagesEnabled = true;
+
+    // Existing mappings are made global. TLB entries cached before this are not global, which is
+    // harmless, they are only flushed once more.
+    for (UINT pdeIndex = KERNEL_PDE_INDEX; pdeIndex < RECURSIVE_PDE_INDEX; pdeIndex++) {
+        ArchPageDirectoryEntry* pde = s_getPdeFromCurrentPd (pdeIndex);
+        if (!pde->present) {
+            continue;
+        }
+
+        // Large page has no page table, the PDE itself is made global.
+        if (pde->page_size) {
+            pde->global_page = 1;
+            continue;
+        }
+
+        for (UINT pteIndex = 0; pteIndex < 1024; pteIndex++) {
+            bool isKmapSlot = pdeIndex == KERNEL_PDE_INDEX && pteIndex >= KMAP_FIRST_PTE_INDEX &&
+                              pteIndex < KMAP_FIRST_PTE_INDEX + CONFIG_KMAP_SLOT_COUNT;
+            ArchPageTableEntry* pte = s_getPteFromCurrentPd (pdeIndex, pteIndex);
+            if (pte->present && !isKmapSlot) {
+                pte->global_page = 1;
+            }
+        }
+    }
+
+    INFO ("Global pages enabled");
+    return true;
+}
+
+/***************************************************************************************************
+ * Turns on 4 MByte pages (large pages), if the processor supports them. Then kpg_mapContinous maps
+ * ranges of the kernel address space, given with PG_MAP_FLAG_LARGE_PAGES, with a PDE per 4 MByte
+ * where both virtual and physical addresses are aligned to a large page, instead of a page table.
+ *
+ * Must be called with the kernel page directory, before any process is created. Kernel PDEs cannot
+ * change once copied to a process, so large pages are mapped or removed only till then.
+ *
+ * @return          True if large pages are turned on, false if the processor does not support
+ *                  them.
+ **************************************************************************************************/
+bool kpg_enableLargePages (void)
+{
+    FUNC_ENTRY();
+
+    k_assert (!s_isKernelPdeShared, "Kernel PDEs are already copied to a process");
+
+    if (!X86_IS_LARGE_PAGES_SUPPORTED()) {
+        INFO ("Large pages are not supported");
+        return false;
+    }
+
+    X86_ENABLE_LARGE_PAGES();
+    s_isLargePagesEnabled = true;
+
+    INFO ("Large pages enabled");
+    return true;
+}
+
+/***************************************************************************************************
+ * Gets the size of a large page, if new mappings of the kernel address space can use them.
+ *
+ * @return          Size of a large page in bytes. 0 if large pages are off, or can no longer be
+ *                  mapped.
+ **************************************************************************************************/
+SIZE kpg_getLargePageSizeBytes (void)
+{
+    FUNC_ENTRY();
+
+    return (s_isLargePagesEnabled && !s_isKernelPdeShared) ? LARGE_PAGE_SIZE_BYTES : 0;
+}
+
+/***************************************************************************************************
+ * Gets the address of a physical address in the direct map.
+ *
+ * @Input   pa      Physical address. Need not be page aligned.
+ * @return          Virtual address in the direct map. NULL if the physical address is not in it.
+ **************************************************************************************************/
+void* kpg_getDirectMapAddress (Physical pa)
+{
+    FUNC_ENTRY ("Physical address: %px", pa.val);
+
+    return s_getDirectMapAddress (pa);
 }
 
 /***************************************************************************************************
@@ -247,6 +722,85 @@ bool kpg_unmapContinous (PageDirectory pd, PTR vaStart, SIZE numPages)
     return true;
 }
 
+/***************************************************************************************************
+ * Removes the mappings of a range of virtual pages. Pages which are not mapped are skipped. Each
+ * page table of the range is temporarily mapped only once and the TLB is flushed once at the end.
+ * Page tables left with no mapping are freed, except those of the kernel address space, which are
+ * shared by every page directory. A large page is removed only as a whole.
+ *
+ * @Input   pd        Page directory which contains the virtual addresses.
+ * @Input   vaStart   Start of the virtual address range. Must be page aligned.
+ * @Input   numPages  Number of pages in the range.
+ * @Input   flags     PG_UNMAP_FLAG_FREE_FRAMES - Physical pages which were mapped are freed.
+ * @return            True if successful, false otherwise. Error number is set.
+ * @error             ERR_WRONG_ALIGNMENT - Virtual address is not page aligned.
+ *                    ERR_INVALID_RANGE   - Range has a part of a large page, or a large page which
+ *                                          can no longer be removed. Pages before it are unmapped.
+ **************************************************************************************************/
+bool kpg_unmapRange (PageDirectory pd, PTR vaStart, SIZE numPages, PagingOperationFlags flags)
+{
+    FUNC_ENTRY ("PD: %px, VA Start: %px, num Pages: %x, flags: %x", pd, vaStart, numPages, flags);
+
+    k_assert (pd != NULL, "Page Directory is null.");
+
+    if (!IS_ALIGNED (vaStart, CONFIG_PAGE_FRAME_SIZE_BYTES)) {
+        RETURN_ERROR (ERR_WRONG_ALIGNMENT, false);
+    }
+
+    bool success     = true;
+    bool isWrongPart = false;
+    SIZE done        = 0;
+    PTR va           = vaStart;
+    while (done < numPages && success && !isWrongPart) {
+        IndexInfo info              = s_getTableIndices (va);
+        ArchPageDirectoryEntry* pde = &pd[info.pdeIndex];
+        SIZE count                  = MIN (numPages - done, 1024U - info.pteIndex);
+
+        if (pde->present && pde->page_size) {
+            if ((isWrongPart = count != LARGE_PAGE_PAGE_COUNT ||
+                               !s_isLargePageAllowed (info.pdeIndex))) {
+                break;
+            }
+            success = s_removeLargePage (va, pde, flags);
+        } else if (pde->present) {
+            Physical ptaddr = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pde->pageTableFrame));
+            PageTable pt    = (PageTable)s_temporaryMap (ptaddr);
+            for (UINT pteIndex = info.pteIndex; pteIndex < info.pteIndex + count && success;
+                 pteIndex++) {
+                if (pt[pteIndex].present) {
+                    pt[pteIndex].present = 0;
+                    if (BIT_ISSET (flags, PG_UNMAP_FLAG_FREE_FRAMES)) {
+                        Physical pa = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pt[pteIndex].pageFrame));
+                        success     = kpmm_free (pa, 1);
+                    }
+                }
+            }
+            bool isEmpty = success && info.pdeIndex < KERNEL_PDE_INDEX && s_isPageTableEmpty (pt);
+            s_temporaryUnmap();
+
+            if (isEmpty) {
+                INFO ("Freeing page table for address %px", va);
+                pde->present = 0;
+                success      = kpmm_free (ptaddr, 1);
+            }
+        }
+
+        done += count;
+        va += PAGEFRAMES_TO_BYTES (count);
+    }
+
+    // Mappings removed before a failure must not remain in the TLB.
+    s_flushTLBRange (vaStart, done);
+
+    if (isWrongPart) {
+        RETURN_ERROR (ERR_INVALID_RANGE, false);
+    }
+    if (!success) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+    return true;
+}
+
 /***************************************************************************************************
  * Disassociates mapping between a physical page and virtual page. It does not deallocate paging
  * structures that were allocated for this mapping to work.
@@ -256,6 +810,7 @@ bool kpg_unmapContinous (PageDirectory pd, PTR vaStart, SIZE numPages)
  * @return          True if unmapping was successful, false otherwise. Error number is set.
  * @error           ERR_DOUBLE_FREE  - Virtual address is already not present.
  *                  ERR_WRONG_ALIGNMENT - Input is not page aligned.
+ *                  ERR_INVALID_RANGE   - Virtual address is in a large page.
  **************************************************************************************************/
 bool kpg_unmap (PageDirectory pd, PTR va)
 {
@@ -273,12 +828,16 @@ bool kpg_unmap (PageDirectory pd, PTR va)
         RETURN_ERROR (ERR_DOUBLE_FREE, false); // Page table is already unmapped.
     }
 
+    if (pde->page_size) {
+        RETURN_ERROR (ERR_INVALID_RANGE, false); // Large page is only removed as a whole.
+    }
+
     Physical pt_phyaddr     = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pde->pageTableFrame));
-    PageTable pt            = (PageTable)s_internal_temporaryMap (pt_phyaddr);
+    PageTable pt            = (PageTable)s_temporaryMap (pt_phyaddr);
     ArchPageTableEntry* pte = &pt[info.pteIndex];
 
     if (!pte->present) {
-        s_internal_temporaryUnmap();
+        s_temporaryUnmap();
         // Panic or assert may not be the right decision here. At this time I want the caller to
         // take action. The caller will be at a better position to take decision.
         RETURN_ERROR (ERR_DOUBLE_FREE, false);
@@ -287,14 +846,17 @@ bool kpg_unmap (PageDirectory pd, PTR va)
     pte->present = false;
     x86_TLB_INVAL_SINGLE (va); // This PTE effects virtual address VA. Thus flushing va.
 
-    s_internal_temporaryUnmap();
+    s_temporaryUnmap();
 
     return true;
 }
 
 /***************************************************************************************************
  * Associates multiple physical pages with virtual ones. It will create necessary paging structures
- * if it does not exist for the mapping to work.
+ * if it does not exist for the mapping to work. Each page table of the range is temporarily mapped
+ * only once and the TLB is flushed once at the end. With PG_MAP_FLAG_LARGE_PAGES, if large pages
+ * are allowed, each 4 MByte of the range where both addresses are aligned to a large page is
+ * mapped by a PDE instead.
  *
  * @Input   pd        Page directory which will contain this virtual address.
  * @Input   vaStart   Virtual address which will map to the physical address. Must be page aligned.
@@ -303,6 +865,9 @@ bool kpg_unmap (PageDirectory pd, PTR va)
  * @Input   flags     PDE/PTE flags to be used for the mapping. PG_MAP_FLAG_* items.
  * @return            True if mapping was successful, false otherwise. Error number is set.
  * @error             ERR_INVALID_ARGUMENT - Number of pages is zero which is invalid.
+ *                    ERR_WRONG_ALIGNMENT  - Inputs are not page aligned.
+ *                    ERR_DOUBLE_ALLOC     - A virtual address is already present. Pages before it
+ *                                           remain mapped.
  **************************************************************************************************/
 bool kpg_mapContinous (PageDirectory pd, PTR vaStart, Physical paStart, SIZE numPages,
                        PagingMapFlags flags)
@@ -310,17 +875,64 @@ bool kpg_mapContinous (PageDirectory pd, PTR vaStart, Physical paStart, SIZE num
     FUNC_ENTRY ("PD: %px, VA Start: %px, PA Start: %px, num Pages: %x, flags: %x", pd, vaStart,
                 paStart.val, numPages, flags);
 
+    k_assert (pd != NULL, "Page Directory is null.");
+
     if (numPages == 0) {
         RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
     }
 
-    Physical pa = paStart;
-    PTR va      = vaStart;
-    for (SIZE pgIndex = 0; pgIndex < numPages;
-         pgIndex++, pa.val += CONFIG_PAGE_FRAME_SIZE_BYTES, va += CONFIG_PAGE_FRAME_SIZE_BYTES) {
-        if (!kpg_map (pd, va, pa, flags)) {
-            RETURN_ERROR (ERROR_PASSTHROUGH, false); // Map failed
+    if (!IS_ALIGNED (vaStart, CONFIG_PAGE_FRAME_SIZE_BYTES) ||
+        !IS_ALIGNED (paStart.val, CONFIG_PAGE_FRAME_SIZE_BYTES)) {
+        RETURN_ERROR (ERR_WRONG_ALIGNMENT, false);
+    }
+
+    Physical pa          = paStart;
+    PTR va               = vaStart;
+    SIZE mapped          = 0;
+    bool isAlreadyMapped = false;
+    while (mapped < numPages && !isAlreadyMapped) {
+        IndexInfo info              = s_getTableIndices (va);
+        ArchPageDirectoryEntry* pde = &pd[info.pdeIndex];
+        bool isGlobal               = s_isGlobalPde (info.pdeIndex);
+
+        // A page table with no mapping, preallocated for example, is replaced by the large page.
+        if (BIT_ISSET (flags, PG_MAP_FLAG_LARGE_PAGES) && s_isLargePageAllowed (info.pdeIndex) &&
+            numPages - mapped >= LARGE_PAGE_PAGE_COUNT &&
+            IS_ALIGNED (va, LARGE_PAGE_SIZE_BYTES) && IS_ALIGNED (pa.val, LARGE_PAGE_SIZE_BYTES) &&
+            s_freeEmptyPageTable (pde)) {
+            s_writeLargePDE (pde, pa, flags, isGlobal);
+            mapped += LARGE_PAGE_PAGE_COUNT;
+            va += LARGE_PAGE_SIZE_BYTES;
+            pa.val += LARGE_PAGE_SIZE_BYTES;
+            continue;
+        }
+
+        if ((isAlreadyMapped = pde->present && pde->page_size)) {
+            break;
         }
+
+        if (!pde->present && !s_createPageTable (va, pde, flags)) {
+            k_panic ("Memory allocation failed");
+        }
+
+        Physical ptaddr = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pde->pageTableFrame));
+        PageTable pt    = (PageTable)s_temporaryMap (ptaddr);
+        for (UINT pteIndex = info.pteIndex; pteIndex < 1024 && mapped < numPages; pteIndex++) {
+            if ((isAlreadyMapped = pt[pteIndex].present)) {
+                break;
+            }
+            s_writePTE (&pt[pteIndex], pa, flags, isGlobal);
+            mapped++;
+            va += CONFIG_PAGE_FRAME_SIZE_BYTES;
+            pa.val += CONFIG_PAGE_FRAME_SIZE_BYTES;
+        }
+        s_temporaryUnmap();
+    }
+
+    s_flushTLBRange (vaStart, mapped);
+
+    if (isAlreadyMapped) {
+        RETURN_ERROR (ERR_DOUBLE_ALLOC, false);
     }
     return true;
 }
@@ -350,36 +962,223 @@ bool kpg_map (PageDirectory pd, PTR va, Physical pa, PagingMapFlags flags)
 
     IndexInfo info              = s_getTableIndices (va);
     ArchPageDirectoryEntry* pde = &pd[info.pdeIndex];
-    if (!pde->present) {
-        INFO ("Creating new page table for address %px", va);
+    if (pde->present && pde->page_size) {
+        RETURN_ERROR (ERR_DOUBLE_ALLOC, false); // Large page maps it already.
+    }
+
+    if (!pde->present && !s_createPageTable (va, pde, flags)) {
+        k_panic ("Memory allocation failed");
+    }
+
+    // In order to access the page table a temporary mapping is required.
+    Physical ptaddr         = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pde->pageTableFrame));
+    PageTable tempva        = (PageTable)s_temporaryMap (ptaddr);
+    ArchPageTableEntry* pte = &tempva[info.pteIndex];
+
+    if (pte->present) {
+        s_temporaryUnmap();
+        RETURN_ERROR (ERR_DOUBLE_ALLOC, false);
+    }
 
-        // Allocate phy mem for new page table.
-        Physical pa_new;
-        if (kpmm_alloc (&pa_new, 1, PMM_REGION_ANY) == false) {
+    s_setupPTE (va, pte, pa, flags, s_isGlobalPde (info.pdeIndex));
+    s_temporaryUnmap();
+    return true;
+}
+
+/***************************************************************************************************
+ * Maps the given page frames, in order, to those virtual pages of a range which are not already
+ * mapped. Mapped pages, including those of large pages, are skipped. It stops when either the range
+ * ends or the page frames run out. Each page table of the range is temporarily mapped only once.
+ *
+ * @Input   pd          Page directory which will contain the virtual addresses.
+ * @Input   vaStart     Start of the virtual address range. Must be page aligned.
+ * @Input   numPages    Number of virtual pages in the range.
+ * @Input   frames      Page frames to map. Must be page aligned.
+ * @Input   frameCount  Number of page frames in 'frames'.
+ * @Input   flags       PDE/PTE flags to be used for the mapping. PG_MAP_FLAG_* items.
+ * @Output  framesUsed  Number of page frames which were mapped, these are from the start of
+ *                      'frames'.
+ * @return              True if successful, false otherwise. Error number is set.
+ * @error               ERR_WRONG_ALIGNMENT - Virtual address is not page aligned.
+ **************************************************************************************************/
+bool kpg_mapUnmappedPages (PageDirectory pd, PTR vaStart, SIZE numPages,
+                           Physical const* const frames, SIZE frameCount, PagingMapFlags flags,
+                           SIZE* const framesUsed)
+{
+    FUNC_ENTRY ("PD: %px, VA Start: %px, num Pages: %x, frames: %px, frame count: %x, flags: %x",
+                pd, vaStart, numPages, frames, frameCount, flags);
+
+    k_assert (pd != NULL, "Page Directory is null.");
+    k_assert (framesUsed != NULL, "Invalid input");
+
+    if (!IS_ALIGNED (vaStart, CONFIG_PAGE_FRAME_SIZE_BYTES)) {
+        RETURN_ERROR (ERR_WRONG_ALIGNMENT, false);
+    }
+
+    SIZE used = 0;
+    PTR va    = vaStart;
+    PTR vaEnd = vaStart + PAGEFRAMES_TO_BYTES (numPages);
+    while (va < vaEnd && used < frameCount) {
+        IndexInfo info              = s_getTableIndices (va);
+        ArchPageDirectoryEntry* pde = &pd[info.pdeIndex];
+        if (pde->present && pde->page_size) {
+            va = MIN (va + PAGEFRAMES_TO_BYTES (1024U - info.pteIndex), vaEnd);
+            continue;
+        }
+
+        if (!pde->present && !s_createPageTable (va, pde, flags)) {
             k_panic ("Memory allocation failed");
         }
 
-        // Initialize the page table.
-        void* tempva = s_internal_temporaryMap (pa_new);
-        k_memset (tempva, 0, CONFIG_PAGE_FRAME_SIZE_BYTES);
-        s_internal_temporaryUnmap();
+        bool isGlobal   = s_isGlobalPde (info.pdeIndex);
+        Physical ptaddr = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pde->pageTableFrame));
+        PageTable pt    = (PageTable)s_temporaryMap (ptaddr);
+        for (UINT pteIndex = info.pteIndex; pteIndex < 1024 && va < vaEnd && used < frameCount;
+             pteIndex++, va += CONFIG_PAGE_FRAME_SIZE_BYTES) {
+            if (!pt[pteIndex].present) {
+                s_writePTE (&pt[pteIndex], frames[used++], flags, isGlobal);
+            }
+        }
+        s_temporaryUnmap();
+    }
+
+    s_flushTLBRange (vaStart, BYTES_TO_PAGEFRAMES_FLOOR (va - vaStart));
+
+    *framesUsed = used;
+    return true;
+}
 
-        // Reference the page table in the PDE.
-        s_setupPDE (va, pde, pa_new, flags);
+/***************************************************************************************************
+ * Maps the page frames of a range in the source page directory at the same virtual addresses in the
+ * destination one. Pages are made read-only in both, so that the first write to either copy causes
+ * a page fault. Each page frame gets one more owner in the PMM. Pages which are not mapped in the
+ * source are skipped. Each page table of the range is temporarily mapped only once.
+ * Source is expected to be the loaded page directory (as when a process creates another one), then
+ * only the range is flushed from the TLB. For any other source the whole TLB is flushed.
+ *
+ * @Input   srcPD       Page directory which has the mappings.
+ * @Input   destPD      Page directory which gets the mappings. Range must not be mapped here.
+ * @Input   vaStart     Start of the virtual address range. Must be page aligned.
+ * @Input   numPages    Number of pages in the range.
+ * @Input   flags       PDE/PTE flags to be used for the mapping. PG_MAP_FLAG_WRITABLE is ignored for
+ *                      the PTEs.
+ * @return              True if successful, false otherwise. Error number is set. Pages before the
+ *                      failure remain mapped in both.
+ * @error               ERR_WRONG_ALIGNMENT - Virtual address is not page aligned.
+ *                      ERR_DOUBLE_ALLOC    - A virtual address is already mapped in destination.
+ *                      ERR_OVERFLOW        - A page frame has too many owners.
+ **************************************************************************************************/
+bool kpg_shareMappings (PageDirectory srcPD, PageDirectory destPD, PTR vaStart, SIZE numPages,
+                        PagingMapFlags flags)
+{
+    FUNC_ENTRY ("Source PD: %px, destination PD: %px, VA Start: %px, num Pages: %x, flags: %x",
+                srcPD, destPD, vaStart, numPages, flags);
+
+    k_assert (srcPD != NULL && destPD != NULL, "Page Directory is null.");
+
+    if (!IS_ALIGNED (vaStart, CONFIG_PAGE_FRAME_SIZE_BYTES)) {
+        RETURN_ERROR (ERR_WRONG_ALIGNMENT, false);
+    }
+
+    PagingMapFlags pteFlags = flags & ~(UINT)PG_MAP_FLAG_WRITABLE;
+    bool success            = true;
+    bool isAlreadyMapped    = false;
+    SIZE done               = 0;
+    PTR va                  = vaStart;
+    while (done < numPages && success && !isAlreadyMapped) {
+        IndexInfo info                  = s_getTableIndices (va);
+        ArchPageDirectoryEntry* srcPde  = &srcPD[info.pdeIndex];
+        ArchPageDirectoryEntry* destPde = &destPD[info.pdeIndex];
+        SIZE count                      = MIN (numPages - done, 1024U - info.pteIndex);
+
+        if (srcPde->present) {
+            k_assert (!srcPde->page_size, "Large pages are not shared");
+
+            if (!destPde->present && !s_createPageTable (va, destPde, flags)) {
+                k_panic ("Memory allocation failed");
+            }
+
+            bool isGlobal     = s_isGlobalPde (info.pdeIndex);
+            Physical srcPtPA  = PHYSICAL (PAGEFRAME_TO_PHYSICAL (srcPde->pageTableFrame));
+            Physical destPtPA = PHYSICAL (PAGEFRAME_TO_PHYSICAL (destPde->pageTableFrame));
+            PageTable srcPt   = (PageTable)s_temporaryMap (srcPtPA);
+            PageTable destPt  = (PageTable)s_temporaryMap (destPtPA);
+            for (UINT pteIndex = info.pteIndex; pteIndex < info.pteIndex + count; pteIndex++) {
+                if (!srcPt[pteIndex].present) {
+                    continue;
+                }
+
+                Physical pa = PHYSICAL (PAGEFRAME_TO_PHYSICAL (srcPt[pteIndex].pageFrame));
+                if ((isAlreadyMapped = destPt[pteIndex].present) || !(success = kpmm_share (pa))) {
+                    break;
+                }
+                srcPt[pteIndex].write_allowed = 0;
+                s_writePTE (&destPt[pteIndex], pa, pteFlags, isGlobal);
+            }
+            s_temporaryUnmap();
+            s_temporaryUnmap();
+        }
+
+        done += count;
+        va += PAGEFRAMES_TO_BYTES (count);
+    }
+
+    // Source mappings, which were writable before, must not remain in the TLB. Only the loaded page
+    // directory can be flushed by address.
+    if (s_isLoadedPD (srcPD)) {
+        s_flushTLBRange (vaStart, done);
+    } else {
+        X86_TLB_INVAL_COMPLETE_GLOBAL();
+    }
+
+    if (isAlreadyMapped) {
+        RETURN_ERROR (ERR_DOUBLE_ALLOC, false);
+    }
+    if (!success) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+    return true;
+}
+
+/***************************************************************************************************
+ * Changes the page frame and flags of a virtual page which is already mapped.
+ *
+ * @Input   pd      Page directory which contains this virtual address.
+ * @Input   va      Virtual address which is mapped. Must be page aligned.
+ * @Input   pa      Physical address it will map to. Must be page aligned.
+ * @Input   flags   PTE flags to be used for the mapping. PG_MAP_FLAG_* items.
+ * @return          True if successful, false otherwise. Error number is set.
+ * @error           ERR_PAGE_WRONG_STATE - Virtual address is not mapped, or is in a large page.
+ *                  ERR_WRONG_ALIGNMENT  - Inputs are not page aligned.
+ **************************************************************************************************/
+bool kpg_remap (PageDirectory pd, PTR va, Physical pa, PagingMapFlags flags)
+{
+    FUNC_ENTRY ("PD: %px, VA: %px, PA: %px, flags: %x", pd, va, pa.val, flags);
+
+    k_assert (pd != NULL, "Page Directory is null.");
+
+    if (!IS_ALIGNED (va, CONFIG_PAGE_FRAME_SIZE_BYTES) ||
+        !IS_ALIGNED (pa.val, CONFIG_PAGE_FRAME_SIZE_BYTES)) {
+        RETURN_ERROR (ERR_WRONG_ALIGNMENT, false);
+    }
+
+    IndexInfo info              = s_getTableIndices (va);
+    ArchPageDirectoryEntry* pde = &pd[info.pdeIndex];
+    if (!pde->present || pde->page_size) {
+        RETURN_ERROR (ERR_PAGE_WRONG_STATE, false);
     }
 
-    // In order to access the page table a temporary mapping is required.
     Physical ptaddr         = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pde->pageTableFrame));
-    PageTable tempva        = (PageTable)s_internal_temporaryMap (ptaddr);
+    PageTable tempva        = (PageTable)s_temporaryMap (ptaddr);
     ArchPageTableEntry* pte = &tempva[info.pteIndex];
 
-    if (pte->present) {
-        s_internal_temporaryUnmap();
-        RETURN_ERROR (ERR_DOUBLE_ALLOC, false);
+    if (!pte->present) {
+        s_temporaryUnmap();
+        RETURN_ERROR (ERR_PAGE_WRONG_STATE, false);
     }
 
-    s_setupPTE (va, pte, pa, flags);
-    s_internal_temporaryUnmap();
+    s_setupPTE (va, pte, pa, flags, s_isGlobalPde (info.pdeIndex));
+    s_temporaryUnmap();
     return true;
 }
 
@@ -402,16 +1201,20 @@ bool kpg_doesMappingExists (PageDirectory pd, PTR va, Physical* pa)
     ArchPageDirectoryEntry* pde = &pd[info.pdeIndex];
     bool isMapped               = false;
 
-    if (pde->present) {
+    if (pde->present && pde->page_size) {
+        *pa      = createPhysical (PAGEFRAME_TO_PHYSICAL (pde->pageTableFrame) |
+                                   (va & (LARGE_PAGE_SIZE_BYTES - 1)));
+        isMapped = true;
+    } else if (pde->present) {
         Physical pt_phyaddr     = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pde->pageTableFrame));
-        void* pt_vaddr          = s_internal_temporaryMap (pt_phyaddr);
+        void* pt_vaddr          = s_temporaryMap (pt_phyaddr);
         ArchPageTableEntry* pte = &((ArchPageTableEntry*)pt_vaddr)[info.pteIndex];
         if (pte->present) {
             Physical phy_addr = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pte->pageFrame) | info.offset);
             *pa               = phy_addr;
             isMapped          = true;
         }
-        s_internal_temporaryUnmap();
+        s_temporaryUnmap();
     }
 
     INFO("Is mapped: %x", isMapped);
@@ -437,15 +1240,14 @@ bool kpg_setupPageDirectory (Physical* const pd, PagingOperationFlags flags,
     // Create a new, empty Page Directory.
     // ---------------------------------------------------------------
     if (BIT_ISSET (flags, PG_NEWPD_FLAG_CREATE_NEW)) {
-        if (kpmm_alloc (pd, 1, PMM_REGION_ANY) == false) {
+        if (kpmm_allocZeroed (pd, PMM_REGION_ANY) == false) {
             RETURN_ERROR (ERROR_PASSTHROUGH, false); // PMM alloc failure
         }
         INFO ("New PD physical location: %px", pd->val);
 
-        l_pd = s_internal_temporaryMap (*pd);
-        k_memset (l_pd, 0, CONFIG_PAGE_FRAME_SIZE_BYTES);
+        l_pd = s_temporaryMap (*pd);
     } else {
-        l_pd = s_internal_temporaryMap (*pd);
+        l_pd = s_temporaryMap (*pd);
     }
 
     // ---------------------------------------------------------------
@@ -459,6 +1261,7 @@ bool kpg_setupPageDirectory (Physical* const pd, PagingOperationFlags flags,
             l_pd[pdi] = l_kernelPD[pdi];
         }
         kpg_temporaryUnmap();
+        s_isKernelPdeShared = true;
     }
 
     // ---------------------------------------------------------------
@@ -468,7 +1271,7 @@ bool kpg_setupPageDirectory (Physical* const pd, PagingOperationFlags flags,
         l_pd[RECURSIVE_PDE_INDEX].pageTableFrame = PHYSICAL_TO_PAGEFRAME (pd->val);
     }
 
-    s_internal_temporaryUnmap();
+    s_temporaryUnmap();
     return true;
 }
 /***************************************************************************************************
@@ -488,14 +1291,15 @@ bool kpg_deletePageDirectory (Physical pd, PagingOperationFlags flags)
     k_assert (pd.val != PAGEFRAME_TO_PHYSICAL (cr3.physical), "Cannot delete the current PD");
 
     // Deallocate physical memory used by the page tables referenced by this page directory.
-    PageDirectory pd_vaddr = s_internal_temporaryMap (pd);
+    PageDirectory pd_vaddr = s_temporaryMap (pd);
     UINT endIndex = BIT_ISSET (flags, PG_DELPD_FLAG_KEEP_KERNEL_PAGES) ? KERNEL_PDE_INDEX : 1024;
 
     INFO ("Freeing PDE from index 0 to index %u", endIndex);
 
     for (UINT i = 0; i < endIndex; i++) {
         ArchPageDirectoryEntry pde = pd_vaddr[i];
-        if (pde.present == 1) {
+        // Large page of the kernel address space is not owned by the page directory.
+        if (pde.present == 1 && pde.page_size == 0) {
             Physical pt = PHYSICAL (PAGEFRAME_TO_PHYSICAL (pde.pageTableFrame));
             INFO ("Freeing PDE Index: %u, Page Table physical address: %x", i, pt.val);
             if (!kpmm_free (pt, 1)) {
@@ -504,7 +1308,7 @@ bool kpg_deletePageDirectory (Physical pd, PagingOperationFlags flags)
         }
     }
 
-    s_internal_temporaryUnmap();
+    s_temporaryUnmap();
 
     // Now deallocate page used by the page directory itself.
     if (!kpmm_free (pd, 1)) {
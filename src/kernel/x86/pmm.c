@@ -12,13 +12,43 @@
 #include <moslimits.h>
 #include <types.h>
 #include <x86/boot.h>
+#include <memloc.h>
 #include <kerror.h>
 #include <panic.h>
 #include <paging.h>
 #include <kdebug.h>
 #include <kstdlib.h>
+#include <kernel.h>
+
+/* Early allocations are few (PAB and such), each one is remembered so that it can be marked used
+ * in the PAB. */
+#define EARLY_ALLOC_MAX_COUNT 4
+
+/* Early allocations must fit the early allocation region even when the PAB addresses all of 4 GB.
+ * The buddy tree has one byte for each page frame and one bit for each pair. */
+#ifdef PMM_BUDDY_ALLOCATOR
+    #define EARLY_ALLOC_MAX_BYTES \
+        (MAX_PAB_SIZE_BYTES + MAX_PAB_ADDRESSABLE_PAGE_COUNT + MAX_PAB_ADDRESSABLE_PAGE_COUNT / 8)
+#else
+    #define EARLY_ALLOC_MAX_BYTES MAX_PAB_SIZE_BYTES
+#endif
+
+#if !defined(UNITTEST) && EARLY_ALLOC_MAX_BYTES > X86_MEM_LEN_BYTES_KERNEL_EARLY_ALLOC
+    #error "Early allocations do not fit the early allocation region"
+#endif
+
+typedef struct EarlyAllocation {
+    Physical start;
+    UINT pageFrameCount;
+} EarlyAllocation;
+
+static EarlyAllocation s_earlyAllocations[EARLY_ALLOC_MAX_COUNT];
+static UINT s_earlyAllocationCount = 0;
+static SIZE s_earlyAllocatedBytes  = 0; // Bytes mapped in the early allocation region.
 
 static void s_markFreeMemory (Bitmap *bitmap);
+static void s_markEarlyAllocations (Bitmap *bitmap);
+static U64 s_getBootFilesEnd (void);
 
 /***************************************************************************************************
  * Initializes PAB array for x86 architecture.
@@ -31,8 +61,143 @@ void kpmm_arch_init (Bitmap *bitmap)
 {
     FUNC_ENTRY();
 
-    k_memset (bitmap->bitmap, 0xAA, PAB_SIZE_BYTES);
+    k_memset (bitmap->bitmap, 0xAA, bitmap->size);
     s_markFreeMemory (bitmap);
+    s_markEarlyAllocations (bitmap);
+}
+
+/***************************************************************************************************
+ * Number of page frames the PAB needs to address. This is every page frame till the end of the last
+ * free memory map item, within the limit of what the PAB can address (4 GB).
+ *
+ * @return  Number of page frames.
+ **************************************************************************************************/
+UINT kpmm_arch_getPageFrameCount (void)
+{
+    FUNC_ENTRY();
+
+    INT mmapCount  = kboot_getBootMemoryMapItemCount();
+    U64 freeEndMax = 0;
+
+    for (INT i = 0; i < mmapCount; i++) {
+        BootMemoryMapItem memmap = kboot_getBootMemoryMapItem (i);
+        if (memmap.type != MMTYPE_FREE || memmap.length == 0) {
+            continue;
+        }
+
+        U64 endAddress = MIN (MAX_PAB_ADDRESSABLE_BYTE_COUNT, memmap.baseAddr + memmap.length);
+        freeEndMax     = MAX (freeEndMax, endAddress);
+    }
+
+    UINT pageFrameCount = (UINT)(freeEndMax / CONFIG_PAGE_FRAME_SIZE_BYTES);
+    INFO ("PAB page frame count: %x", pageFrameCount);
+
+    if (pageFrameCount == 0) {
+        k_panic ("No free memory in memory map");
+    }
+    return pageFrameCount;
+}
+
+/***************************************************************************************************
+ * Allocates memory before PMM is ready. Physical pages are taken from free memory (as per the memory
+ * map) just after the module files. These are mapped in the early allocation region one after the
+ * other.
+ *
+ * NOTE: Allocated memory is never freed.
+ *
+ * @input   byteCount   Number of bytes to allocate. Rounded up to whole pages.
+ * @return  Virtual address of the allocated memory.
+ * @error   Panics if called after PMM is ready or if there is not enough memory.
+ **************************************************************************************************/
+PTR kpmm_arch_earlyAlloc (SIZE byteCount)
+{
+    FUNC_ENTRY ("byteCount: %x", byteCount);
+
+    k_assert (!KERNEL_PHASE_CHECK (KERNEL_PHASE_STATE_PMM_READY), "PMM is already initialized");
+    k_assert (byteCount > 0, "Must be > zero");
+
+    if (s_earlyAllocationCount == EARLY_ALLOC_MAX_COUNT) {
+        k_panic ("Too many early allocations");
+    }
+
+    UINT pageFrameCount = BYTES_TO_PAGEFRAMES_CEILING (byteCount);
+    U64 lengthBytes     = (U64)pageFrameCount * CONFIG_PAGE_FRAME_SIZE_BYTES;
+
+    if (lengthBytes > ARCH_MEM_LEN_BYTES_KERNEL_EARLY_ALLOC - s_earlyAllocatedBytes) {
+        k_panic ("Early allocation region is full");
+    }
+
+    // Memory before this is used by either the kernel, module files or previous early allocations.
+    U64 lowestStart = s_getBootFilesEnd();
+    if (s_earlyAllocationCount > 0) {
+        EarlyAllocation* last = &s_earlyAllocations[s_earlyAllocationCount - 1];
+        U64 lastEnd = (U64)last->start.val + PAGEFRAMES_TO_BYTES (last->pageFrameCount);
+        lowestStart = MAX (lowestStart, lastEnd);
+    }
+
+    // Lowest free memory, which is large enough is taken.
+    U64 startAddress = MAX_PAB_ADDRESSABLE_BYTE_COUNT;
+    INT mmapCount    = kboot_getBootMemoryMapItemCount();
+
+    for (INT i = 0; i < mmapCount; i++) {
+        BootMemoryMapItem memmap = kboot_getBootMemoryMapItem (i);
+        if (memmap.type != MMTYPE_FREE) {
+            continue;
+        }
+
+        U64 start = MAX (ALIGN_UP (memmap.baseAddr, CONFIG_PAGE_FRAME_SIZE_BYTES), lowestStart);
+        U64 end   = MIN (memmap.baseAddr + memmap.length, MAX_PAB_ADDRESSABLE_BYTE_COUNT);
+        end       = ALIGN_DOWN (end, CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+        if (start < end && end - start >= lengthBytes) {
+            startAddress = MIN (startAddress, start);
+        }
+    }
+
+    if (startAddress == MAX_PAB_ADDRESSABLE_BYTE_COUNT) {
+        k_panic ("Not enough memory for early allocation");
+    }
+
+    // Page table for the early allocation region already exists, so mapping requires no allocation.
+    Physical pa = PHYSICAL ((USYSINT)startAddress);
+    PTR va      = ARCH_MEM_START_KERNEL_EARLY_ALLOC + s_earlyAllocatedBytes;
+    if (!kpg_mapContinous (kpg_getcurrentpd(), va, pa, pageFrameCount,
+                           PG_MAP_FLAG_KERNEL | PG_MAP_FLAG_WRITABLE | PG_MAP_FLAG_CACHE_ENABLED)) {
+        k_panicOnError();
+    }
+
+    s_earlyAllocations[s_earlyAllocationCount++] = (EarlyAllocation){ pa, pageFrameCount };
+    s_earlyAllocatedBytes += (SIZE)lengthBytes;
+
+    INFO ("Early allocation: VA: %px, PA: %px, Pages: %x", va, pa.val, pageFrameCount);
+    return va;
+}
+
+/***************************************************************************************************
+ * Number of bytes mapped in the early allocation region.
+ *
+ * @return  Number of bytes. Always page aligned.
+ **************************************************************************************************/
+SIZE kpmm_arch_getEarlyAllocatedBytes (void)
+{
+    return s_earlyAllocatedBytes;
+}
+
+/***************************************************************************************************
+ * Memory just after the kernel and the last module file. Module files are loaded one after the
+ * other, after the kernel. Without module files this is the end of the kernel image.
+ *
+ * @return  Physical address of the first page after the kernel and the last module file.
+ **************************************************************************************************/
+static U64 s_getBootFilesEnd (void)
+{
+    U64 end        = ARCH_MEM_END_PHYSICAL_KERNEL_IMAGE;
+    INT filesCount = kboot_getBootFileItemCount();
+    if (filesCount > 0) {
+        BootFileItem lastFile = kboot_getBootFileItem (filesCount - 1);
+        end                   = MAX (end, (U64)lastFile.startLocation + lastFile.length);
+    }
+    return ALIGN_UP (end, CONFIG_PAGE_FRAME_SIZE_BYTES);
 }
 
 /***************************************************************************************************
@@ -45,7 +210,7 @@ void kpmm_arch_init (Bitmap *bitmap)
 static void s_markFreeMemory (Bitmap *bitmap)
 {
     INT mmapCount = kboot_getBootMemoryMapItemCount ();
-    size_t actualAddressableMemorySize = kpmm_getUsableMemorySize (PMM_REGION_ANY);
+    U64 actualAddressableMemorySize = (U64)BITMAP_CAPACITY (bitmap) * CONFIG_PAGE_FRAME_SIZE_BYTES;
 
     for (INT i = 0; i < mmapCount; i++)
     {
@@ -68,8 +233,8 @@ static void s_markFreeMemory (Bitmap *bitmap)
         lengthBytes = MAX(CONFIG_PAGE_FRAME_SIZE_BYTES, lengthBytes);
 
         // At this point, start and end address is within the addressable range.
-        UINT pageFrameCount = BYTES_TO_PAGEFRAMES_FLOOR ((USYSINT)lengthBytes);
-        UINT startPageFrame = BYTES_TO_PAGEFRAMES_FLOOR ((USYSINT)startAddress);
+        UINT pageFrameCount = (UINT)(lengthBytes / CONFIG_PAGE_FRAME_SIZE_BYTES);
+        UINT startPageFrame = (UINT)(startAddress / CONFIG_PAGE_FRAME_SIZE_BYTES);
 
         bool success = bitmap_setContinous(bitmap, startPageFrame, pageFrameCount,
                                            PMM_STATE_FREE);
@@ -78,6 +243,23 @@ static void s_markFreeMemory (Bitmap *bitmap)
     }
 }
 
+/***************************************************************************************************
+ * Marks memory allocated by kpmm_arch_earlyAlloc as used.
+ *
+ * @return  nothing
+ * @error   On failure, processor is halted.
+ **************************************************************************************************/
+static void s_markEarlyAllocations (Bitmap *bitmap)
+{
+    for (UINT i = 0; i < s_earlyAllocationCount; i++) {
+        EarlyAllocation* ea = &s_earlyAllocations[i];
+        UINT startPageFrame = BYTES_TO_PAGEFRAMES_FLOOR (ea->start.val);
+
+        if (!bitmap_setContinous (bitmap, startPageFrame, ea->pageFrameCount, PMM_STATE_USED))
+            k_panic ("PAB cannot be initialized.");
+    }
+}
+
 /***************************************************************************************************
  * Gets the total amount of installed memory.
  * This is the size of installed RAM, which may be is different than the usable size of the RAM. The
@@ -23,17 +23,32 @@
 #include <intrusive_queue.h>
 #include <vmm.h>
 #include <memloc.h>
+#include <x86/boot.h>
+#include <handle.h>
 
 #define PROCESS_STACK_SIZE_PAGES 0x1
 #define PROCESS_STACK_VA_TOP(stackstart, pages) \
     ((stackstart) + (pages)*CONFIG_PAGE_FRAME_SIZE_BYTES - 1)
 #define PARENT_PROCESS_ID(child) ((child->parent) ? child->parent->processID : PROCESS_ID_KERNEL)
 #define MAX_PROCESS_COUNT        20
+#define MAX_PROGRAM_IMAGE_COUNT  CONFIG_BOOT_MAX_FILES_COUNT // One for each boot-loaded file.
+
+// Copy of a boot-loaded binary. Processes started from it map its page frames, which are copied
+// only when written. Images are kept as long as the boot-loaded files, which is forever.
+typedef struct ProgramImage {
+    PTR start;           // Address of the boot-loaded binary.
+    VMemoryShare* share; // Page frames with the copy of the binary.
+} ProgramImage;
 
 static UINT processCount;
 static KProcessInfo* currentProcess = NULL;
 static KProcessInfo* rootProcess = NULL;
 static ListNode schedulerQueueHead  = { 0 };
+static KMemCache* s_processInfoCache   = NULL;
+static KMemCache* s_registerStateCache = NULL;
+static KMemCache* s_eventCache         = NULL;
+static ProgramImage s_programImages[MAX_PROGRAM_IMAGE_COUNT];
+static UINT s_programImageCount;
 
 static bool s_switchProcess (KProcessInfo* nextProcess, ProcessRegisterState* currentProcessState);
 static KProcessInfo* s_processInfo_malloc (KProcessFlags flags);
@@ -43,6 +58,8 @@ static bool s_createProcessPageDirectory (KProcessInfo* pinfo);
 static bool s_setupProcessBinaryMemory (void* processStartAddress, SIZE binLengthBytes,
                                         KProcessInfo* pinfo);
 static bool s_setupProcessStackMemory (KProcessInfo* pinfo);
+static bool s_isBootLoadedFile (void* processStartAddress, SIZE binLengthBytes);
+static VMemoryShare* s_getProgramImage (void* processStartAddress, SIZE binLengthBytes);
 static bool s_setupProcessDataMemory (KProcessInfo* pinfo);
 static bool kprocess_kill_process (KProcessInfo** process, U8 exitCode);
 #if defined(DEBUG) && defined(PORT_E9_ENABLED)
@@ -56,7 +73,7 @@ __attribute__ ((noreturn)) void jump_to_process (U32 type, x86_CR3 cr3, ProcessR
 
 /***************************************************************************************************
  * Jumps to the entry point of a process and switches stacks, address space depending on process
- * flags.
+ * flags. CR3 is not loaded if the process has the address space which is already loaded.
  *
  * @Input flags         Process flags
  * @Input stack pointer User mode stack top virtual address.
@@ -85,6 +102,16 @@ __asm__(".struct 0;"
         "mov eax, [ebp + 4];"  // Process flags
         "mov ecx, [ebp + 8];"  // CR3 value.
         "mov edx, [ebp + 12];" // Base of ProcessRegisterState struct
+        /////// Change CR3 ////////
+        // A thread can be scheduled to run after a process which is not its parent, so the page
+        // directory of the next process is compared with the loaded one. Loading CR3 flushes the
+        // TLB, so it is skipped when the address space stays the same (thread of the same process,
+        // for example).
+        "mov ebx, cr3;"
+        "cmp ebx, ecx;"
+        "je .skip_cr3_load;"
+        "mov cr3, ecx;"
+        ".skip_cr3_load:;"
         /////// Restore GP registers ////////
         "mov ebx, [edx + proc_ebx];" // General purpose registers
         "mov esi, [edx + proc_esi];" // General purpose registers
@@ -96,11 +123,6 @@ __asm__(".struct 0;"
         "mov es, [edx + proc_ds];"
         "mov fs, [edx + proc_ds];"
         "mov gs, [edx + proc_ds];"
-        /////// Change CR3 ////////
-        // CR3 must change even for Threads because a thread can be scheduled to run after a process
-        // which is not its parent.
-        "mov cr3, ecx;"
-        ///////////////////////////
         "test eax, PROCESS_FLAGS_KERNEL_PROCESS;"
         "jz .load_user_process;"
         /////// Load Kernel Process ////////
@@ -120,13 +142,14 @@ __asm__(".struct 0;"
 
 static KProcessInfo* s_processInfo_malloc (KProcessFlags flags)
 {
-    KProcessInfo* pInfo = kmalloc (sizeof (KProcessInfo));
+    KProcessInfo* pInfo = kmem_cache_alloc (s_processInfoCache);
 
     if (pInfo == NULL) {
         RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
     }
 
-    if ((pInfo->registerStates = kmalloc (sizeof (ProcessRegisterState))) == NULL) {
+    if ((pInfo->registerStates = kmem_cache_alloc (s_registerStateCache)) == NULL) {
+        kmem_cache_free (s_processInfoCache, pInfo);
         RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
     }
 
@@ -216,9 +239,16 @@ static bool s_createProcessPageDirectory (KProcessInfo* pinfo)
             RETURN_ERROR (ERROR_PASSTHROUGH, false); // Cannot create new process.
         }
 
+        // Clones start with the same memory as their parent. Nothing is copied until written.
         INFO ("New VMManager is being created");
-        if (!(pinfo->context = kvmm_new (ARCH_MEM_START_PROCESS_MEMORY, ARCH_MEM_END_PROCESS_MEMORY,
-                                         newPD, PMM_REGION_ANY))) {
+        if (BIT_ISSET (pinfo->flags, PROCESS_FLAGS_CLONE)) {
+            pinfo->context = kvmm_clone (kprocess_getCurrentContext(), newPD);
+        } else {
+            pinfo->context = kvmm_new (ARCH_MEM_START_PROCESS_MEMORY, ARCH_MEM_END_PROCESS_MEMORY,
+                                       newPD, PMM_REGION_ANY);
+        }
+
+        if (pinfo->context == NULL) {
             // Since the PD created before is yet not part of the 'context' we have to delete it
             // here as no one knows about it.
             if (!kpg_deletePageDirectory (newPD, PG_DELPD_FLAG_KEEP_KERNEL_PAGES)) {
@@ -234,6 +264,65 @@ static bool s_createProcessPageDirectory (KProcessInfo* pinfo)
     return true;
 }
 
+static bool s_isBootLoadedFile (void* processStartAddress, SIZE binLengthBytes)
+{
+    INT filesCount = kboot_getBootFileItemCount();
+    for (INT i = 0; i < filesCount; i++) {
+        BootFileItem file = kboot_getBootFileItem (i);
+        Physical start    = PHYSICAL (file.startLocation);
+        if (HIGHER_HALF_KERNEL_TO_VA (start) == processStartAddress &&
+            file.length == binLengthBytes) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/***************************************************************************************************
+ * Gets the program image of a boot-loaded binary. Binary is copied to the image only the first time.
+ *
+ * @Input   processStartAddress Address of the boot-loaded binary.
+ * @Input   binLengthBytes      Size of the binary in bytes.
+ * @return                      Share with the copy of the binary. NULL on failure.
+ * @error                       ERR_OUT_OF_MEM - Not enough memory for the image.
+ **************************************************************************************************/
+static VMemoryShare* s_getProgramImage (void* processStartAddress, SIZE binLengthBytes)
+{
+    FUNC_ENTRY ("processStartAddress: %px, binLengthBytes: %x", processStartAddress,
+                binLengthBytes);
+
+    for (UINT i = 0; i < s_programImageCount; i++) {
+        if (s_programImages[i].start == (PTR)processStartAddress) {
+            return s_programImages[i].share;
+        }
+    }
+
+    k_assert (s_programImageCount < MAX_PROGRAM_IMAGE_COUNT, "Too many program images");
+
+    // Boot-loaded files are not page aligned, so their page frames cannot be mapped as they are.
+    VMemoryShare* share = NULL;
+    if (!(share = kvmm_newShare (BYTES_TO_PAGEFRAMES_CEILING (binLengthBytes), PMM_REGION_ANY))) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+    }
+
+    PTR va = kvmm_mapShare (g_kstate.context, share, VMM_MEMMAP_FLAG_KERNEL_PAGE);
+    if (va == 0) {
+        kvmm_releaseShare (share);
+        RETURN_ERROR (ERROR_PASSTHROUGH, NULL);
+    }
+
+    k_memcpy ((void*)va, processStartAddress, binLengthBytes);
+
+    if (!kvmm_unmapShare (g_kstate.context, va)) {
+        BUG(); // Cannot fail. It was mapped just above.
+    }
+
+    s_programImages[s_programImageCount++] = (ProgramImage){ .start = (PTR)processStartAddress,
+                                                             .share = share };
+    INFO ("Program image for binary at %px is created.", processStartAddress);
+    return share;
+}
+
 static bool s_setupProcessBinaryMemory (void* processStartAddress, SIZE binLengthBytes,
                                         KProcessInfo* pinfo)
 {
@@ -241,8 +330,9 @@ static bool s_setupProcessBinaryMemory (void* processStartAddress, SIZE binLengt
                 binLengthBytes, pinfo);
 
     // For Threads there is nothing to be setup for program text other thatn just setting of process
-    // data.
-    if (BIT_ISSET (pinfo->flags, PROCESS_FLAGS_THREAD)) {
+    // data. Same is true for clones, program text is already in their context.
+    if (BIT_ISSET (pinfo->flags, PROCESS_FLAGS_THREAD) ||
+        BIT_ISSET (pinfo->flags, PROCESS_FLAGS_CLONE)) {
         pinfo->binary.virtualMemoryStart = (PTR)processStartAddress;
         return true;
     }
@@ -252,10 +342,23 @@ static bool s_setupProcessBinaryMemory (void* processStartAddress, SIZE binLengt
     pinfo->binary.virtualMemoryStart = ARCH_MEM_START_PROCESS_TEXT;
     pinfo->binary.sizePages          = BYTES_TO_PAGEFRAMES_CEILING (binLengthBytes);
 
+    // Processes started from the same boot-loaded binary share its program image. Pages are copied
+    // only when written, so only the data which a process changes is private to it. Other binaries
+    // are copied for every process.
+    VMemoryShare* image = NULL;
+    bool isBootLoaded   = s_isBootLoadedFile (processStartAddress, binLengthBytes);
+    if (isBootLoaded && !(image = s_getProgramImage (processStartAddress, binLengthBytes))) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+
     // Allocate virtual and physical memory for the program binary.
     Physical pa;
-    if (!(kvmm_memmap (pinfo->context, pinfo->binary.virtualMemoryStart, NULL,
-                       pinfo->binary.sizePages, VMM_MEMMAP_FLAG_IMMCOMMIT, &pa))) {
+    if (isBootLoaded) {
+        if (!kvmm_mapSharePrivate (pinfo->context, pinfo->binary.virtualMemoryStart, image)) {
+            RETURN_ERROR (ERROR_PASSTHROUGH, false);
+        }
+    } else if (!(kvmm_memmap (pinfo->context, pinfo->binary.virtualMemoryStart, NULL,
+                              pinfo->binary.sizePages, VMM_MEMMAP_FLAG_IMMCOMMIT, &pa))) {
         RETURN_ERROR (ERROR_PASSTHROUGH, false); // allocation failed
     }
     // memmap can store some metadata (for debugging) about the process and purpose. The process PID
@@ -265,7 +368,9 @@ static bool s_setupProcessBinaryMemory (void* processStartAddress, SIZE binLengt
     kvmm_setAddressSpaceMetadata (pinfo->context, pinfo->binary.virtualMemoryStart, "proc bin",
                                   &pinfo->processID);
 
-    k_memcpyToPhyMem (pa, (PTR)processStartAddress, 0, 0, binLengthBytes);
+    if (!isBootLoaded) {
+        k_memcpyToPhyMem (pa, (PTR)processStartAddress, 0, 0, binLengthBytes);
+    }
     return true;
 }
 
@@ -273,7 +378,8 @@ static bool s_setupProcessDataMemory (KProcessInfo* pinfo)
 {
     FUNC_ENTRY ("Pinfo: %px", pinfo);
 
-    if (BIT_ISUNSET (pinfo->flags, PROCESS_FLAGS_THREAD)) {
+    if (BIT_ISUNSET (pinfo->flags, PROCESS_FLAGS_THREAD) &&
+        BIT_ISUNSET (pinfo->flags, PROCESS_FLAGS_CLONE)) {
         // Data memory address space is never Privileged. This is because its going to be shared
         // among all the other child processes (whether they are privileged or not).
         VMemoryMemMapFlags flags = VMM_MEMMAP_FLAG_NONE;
@@ -289,7 +395,8 @@ static bool s_setupProcessDataMemory (KProcessInfo* pinfo)
         kvmm_setAddressSpaceMetadata (pinfo->context, pinfo->data.virtualMemoryStart, "proc data",
                                       &pinfo->processID);
     } else if (currentProcess != NULL) {
-        // Threads reuse the data section of its parent.
+        // Threads reuse the data section of its parent. Clones have their own copy of it, at the
+        // same address.
         pinfo->data = currentProcess->data;
         INFO ("Reusing data area of parent process ID: %u for process ID: %u",
               PARENT_PROCESS_ID (pinfo), pinfo->processID);
@@ -307,6 +414,16 @@ static bool s_setupProcessStackMemory (KProcessInfo* pinfo)
 {
     FUNC_ENTRY ("Pinfo: %px", pinfo);
 
+    // Clones have their own copy of the stack of their parent, at the same address. It is used from
+    // its top again.
+    if (BIT_ISSET (pinfo->flags, PROCESS_FLAGS_CLONE)) {
+        k_assert (currentProcess != NULL, "Clones must have a parent");
+        pinfo->stack = currentProcess->stack;
+        INFO ("Reusing stack of parent process ID: %u for process ID: %u",
+              currentProcess->processID, pinfo->processID);
+        return true;
+    }
+
     // Process stacks are always allocated dynamically. Their sizes are fixed for now though
     VMemoryMemMapFlags flags = VMM_MEMMAP_FLAG_NONE;
     pinfo->stack.sizePages   = BYTES_TO_PAGEFRAMES_CEILING (ARCH_MEM_LEN_BYTES_PROCESS_STACK);
@@ -510,18 +627,29 @@ static bool kprocess_kill_process (KProcessInfo** process, U8 exitCode)
     }
 
     INFO ("Freeing register states");
-    if (!kfree (l_process->registerStates)) {
+    if (!kmem_cache_free (s_registerStateCache, l_process->registerStates)) {
         BUG(); // Cannot fail under normal operation. It was allocated so should also be freed.
     }
 
     // Delete items in the events queue
     INFO ("Freeing process events queue");
     ListNode* evnode = NULL;
-    list_for_each (&l_process->eventsQueueHead, evnode)
-    {
+    while ((evnode = dequeue (&l_process->eventsQueueHead)) != NULL) {
         KProcessEvent* e = LIST_ITEM (evnode, KProcessEvent, eventQueueNode);
         k_assert (e != NULL, "Event cannot be NULL");
-        kfree (e);
+        kmem_cache_free (s_eventCache, e);
+    }
+
+    // Shared memory handles the process did not close. Pages stay while mapped in other processes.
+    INFO ("Closing shared memory handles");
+    Handle h = INVALID_HANDLE;
+    while ((h = khandle_findHandle (KERNEL_OBJECT_TYPE_SHARE, l_process->processID))
+           != INVALID_HANDLE) {
+        VMemoryShare* share = khandle_getObject (h, KERNEL_OBJECT_TYPE_SHARE);
+        if (share == NULL || !khandle_freeHandle (h)) {
+            FATAL_BUG(); // Cannot fail, handle was just found.
+        }
+        kvmm_releaseShare (share);
     }
 
     // Remove the process from its parent child process list
@@ -536,7 +664,7 @@ static bool kprocess_kill_process (KProcessInfo** process, U8 exitCode)
 
     // Now the process item can be freed.
     INFO ("Process removed from scheduler queue. Freeeing process item");
-    kfree (l_process);
+    kmem_cache_free (s_processInfoCache, l_process);
     *process = NULL; // Fix: Causes page fault when killing kernel process!
     processCount--;
 
@@ -561,6 +689,12 @@ static void change_parent_process (KProcessInfo* const p, KProcessInfo* const pa
 void kprocess_init(void)
 {
     list_init (&schedulerQueueHead);
+
+    if (!(s_processInfoCache = kmem_cache_create ("process", sizeof (KProcessInfo))) ||
+        !(s_registerStateCache = kmem_cache_create ("regstate", sizeof (ProcessRegisterState))) ||
+        !(s_eventCache = kmem_cache_create ("procevent", sizeof (KProcessEvent)))) {
+        FATAL_BUG(); // Should not fail.
+    }
 }
 
 INT kprocess_create (void* processStartAddress, SIZE binLengthBytes, KProcessFlags flags)
@@ -587,6 +721,14 @@ INT kprocess_create (void* processStartAddress, SIZE binLengthBytes, KProcessFla
         RETURN_ERROR (ERR_PROC_CREATE_NOT_ALLOWED, KERNEL_EXIT_FAILURE);
     }
 
+    // Clones are made of a user process. Kernel stacks cannot be copied on write.
+    if (BIT_ISSET (flags, PROCESS_FLAGS_CLONE) &&
+        (currentProcess == NULL || BIT_ISSET (currentProcess->flags, PROCESS_FLAGS_KERNEL_PROCESS) ||
+         BIT_ISSET (flags, PROCESS_FLAGS_KERNEL_PROCESS) ||
+         BIT_ISSET (flags, PROCESS_FLAGS_THREAD))) {
+        RETURN_ERROR (ERR_PROC_CREATE_NOT_ALLOWED, KERNEL_EXIT_FAILURE);
+    }
+
     KProcessInfo* pinfo = NULL;
     if (!(pinfo = s_processInfo_malloc (flags))) {
         goto failure;
@@ -808,7 +950,7 @@ bool kprocess_popEvent (UINT pid, KProcessEvent* ev)
     *ev = *e;
 
     // Free KProcessEvent item now that its dequeued.
-    kfree (e);
+    kmem_cache_free (s_eventCache, e);
 
     return true;
 }
@@ -820,7 +962,7 @@ bool kprocess_pushEvent (UINT pid, UINT eventID, UINT eventData)
     KProcessInfo* pinfo = s_getProcessInfoFromID (pid);
     k_assert (pinfo != NULL, "Invalid PID");
 
-    KProcessEvent* e = kmalloc (sizeof (KProcessEvent));
+    KProcessEvent* e = kmem_cache_alloc (s_eventCache);
     if (e == NULL) {
         RETURN_ERROR (ERROR_PASSTHROUGH, false);
     }
@@ -832,27 +974,3 @@ bool kprocess_pushEvent (UINT pid, UINT eventID, UINT eventData)
     enqueue (&pinfo->eventsQueueHead, &e->eventQueueNode);
     return true;
 }
-
-void kprocess_syncPD(void)
-{
-    FUNC_ENTRY();
-
-    if (!KERNEL_PHASE_CHECK (KERNEL_PHASE_STATE_KERNEL_READY)) {
-        return;
-    }
-
-    Physical kernelPD = kvmm_getPageDirectory (g_kstate.context);
-
-    ListNode* node  = NULL;
-    KProcessInfo* p = NULL;
-    list_for_each (&schedulerQueueHead, node)
-    {
-        p           = LIST_ITEM (node, KProcessInfo, schedulerQueueNode);
-        Physical pd = kvmm_getPageDirectory (p->context);
-        if (!kpg_setupPageDirectory (&pd,
-                                     PG_NEWPD_FLAG_COPY_KERNEL_PAGES | PG_NEWPD_FLAG_RECURSIVE_MAP,
-                                     &kernelPD)) {
-            FATAL_BUG(); // No reason it should fail.
-        }
-    }
-}
@@ -17,6 +17,8 @@
 #include <handle.h>
 #include <panic.h>
 #include <cm/osif.h>
+#include <memmanage.h>
+#include <pmm.h>
 #if ARCH == x86
     #include <x86/paging.h>
     #include <x86/boot.h>
@@ -49,6 +51,15 @@ U32 ksys_process_getPID (SystemcallFrame frame);
 U32 ksys_get_tickcount (SystemcallFrame frame);
 PTR ksys_process_getDataMemoryStart (SystemcallFrame frame);
 U32 sys_get_os_error (SystemcallFrame frame);
+PTR ksys_process_memmap (SystemcallFrame frame, SIZE bytes);
+SIZE ksys_process_memunmap (SystemcallFrame frame, PTR va);
+bool ksys_get_memory_stats (SystemcallFrame frame, OSIF_Allocators allocator,
+                            OSIF_AllocatorStats* const stats);
+U32 ksys_process_getPageFaultCount (SystemcallFrame frame);
+Handle ksys_shm_create (SystemcallFrame frame, SIZE bytes);
+PTR ksys_shm_map (SystemcallFrame frame, Handle h, bool isReadOnly);
+bool ksys_shm_unmap (SystemcallFrame frame, PTR va);
+bool ksys_shm_close (SystemcallFrame frame, Handle h);
 
 #ifdef GRAPHICS_MODE_ENABLED
 Handle ksys_window_createWindow (SystemcallFrame frame, const char* winTitle);
@@ -120,6 +131,15 @@ void* g_syscall_table[] = {
 #else
     &s_handleInvalidSystemCall,      // 17
 #endif
+    //---------------------------
+    &ksys_process_memmap,            // 18
+    &ksys_process_memunmap,          // 19
+    &ksys_get_memory_stats,          // 20
+    &ksys_process_getPageFaultCount, // 21
+    &ksys_shm_create,                // 22
+    &ksys_shm_map,                   // 23
+    &ksys_shm_unmap,                 // 24
+    &ksys_shm_close,                 // 25
 };
 #pragma GCC diagnostic pop
 
@@ -289,6 +309,9 @@ void ksys_yieldProcess (SystemcallFrame frame, U32 ebx, U32 ecx, U32 edx, U32 es
         .ds     = frame.ss,
     };
 
+    // Process has nothing to do, so the time is used to zero few free page frames.
+    kpmm_refillZeroPool (CONFIG_IDLE_ZEROED_PAGES);
+
     kprocess_yield (&state);
 }
 
@@ -321,6 +344,148 @@ PTR ksys_process_getDataMemoryStart (SystemcallFrame frame)
     return section == NULL ? (PTR)0 : section->virtualMemoryStart;
 }
 
+PTR ksys_process_memmap (SystemcallFrame frame, SIZE bytes)
+{
+    FUNC_ENTRY ("Frame return address: %x:%x, bytes: %x", frame.cs, frame.eip, bytes);
+    (void)frame;
+
+    if (bytes == 0) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, (PTR)NULL);
+    }
+
+    // Like the data memory, these pages are never privileged and are committed on access.
+    PTR va = kvmm_allocGuarded (kprocess_getCurrentContext(), BYTES_TO_PAGEFRAMES_CEILING (bytes),
+                                VMM_MEMMAP_FLAG_NONE);
+    if (va == (PTR)NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, (PTR)NULL);
+    }
+
+    kvmm_setAddressSpaceMetadata (kprocess_getCurrentContext(), va, "proc memmap", NULL);
+    return va;
+}
+
+SIZE ksys_process_memunmap (SystemcallFrame frame, PTR va)
+{
+    FUNC_ENTRY ("Frame return address: %x:%x, va: %px", frame.cs, frame.eip, va);
+    (void)frame;
+
+    // Only ranges created by the memmap system call can be freed. Number of pages freed is
+    // returned, so that the caller can account for them.
+    SIZE pageCount = 0;
+    if (!kvmm_freeGuarded (kprocess_getCurrentContext(), va, &pageCount)) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, 0);
+    }
+    return pageCount;
+}
+
+bool ksys_get_memory_stats (SystemcallFrame frame, OSIF_Allocators allocator,
+                            OSIF_AllocatorStats* const stats)
+{
+    FUNC_ENTRY ("Frame return address: %x:%x, allocator: %u, stats: %px", frame.cs, frame.eip,
+                allocator, stats);
+    (void)frame;
+
+    if (stats == NULL) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+    }
+
+    switch (allocator) {
+        case OSIF_ALLOCATOR_PMM: kpmm_getStats (stats); break;
+        case OSIF_ALLOCATOR_KMALLOC: kmalloc_getStats (stats); break;
+        case OSIF_ALLOCATOR_SALLOC: ksalloc_getStats (stats); break;
+        default: RETURN_ERROR (ERR_INVALID_ARGUMENT, false);
+    }
+    return true;
+}
+
+U32 ksys_process_getPageFaultCount (SystemcallFrame frame)
+{
+    FUNC_ENTRY ("Frame return address: %x:%x", frame.cs, frame.eip);
+    (void)frame;
+    return kvmm_getPageFaultCount (kprocess_getCurrentContext());
+}
+
+Handle ksys_shm_create (SystemcallFrame frame, SIZE bytes)
+{
+    FUNC_ENTRY ("Frame return address: %x:%x, bytes: %x", frame.cs, frame.eip, bytes);
+    (void)frame;
+
+    // Page frames of a share are allocated right away, so a process must not be able to take all of
+    // the physical memory with one.
+    if (bytes > CONFIG_SHM_MAX_SIZE_BYTES) {
+        RETURN_ERROR (ERR_INVALID_ARGUMENT, INVALID_HANDLE);
+    }
+    if (bytes > kpmm_getFreeMemorySize()) {
+        RETURN_ERROR (ERR_OUT_OF_MEM, INVALID_HANDLE);
+    }
+
+    VMemoryShare* share = kvmm_newShare (BYTES_TO_PAGEFRAMES_CEILING (bytes), PMM_REGION_ANY);
+    if (share == NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, INVALID_HANDLE);
+    }
+
+    // Reference of the creator is owned by the handle, and released when the handle is closed.
+    Handle newh;
+    newh = khandle_createHandle (share, KERNEL_OBJECT_TYPE_SHARE, kprocess_getCurrentPID());
+    if (newh == INVALID_HANDLE) {
+        kvmm_releaseShare (share);
+        RETURN_ERROR (ERROR_PASSTHROUGH, INVALID_HANDLE);
+    }
+
+    return newh;
+}
+
+PTR ksys_shm_map (SystemcallFrame frame, Handle h, bool isReadOnly)
+{
+    FUNC_ENTRY ("Frame return address: %x:%x, Handle: %x, read only: %x", frame.cs, frame.eip, h,
+                isReadOnly);
+    (void)frame;
+
+    VMemoryShare* share = NULL;
+    if (!(share = khandle_getObject (h, KERNEL_OBJECT_TYPE_SHARE))) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, (PTR)NULL);
+    }
+
+    VMemoryMemMapFlags flags = isReadOnly ? VMM_MEMMAP_FLAG_READONLY : VMM_MEMMAP_FLAG_NONE;
+    PTR va                   = kvmm_mapShare (kprocess_getCurrentContext(), share, flags);
+    if (va == (PTR)NULL) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, (PTR)NULL);
+    }
+
+    kvmm_setAddressSpaceMetadata (kprocess_getCurrentContext(), va, "shm", NULL);
+    return va;
+}
+
+bool ksys_shm_unmap (SystemcallFrame frame, PTR va)
+{
+    FUNC_ENTRY ("Frame return address: %x:%x, va: %px", frame.cs, frame.eip, va);
+    (void)frame;
+
+    // Only mappings created by the shm map system call can be unmapped.
+    if (!kvmm_unmapShare (kprocess_getCurrentContext(), va)) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+    return true;
+}
+
+bool ksys_shm_close (SystemcallFrame frame, Handle h)
+{
+    FUNC_ENTRY ("Frame return address: %x:%x, Handle: %x", frame.cs, frame.eip, h);
+    (void)frame;
+
+    VMemoryShare* share = NULL;
+    if (!(share = khandle_getObject (h, KERNEL_OBJECT_TYPE_SHARE))) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+
+    // Pages stay while they are mapped in some process.
+    if (!khandle_freeHandle (h)) {
+        RETURN_ERROR (ERROR_PASSTHROUGH, false);
+    }
+    kvmm_releaseShare (share);
+    return true;
+}
+
 bool ksys_processPopEvent (SystemcallFrame frame, OSIF_ProcessEvent* const e)
 {
     FUNC_ENTRY ("Frame return address: %x:%x, e: %px ", frame.cs, frame.eip, e);
@@ -364,7 +529,8 @@ Handle ksys_window_createWindow (SystemcallFrame frame, const char* winTitle)
 
     // Create handle for Window obj
     Handle newh;
-    if ((newh = khandle_createHandle (win)) == KERNEL_EXIT_FAILURE) {
+    newh = khandle_createHandle (win, KERNEL_OBJECT_TYPE_WINDOW, kprocess_getCurrentPID());
+    if (newh == INVALID_HANDLE) {
         kcompose_destroyWindow (win);
         RETURN_ERROR (ERROR_PASSTHROUGH, INVALID_HANDLE);
     }
@@ -379,7 +545,7 @@ bool ksys_window_destoryWindow (SystemcallFrame frame, Handle h)
 
     // Get window associated with this handle
     Window* win = NULL;
-    if (!(win = khandle_getObject (h))) {
+    if (!(win = khandle_getObject (h, KERNEL_OBJECT_TYPE_WINDOW))) {
         RETURN_ERROR (ERROR_PASSTHROUGH, INVALID_HANDLE);
     }
 
@@ -391,7 +557,7 @@ bool ksys_getWindowFB (SystemcallFrame frame, Handle h, OSIF_WindowFrameBufferIn
     FUNC_ENTRY ("Frame return address: %x:%x, Handle: %x", frame.cs, frame.eip, h);
     (void)frame;
     Window* win = NULL;
-    if (!(win = khandle_getObject (h))) {
+    if (!(win = khandle_getObject (h, KERNEL_OBJECT_TYPE_WINDOW))) {
         RETURN_ERROR (ERROR_PASSTHROUGH, false);
     }
 
@@ -12,6 +12,7 @@
 */
 
 #include <panic.h>
+#include <kassert.h>
 #include <types.h>
 #include <kstdlib.h>
 #include <utils.h>
@@ -22,6 +23,10 @@
 
 #define IOMAP_SIZE 0x100        // Covers VGA ports and normal IO ports.
 
+// TSS must not cross a page boundary. Aligning it to a power of two not less than its size, which
+// is less than a page, makes sure of that.
+#define TSS_ALIGNMENT 512
+
 struct tss {
     U32 prevtask;
     U32 esp0;
@@ -62,7 +67,8 @@ void ktss_init (void)
 {
     FUNC_ENTRY();
 
-    if ((tss_entry = ksalloc(sizeof(struct tss))) == NULL)
+    k_assert (sizeof (struct tss) <= TSS_ALIGNMENT, "TSS larger than its alignment");
+    if ((tss_entry = ksalloc_aligned (sizeof (struct tss), TSS_ALIGNMENT)) == NULL)
     {
         k_panic("Memory allocation failed for TSS");
     }
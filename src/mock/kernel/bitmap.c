@@ -6,6 +6,8 @@ DEFINE_FUNC(BitmapState, bitmap_get, Bitmap*, UINT);
 DEFINE_FUNC(bool, bitmap_setContinous, Bitmap *, UINT, UINT, BitmapState);
 DEFINE_FUNC(INT, bitmap_findContinous, Bitmap *, BitmapState, UINT);
 DEFINE_FUNC(bool, bitmap_findContinousAt, Bitmap *, BitmapState, UINT, UINT);
+DEFINE_FUNC(INT, bitmap_findContinousInRange, Bitmap *, BitmapState, UINT, UINT, UINT);
+DEFINE_FUNC(UINT, bitmap_countContinous, Bitmap *, BitmapState, UINT, UINT);
 
 void resetBitmapFake(void)
 {
@@ -13,4 +15,6 @@ void resetBitmapFake(void)
     RESET_MOCK(bitmap_setContinous);
     RESET_MOCK(bitmap_findContinous);
     RESET_MOCK(bitmap_findContinousAt);
+    RESET_MOCK(bitmap_findContinousInRange);
+    RESET_MOCK(bitmap_countContinous);
 }
@@ -0,0 +1,18 @@
+#define YUKTI_TEST_STRIP_PREFIX
+#include <unittest/yukti.h>
+#include <mock/kernel/kmalloc.h>
+
+DEFINE_FUNC(void*, kmalloc, size_t);
+DEFINE_FUNC(bool, kfree, void*);
+DEFINE_FUNC(KMemCache*, kmem_cache_create, const CHAR*, SIZE);
+DEFINE_FUNC(void*, kmem_cache_allocz, KMemCache*);
+DEFINE_FUNC(bool, kmem_cache_free, KMemCache*, void*);
+
+void resetKmallocFake(void)
+{
+    RESET_MOCK(kmalloc);
+    RESET_MOCK(kfree);
+    RESET_MOCK(kmem_cache_create);
+    RESET_MOCK(kmem_cache_allocz);
+    RESET_MOCK(kmem_cache_free);
+}
@@ -7,9 +7,32 @@
 
 DEFINE_FUNC_FALLBACK (void *, kpg_temporaryMap, Physical);
 DEFINE_FUNC_VOID (kpg_temporaryUnmap);
+DEFINE_FUNC_FALLBACK (bool, kpg_zeroPageFrame, Physical);
+DEFINE_FUNC_FALLBACK (bool, kpg_copyPageFrame, Physical, Physical);
+DEFINE_FUNC_FALLBACK (void *, kpg_getDirectMapAddress, Physical);
+DEFINE_FUNC_FALLBACK (bool, kpg_mapContinous, PageDirectory, PTR, Physical, SIZE, PagingMapFlags);
+DEFINE_FUNC (PageDirectory, kpg_getcurrentpd);
+DEFINE_FUNC (SIZE, kpg_getLargePageSizeBytes);
+DEFINE_FUNC (bool, kpg_unmapRange, PageDirectory, PTR, SIZE, PagingOperationFlags);
+DEFINE_FUNC (bool, kpg_doesMappingExists, PageDirectory, PTR, Physical*);
+DEFINE_FUNC (bool, kpg_shareMappings, PageDirectory, PageDirectory, PTR, SIZE, PagingMapFlags);
+DEFINE_FUNC_FALLBACK (bool, kpg_remap, PageDirectory, PTR, Physical, PagingMapFlags);
+DEFINE_FUNC (bool, kpg_mapUnmappedPages, PageDirectory, PTR, SIZE, Physical const*, SIZE, PagingMapFlags,
+             SIZE*);
 
 void resetPagingFake(void)
 {
     RESET_MOCK (kpg_temporaryMap);
     RESET_MOCK (kpg_temporaryUnmap);
+    RESET_MOCK (kpg_zeroPageFrame);
+    RESET_MOCK (kpg_copyPageFrame);
+    RESET_MOCK (kpg_getDirectMapAddress);
+    RESET_MOCK (kpg_mapContinous);
+    RESET_MOCK (kpg_getcurrentpd);
+    RESET_MOCK (kpg_getLargePageSizeBytes);
+    RESET_MOCK (kpg_unmapRange);
+    RESET_MOCK (kpg_doesMappingExists);
+    RESET_MOCK (kpg_shareMappings);
+    RESET_MOCK (kpg_remap);
+    RESET_MOCK (kpg_mapUnmappedPages);
 }
@@ -9,6 +9,12 @@ DEFINE_FUNC_VOID(kpmm_init);
 DEFINE_FUNC_FALLBACK(bool, kpmm_free, Physical, UINT);
 DEFINE_FUNC(bool, kpmm_alloc, Physical*, UINT, KernelPhysicalMemoryRegions);
 DEFINE_FUNC_FALLBACK(bool, kpmm_allocAt, Physical, UINT, KernelPhysicalMemoryRegions);
+DEFINE_FUNC(bool, kpmm_allocZeroed, Physical*, KernelPhysicalMemoryRegions);
+DEFINE_FUNC_FALLBACK(bool, kpmm_freeZeroed, Physical);
+DEFINE_FUNC_FALLBACK(bool, kpmm_share, Physical);
+DEFINE_FUNC_FALLBACK(UINT, kpmm_getShareCount, Physical);
+DEFINE_FUNC(bool, kpmm_getZeroFrame, Physical*);
+DEFINE_FUNC_FALLBACK(bool, kpmm_isZeroFrame, Physical);
 DEFINE_FUNC(size_t,  kpmm_getFreeMemorySize);
 DEFINE_FUNC(USYSINT, kpmm_getUsableMemorySize, KernelPhysicalMemoryRegions);
 
@@ -18,6 +24,12 @@ void resetPmm(void)
     RESET_MOCK(kpmm_free);
     RESET_MOCK(kpmm_alloc);
     RESET_MOCK(kpmm_allocAt);
+    RESET_MOCK(kpmm_allocZeroed);
+    RESET_MOCK(kpmm_freeZeroed);
+    RESET_MOCK(kpmm_share);
+    RESET_MOCK(kpmm_getShareCount);
+    RESET_MOCK(kpmm_getZeroFrame);
+    RESET_MOCK(kpmm_isZeroFrame);
     RESET_MOCK(kpmm_getFreeMemorySize);
     RESET_MOCK(kpmm_getUsableMemorySize);
 }
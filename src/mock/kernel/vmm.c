@@ -4,8 +4,14 @@
 
 DEFINE_FUNC (PTR, kvmm_memmap, VMemoryManager* , PTR , Physical const* const, SIZE,
                  VMemoryMemMapFlags , Physical* const );
+DEFINE_FUNC (bool, kvmm_decommit, VMemoryManager*, PTR, SIZE);
+DEFINE_FUNC (PTR, kvmm_allocGuarded, VMemoryManager*, SIZE, VMemoryMemMapFlags);
+DEFINE_FUNC (bool, kvmm_freeGuarded, VMemoryManager*, PTR, SIZE* const);
 
 void resetVMMFake(void)
 {
     RESET_MOCK(kvmm_memmap);
+    RESET_MOCK(kvmm_decommit);
+    RESET_MOCK(kvmm_allocGuarded);
+    RESET_MOCK(kvmm_freeGuarded);
 }
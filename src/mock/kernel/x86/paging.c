@@ -3,7 +3,7 @@
 #include <mock/kernel/x86/paging.h>
 
 DEFINE_FUNC (ArchPageDirectoryEntry *, s_getPdeFromCurrentPd, UINT);
-DEFINE_FUNC (ArchPageTableEntry *, s_getPteFromCurrentPd, UINT);
+DEFINE_FUNC (ArchPageTableEntry *, s_getPteFromCurrentPd, UINT, UINT);
 DEFINE_FUNC (void *, s_getLinearAddress, UINT, UINT, UINT);
 
 void resetPagingFake(void)
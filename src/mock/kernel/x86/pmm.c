@@ -4,9 +4,13 @@
 
 DEFINE_FUNC_VOID(kpmm_arch_init, Bitmap *);
 DEFINE_FUNC(U64, kpmm_arch_getInstalledMemoryByteCount);
+DEFINE_FUNC(UINT, kpmm_arch_getPageFrameCount);
+DEFINE_FUNC(PTR, kpmm_arch_earlyAlloc, SIZE);
 
 void resetX86Pmm(void)
 {
     RESET_MOCK(kpmm_arch_init);
     RESET_MOCK(kpmm_arch_getInstalledMemoryByteCount);
+    RESET_MOCK(kpmm_arch_getPageFrameCount);
+    RESET_MOCK(kpmm_arch_earlyAlloc);
 }
@@ -1,6 +1,9 @@
 
 set(pmm_mock_sources
     ${PROJECT_SOURCE_DIR}/src/mock/kernel/x86/pmm.c
+    ${PROJECT_SOURCE_DIR}/src/mock/kernel/paging.c
+    ${PROJECT_SOURCE_DIR}/src/mock/kernel/kmalloc.c
+    ${PROJECT_SOURCE_DIR}/src/mock/kernel/kstdlib.c
     )
 
 set(kmalloc_mock_sources
@@ -8,6 +11,12 @@ set(kmalloc_mock_sources
     ${PROJECT_SOURCE_DIR}/src/mock/kernel/kstdlib.c
     )
 
+set(slab_mock_sources
+    ${PROJECT_SOURCE_DIR}/src/mock/kernel/vmm.c
+    ${PROJECT_SOURCE_DIR}/src/mock/kernel/salloc.c
+    ${PROJECT_SOURCE_DIR}/src/mock/kernel/kstdlib.c
+    )
+
 set(salloc_mock_sources
     ${PROJECT_SOURCE_DIR}/src/mock/kernel/kstdlib.c
     )
@@ -23,3 +32,10 @@ set(handles_mock_sources
 set(cm_malloc_mock_sources
     ${PROJECT_SOURCE_DIR}/src/mock/cm/cm.c
     )
+
+set(vmm_mock_sources
+    ${PROJECT_SOURCE_DIR}/src/mock/kernel/pmm.c
+    ${PROJECT_SOURCE_DIR}/src/mock/kernel/paging.c
+    ${PROJECT_SOURCE_DIR}/src/mock/kernel/salloc.c
+    ${PROJECT_SOURCE_DIR}/src/mock/kernel/kmalloc.c
+    )
@@ -1 +0,0 @@
-../kernel/kmalloc_test.c
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <unittest/yukti.h>
 #include <bitmap.h>
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
 #include <types.h>
 #include <utils.h>
 #include <kerror.h>
@@ -41,6 +43,11 @@ bitmap_findContinous
 - len == 0                      | panics                      | zero_length_mustfail
 - Continous block is available  | Finds correct block. true   | findContinous_mustpass
 - Continous block is unavilable | false                       | findContinous_mustpass
+- Random bitmaps, every bitsPerState | Same as linear search | findContinous_reference_mustpass
+
+bitmap_findContinousInRange & bitmap_countContinous
+- Random bitmaps, every bitsPerState | Same as linear search | findContinous_reference_mustpass
+- Fully fragmented 128 MB PAB   | Same as linear search, faster | findContinous_fragmented_benchmark
 
 bitmap_findContinousAt
 - state >= BITMAP_MAX_STATE(b)          | panics                    | invalid_state_mustfail
@@ -223,6 +230,120 @@ TEST(bitmap, bitmap_splited_mustpass)
     END();
 }
 
+/**************************************************************************************************
+ * Reference implementations of bitmap_findContinous and bitmap_findContinousAt. This is the simple
+ * linear search, checking every index one state at a time, which the word at a time search must
+ * match.
+**************************************************************************************************/
+static bool reference_findContinousAt (Bitmap* b, BitmapState state, UINT len, UINT indexAt)
+{
+    if (indexAt + len > BITMAP_CAPACITY (b))
+        return false;
+
+    UINT i = 0;
+    for (; i < len && bitmap_get (b, indexAt + i) == state; i++)
+        ;
+    return (i == len);
+}
+
+static INT reference_findContinous (Bitmap* b, BitmapState state, UINT len)
+{
+    for (UINT index = 0; index < BITMAP_CAPACITY (b); index++) {
+        if (reference_findContinousAt (b, state, len, index))
+            return (INT)index;
+    }
+    return KERNEL_EXIT_FAILURE;
+}
+
+/**************************************************************************************************
+ * Searches random bitmaps of odd sizes, at every bitsPerState and compares the result with the
+ * linear search. Covers bitmap_findContinous, bitmap_findContinousAt, bitmap_findContinousInRange
+ * and bitmap_countContinous.
+**************************************************************************************************/
+TEST(bitmap, findContinous_reference_mustpass)
+{
+    static BitmapState mem[37];
+    UINT bitsPerStates[] = { 1, 2, 4, 8 };
+
+    srand (1);
+    for (UINT i = 0; i < ARRAY_LENGTH (bitsPerStates); i++) {
+        for (UINT iter = 0; iter < 200; iter++) {
+            // Odd sizes and start offsets to cover partially filled and unaligned words.
+            UINT offset = (UINT)rand() % 4;
+            Bitmap rb = { &mem[offset], (SIZE)(1 + (UINT)rand() % (sizeof (mem) - 4)),
+                          bitsPerStates[i], isValid };
+
+            // Bias towards one state, so that long runs are present.
+            for (UINT k = 0; k < rb.size; k++) {
+                rb.bitmap[k] = (rand() % 3 == 0) ? (BitmapState)rand() : 0;
+            }
+
+            BitmapState state = (BitmapState)((UINT)rand() % BITMAP_MAX_STATE (&rb));
+            UINT len          = 1 + (UINT)rand() % (BITMAP_CAPACITY (&rb) + 1);
+
+            EQ_SCALAR (reference_findContinous (&rb, state, len),
+                       bitmap_findContinous (&rb, state, len));
+
+            UINT at = (UINT)rand() % BITMAP_CAPACITY (&rb);
+            EQ_SCALAR (reference_findContinousAt (&rb, state, len, at),
+                       bitmap_findContinousAt (&rb, state, len, at));
+
+            UINT run = 0;
+            for (; at + run < BITMAP_CAPACITY (&rb) && run < len &&
+                   bitmap_get (&rb, at + run) == state;
+                 run++)
+                ;
+            EQ_SCALAR (run, bitmap_countContinous (&rb, state, at, len));
+
+            // Section must be within the range [from, to).
+            UINT from     = (UINT)rand() % BITMAP_CAPACITY (&rb);
+            UINT to       = from + (UINT)rand() % (BITMAP_CAPACITY (&rb) - from + 1);
+            INT expected  = KERNEL_EXIT_FAILURE;
+            for (UINT i = from; i + len <= to && expected == KERNEL_EXIT_FAILURE; i++) {
+                if (reference_findContinousAt (&rb, state, len, i))
+                    expected = (INT)i;
+            }
+            EQ_SCALAR (expected, bitmap_findContinousInRange (&rb, state, len, from, to));
+        }
+    }
+    END();
+}
+
+/**************************************************************************************************
+ * 128 MB of RAM fragmented so that free blocks are always one page frame short of the requested
+ * length. Every search fails and must look at the whole PAB.
+ * Prints time taken by the linear search and the bitmap_findContinous.
+**************************************************************************************************/
+TEST(bitmap, findContinous_fragmented_benchmark)
+{
+    // 128 MB / 4 KB per page frame, 2 bits per state.
+    static BitmapState pab[(128 * 1024 * 1024 / 4096) * 2 / 8];
+    Bitmap pb = { pab, sizeof (pab), 2, isValid };
+
+    UINT lens[] = { 2, 8, 64 };
+    for (UINT i = 0; i < ARRAY_LENGTH (lens); i++) {
+        // Free blocks of (len - 1) page frames with one used page frame in between.
+        memset (pab, 0, sizeof (pab));
+        for (UINT frame = lens[i] - 1; frame < BITMAP_CAPACITY (&pb); frame += lens[i]) {
+            pab[frame / 4] |= (BitmapState)(1 << ((frame % 4) * 2));
+        }
+
+        clock_t start    = clock();
+        INT expected     = reference_findContinous (&pb, 0, lens[i]);
+        clock_t linear   = clock() - start;
+
+        start            = clock();
+        INT got          = bitmap_findContinous (&pb, 0, lens[i]);
+        clock_t wordwise = clock() - start;
+
+        EQ_SCALAR (KERNEL_EXIT_FAILURE, expected);
+        EQ_SCALAR (expected, got);
+        printf ("\n  len %2u: linear %9.3f ms, word at a time %7.3f ms", lens[i],
+                (double)linear * 1000 / CLOCKS_PER_SEC, (double)wordwise * 1000 / CLOCKS_PER_SEC);
+    }
+    END();
+}
+
 #ifdef DEBUG
 /**************************************************************************************************
  * Bitmap bits per state must be a factor of 8.
@@ -398,5 +519,7 @@ int main(void) {
     findContinousAt_mustpass();
     get_mustpass();
     bitmap_splited_mustpass();
+    findContinous_reference_mustpass();
+    findContinous_fragmented_benchmark();
     RETURN_WITH_REPORT();
 }
@@ -11,10 +11,11 @@
 #include <stdlib.h>
 
 #define HANDLES_ARRAY_COUNT 100
-#define HANDLES_ARRAY_SIZE_BYTES (sizeof(void*) * HANDLES_ARRAY_COUNT)
+#define HANDLES_ARRAY_SIZE_BYTES (sizeof(HandleItem) * HANDLES_ARRAY_COUNT)
 static void* ut_handles;
 #define FIRST_HANDLE 0
 #define LAST_HANDLE HANDLES_ARRAY_COUNT - 1
+#define OWNER_ID 1
 
 /*
  * | TEST CASES                                            | TEST FUNCTION                 |
@@ -31,6 +32,8 @@ static void* ut_handles;
  * |                                                       | remove_invalid_handle_failure |
  * | Invalid handle: Handle poiting to NULL object         | get_invalid_handle_failure    |
  * |                                                       | remove_invalid_handle_failure |
+ * | Get object of another type                            | get_wrong_type_failure        |
+ * | Find handles of a type created by a process           | find_handle_success           |
  * |-------------------------------------------------------|-------------------------------|
  * */
 
@@ -55,11 +58,11 @@ TEST (handles, add_get_first_success)
     // ------------------
 
     int obj1  = 0xAAFFBB00;
-    Handle h1 = khandle_createHandle (&obj1);
+    Handle h1 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID);
     EQ_SCALAR (h1, FIRST_HANDLE);
 
-    EQ_SCALAR ((PTR)khandle_getObject (h1), (PTR)&obj1);
-    EQ_SCALAR (*(int*)khandle_getObject (h1), obj1);
+    EQ_SCALAR ((PTR)khandle_getObject (h1, KERNEL_OBJECT_TYPE_SHARE), (PTR)&obj1);
+    EQ_SCALAR (*(int*)khandle_getObject (h1, KERNEL_OBJECT_TYPE_SHARE), obj1);
 
     END();
 }
@@ -69,15 +72,15 @@ TEST (handles, add_get_last_success)
     // Pre setup:
     // Fill all but the last item of the handles array will non NULL value.
     // ------------------
-    memset (ut_handles, 0x1, HANDLES_ARRAY_SIZE_BYTES - sizeof (void*));
+    memset (ut_handles, 0x1, HANDLES_ARRAY_SIZE_BYTES - sizeof (HandleItem));
     // ------------------
 
     int obj1  = 0xAAFFBB00;
-    Handle h1 = khandle_createHandle (&obj1);
+    Handle h1 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID);
     EQ_SCALAR (h1, LAST_HANDLE);
 
-    EQ_SCALAR ((PTR)khandle_getObject (h1), (PTR)&obj1);
-    EQ_SCALAR (*(int*)khandle_getObject (h1), obj1);
+    EQ_SCALAR ((PTR)khandle_getObject (h1, KERNEL_OBJECT_TYPE_SHARE), (PTR)&obj1);
+    EQ_SCALAR (*(int*)khandle_getObject (h1, KERNEL_OBJECT_TYPE_SHARE), obj1);
 
     END();
 }
@@ -89,7 +92,7 @@ TEST (handles, add_null_obj_inadd_failure)
     // None
     // ------------------
 
-    EQ_SCALAR (khandle_createHandle (NULL), INVALID_HANDLE);
+    EQ_SCALAR (khandle_createHandle (NULL, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID), INVALID_HANDLE);
     EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
     END();
 }
@@ -103,7 +106,7 @@ TEST (handles, add_oom_failure)
     // ------------------
 
     int obj1 = 0xAAFFBB00;
-    EQ_SCALAR (khandle_createHandle (&obj1), INVALID_HANDLE);
+    EQ_SCALAR (khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID), INVALID_HANDLE);
     EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_OUT_OF_MEM);
     END();
 }
@@ -114,16 +117,16 @@ TEST (handles, get_invalid_handle_failure)
     // add one object to obtain its handle
     // ------------------
     int obj1  = 0xAAFFBB00;
-    Handle h1 = khandle_createHandle (&obj1);
+    Handle h1 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID);
     NEQ_SCALAR (h1, INVALID_HANDLE);
     // ------------------
 
     // Invalid handle 1: Exceeds the Max count
-    EQ_SCALAR ((PTR)khandle_getObject (HANDLES_ARRAY_COUNT), (PTR)NULL);
+    EQ_SCALAR ((PTR)khandle_getObject (HANDLES_ARRAY_COUNT, KERNEL_OBJECT_TYPE_SHARE), (PTR)NULL);
     EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_HANDLE);
 
     // Invalid handle 1: Handle that points to NULL object
-    EQ_SCALAR ((PTR)khandle_getObject (h1 + 1), (PTR)NULL);
+    EQ_SCALAR ((PTR)khandle_getObject (h1 + 1, KERNEL_OBJECT_TYPE_SHARE), (PTR)NULL);
     EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_HANDLE);
     END();
 }
@@ -134,7 +137,7 @@ TEST (handles, remove_invalid_handle_failure)
     // add one object to obtain its handle
     // ------------------
     int obj1  = 0xAAFFBB00;
-    Handle h1 = khandle_createHandle (&obj1);
+    Handle h1 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID);
     NEQ_SCALAR (h1, INVALID_HANDLE);
     // ------------------
 
@@ -154,9 +157,9 @@ TEST (handles, remove_object_success)
     // add three objects to obtain its handle
     // ------------------
     int obj1  = 0xAAFFBB00;
-    Handle h1 = khandle_createHandle (&obj1);
-    Handle h2 = khandle_createHandle (&obj1);
-    Handle h3 = khandle_createHandle (&obj1);
+    Handle h1 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID);
+    Handle h2 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID);
+    Handle h3 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID);
     NEQ_SCALAR (h1, INVALID_HANDLE);
     NEQ_SCALAR (h2, INVALID_HANDLE);
     NEQ_SCALAR (h3, INVALID_HANDLE);
@@ -166,7 +169,45 @@ TEST (handles, remove_object_success)
     EQ_SCALAR (khandle_freeHandle (h2), true);
 
     // Adding a object again should give the same handle.
-    EQ_SCALAR (khandle_createHandle (&obj1), h2);
+    EQ_SCALAR (khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID), h2);
+    END();
+}
+
+TEST (handles, get_wrong_type_failure)
+{
+    // Pre setup:
+    // add one object to obtain its handle
+    // ------------------
+    int obj1  = 0xAAFFBB00;
+    Handle h1 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_WINDOW, OWNER_ID);
+    NEQ_SCALAR (h1, INVALID_HANDLE);
+    // ------------------
+
+    EQ_SCALAR ((PTR)khandle_getObject (h1, KERNEL_OBJECT_TYPE_SHARE), (PTR)NULL);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    EQ_SCALAR (khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_INVALID, OWNER_ID), INVALID_HANDLE);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+    END();
+}
+
+TEST (handles, find_handle_success)
+{
+    // Pre setup:
+    // add objects of different types and owners
+    // ------------------
+    int obj1  = 0xAAFFBB00;
+    Handle h1 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_WINDOW, OWNER_ID);
+    Handle h2 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID + 1);
+    Handle h3 = khandle_createHandle (&obj1, KERNEL_OBJECT_TYPE_SHARE, OWNER_ID);
+    NEQ_SCALAR (h1, INVALID_HANDLE);
+    NEQ_SCALAR (h2, INVALID_HANDLE);
+    NEQ_SCALAR (h3, INVALID_HANDLE);
+    // ------------------
+
+    EQ_SCALAR (khandle_findHandle (KERNEL_OBJECT_TYPE_SHARE, OWNER_ID), h3);
+    EQ_SCALAR (khandle_freeHandle (h3), true);
+    EQ_SCALAR (khandle_findHandle (KERNEL_OBJECT_TYPE_SHARE, OWNER_ID), INVALID_HANDLE);
     END();
 }
 
@@ -192,5 +233,7 @@ int main(void)
     get_invalid_handle_failure();
     remove_object_success();
     remove_invalid_handle_failure();
+    get_wrong_type_failure();
+    find_handle_success();
     RETURN_WITH_REPORT();
 }
@@ -14,10 +14,14 @@
     #include <mock/cm/cm.h>
 
     typedef CM_MallocHeader MallocHeader;
+    #define FREE_BIN_COUNT            CM_MALLOC_FREE_BIN_COUNT
+    #define LARGE_THRESHOLD_BYTES     CM_MALLOC_LARGE_THRESHOLD_BYTES
+    typedef CM_MallocFooter MallocFooter;
     #define MALLOC_FN_UNDER_TEST      cm_malloc
     #define FREE_FN_UNDER_TEST        cm_free
     #define MALLOCZ_FN_UNDER_TEST     cm_calloc
     #define MALLOC_INIT_FN_UNDER_TEST cm_malloc_init
+    #define GET_STATS_FN_UNDER_TEST   cm_malloc_getStats
 #else
     #include <memmanage.h>
     #include <kerror.h>
@@ -26,10 +30,14 @@
     #include <mock/kernel/kstdlib.h>
 
     typedef KMallocHeader MallocHeader;
+    #define FREE_BIN_COUNT            KMALLOC_FREE_BIN_COUNT
+    #define LARGE_THRESHOLD_BYTES     KMALLOC_LARGE_THRESHOLD_BYTES
+    typedef KMallocFooter MallocFooter;
     #define MALLOC_FN_UNDER_TEST      kmalloc
     #define FREE_FN_UNDER_TEST        kfree
     #define MALLOCZ_FN_UNDER_TEST     kmallocz
     #define MALLOC_INIT_FN_UNDER_TEST kmalloc_init
+    #define GET_STATS_FN_UNDER_TEST   kmalloc_getStats
 #endif // LIBCM
 
 /* |Test case description                                       | Test function name             |
@@ -40,15 +48,25 @@
  * | free: Address input found. Combining next. Freed           | free_combining_next_adj_nodes  |
  * | free: Address input found. Combining prev. Freed           | free_combining_prev_adj_nodes  |
  * | free: Address input not found. Invalid argument error      | free_wrong_input               |
+ * | free: Address input already freed. Double free error       | free_double_free               |
+ * | free: Freed again after combining with neighbours. Error   | free_double_free_combined      |
+ * | free: Header before address input is corrupt. Error        | free_corrupt_header            |
  * | malloc_getUsedMemory: When no memory is allocated          | used_memory_test               |
  * | malloc_getUsedMemory: When some memory is allocated        | used_memory_test               |
+ * | malloc: Smaller free node is used over a larger one        | allocation_best_fit            |
+ * | malloc/free: Large allocation uses own virtual pages       | large_allocation               |
+ * | malloc/free: Counters are updated on every call            | allocation_stats               |
+ * | Replays an allocation trace. Prints peak heap usage.       | trace_fragmentation_benchmark  |
+ * | kmalloc: No free node is large enough. Arena grows         | arena_grow                     |
+ * | kfree: Large free node at arena end. Arena shrinks         | arena_trim                     |
+ * | kmalloc_aligned: Alignments from 16 bytes to 4 KB          | aligned_allocation             |
+ * | kmalloc_aligned: Alignment not a power of two or too large | aligned_wrong_alignment        |
  * |------------------------------------------------------------|--------------------------------|
  */
 
 typedef enum MallocLists {
     FREE_LIST,
-    ALLOC_LIST,
-    ADJ_LIST
+    ALLOC_LIST
 } MallocLists;
 
 typedef struct SectionAttributes {
@@ -56,16 +74,36 @@ typedef struct SectionAttributes {
     bool isAllocated;
 } SectionAttributes;
 
-extern ListNode s_freeHead, s_allocHead, s_adjHead;
-ListNode s_freeHead, s_allocHead, s_adjHead;
+extern ListNode s_freeBins[FREE_BIN_COUNT], s_allocHead;
+ListNode s_freeBins[FREE_BIN_COUNT], s_allocHead;
 
 // The malloc buffer size must be large enough to meet the test expectations.
 #define UT_MALLOC_SIZE_BYTES 400
-char malloc_buffer[UT_MALLOC_SIZE_BYTES];
+
+// Heap size used by the trace benchmark. It uses the same buffer.
+#define UT_TRACE_HEAP_SIZE_BYTES (16 * KB)
+
+// Reserved range size used by the arena tests. Initial arena is smaller than this.
+#define UT_ARENA_RESERVE_BYTES (128 * KB)
+#define UT_ARENA_ALLOC_BYTES   (2 * KB) // Smaller than the large allocation threshold.
+
+char malloc_buffer[MAX (UT_MALLOC_SIZE_BYTES, MAX (UT_TRACE_HEAP_SIZE_BYTES,
+                                                   UT_ARENA_RESERVE_BYTES))]
+    __attribute__ ((aligned (CONFIG_PAGE_FRAME_SIZE_BYTES)));
+
+// Pages of a large allocation. Memory is not accessed by the tests.
+static char large_buffer[CONFIG_PAGE_FRAME_SIZE_BYTES];
+#define UT_LARGE_ALLOC_BYTES (LARGE_THRESHOLD_BYTES + 1)
+#define UT_LARGE_ALLOC_PAGES 2U // Pages in UT_LARGE_ALLOC_BYTES.
+#ifdef LIBCM
+static void* unmapped_addr;
+#else
+static bool kvmm_freeGuarded_handler (VMemoryManager* vmm, PTR va, SIZE* const outPages);
+#endif
 
 static inline size_t getNodeSize (size_t usableSize)
 {
-    return sizeof (MallocHeader) + usableSize;
+    return sizeof (MallocHeader) + usableSize + sizeof (MallocFooter);
 }
 
 static inline MallocHeader* calculateHeaderLocation (void* usableAddrStart)
@@ -226,14 +264,369 @@ TEST (kfree, free_wrong_input)
     EQ_SCALAR (FREE_FN_UNDER_TEST (NULL), false);
 #ifdef LIBCM
     EQ_SCALAR (cm_panic_invoked, true);
+#else
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+#endif
+    END();
+}
+
+TEST (kfree, free_double_free)
+{
+    void* addr1 = MALLOC_FN_UNDER_TEST (100);
+    NEQ_ADDRESS (MALLOC_FN_UNDER_TEST (50), NULL);
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr1), true);
+    // ------------------------------------------------------------------------------------------
+
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr1), false);
+#ifdef LIBCM
+    EQ_SCALAR (cm_panic_invoked, true);
 #else
     EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_DOUBLE_FREE);
 #endif
     END();
 }
 
+TEST (kfree, free_double_free_combined)
+{
+    void* addr1 = MALLOC_FN_UNDER_TEST (100);
+    void* addr2 = MALLOC_FN_UNDER_TEST (100);
+    NEQ_ADDRESS (MALLOC_FN_UNDER_TEST (50), NULL);
+
+    // addr2 is combined into addr1, which was free before it.
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr1), true);
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr2), true);
+    // ------------------------------------------------------------------------------------------
+
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr2), false);
+#ifdef LIBCM
+    EQ_SCALAR (cm_panic_invoked, true);
+#else
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_DOUBLE_FREE);
+#endif
+    END();
+}
+
+TEST (kfree, free_corrupt_header)
+{
+    char* addr1 = MALLOC_FN_UNDER_TEST (100);
+    NEQ_ADDRESS (MALLOC_FN_UNDER_TEST (50), NULL);
+    // ------------------------------------------------------------------------------------------
+
+    // Address within an allocation.
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr1 + 8), false);
+
+    // Footer does not agree with the header.
+    MallocHeader* header = calculateHeaderLocation (addr1);
+    header->netNodeSize += 4;
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr1), false);
+#ifdef LIBCM
+    EQ_SCALAR (cm_panic_invoked, true);
+#else
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+#endif
+
+    // Nothing has changed.
+    header->netNodeSize -= 4;
+    EQ_SCALAR (true, isAddressFoundInList (addr1, ALLOC_LIST));
+    END();
+}
+
+TEST (kmalloc, allocation_best_fit)
+{
+    // Pre-condition: Two free nodes, a larger one before a smaller one. Both in the same bin.
+    void *addr1, *addr2;
+    NEQ_ADDRESS ((addr1 = MALLOC_FN_UNDER_TEST (60 + getNodeSize (0))), NULL);
+    NEQ_ADDRESS (MALLOC_FN_UNDER_TEST (10), NULL);
+    NEQ_ADDRESS ((addr2 = MALLOC_FN_UNDER_TEST (40 + getNodeSize (0))), NULL);
+    NEQ_ADDRESS (MALLOC_FN_UNDER_TEST (10), NULL);
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr2), true);
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr1), true); // Larger node is now first in the bin.
+    // ------------------------------------------------------------------------------------------
+
+    // Smaller node, which is large enough, is used. Free nodes are split only when the remaining
+    // part can hold a node.
+    EQ_ADDRESS (MALLOC_FN_UNDER_TEST (40), addr2);
+    END();
+}
+
+TEST (kmalloc, large_allocation)
+{
+    // Pre-condition: Nothing
+    size_t freeListCapPrev = getCapacity (FREE_LIST);
+#ifndef LIBCM
+    kvmm_allocGuarded_fake.ret = (PTR)large_buffer;
+    kvmm_freeGuarded_fake.ret  = true;
+    MUST_CALL_ANY_ORDER (kvmm_allocGuarded, _, V (2U), V (VMM_MEMMAP_FLAG_KERNEL_PAGE));
+    MUST_CALL_ANY_ORDER (kvmm_freeGuarded, _, V ((PTR)large_buffer), _);
+#endif
+    // ------------------------------------------------------------------------------------------
+
+    // Large allocation does not use the heap.
+    void* addr = MALLOC_FN_UNDER_TEST (UT_LARGE_ALLOC_BYTES);
+    EQ_ADDRESS (addr, large_buffer);
+    EQ_SCALAR (getCapacity (FREE_LIST), freeListCapPrev);
+    EQ_SCALAR (getCapacity (ALLOC_LIST), 0U);
+
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr), true);
+#ifdef LIBCM
+    EQ_ADDRESS (unmapped_addr, large_buffer);
+#endif
+    EQ_SCALAR (getCapacity (FREE_LIST), freeListCapPrev);
+    END();
+}
+
+TEST (kmalloc, allocation_stats)
+{
+    // Pre-condition: Nothing
+#ifndef LIBCM
+    kvmm_allocGuarded_fake.ret    = (PTR)large_buffer;
+    kvmm_freeGuarded_fake.handler = kvmm_freeGuarded_handler;
+#endif
+    OSIF_AllocatorStats stats;
+    GET_STATS_FN_UNDER_TEST (&stats);
+    EQ_SCALAR (stats.usedBytes, 0U);
+    EQ_SCALAR (stats.allocCount, 0U);
+    // ------------------------------------------------------------------------------------------
+
+    void *addr1, *addr2;
+    NEQ_ADDRESS ((addr1 = MALLOC_FN_UNDER_TEST (100)), NULL);
+    NEQ_ADDRESS (MALLOC_FN_UNDER_TEST (50), NULL);
+    NEQ_ADDRESS ((addr2 = MALLOC_FN_UNDER_TEST (UT_LARGE_ALLOC_BYTES)), NULL);
+    EQ_ADDRESS (MALLOC_FN_UNDER_TEST (UT_MALLOC_SIZE_BYTES), NULL); // More than the heap.
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr1), true);
+    EQ_SCALAR (FREE_FN_UNDER_TEST (addr2), true);
+
+    size_t largeBytes = UT_LARGE_ALLOC_PAGES * CONFIG_PAGE_FRAME_SIZE_BYTES;
+    GET_STATS_FN_UNDER_TEST (&stats);
+    EQ_SCALAR (stats.usedBytes, getNodeSize (50));
+    EQ_SCALAR (stats.peakUsedBytes, getNodeSize (100) + getNodeSize (50) + largeBytes);
+    EQ_SCALAR (stats.allocCount, 3U);
+    EQ_SCALAR (stats.freeCount, 2U);
+    EQ_SCALAR (stats.failedCount, 1U);
+
+    // Histogram counts requested sizes. Failed allocations are not counted.
+    UINT histogramTotal = 0;
+    for (UINT i = 0; i < OSIF_ALLOCATOR_STATS_HISTOGRAM_BUCKETS; i++) {
+        histogramTotal += stats.sizeHistogram[i];
+    }
+    EQ_SCALAR (histogramTotal, 3U);
+    EQ_SCALAR (stats.sizeHistogram[6], 1U);  // 100 bytes
+    EQ_SCALAR (stats.sizeHistogram[5], 1U);  // 50 bytes
+    EQ_SCALAR (stats.sizeHistogram[12], 1U); // Large allocation
+    END();
+}
+
+/* Allocation trace recorded from a run with kernel objects of various lifetimes. Objects are
+ * identified by a slot number, which is reused once the object is freed. */
+typedef struct TraceOp {
+    char op; // 'A' for allocation, 'F' for free.
+    U8 slot;
+    U16 bytes;
+} TraceOp;
+
+static const TraceOp trace[] = {
+    { 'A',  0, 512 }, { 'A',  1,  64 }, { 'A',  2, 128 }, { 'A',  3,  32 }, { 'A',  4, 256 }, { 'A',  5,  48 },
+    { 'A',  6,  40 }, { 'F',  6,   0 }, { 'A',  6,  40 }, { 'F',  6,   0 }, { 'A',  6, 160 }, { 'A',  7,  96 },
+    { 'A',  8,  40 }, { 'A',  9,  24 }, { 'F',  9,   0 }, { 'F',  6,   0 }, { 'F',  7,   0 }, { 'F',  8,   0 },
+    { 'A',  6,  24 }, { 'F',  6,   0 }, { 'A',  6,  40 }, { 'F',  6,   0 }, { 'A',  6,  24 }, { 'F',  6,   0 },
+    { 'A',  6,  24 }, { 'F',  6,   0 }, { 'A',  6, 160 }, { 'A',  7,  96 }, { 'A',  8,  40 }, { 'A',  9, 160 },
+    { 'A', 10,  96 }, { 'A', 11,  40 }, { 'A', 12, 160 }, { 'A', 13,  96 }, { 'A', 14,  40 }, { 'A', 15, 160 },
+    { 'A', 16,  96 }, { 'A', 17,  40 }, { 'A', 18,  40 }, { 'F', 18,   0 }, { 'A', 18, 160 }, { 'A', 19,  96 },
+    { 'A', 20,  40 }, { 'A', 21, 160 }, { 'A', 22,  96 }, { 'A', 23,  40 }, { 'F',  6,   0 }, { 'F',  7,   0 },
+    { 'F',  8,   0 }, { 'A',  6,  40 }, { 'F',  6,   0 }, { 'F', 21,   0 }, { 'F', 22,   0 }, { 'F', 23,   0 },
+    { 'A',  6,  24 }, { 'F', 12,   0 }, { 'F', 13,   0 }, { 'F', 14,   0 }, { 'A',  7,  24 }, { 'F',  7,   0 },
+    { 'A',  7,  40 }, { 'F',  7,   0 }, { 'A',  7, 160 }, { 'A',  8,  96 }, { 'A', 12,  40 }, { 'A', 13, 160 },
+    { 'A', 14,  96 }, { 'A', 21,  40 }, { 'A', 22, 160 }, { 'A', 23,  96 }, { 'A', 24,  40 }, { 'A', 25,  24 },
+    { 'F', 25,   0 }, { 'A', 25,  72 }, { 'A', 26,  64 }, { 'F', 22,   0 }, { 'F', 23,   0 }, { 'F', 24,   0 },
+    { 'A', 22, 160 }, { 'A', 23,  96 }, { 'A', 24,  40 }, { 'A', 27,  24 }, { 'F', 27,   0 }, { 'F',  7,   0 },
+    { 'F',  8,   0 }, { 'F', 12,   0 }, { 'F', 25,   0 }, { 'F', 26,   0 }, { 'A',  7,  24 }, { 'F',  7,   0 },
+    { 'A',  7,  24 }, { 'F',  7,   0 }, { 'A',  7,  24 }, { 'F',  7,   0 }, { 'A',  7, 160 }, { 'A',  8,  96 },
+    { 'A', 12,  40 }, { 'A', 25,  24 }, { 'F', 25,   0 }, { 'F', 13,   0 }, { 'F', 14,   0 }, { 'F', 21,   0 },
+    { 'F', 15,   0 }, { 'F', 16,   0 }, { 'F', 17,   0 }, { 'F',  6,   0 }, { 'A',  6, 160 }, { 'A', 13,  96 },
+    { 'A', 14,  40 }, { 'A', 15,  88 }, { 'A', 16,  16 }, { 'A', 17, 160 }, { 'A', 21,  96 }, { 'A', 25,  40 },
+    { 'A', 26,  88 }, { 'A', 27,  24 }, { 'F', 22,   0 }, { 'F', 23,   0 }, { 'F', 24,   0 }, { 'F', 15,   0 },
+    { 'A', 15, 160 }, { 'A', 22,  96 }, { 'A', 23,  40 }, { 'A', 24,  24 }, { 'F', 24,   0 }, { 'F', 18,   0 },
+    { 'F', 19,   0 }, { 'F', 20,   0 }, { 'F', 16,   0 }, { 'A', 16,  24 }, { 'F', 16,   0 }, { 'F', 15,   0 },
+    { 'F', 22,   0 }, { 'F', 23,   0 }, { 'A', 15,  40 }, { 'A', 16, 160 }, { 'A', 18,  96 }, { 'A', 19,  40 },
+    { 'F',  7,   0 }, { 'F',  8,   0 }, { 'F', 12,   0 }, { 'F',  6,   0 }, { 'F', 13,   0 }, { 'F', 14,   0 },
+    { 'A',  6,  40 }, { 'A',  7, 160 }, { 'A',  8,  96 }, { 'A', 12,  40 }, { 'A', 13,  24 }, { 'F', 13,   0 },
+    { 'F',  7,   0 }, { 'F',  8,   0 }, { 'F', 12,   0 }, { 'A',  7,  40 }, { 'F',  7,   0 }, { 'A',  7, 160 },
+    { 'A',  8,  96 }, { 'A', 12,  40 }, { 'A', 13,  24 }, { 'F', 13,   0 }, { 'A', 13,  24 }, { 'F', 13,   0 },
+    { 'A', 13,  72 }, { 'A', 14,  24 }, { 'F', 14,   0 }, { 'A', 14,  24 }, { 'F', 14,   0 }, { 'A', 14,  40 },
+    { 'A', 20, 160 }, { 'A', 22,  96 }, { 'A', 23,  40 }, { 'F', 17,   0 }, { 'F', 21,   0 }, { 'F', 25,   0 },
+    { 'F', 26,   0 }, { 'F', 27,   0 }, { 'F', 15,   0 }, { 'A', 15, 160 }, { 'A', 17,  96 }, { 'A', 21,  40 },
+    { 'A', 24, 160 }, { 'A', 25,  96 }, { 'A', 26,  40 }, { 'F', 15,   0 }, { 'F', 17,   0 }, { 'F', 21,   0 },
+    { 'A', 15,  24 }, { 'A', 17, 160 }, { 'A', 21,  96 }, { 'A', 27,  40 }, { 'A', 28,  24 }, { 'F', 28,   0 },
+    { 'A', 28,  24 }, { 'F', 28,   0 }, { 'A', 28,  72 }, { 'A', 29,  24 }, { 'F', 29,   0 }, { 'A', 29,  40 },
+    { 'F', 29,   0 }, { 'F', 16,   0 }, { 'F', 18,   0 }, { 'F', 19,   0 }, { 'F',  6,   0 }, { 'F', 13,   0 },
+    { 'A',  6,  24 }, { 'A', 13,  24 }, { 'A', 16,  24 }, { 'A', 18,  56 }, { 'A', 19,  24 }, { 'F',  9,   0 },
+    { 'F', 10,   0 }, { 'F', 11,   0 }, { 'F', 14,   0 }, { 'F', 18,   0 }, { 'A',  9,  88 }, { 'A', 10,  40 },
+    { 'F', 10,   0 }, { 'A', 10, 160 }, { 'A', 11,  96 }, { 'A', 14,  40 }, { 'A', 18, 160 }, { 'A', 29,  96 },
+    { 'A', 30,  40 }, { 'F',  7,   0 }, { 'F',  8,   0 }, { 'F', 12,   0 }, { 'F', 15,   0 }, { 'F', 28,   0 },
+    { 'F',  9,   0 }, { 'A',  7,  64 }, { 'F', 18,   0 }, { 'F', 29,   0 }, { 'F', 30,   0 }, { 'A',  8,  40 },
+    { 'A',  9, 160 }, { 'A', 12,  96 }, { 'A', 15,  40 }, { 'A', 18,  24 }, { 'F', 18,   0 }, { 'A', 18, 160 },
+    { 'A', 28,  96 }, { 'A', 29,  40 }, { 'F', 18,   0 }, { 'F', 28,   0 }, { 'F', 29,   0 }, { 'A', 18, 160 },
+    { 'A', 28,  96 }, { 'A', 29,  40 }, { 'A', 30,  40 }, { 'F', 30,   0 }, { 'F', 17,   0 }, { 'F', 21,   0 },
+    { 'F', 27,   0 }, { 'F', 13,   0 }, { 'F', 16,   0 }, { 'F', 19,   0 }, { 'F',  7,   0 }, { 'A',  7, 160 },
+    { 'A', 13,  96 }, { 'A', 16,  40 }, { 'A', 17,  24 }, { 'F',  9,   0 }, { 'F', 12,   0 }, { 'F', 15,   0 },
+    { 'A',  9,  24 }, { 'F',  9,   0 }, { 'A',  9,  24 }, { 'F',  9,   0 }, { 'A',  9,  40 }, { 'F',  7,   0 },
+    { 'F', 13,   0 }, { 'F', 16,   0 }, { 'F', 17,   0 }, { 'A',  7,  40 }, { 'A', 12, 160 }, { 'A', 13,  96 },
+    { 'A', 15,  40 }, { 'F', 20,   0 }, { 'F', 22,   0 }, { 'F', 23,   0 }, { 'A', 16,  24 }, { 'A', 17, 160 },
+    { 'A', 19,  96 }, { 'A', 20,  40 }, { 'A', 21,  24 }, { 'F', 17,   0 }, { 'F', 19,   0 }, { 'F', 20,   0 },
+    { 'F', 21,   0 }, { 'A', 17,  24 }, { 'A', 19,  88 }, { 'F', 24,   0 }, { 'F', 25,   0 }, { 'F', 26,   0 },
+    { 'F',  6,   0 }, { 'F',  9,   0 }, { 'F',  7,   0 }, { 'A',  6, 160 }, { 'A',  7,  96 }, { 'A',  9,  40 },
+    { 'F', 10,   0 }, { 'F', 11,   0 }, { 'F', 14,   0 }, { 'F',  8,   0 }, { 'F', 18,   0 }, { 'F', 28,   0 },
+    { 'F', 29,   0 }, { 'F', 12,   0 }, { 'F', 13,   0 }, { 'F', 15,   0 }, { 'F', 16,   0 }, { 'F', 17,   0 },
+    { 'F', 19,   0 }, { 'F',  6,   0 }, { 'F',  7,   0 }, { 'F',  9,   0 },
+};
+
+TEST (kmalloc, trace_fragmentation_benchmark)
+{
+    static void* slots[64];
+    size_t liveBytes = 0, peakLiveBytes = 0, peakHeapBytes = 0;
+
+    // Pre-condition: Larger heap.
+#ifdef LIBCM
+    g_utmm.cm_arch_mem_len_bytes_malloc = UT_TRACE_HEAP_SIZE_BYTES;
+#else
+    g_utmm.arch_mem_len_bytes_kmalloc = UT_TRACE_HEAP_SIZE_BYTES;
+#endif
+    MALLOC_INIT_FN_UNDER_TEST();
+    // ------------------------------------------------------------------------------------------
+
+    for (size_t i = 0; i < ARRAY_LENGTH (trace); i++) {
+        const TraceOp* op = &trace[i];
+        assert (op->slot < ARRAY_LENGTH (slots));
+
+        if (op->op == 'A') {
+            NEQ_ADDRESS ((slots[op->slot] = MALLOC_FN_UNDER_TEST (op->bytes)), NULL);
+
+            // Heap usage is the distance of the end of the highest allocation from the start.
+            size_t heapBytes = (size_t)((char*)slots[op->slot] + op->bytes - malloc_buffer);
+            liveBytes += op->bytes;
+            peakLiveBytes = MAX (peakLiveBytes, liveBytes);
+            peakHeapBytes = MAX (peakHeapBytes, heapBytes);
+        } else {
+            // Header can get combined with the next node on free, so size is read before that.
+            liveBytes -= calculateHeaderLocation (slots[op->slot])->netNodeSize - getNodeSize (0);
+            EQ_SCALAR (FREE_FN_UNDER_TEST (slots[op->slot]), true);
+        }
+    }
+
+    printf ("\n  %zu operations. Peak live: %zu bytes. Peak heap usage: %zu bytes (%zu%%).",
+            ARRAY_LENGTH (trace), peakLiveBytes, peakHeapBytes, peakHeapBytes * 100 / peakLiveBytes);
+    END();
+}
+
 #ifndef LIBCM
-// Kernel only test. No corresponding function in libcm.
+// Kernel only tests. libcm heap does not grow.
+TEST (kmalloc, arena_grow)
+{
+    // Pre-condition: Reserved range is larger than the initial arena.
+    g_utmm.arch_mem_len_bytes_kmalloc = UT_ARENA_RESERVE_BYTES;
+    MALLOC_INIT_FN_UNDER_TEST();
+    UINT memmapCount = kvmm_memmap_fake.invokeCount;
+    // ------------------------------------------------------------------------------------------
+
+    // Allocations more than the initial arena size. Free node at the end is combined with the new
+    // part every time the arena grows, so allocations are placed one after another.
+    char* addr1 = MALLOC_FN_UNDER_TEST (UT_ARENA_ALLOC_BYTES);
+    NEQ_ADDRESS (addr1, NULL);
+    for (UINT i = 1; i < 10; i++) {
+        EQ_ADDRESS (MALLOC_FN_UNDER_TEST (UT_ARENA_ALLOC_BYTES),
+                    addr1 + i * getNodeSize (UT_ARENA_ALLOC_BYTES));
+    }
+
+    // Arena cannot grow beyond the reserved range.
+    void* addr;
+    while ((addr = MALLOC_FN_UNDER_TEST (UT_ARENA_ALLOC_BYTES)) != NULL) {
+        EQ_SCALAR ((PTR)addr < (PTR)malloc_buffer + UT_ARENA_RESERVE_BYTES, true);
+    }
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_OUT_OF_MEM);
+
+    // Range is reserved only once, at init.
+    EQ_SCALAR (kvmm_memmap_fake.invokeCount, memmapCount);
+    END();
+}
+
+TEST (kmalloc, arena_trim)
+{
+    // Pre-condition: Arena has grown for a number of allocations.
+    void* addrs[40];
+    g_utmm.arch_mem_len_bytes_kmalloc = UT_ARENA_RESERVE_BYTES;
+    kvmm_decommit_fake.ret            = true;
+    MALLOC_INIT_FN_UNDER_TEST();
+
+    for (UINT i = 0; i < ARRAY_LENGTH (addrs); i++) {
+        NEQ_ADDRESS ((addrs[i] = MALLOC_FN_UNDER_TEST (UT_ARENA_ALLOC_BYTES)), NULL);
+    }
+    size_t arenaSize = getCapacity (FREE_LIST) + getCapacity (ALLOC_LIST);
+    // ------------------------------------------------------------------------------------------
+
+    // Initial arena size worth of bytes is kept free at the end. Rest is given back.
+    PTR newEnd = ALIGN_UP ((PTR)malloc_buffer + getNodeSize (0) + 16 * KB,
+                           CONFIG_PAGE_FRAME_SIZE_BYTES);
+    MUST_CALL_ANY_ORDER (kvmm_decommit, _, V (newEnd),
+                         V (((PTR)malloc_buffer + arenaSize - newEnd) / CONFIG_PAGE_FRAME_SIZE_BYTES));
+
+    for (UINT i = 0; i < ARRAY_LENGTH (addrs); i++) {
+        EQ_SCALAR (FREE_FN_UNDER_TEST (addrs[i]), true);
+    }
+    EQ_SCALAR (getCapacity (FREE_LIST), newEnd - (PTR)malloc_buffer);
+    EQ_SCALAR (getCapacity (ALLOC_LIST), 0U);
+
+    // Remaining arena can be used without growing.
+    EQ_ADDRESS (MALLOC_FN_UNDER_TEST (UT_ARENA_ALLOC_BYTES), addrs[0]);
+    END();
+}
+
+// Kernel only tests. No corresponding function in libcm.
+TEST (kmalloc_aligned, aligned_allocation)
+{
+    // Pre-condition: Arena is large enough for the largest alignment.
+    g_utmm.arch_mem_len_bytes_kmalloc = UT_ARENA_RESERVE_BYTES;
+    MALLOC_INIT_FN_UNDER_TEST();
+    size_t freeListCapPrev = getCapacity (FREE_LIST);
+    // ------------------------------------------------------------------------------------------
+
+    void* addrs[9];
+    UINT count = 0;
+    for (size_t align = 16; align <= 4 * KB; align *= 2, count++) {
+        addrs[count] = kmalloc_aligned (24, align);
+        NEQ_ADDRESS (addrs[count], NULL);
+        EQ_SCALAR (IS_ALIGNED ((PTR)addrs[count], align), true);
+        EQ_SCALAR (isAddressFoundInList (addrs[count], ALLOC_LIST), true);
+    }
+
+    // Parts skipped for alignment remain free. Arena did not grow for them.
+    EQ_SCALAR (getCapacity (ALLOC_LIST), count * getNodeSize (24));
+    EQ_SCALAR (getCapacity (FREE_LIST) + getCapacity (ALLOC_LIST), freeListCapPrev);
+
+    // Regions are combined back when all of them are freed.
+    for (UINT i = 0; i < count; i++) {
+        EQ_SCALAR (FREE_FN_UNDER_TEST (addrs[i]), true);
+    }
+    SectionAttributes secAttrs[] = {
+        { freeListCapPrev, false }
+    };
+    matchSectionPlacementAndAttributes (secAttrs, ARRAY_LENGTH (secAttrs));
+
+    // Large allocations are always page aligned.
+    kvmm_allocGuarded_fake.ret = (PTR)large_buffer;
+    EQ_ADDRESS (kmalloc_aligned (UT_LARGE_ALLOC_BYTES, 4 * KB), large_buffer);
+    END();
+}
+
+TEST (kmalloc_aligned, aligned_wrong_alignment)
+{
+    size_t aligns[] = { 0, 24, 8 * KB };
+    for (size_t i = 0; i < ARRAY_LENGTH (aligns); i++) {
+        EQ_ADDRESS (kmalloc_aligned (24, aligns[i]), NULL);
+        EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_WRONG_ALIGNMENT);
+    }
+    END();
+}
+
 TEST (kmalloc_getUsedMemory, used_memory_test)
 {
     // When there are no allocation
@@ -252,28 +645,36 @@ TEST (kmalloc_getUsedMemory, used_memory_test)
 
 static void matchSectionPlacementAndAttributes (SectionAttributes* secAttrs, size_t count)
 {
-    ListNode* node       = NULL;
-    MallocHeader* header = NULL;
+    // Sections are walked in the order they are in the buffer using their sizes.
+    MallocHeader* header = (MallocHeader*)malloc_buffer;
     size_t i             = 0;
-    list_for_each (&s_adjHead, node)
+    while ((char*)header < malloc_buffer + UT_MALLOC_SIZE_BYTES)
     {
         assert (i < count);
-        header = LIST_ITEM (node, MallocHeader, adjnode);
         EQ_SCALAR (header->netNodeSize, secAttrs[i].nodeSize);
         EQ_SCALAR (header->isAllocated, secAttrs[i].isAllocated);
+
+        // Boundary tag must agree with the header.
+        MallocFooter* footer = (MallocFooter*)((char*)header + header->netNodeSize -
+                                               sizeof (MallocFooter));
+        EQ_SCALAR (footer->netNodeSize, header->netNodeSize);
+
+        header = (MallocHeader*)((char*)header + header->netNodeSize);
         i++;
     }
+    EQ_SCALAR (i, count);
 }
 
-static ListNode* getListHead (MallocLists list)
+// Free list is made of all the free bins. Sets 'count' to the number of list heads.
+static ListNode* getListHeads (MallocLists list, size_t* count)
 {
     switch (list) {
     case FREE_LIST:
-        return &s_freeHead;
+        *count = FREE_BIN_COUNT;
+        return s_freeBins;
     case ALLOC_LIST:
+        *count = 1;
         return &s_allocHead;
-    case ADJ_LIST:
-        return &s_adjHead;
     default:
         assert (false); // Unreachable
     };
@@ -286,8 +687,6 @@ static MallocHeader* getMallocHeaderFromList (MallocLists list, ListNode* node)
         return LIST_ITEM (node, MallocHeader, freenode);
     case ALLOC_LIST:
         return LIST_ITEM (node, MallocHeader, allocnode);
-    case ADJ_LIST:
-        return LIST_ITEM (node, MallocHeader, adjnode);
     default:
         assert (false); // Unreachable
     };
@@ -295,14 +694,17 @@ static MallocHeader* getMallocHeaderFromList (MallocLists list, ListNode* node)
 
 static bool isAddressFoundInList (void* addr, MallocLists list)
 {
-    ListNode* head = getListHead (list);
-    ListNode* node = NULL;
-
-    list_for_each (head, node)
-    {
-        MallocHeader* header = getMallocHeaderFromList (list, node);
-        if ((PTR)header == (PTR)calculateHeaderLocation (addr))
-            return true;
+    size_t count    = 0;
+    ListNode* heads = getListHeads (list, &count);
+    ListNode* node  = NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        list_for_each (&heads[i], node)
+        {
+            MallocHeader* header = getMallocHeaderFromList (list, node);
+            if ((PTR)header == (PTR)calculateHeaderLocation (addr))
+                return true;
+        }
     }
 
     return false;
@@ -310,13 +712,16 @@ static bool isAddressFoundInList (void* addr, MallocLists list)
 
 static size_t getCapacity (MallocLists list)
 {
-    ListNode* head = getListHead (list);
-    ListNode* node = NULL;
-    size_t capa    = 0;
-
-    list_for_each (head, node)
-    {
-        capa += getMallocHeaderFromList (list, node)->netNodeSize;
+    size_t count    = 0;
+    ListNode* heads = getListHeads (list, &count);
+    ListNode* node  = NULL;
+    size_t capa     = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        list_for_each (&heads[i], node)
+        {
+            capa += getMallocHeaderFromList (list, node)->netNodeSize;
+        }
     }
 
     return capa;
@@ -329,7 +734,6 @@ static size_t getCapacity (MallocLists list)
 S32 syscall_handler (OSIF_SYSCALLS fn, U32 arg1, U32 arg2, U32 arg3, U32 arg4, U32 arg5)
 {
     // Unused parameters
-    (void)arg1;
     (void)arg2;
     (void)arg3;
     (void)arg4;
@@ -339,17 +743,33 @@ S32 syscall_handler (OSIF_SYSCALLS fn, U32 arg1, U32 arg2, U32 arg3, U32 arg4, U
     case OSIF_SYSCALL_PROCESS_GET_DATAMEM_START:
         return (S32)malloc_buffer;
         break;
+    case OSIF_SYSCALL_PROCESS_MEMMAP:
+        return (S32)large_buffer;
+        break;
+    case OSIF_SYSCALL_PROCESS_MEMUNMAP:
+        // Only the large allocation can be unmapped. Returns the number of pages unmapped.
+        unmapped_addr = (void*)(PTR)arg1;
+        return (unmapped_addr == large_buffer) ? UT_LARGE_ALLOC_PAGES : 0;
+        break;
     default:
         assert (false);
         break;
     }
     return 0;
 }
+#else
+static bool kvmm_freeGuarded_handler (VMemoryManager* vmm, PTR va, SIZE* const outPages)
+{
+    (void)vmm;
+    *outPages = UT_LARGE_ALLOC_PAGES;
+    return va == (PTR)large_buffer;
+}
 #endif
 
 void yt_reset(void)
 {
 #ifdef LIBCM
+    unmapped_addr                       = NULL;
     syscall_fake.handler                = syscall_handler;
     g_utmm.cm_arch_mem_len_bytes_malloc = UT_MALLOC_SIZE_BYTES;
 #else
@@ -369,7 +789,18 @@ int main(void)
     free_combining_prev_adj_nodes();
     free_combining_next_adj_nodes();
     free_wrong_input();
+    free_double_free();
+    free_double_free_combined();
+    free_corrupt_header();
+    allocation_best_fit();
+    large_allocation();
+    allocation_stats();
+    trace_fragmentation_benchmark();
 #ifndef LIBCM
+    arena_grow();
+    arena_trim();
+    aligned_allocation();
+    aligned_wrong_alignment();
     used_memory_test();
 #endif
     zero_fill_allocation();
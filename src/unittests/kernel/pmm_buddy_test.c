@@ -0,0 +1,203 @@
+#define YUKTI_TEST_STRIP_PREFIX
+#define YUKTI_TEST_IMPLEMENTATION
+#include <unittest/yukti.h>
+#include <string.h>
+#include <stdlib.h>
+#include <types.h>
+#include <utils.h>
+#include <kerror.h>
+#include <moslimits.h>
+#include <pmm_buddy.h>
+#include <panic.h>
+
+/*
+ * TEST CASES
+ * =================================================================================================
+ * kpmm_buddy_init:
+ * 1. Every page frame is used after init            | find fails       | init_allUsed
+ * 2. Page frame count not a power of two            | Blocks beyond    | init_frameCountNotPowerOfTwo
+ *                                                   | count not found  |
+ *
+ * kpmm_buddy_find:
+ * 1. Every page frame free                          | Frame 0          | find_allFree
+ * 2. Free frames not making an aligned block        | Fails            | find_unalignedFree
+ * 3. Request not a power of two                     | Next order block | find_roundsUpToOrder
+ * 4. Lowest free block of the order is found        | Lowest block     | find_lowestBlock
+ *
+ * kpmm_buddy_markFree:
+ * 1. Buddies freed one at a time coalesce           | Larger block     | markFree_coalesce
+ *
+ * kpmm_buddy_markUsed:
+ * 1. Using part of a free block splits it           | Remaining found  | markUsed_split
+ *
+ * Random markFree/markUsed compared against a plain array of page frame states
+ *                                     | Same block as plain search | stress_compareWithPlainArray
+ */
+
+#define FRAME_COUNT (16 * KB)
+
+static U8 s_memory[FRAME_COUNT + FRAME_COUNT / 8];
+
+TEST (buddy, init_allUsed)
+{
+    EQ_SCALAR (KERNEL_EXIT_FAILURE, kpmm_buddy_find (1));
+    END();
+}
+
+TEST (buddy, init_frameCountNotPowerOfTwo)
+{
+    EQ_SCALAR (1024U + 1024U / 8U, kpmm_buddy_getMemorySize (1000));
+
+    kpmm_buddy_init (s_memory, 1000);
+    kpmm_buddy_markFree (0, 1000);
+
+    EQ_SCALAR (0, kpmm_buddy_find (512));
+    EQ_SCALAR (KERNEL_EXIT_FAILURE, kpmm_buddy_find (1000));
+
+    // Page frames 1000 to 1023 are not part of the PAB, so they are never free.
+    kpmm_buddy_markUsed (0, 512);
+    EQ_SCALAR (512, kpmm_buddy_find (256));
+    EQ_SCALAR (KERNEL_EXIT_FAILURE, kpmm_buddy_find (512));
+
+    kpmm_buddy_markUsed (512, 480);
+    EQ_SCALAR (992, kpmm_buddy_find (8));
+    EQ_SCALAR (KERNEL_EXIT_FAILURE, kpmm_buddy_find (16));
+    END();
+}
+
+TEST (buddy, find_allFree)
+{
+    kpmm_buddy_markFree (0, FRAME_COUNT);
+
+    EQ_SCALAR (0, kpmm_buddy_find (1));
+    EQ_SCALAR (0, kpmm_buddy_find (FRAME_COUNT));
+    EQ_SCALAR (KERNEL_EXIT_FAILURE, kpmm_buddy_find (FRAME_COUNT + 1));
+    END();
+}
+
+TEST (buddy, find_unalignedFree)
+{
+    // Frames 2 to 5 are free, but no aligned block of 4 frames is.
+    kpmm_buddy_markFree (2, 4);
+
+    EQ_SCALAR (KERNEL_EXIT_FAILURE, kpmm_buddy_find (4));
+    EQ_SCALAR (2, kpmm_buddy_find (2));
+    EQ_SCALAR (2, kpmm_buddy_find (1));
+    END();
+}
+
+TEST (buddy, find_roundsUpToOrder)
+{
+    // Frames 3 to 7 are free. 3 frames need an aligned block of 4, which is frames 4 to 7.
+    kpmm_buddy_markFree (3, 5);
+
+    EQ_SCALAR (4, kpmm_buddy_find (3));
+    EQ_SCALAR (KERNEL_EXIT_FAILURE, kpmm_buddy_find (5));
+    END();
+}
+
+TEST (buddy, find_lowestBlock)
+{
+    kpmm_buddy_markFree (FRAME_COUNT - 16, 16);
+    kpmm_buddy_markFree (64, 16);
+
+    EQ_SCALAR (64, kpmm_buddy_find (16));
+    EQ_SCALAR (64, kpmm_buddy_find (1));
+
+    kpmm_buddy_markUsed (64, 1);
+    EQ_SCALAR ((INT)FRAME_COUNT - 16, kpmm_buddy_find (16));
+    EQ_SCALAR (65, kpmm_buddy_find (1));
+    EQ_SCALAR (72, kpmm_buddy_find (8));
+    END();
+}
+
+TEST (buddy, markFree_coalesce)
+{
+    for (UINT frame = 0; frame < 8; frame++) {
+        EQ_SCALAR (KERNEL_EXIT_FAILURE, kpmm_buddy_find (8));
+        kpmm_buddy_markFree (7 - frame, 1);
+    }
+
+    EQ_SCALAR (0, kpmm_buddy_find (8));
+    EQ_SCALAR (KERNEL_EXIT_FAILURE, kpmm_buddy_find (9));
+    END();
+}
+
+TEST (buddy, markUsed_split)
+{
+    kpmm_buddy_markFree (0, 1024);
+    kpmm_buddy_markUsed (0, 3);
+
+    EQ_SCALAR (KERNEL_EXIT_FAILURE, kpmm_buddy_find (1024));
+    EQ_SCALAR (512, kpmm_buddy_find (512));
+    EQ_SCALAR (3, kpmm_buddy_find (1));
+    EQ_SCALAR (4, kpmm_buddy_find (4));
+
+    kpmm_buddy_markFree (0, 3);
+    EQ_SCALAR (0, kpmm_buddy_find (1024));
+    END();
+}
+
+/* Lowest aligned block of the smallest order holding pageCount frames, on a plain array. */
+static INT plain_find (const bool* isFree, UINT pageCount)
+{
+    UINT blockSize = 1;
+    while (blockSize < pageCount)
+        blockSize *= 2;
+
+    for (UINT start = 0; start + blockSize <= FRAME_COUNT; start += blockSize) {
+        UINT i = 0;
+        for (; i < blockSize && isFree[start + i]; i++)
+            ;
+        if (i == blockSize)
+            return (INT)start;
+    }
+    return KERNEL_EXIT_FAILURE;
+}
+
+TEST (buddy, stress_compareWithPlainArray)
+{
+    static bool isFree[FRAME_COUNT];
+    memset (isFree, 0, sizeof (isFree));
+
+    srand (11);
+    for (UINT iter = 0; iter < 5000; iter++) {
+        UINT count = ((UINT)rand() % 4 == 0) ? 1 + (UINT)rand() % 2000 : 1 + (UINT)rand() % 16;
+        UINT start = (UINT)rand() % (FRAME_COUNT - count);
+        bool free  = (rand() % 2 == 0);
+
+        if (free)
+            kpmm_buddy_markFree (start, count);
+        else
+            kpmm_buddy_markUsed (start, count);
+
+        for (UINT i = 0; i < count; i++)
+            isFree[start + i] = free;
+
+        UINT findCount = 1 + (UINT)rand() % 300;
+        EQ_SCALAR (plain_find (isFree, findCount), kpmm_buddy_find (findCount));
+    }
+
+    END();
+}
+
+void yt_reset (void)
+{
+    panic_invoked = false;
+    kpmm_buddy_init (s_memory, FRAME_COUNT);
+}
+
+int main (void)
+{
+    YT_INIT();
+    init_allUsed();
+    init_frameCountNotPowerOfTwo();
+    find_allFree();
+    find_unalignedFree();
+    find_roundsUpToOrder();
+    find_lowestBlock();
+    markFree_coalesce();
+    markUsed_split();
+    stress_compareWithPlainArray();
+    RETURN_WITH_REPORT();
+}
@@ -3,9 +3,14 @@
 #define YUKTI_TEST_IMPLEMENTATION
 #include <unittest/yukti.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <time.h>
 #include <mock/kernel/kstdlib.h>
+#include <mock/kernel/kmalloc.h>
 #include <mock/kernel/x86/pmm.h>
+#include <mock/kernel/paging.h>
 #include <string.h>
+#include <stdlib.h>
 #include <utils.h>
 #include <moslimits.h>
 #include <paging.h>
@@ -25,7 +30,9 @@
 #define PAB_BYTE(addr) ((addr) / (STATES_PER_BYTE))
 #define PAB_BIT(addr)  (((addr) % (STATES_PER_BYTE)) * BITS_PER_STATE)
 
-static U8 pab[PAB_SIZE_BYTES];
+#define PAB_PAGE_COUNT (16 * KB) // PAB for 64 MB of RAM
+
+static U8 pab[PAB_PAGE_COUNT / STATES_PER_BYTE];
 
 static void validate_pab (const U8 *pab, USYSINT addr, KernelPhysicalMemoryStates state);
 static void set_pab (U8 *const pab, USYSINT start, UINT pgCount, KernelPhysicalMemoryStates state);
@@ -53,12 +60,65 @@ static void set_pab (U8 *const pab, USYSINT start, UINT pgCount, KernelPhysicalM
  * 2. Start addr + pg count > Usable RAM | ERR_OUTSIDE_ADDRESSABLE_RANGE| free_allocat_outsideRange
  * 3. Not enough free pages at addr      | ERR_DOUBLE_ALLOC             | alloc_allocAt_outOfMem
  * 4. Some pages are free                | Success                      | allocAt_success
+ *
+ * Summary & next fit:
+ * 1. Allocations continue from the last allocation | Success | alloc_nextFit
+ * 2. Search wraps to the start of PAB              | Success | alloc_nextFit_wrapAround
+ * 3. Random alloc/allocAt/free compared against a plain next fit search on a shadow copy of PAB
+ *    | Same page frames allocated, PAB matches shadow copy | stress_compareWithPlainBitmap
+ *
+ * kpmm_share:
+ * 1. Shared page frame is freed by its last owner | Success | share_freedByLastOwner
+ * 2. Page frame is free or has too many owners    | ERR_INVALID_ARGUMENT, ERR_OVERFLOW
+ *    | share_failure
+ * 3. Zero frame is allocated once, has any number of owners and is never freed
+ *    | Success | share_zeroFrameNeverFreed
+ * 4. Share counts cannot be allocated              | ERR_OUT_OF_MEM | share_outOfMemory
+ *
+ * Statistics:
+ * 1. Alloc, allocAt, free and failures are counted | Counters match | stats_counters
+ *
+ * Zeroed pool:
+ * 1. Refill zeroes page frames, allocation takes them without zeroing | Success | zeroPool_allocation
+ * 2. Allocation with an empty pool zeroes the page frame              | Success | zeroPool_allocation
+ * 3. Pool is given back when free page frames run out  | Success | zeroPool_givenBackWhenOutOfMemory
+ * 4. Unused zeroed page frame goes back to the pool, or is freed if pool is full
+ *    | Success | zeroPool_freeZeroed
+ * 5. Prints time taken to allocate zeroed page frames with and without the pool
+ *    | Success | zeroPool_benchmark
  */
 
+// Stands in for the page frame, which is zeroed through the temporary map.
+static U8 zero_page_buffer[CONFIG_PAGE_FRAME_SIZE_BYTES];
+
+static bool kpg_zeroPageFrame_handler (Physical pa)
+{
+    (void)pa;
+    memset (zero_page_buffer, 0, sizeof (zero_page_buffer));
+    return true;
+}
+
+static PTR kpmm_arch_earlyAlloc_handler (SIZE byteCount)
+{
+    // PAB is the only early allocation.
+    (void)byteCount;
+    return (PTR)pab;
+}
+
+static void* kmalloc_handler (size_t bytes)
+{
+    return malloc (bytes);
+}
+
+static void* k_memset_handler (void* s, U8 c, size_t n)
+{
+    return memset (s, c, n);
+}
+
 static void init_pab(void)
 {
     // Clear PAB.
-    set_pab (pab, 0, MAX_PAB_ADDRESSABLE_PAGE_COUNT, PMM_STATE_INVALID);
+    set_pab (pab, 0, PAB_PAGE_COUNT, PMM_STATE_INVALID);
     set_pab (pab, 0, MAX_ACTUAL_PAGE_COUNT, PMM_STATE_FREE);
 }
 
@@ -225,6 +285,96 @@ TEST (PMM, free_success)
     END();
 }
 
+TEST (PMM, share_freedByLastOwner)
+{
+    Physical addr = createPhysical (CONFIG_PAGE_FRAME_SIZE_BYTES);
+    EQ_SCALAR (true, kpmm_allocAt (addr, 1, PMM_REGION_ANY));
+    size_t freeMemSize = kpmm_getFreeMemorySize();
+
+    EQ_SCALAR (true, kpmm_share (addr));
+    EQ_SCALAR (true, kpmm_share (addr));
+    EQ_SCALAR (kpmm_getShareCount (addr), 2U);
+
+    // Other owners only give up their ownership.
+    EQ_SCALAR (true, kpmm_free (addr, 1));
+    EQ_SCALAR (true, kpmm_free (addr, 1));
+    EQ_SCALAR (kpmm_getShareCount (addr), 0U);
+    EQ_SCALAR (kpmm_getPageStatus (addr), PMM_STATE_USED);
+    EQ_SCALAR (kpmm_getFreeMemorySize(), freeMemSize);
+
+    // Last owner frees it.
+    EQ_SCALAR (true, kpmm_free (addr, 1));
+    EQ_SCALAR (kpmm_getPageStatus (addr), PMM_STATE_FREE);
+    EQ_SCALAR (kpmm_getFreeMemorySize(), freeMemSize + CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    END();
+}
+
+TEST (PMM, share_zeroFrameNeverFreed)
+{
+    Physical zeroFrame, addr;
+    EQ_SCALAR (true, kpmm_getZeroFrame (&zeroFrame));
+    EQ_SCALAR (true, kpmm_getZeroFrame (&addr));
+    EQ_SCALAR (addr.val, zeroFrame.val);
+    EQ_SCALAR (kpg_zeroPageFrame_fake.invokeCount, 1U);
+    EQ_SCALAR (true, kpmm_isZeroFrame (zeroFrame));
+    size_t freeMemSize = kpmm_getFreeMemorySize();
+
+    for (UINT i = 0; i <= PMM_MAX_SHARE_COUNT; i++) {
+        EQ_SCALAR (true, kpmm_share (zeroFrame));
+    }
+    EQ_SCALAR (kpmm_getShareCount (zeroFrame), 0U);
+
+    EQ_SCALAR (true, kpmm_free (zeroFrame, 1));
+    EQ_SCALAR (kpmm_getPageStatus (zeroFrame), PMM_STATE_USED);
+    EQ_SCALAR (kpmm_getFreeMemorySize(), freeMemSize);
+
+    // Other page frames are not the zero frame.
+    EQ_SCALAR (true, kpmm_alloc (&addr, 1, PMM_REGION_ANY));
+    EQ_SCALAR (false, kpmm_isZeroFrame (addr));
+    END();
+}
+
+TEST (PMM, share_failure)
+{
+    Physical addr = createPhysical (CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    EQ_SCALAR (false, kpmm_share (addr));
+    EQ_SCALAR (g_kstate.errorNumber, ERR_INVALID_ARGUMENT);
+
+    EQ_SCALAR (true, kpmm_allocAt (addr, 1, PMM_REGION_ANY));
+    for (UINT i = 0; i < PMM_MAX_SHARE_COUNT; i++) {
+        kpmm_share (addr);
+    }
+    EQ_SCALAR (false, kpmm_share (addr));
+    EQ_SCALAR (g_kstate.errorNumber, ERR_OVERFLOW);
+    EQ_SCALAR (kpmm_getShareCount (addr), PMM_MAX_SHARE_COUNT);
+
+    EQ_SCALAR (false, kpmm_share (createPhysical (1)));
+    EQ_SCALAR (g_kstate.errorNumber, ERR_WRONG_ALIGNMENT);
+
+    END();
+}
+
+TEST (PMM, share_outOfMemory)
+{
+    Physical addr = createPhysical (CONFIG_PAGE_FRAME_SIZE_BYTES);
+    EQ_SCALAR (true, kpmm_allocAt (addr, 1, PMM_REGION_ANY));
+
+    // Share counts are allocated on the first share.
+    kmalloc_fake.handler = NULL;
+    kmalloc_fake.ret     = NULL;
+    EQ_SCALAR (false, kpmm_share (addr));
+    EQ_SCALAR (g_kstate.errorNumber, ERR_OUT_OF_MEM);
+    EQ_SCALAR (kpmm_getShareCount (addr), 0U);
+
+    // Page frame still has only one owner.
+    EQ_SCALAR (true, kpmm_free (addr, 1));
+    EQ_SCALAR (kpmm_getPageStatus (addr), PMM_STATE_FREE);
+
+    END();
+}
+
 TEST (PMM, memSize_zerofree)
 {
     // Set every page in PAB.
@@ -251,6 +401,323 @@ TEST (PMM, memSize_somefree)
     END();
 }
 
+TEST (PMM, stats_counters)
+{
+    // Page frames used at init are counted as used.
+    set_pab (pab, 0, MAX_ACTUAL_PAGE_COUNT, PMM_STATE_USED);
+    set_pab (pab, CONFIG_PAGE_FRAME_SIZE_BYTES, 4, PMM_STATE_FREE);
+
+    OSIF_AllocatorStats stats;
+    kpmm_getStats (&stats);
+    EQ_SCALAR (stats.usedBytes, (size_t)(MAX_ACTUAL_PAGE_COUNT - 4) * CONFIG_PAGE_FRAME_SIZE_BYTES);
+    EQ_SCALAR (stats.peakUsedBytes, stats.usedBytes);
+    EQ_SCALAR (stats.allocCount, 0U);
+    size_t usedAtInit = stats.usedBytes;
+
+    Physical addr;
+    EQ_SCALAR (true, kpmm_alloc (&addr, 3, PMM_REGION_ANY));
+    EQ_SCALAR (false, kpmm_alloc (&addr, 2, PMM_REGION_ANY));
+    EQ_SCALAR (true, kpmm_allocAt (createPhysical (4 * CONFIG_PAGE_FRAME_SIZE_BYTES), 1,
+                                   PMM_REGION_ANY));
+    EQ_SCALAR (kpmm_getFreeMemorySize(), 0U);
+
+    // Free a page frame which was used at init and one allocated above.
+    EQ_SCALAR (true, kpmm_free (createPhysical (8 * CONFIG_PAGE_FRAME_SIZE_BYTES), 1));
+    EQ_SCALAR (true, kpmm_free (addr, 1));
+    EQ_SCALAR (kpmm_getFreeMemorySize(), (size_t)2 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    kpmm_getStats (&stats);
+    EQ_SCALAR (stats.usedBytes, usedAtInit + 2 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+    EQ_SCALAR (stats.peakUsedBytes, usedAtInit + 4 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+    EQ_SCALAR (stats.allocCount, 2U);
+    EQ_SCALAR (stats.freeCount, 2U);
+    EQ_SCALAR (stats.failedCount, 1U);
+
+    // Histogram counts page frames.
+    EQ_SCALAR (stats.sizeHistogram[0], 1U);
+    EQ_SCALAR (stats.sizeHistogram[1], 1U);
+    END();
+}
+
+TEST (PMM, zeroPool_allocation)
+{
+    size_t freeMemSize = kpmm_getFreeMemorySize();
+
+    // Page frames are zeroed using temporary map, which is not ready before the VMM.
+    EQ_SCALAR (kpmm_refillZeroPool (4), 0U);
+    EQ_SCALAR (kpg_zeroPageFrame_fake.invokeCount, 0U);
+
+    g_kstate.phase = KERNEL_PHASE_STATE_VMM_READY;
+
+    // Page frames in the pool are still free memory.
+    EQ_SCALAR (kpmm_refillZeroPool (4), 4U);
+    EQ_SCALAR (kpg_zeroPageFrame_fake.invokeCount, 4U);
+    EQ_SCALAR (kpmm_getFreeMemorySize(), freeMemSize);
+
+    // Taken from the pool, so not zeroed again.
+    Physical addr;
+    EQ_SCALAR (true, kpmm_allocZeroed (&addr, PMM_REGION_ANY));
+    EQ_SCALAR (kpg_zeroPageFrame_fake.invokeCount, 4U);
+    EQ_SCALAR (kpmm_getPageStatus (addr), PMM_STATE_USED);
+    EQ_SCALAR (kpmm_getFreeMemorySize(), freeMemSize - CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    // Pool does not grow beyond its capacity.
+    EQ_SCALAR (kpmm_refillZeroPool (PMM_ZERO_POOL_CAPACITY + 8), PMM_ZERO_POOL_CAPACITY - 3);
+
+    // Empty the pool. Then the page frame is zeroed on allocation.
+    for (UINT i = 0; i < PMM_ZERO_POOL_CAPACITY; i++) {
+        EQ_SCALAR (true, kpmm_allocZeroed (&addr, PMM_REGION_ANY));
+    }
+    UINT zeroedCount = kpg_zeroPageFrame_fake.invokeCount;
+    EQ_SCALAR (true, kpmm_allocZeroed (&addr, PMM_REGION_ANY));
+    EQ_SCALAR (kpg_zeroPageFrame_fake.invokeCount, zeroedCount + 1);
+
+    OSIF_AllocatorStats stats;
+    kpmm_getStats (&stats);
+    EQ_SCALAR (stats.allocCount, PMM_ZERO_POOL_CAPACITY + 2);
+
+    g_kstate.phase = KERNEL_PHASE_STATE_PMM_READY;
+    END();
+}
+
+TEST (PMM, zeroPool_givenBackWhenOutOfMemory)
+{
+    // Only two page frames are free, both are taken by the pool.
+    set_pab (pab, 0, MAX_ACTUAL_PAGE_COUNT, PMM_STATE_USED);
+    set_pab (pab, CONFIG_PAGE_FRAME_SIZE_BYTES, 2, PMM_STATE_FREE);
+
+    g_kstate.phase = KERNEL_PHASE_STATE_VMM_READY;
+    EQ_SCALAR (kpmm_refillZeroPool (PMM_ZERO_POOL_CAPACITY), 2U);
+    EQ_SCALAR (kpmm_getFreeMemorySize(), (size_t)2 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    Physical addr;
+    EQ_SCALAR (true, kpmm_alloc (&addr, 2, PMM_REGION_ANY));
+    EQ_SCALAR (addr.val, CONFIG_PAGE_FRAME_SIZE_BYTES);
+    EQ_SCALAR (kpmm_getFreeMemorySize(), 0U);
+
+    EQ_SCALAR (false, kpmm_allocZeroed (&addr, PMM_REGION_ANY));
+    EQ_SCALAR (g_kstate.errorNumber, ERR_OUT_OF_MEM);
+
+    g_kstate.phase = KERNEL_PHASE_STATE_PMM_READY;
+    END();
+}
+
+TEST (PMM, zeroPool_freeZeroed)
+{
+    size_t freeMemSize = kpmm_getFreeMemorySize();
+    g_kstate.phase     = KERNEL_PHASE_STATE_VMM_READY;
+
+    // Goes back to the pool. Not zeroed again when allocated.
+    Physical addr;
+    EQ_SCALAR (kpmm_refillZeroPool (1), 1U);
+    EQ_SCALAR (true, kpmm_allocZeroed (&addr, PMM_REGION_ANY));
+    EQ_SCALAR (kpg_zeroPageFrame_fake.invokeCount, 1U);
+    EQ_SCALAR (true, kpmm_freeZeroed (addr));
+    EQ_SCALAR (kpmm_getFreeMemorySize(), freeMemSize);
+
+    Physical addr2;
+    EQ_SCALAR (true, kpmm_allocZeroed (&addr2, PMM_REGION_ANY));
+    EQ_SCALAR (addr2.val, addr.val);
+    EQ_SCALAR (kpg_zeroPageFrame_fake.invokeCount, 1U);
+
+    // Pool is full, so page frame is freed.
+    EQ_SCALAR (kpmm_refillZeroPool (PMM_ZERO_POOL_CAPACITY), PMM_ZERO_POOL_CAPACITY);
+    EQ_SCALAR (true, kpmm_freeZeroed (addr2));
+    EQ_SCALAR (kpmm_getPageStatus (addr2), PMM_STATE_FREE);
+    EQ_SCALAR (kpmm_getFreeMemorySize(), freeMemSize);
+
+    OSIF_AllocatorStats stats;
+    kpmm_getStats (&stats);
+    EQ_SCALAR (stats.freeCount, 2U);
+
+    g_kstate.phase = KERNEL_PHASE_STATE_PMM_READY;
+    END();
+}
+
+/**************************************************************************************************
+ * Allocates zeroed page frames, as many as the pool can hold, a few thousand times. Prints time
+ * taken when the page frames are zeroed on allocation and when they are taken from a pool which was
+ * filled before (that is when idle).
+ **************************************************************************************************/
+TEST (PMM, zeroPool_benchmark)
+{
+#define ZERO_POOL_BENCHMARK_ROUNDS 2000
+    Physical frames[PMM_ZERO_POOL_CAPACITY];
+    clock_t withoutPool = 0;
+    clock_t withPool    = 0;
+
+    g_kstate.phase = KERNEL_PHASE_STATE_VMM_READY;
+
+    for (UINT r = 0; r < ZERO_POOL_BENCHMARK_ROUNDS; r++) {
+        clock_t start = clock();
+        for (UINT i = 0; i < PMM_ZERO_POOL_CAPACITY; i++) {
+            EQ_SCALAR (true, kpmm_allocZeroed (&frames[i], PMM_REGION_ANY));
+        }
+        withoutPool += clock() - start;
+
+        for (UINT i = 0; i < PMM_ZERO_POOL_CAPACITY; i++) {
+            EQ_SCALAR (true, kpmm_free (frames[i], 1));
+        }
+
+        EQ_SCALAR (kpmm_refillZeroPool (PMM_ZERO_POOL_CAPACITY), PMM_ZERO_POOL_CAPACITY);
+
+        start = clock();
+        for (UINT i = 0; i < PMM_ZERO_POOL_CAPACITY; i++) {
+            EQ_SCALAR (true, kpmm_allocZeroed (&frames[i], PMM_REGION_ANY));
+        }
+        withPool += clock() - start;
+
+        for (UINT i = 0; i < PMM_ZERO_POOL_CAPACITY; i++) {
+            EQ_SCALAR (true, kpmm_free (frames[i], 1));
+        }
+    }
+
+    printf ("\n  %u zeroed page frames: zeroed on allocation %9.3f ms, from pool %7.3f ms",
+            ZERO_POOL_BENCHMARK_ROUNDS * PMM_ZERO_POOL_CAPACITY,
+            (double)withoutPool * 1000 / CLOCKS_PER_SEC, (double)withPool * 1000 / CLOCKS_PER_SEC);
+
+    g_kstate.phase = KERNEL_PHASE_STATE_PMM_READY;
+    END();
+}
+
+TEST (PMM, alloc_nextFit)
+{
+    Physical first, second, third;
+    EQ_SCALAR (true, kpmm_alloc (&first, 1, PMM_REGION_ANY));
+    EQ_SCALAR (true, kpmm_alloc (&second, 2, PMM_REGION_ANY));
+    EQ_SCALAR (second.val, first.val + CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    // Freed page frame is not reused until search wraps around.
+    EQ_SCALAR (true, kpmm_free (first, 1));
+    EQ_SCALAR (true, kpmm_alloc (&third, 1, PMM_REGION_ANY));
+    EQ_SCALAR (third.val, second.val + 2 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    END();
+}
+
+TEST (PMM, alloc_nextFit_wrapAround)
+{
+    // Only the first three and the last page are free.
+    set_pab (pab, 0, MAX_ACTUAL_PAGE_COUNT, PMM_STATE_USED);
+    set_pab (pab, 0, 3, PMM_STATE_FREE);
+    set_pab (pab, ACTUAL_MEMORY_SIZE - CONFIG_PAGE_FRAME_SIZE_BYTES, 1, PMM_STATE_FREE);
+
+    Physical addr;
+    EQ_SCALAR (true, kpmm_alloc (&addr, 1, PMM_REGION_ANY));
+    EQ_SCALAR (addr.val, 0U);
+
+    // Allocation at the end of the PAB, search must wrap around for the next one.
+    EQ_SCALAR (true, kpmm_allocAt (createPhysical (CONFIG_PAGE_FRAME_SIZE_BYTES), 1,
+                                   PMM_REGION_ANY));
+    EQ_SCALAR (true, kpmm_alloc (&addr, 1, PMM_REGION_ANY));
+    EQ_SCALAR (addr.val, 2 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    EQ_SCALAR (true, kpmm_alloc (&addr, 1, PMM_REGION_ANY));
+    EQ_SCALAR (addr.val, ACTUAL_MEMORY_SIZE - CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    EQ_SCALAR (true, kpmm_free (createPhysical (0), 1));
+    EQ_SCALAR (true, kpmm_alloc (&addr, 1, PMM_REGION_ANY));
+    EQ_SCALAR (addr.val, 0U);
+
+    EQ_SCALAR (false, kpmm_alloc (&addr, 1, PMM_REGION_ANY));
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_OUT_OF_MEM);
+    END();
+}
+
+/* Next fit search on a plain array of page frame states. This is what the PMM must allocate. */
+static INT plain_nextFit (const U8* shadow, UINT frameCount, UINT pageCount, UINT* nextFit)
+{
+    for (UINT i = 0; i < frameCount; i++) {
+        UINT start = (*nextFit + i) % frameCount;
+        if (start + pageCount > frameCount)
+            continue;
+
+        UINT run = 0;
+        for (; run < pageCount && shadow[start + run] == PMM_STATE_FREE; run++)
+            ;
+
+        if (run == pageCount) {
+            *nextFit = (start + pageCount) % frameCount;
+            return (INT)start;
+        }
+    }
+    return KERNEL_EXIT_FAILURE;
+}
+
+TEST (PMM, stress_compareWithPlainBitmap)
+{
+    // Every page frame the PAB can address is usable.
+    kpmm_arch_getInstalledMemoryByteCount_fake.ret = PAGEFRAMES_TO_BYTES (PAB_PAGE_COUNT);
+    init_pab();
+
+    static U8 shadow[PAB_PAGE_COUNT];
+    const UINT frameCount = MAX_ACTUAL_PAGE_COUNT;
+    UINT nextFit          = 0;
+
+    memset (shadow, PMM_STATE_FREE, sizeof (shadow));
+
+    // Few reserved holes, which the PMM must never hand out.
+    for (UINT frame = 100; frame < frameCount; frame += 997) {
+        set_pab (pab, frame * CONFIG_PAGE_FRAME_SIZE_BYTES, 3, PMM_STATE_RESERVED);
+        shadow[frame] = shadow[frame + 1] = shadow[frame + 2] = PMM_STATE_RESERVED;
+    }
+
+    srand (7);
+    for (UINT iter = 0; iter < 20000; iter++) {
+        UINT op        = (UINT)rand() % 10;
+        UINT pageCount = ((UINT)rand() % 4 == 0) ? 1 + (UINT)rand() % 300 : 1 + (UINT)rand() % 4;
+
+        if (op < 5) {
+            Physical addr;
+            INT expected = plain_nextFit (shadow, frameCount, pageCount, &nextFit);
+            bool success = kpmm_alloc (&addr, pageCount, PMM_REGION_ANY);
+
+            EQ_SCALAR (success, (expected != KERNEL_EXIT_FAILURE));
+            if (success) {
+                EQ_SCALAR (addr.val, (USYSINT)expected * CONFIG_PAGE_FRAME_SIZE_BYTES);
+                memset (&shadow[expected], PMM_STATE_USED, pageCount);
+            }
+        } else if (op < 6) {
+            UINT frame = (UINT)rand() % (frameCount - pageCount);
+            UINT run   = 0;
+            for (; run < pageCount && shadow[frame + run] == PMM_STATE_FREE; run++)
+                ;
+
+            Physical addr = createPhysical (frame * CONFIG_PAGE_FRAME_SIZE_BYTES);
+            EQ_SCALAR (kpmm_allocAt (addr, pageCount, PMM_REGION_ANY), (run == pageCount));
+            if (run == pageCount)
+                memset (&shadow[frame], PMM_STATE_USED, pageCount);
+        } else {
+            // Frees the used section at a random page frame.
+            UINT frame = (UINT)rand() % frameCount;
+            UINT run   = 0;
+            for (; run < pageCount && frame + run < frameCount &&
+                   shadow[frame + run] == PMM_STATE_USED;
+                 run++)
+                ;
+
+            if (run > 0) {
+                EQ_SCALAR (true, kpmm_free (createPhysical (frame * CONFIG_PAGE_FRAME_SIZE_BYTES),
+                                            run));
+                memset (&shadow[frame], PMM_STATE_FREE, run);
+            }
+        }
+
+        if (iter % 1000 == 0) {
+            UINT freeCount = 0;
+            for (UINT frame = 0; frame < frameCount; frame++) {
+                // Page frame 0 is not counted by kpmm_getFreeMemorySize.
+                freeCount += (frame > 0 && shadow[frame] == PMM_STATE_FREE);
+                EQ_SCALAR (shadow[frame],
+                           kpmm_getPageStatus (createPhysical (frame * CONFIG_PAGE_FRAME_SIZE_BYTES)));
+            }
+            EQ_SCALAR (kpmm_getFreeMemorySize(), (size_t)freeCount * CONFIG_PAGE_FRAME_SIZE_BYTES);
+        }
+    }
+
+    END();
+}
+
 static void set_pab (U8 *const pab, USYSINT start, UINT pgCount, KernelPhysicalMemoryStates state)
 {
     for (; pgCount > 0; pgCount--, start += CONFIG_PAGE_FRAME_SIZE_BYTES)
@@ -262,6 +729,9 @@ static void set_pab (U8 *const pab, USYSINT start, UINT pgCount, KernelPhysicalM
         pab[byte] &= ~(MAX_STATE << bit);
         pab[byte] |= (state << bit);
     }
+
+    // PAB was changed behind PMM's back. Initializing again rebuilds its summary from the PAB.
+    kpmm_init();
 }
 
 static void validate_pab (const U8 *pab, USYSINT addr, KernelPhysicalMemoryStates state)
@@ -278,6 +748,16 @@ void yt_reset(void)
     panic_invoked = false;
     g_kstate.errorNumber = ERR_NONE;
     resetX86Pmm();
+    resetPagingFake();
+    resetKmallocFake();
+    resetStdLibFake();
+    kpg_zeroPageFrame_fake.handler = kpg_zeroPageFrame_handler;
+    kmalloc_fake.handler           = kmalloc_handler;
+    k_memset_fake.handler          = k_memset_handler;
+
+    // PAB is not allocated, `pab` buffer defined here is used instead.
+    kpmm_arch_getPageFrameCount_fake.ret = PAB_PAGE_COUNT;
+    kpmm_arch_earlyAlloc_fake.handler    = kpmm_arch_earlyAlloc_handler;
 
     // Default size of RAM is set to 2 MB.
     kpmm_arch_getInstalledMemoryByteCount_fake.ret = 2 * MB;
@@ -288,11 +768,7 @@ void yt_reset(void)
 int main(void)
 {
     YT_INIT();
-    // Will just set pointer `s_pab` to point to `pab` buffer defined here. No allocation or
-    // deallocation will take place as memory map count and files count are not set and will be at
-    // default zero.
-    SET_MACRO_MOCK (arch_mem_start_kernel_pab, (PTR)pab);
-    kpmm_init();
+    yt_reset();
 
     zero_page_count();
     allocat_success();
@@ -304,7 +780,19 @@ int main(void)
     // TODO: Why is double free panics but not double alloc?
     free_doubleFree();
     free_reservePages();
+    share_freedByLastOwner();
+    share_failure();
+    share_outOfMemory();
+    share_zeroFrameNeverFreed();
     memSize_zerofree();
     memSize_somefree();
+    stats_counters();
+    zeroPool_allocation();
+    zeroPool_givenBackWhenOutOfMemory();
+    zeroPool_freeZeroed();
+    zeroPool_benchmark();
+    alloc_nextFit();
+    alloc_nextFit_wrapAround();
+    stress_compareWithPlainBitmap();
     RETURN_WITH_REPORT();
 }
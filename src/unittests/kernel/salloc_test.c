@@ -15,6 +15,11 @@
 
 static U8 salloc_buffer[UT_SALLOC_SIZE_BYTES];
 
+// Used by the aligned allocation tests. Large enough for the largest alignment tested.
+#define UT_SALLOC_ALIGNED_SIZE_BYTES (16 * KB)
+static U8 salloc_aligned_buffer[UT_SALLOC_ALIGNED_SIZE_BYTES]
+    __attribute__ ((aligned (CONFIG_PAGE_FRAME_SIZE_BYTES)));
+
 #define ALIGNED_SIZE(sz) ALIGN_UP ((sz), SALLOC_GRANUALITY)
 
 /*
@@ -26,6 +31,10 @@ static U8 salloc_buffer[UT_SALLOC_SIZE_BYTES];
  * | ksalloc          - Given a valid which exceeds the      |                               |
  * |                    available space. Out of memory error.| salloc_out_of_memory          |
  * | ksalloc          - Alignment of allocations.            | salloc_alignments             |
+ * | ksalloc_getUsedMemory/ksalloc_getStats - Counters.      | get_used_memory               |
+ * | ksalloc_aligned  - Alignments from 16 bytes to 4 KB.    | aligned_allocations           |
+ * | ksalloc_aligned  - Skipped space is used later.         | aligned_skipped_space_reused  |
+ * | ksalloc_aligned  - Alignment not a power of two.        | aligned_wrong_alignment       |
  * |---------------------------------------------------------|-------------------------------|
  * */
 
@@ -92,6 +101,69 @@ TEST (ksalloc, get_used_memory)
     NEQ_SCALAR ((PTR)ksalloc (sizes[1]), (PTR)NULL);
 
     EQ_SCALAR (ksalloc_getUsedMemory(), (sizes[0] + sizes[1]));
+
+    // Failed allocations are counted, but do not change the used memory.
+    EQ_SCALAR ((PTR)ksalloc (UT_SALLOC_SIZE_BYTES), (PTR)NULL);
+
+    OSIF_AllocatorStats stats;
+    ksalloc_getStats (&stats);
+    EQ_SCALAR (stats.usedBytes, (sizes[0] + sizes[1]));
+    EQ_SCALAR (stats.peakUsedBytes, (sizes[0] + sizes[1]));
+    EQ_SCALAR (stats.allocCount, 2U);
+    EQ_SCALAR (stats.failedCount, 1U);
+    END();
+}
+
+static void use_aligned_buffer (void)
+{
+    g_utmm.arch_mem_len_bytes_salloc = UT_SALLOC_ALIGNED_SIZE_BYTES;
+    g_utmm.arch_mem_start_salloc     = (uintptr_t)salloc_aligned_buffer;
+    ksalloc_init();
+}
+
+TEST (ksalloc_aligned, aligned_allocations)
+{
+    use_aligned_buffer();
+
+    // Start of the buffer is taken, so that every allocation needs to skip some space.
+    NEQ_SCALAR ((PTR)ksalloc (SALLOC_GRANUALITY), (PTR)NULL);
+
+    for (UINT align = 16; align <= 4 * KB; align *= 2) {
+        void* addr = ksalloc_aligned (24, align);
+        NEQ_SCALAR ((PTR)addr, (PTR)NULL);
+        EQ_SCALAR (IS_ALIGNED ((PTR)addr, align), true);
+    }
+
+    // Alignment less than the granularity is increased to it.
+    EQ_SCALAR (IS_ALIGNED ((PTR)ksalloc_aligned (1, 1), SALLOC_GRANUALITY), true);
+    END();
+}
+
+TEST (ksalloc_aligned, aligned_skipped_space_reused)
+{
+    use_aligned_buffer();
+    PTR start = (PTR)salloc_aligned_buffer;
+
+    EQ_SCALAR ((PTR)ksalloc (SALLOC_GRANUALITY), start);
+    EQ_SCALAR ((PTR)ksalloc_aligned (SALLOC_GRANUALITY, 4 * KB), start + 4 * KB);
+
+    // Space skipped before the page aligned allocation is used by the next ones.
+    EQ_SCALAR ((PTR)ksalloc (SALLOC_GRANUALITY), start + SALLOC_GRANUALITY);
+    EQ_SCALAR ((PTR)ksalloc_aligned (SALLOC_GRANUALITY, 64), start + 64);
+
+    // Which do not fit go after the last allocation.
+    EQ_SCALAR ((PTR)ksalloc (4 * KB), start + 4 * KB + SALLOC_GRANUALITY);
+    EQ_SCALAR (ksalloc_getUsedMemory(), 8 * KB + SALLOC_GRANUALITY);
+    END();
+}
+
+TEST (ksalloc_aligned, aligned_wrong_alignment)
+{
+    UINT aligns[] = { 0, 24, 3 };
+    for (size_t i = 0; i < ARRAY_LENGTH (aligns); i++) {
+        EQ_SCALAR ((PTR)ksalloc_aligned (SALLOC_GRANUALITY, aligns[i]), (PTR)NULL);
+        EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_WRONG_ALIGNMENT);
+    }
     END();
 }
 
@@ -113,5 +185,8 @@ int main(void)
     salloc_alignments();
     salloc_out_of_memory();
     get_used_memory();
+    aligned_allocations();
+    aligned_skipped_space_reused();
+    aligned_wrong_alignment();
     RETURN_WITH_REPORT();
 }
@@ -0,0 +1,288 @@
+#define YUKTI_TEST_STRIP_PREFIX
+#define YUKTI_TEST_IMPLEMENTATION
+#include <unittest/yukti.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utils.h>
+#include <types.h>
+#include <memmanage.h>
+#include <kerror.h>
+#include <kernel.h>
+#include <mosunittest.h>
+#include <mock/kernel/vmm.h>
+#include <mock/kernel/salloc.h>
+#include <mock/kernel/kstdlib.h>
+
+/*
+ * | TEST CASES                                                   | TEST FUNCTION                 |
+ * |--------------------------------------------------------------|-------------------------------|
+ * | kmem_cache_create - Size is zero or larger than a slab.      | create_invalidSize            |
+ * | kmem_cache_alloc  - Objects are packed, aligned, in a page.  | alloc_packedInPage            |
+ * | kmem_cache_alloc  - Slab full. New slab from next page.      | alloc_newSlabWhenFull         |
+ * | kmem_cache_alloc  - Slab region full. Out of memory error.   | alloc_outOfMemory             |
+ * | kmem_cache_allocz - Object is zeroed.                        | allocz_zeroFill               |
+ * | kmem_cache_free   - Freed object is allocated next.          | free_reuse                    |
+ * | kmem_cache_free   - Object from other cache/misaligned.      | free_invalidObject            |
+ * | kmem_cache_free   - Object freed twice.                      | free_doubleFree               |
+ * | kmem_cache_free   - Second free slab goes to other caches.   | free_emptySlabReleased        |
+ * | Churn of 10k small objects. Prints time against kmalloc.     | churn_benchmark               |
+ * |--------------------------------------------------------------|-------------------------------|
+ */
+
+#define UT_SLAB_PAGE_COUNT  256
+#define UT_OBJECT_SIZE      24
+#define PAGE_OF(a)          ALIGN_DOWN ((PTR)(a), CONFIG_PAGE_FRAME_SIZE_BYTES)
+
+static U8 slab_buffer[UT_SLAB_PAGE_COUNT * CONFIG_PAGE_FRAME_SIZE_BYTES]
+    __attribute__ ((aligned (CONFIG_PAGE_FRAME_SIZE_BYTES)));
+
+// kmalloc is only used by the benchmark. Its unit test provides these list heads otherwise.
+extern ListNode s_freeBins[KMALLOC_FREE_BIN_COUNT], s_allocHead;
+ListNode s_freeBins[KMALLOC_FREE_BIN_COUNT], s_allocHead;
+
+#define UT_MALLOC_SIZE_BYTES (2 * MB)
+static U8 malloc_buffer[UT_MALLOC_SIZE_BYTES];
+
+static KMemCache* cache;
+
+static void* kscalloc_handler (UINT bytes)
+{
+    return calloc (1, bytes);
+}
+
+static void* k_memset_handler (void* s, U8 c, size_t n)
+{
+    return memset (s, c, n);
+}
+
+/* Number of objects in one slab, found by allocating till the page changes. */
+static UINT objectsPerSlab (KMemCache* c)
+{
+    PTR first  = (PTR)kmem_cache_alloc (c);
+    UINT count = 0;
+    for (PTR obj = first; PAGE_OF (obj) == PAGE_OF (first); obj = (PTR)kmem_cache_alloc (c)) {
+        count++;
+    }
+    return count;
+}
+
+TEST (slab, create_invalidSize)
+{
+    EQ_SCALAR ((PTR)kmem_cache_create ("zero", 0), (PTR)NULL);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_RANGE);
+
+    g_kstate.errorNumber = ERR_NONE;
+    EQ_SCALAR ((PTR)kmem_cache_create ("page", CONFIG_PAGE_FRAME_SIZE_BYTES), (PTR)NULL);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_RANGE);
+    END();
+}
+
+TEST (slab, alloc_packedInPage)
+{
+    PTR prev = (PTR)kmem_cache_alloc (cache);
+    EQ_SCALAR (PAGE_OF (prev), (PTR)slab_buffer);
+    EQ_SCALAR (IS_ALIGNED (prev, 8), true);
+
+    for (UINT i = 0; i < 50; i++) {
+        PTR obj = (PTR)kmem_cache_alloc (cache);
+        // No header between objects.
+        EQ_SCALAR (obj, prev + UT_OBJECT_SIZE);
+        EQ_SCALAR (PAGE_OF (obj), PAGE_OF (obj + UT_OBJECT_SIZE - 1));
+        prev = obj;
+    }
+    END();
+}
+
+TEST (slab, alloc_newSlabWhenFull)
+{
+    UINT count = objectsPerSlab (cache);
+
+    // Whole page except the slab header is used.
+    GEQ_SCALAR (count, (CONFIG_PAGE_FRAME_SIZE_BYTES - 64) / UT_OBJECT_SIZE);
+
+    // Last allocation by objectsPerSlab is the first object of the next page.
+    PTR obj = (PTR)kmem_cache_alloc (cache);
+    EQ_SCALAR (PAGE_OF (obj), (PTR)slab_buffer + CONFIG_PAGE_FRAME_SIZE_BYTES);
+    END();
+}
+
+TEST (slab, alloc_outOfMemory)
+{
+    KMemCache* large = kmem_cache_create ("large", CONFIG_PAGE_FRAME_SIZE_BYTES / 2);
+
+    // Only one object fits in a slab.
+    for (UINT i = 0; i < UT_SLAB_PAGE_COUNT; i++) {
+        NEQ_SCALAR ((PTR)kmem_cache_alloc (large), (PTR)NULL);
+    }
+
+    EQ_SCALAR ((PTR)kmem_cache_alloc (large), (PTR)NULL);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_OUT_OF_MEM);
+    END();
+}
+
+TEST (slab, allocz_zeroFill)
+{
+    MUST_CALL_ANY_ORDER (k_memset, _, V (0), V (UT_OBJECT_SIZE));
+    NEQ_SCALAR ((PTR)kmem_cache_allocz (cache), (PTR)NULL);
+    END();
+}
+
+TEST (slab, free_reuse)
+{
+    void* a = kmem_cache_alloc (cache);
+    void* b = kmem_cache_alloc (cache);
+
+    EQ_SCALAR (kmem_cache_free (cache, a), true);
+    EQ_SCALAR ((PTR)kmem_cache_alloc (cache), (PTR)a);
+
+    EQ_SCALAR (kmem_cache_free (cache, b), true);
+    EQ_SCALAR (kmem_cache_free (cache, a), true);
+    EQ_SCALAR ((PTR)kmem_cache_alloc (cache), (PTR)a);
+    EQ_SCALAR ((PTR)kmem_cache_alloc (cache), (PTR)b);
+    END();
+}
+
+TEST (slab, free_invalidObject)
+{
+    KMemCache* other = kmem_cache_create ("other", UT_OBJECT_SIZE);
+    U8* obj          = kmem_cache_alloc (cache);
+
+    EQ_SCALAR (kmem_cache_free (other, obj), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    g_kstate.errorNumber = ERR_NONE;
+    EQ_SCALAR (kmem_cache_free (cache, obj + 1), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    // Not from the slab region.
+    g_kstate.errorNumber = ERR_NONE;
+    EQ_SCALAR (kmem_cache_free (cache, malloc_buffer), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    EQ_SCALAR (kmem_cache_free (cache, obj), true);
+    END();
+}
+
+TEST (slab, free_doubleFree)
+{
+    void* a = kmem_cache_alloc (cache);
+
+    EQ_SCALAR (kmem_cache_free (cache, a), true);
+    EQ_SCALAR (kmem_cache_free (cache, a), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_DOUBLE_FREE);
+    END();
+}
+
+TEST (slab, free_emptySlabReleased)
+{
+    static void* objs[2 * CONFIG_PAGE_FRAME_SIZE_BYTES / UT_OBJECT_SIZE];
+
+    UINT count = 2 * objectsPerSlab (cache);
+    yt_reset();
+    KMemCache* other = kmem_cache_create ("other", UT_OBJECT_SIZE);
+
+    for (UINT i = 0; i < count; i++) {
+        objs[i] = kmem_cache_alloc (cache);
+    }
+    EQ_SCALAR (PAGE_OF (objs[count - 1]), (PTR)slab_buffer + CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    // Second slab becomes free first and is kept. First slab is then given back.
+    for (UINT i = count; i > 0; i--) {
+        EQ_SCALAR (kmem_cache_free (cache, objs[i - 1]), true);
+    }
+    PTR obj = (PTR)kmem_cache_alloc (other);
+    EQ_SCALAR (PAGE_OF (obj), (PTR)slab_buffer);
+
+    // Kept slab is used again by the cache.
+    obj = (PTR)kmem_cache_alloc (cache);
+    EQ_SCALAR (PAGE_OF (obj), (PTR)slab_buffer + CONFIG_PAGE_FRAME_SIZE_BYTES);
+    END();
+}
+
+/**************************************************************************************************
+ * Allocates 10k small objects, then frees and allocates them in random order few times.
+ * Prints time taken by kmalloc and by a slab cache.
+ **************************************************************************************************/
+TEST (slab, churn_benchmark)
+{
+#define CHURN_OBJECT_COUNT 10000
+#define CHURN_ROUNDS       4
+    static void* objs[CHURN_OBJECT_COUNT];
+    static UINT order[CHURN_OBJECT_COUNT];
+
+    srand (7);
+    for (UINT i = 0; i < CHURN_OBJECT_COUNT; i++) {
+        order[i] = (UINT)rand() % CHURN_OBJECT_COUNT;
+    }
+
+    kvmm_memmap_fake.ret              = (PTR)malloc_buffer;
+    g_utmm.arch_mem_len_bytes_kmalloc = UT_MALLOC_SIZE_BYTES;
+    g_kstate.phase                    = KERNEL_PHASE_STATE_VMM_READY;
+    kmalloc_init();
+
+    clock_t start = clock();
+    for (UINT i = 0; i < CHURN_OBJECT_COUNT; i++) {
+        NEQ_SCALAR ((PTR)(objs[i] = kmalloc (UT_OBJECT_SIZE)), (PTR)NULL);
+    }
+    for (UINT r = 0; r < CHURN_ROUNDS; r++) {
+        for (UINT i = 0; i < CHURN_OBJECT_COUNT; i++) {
+            EQ_SCALAR (kfree (objs[order[i]]), true);
+            NEQ_SCALAR ((PTR)(objs[order[i]] = kmalloc (UT_OBJECT_SIZE)), (PTR)NULL);
+        }
+    }
+    clock_t kmallocTime = clock() - start;
+
+    start = clock();
+    for (UINT i = 0; i < CHURN_OBJECT_COUNT; i++) {
+        NEQ_SCALAR ((PTR)(objs[i] = kmem_cache_alloc (cache)), (PTR)NULL);
+    }
+    for (UINT r = 0; r < CHURN_ROUNDS; r++) {
+        for (UINT i = 0; i < CHURN_OBJECT_COUNT; i++) {
+            EQ_SCALAR (kmem_cache_free (cache, objs[order[i]]), true);
+            NEQ_SCALAR ((PTR)(objs[order[i]] = kmem_cache_alloc (cache)), (PTR)NULL);
+        }
+    }
+    clock_t slabTime = clock() - start;
+
+    printf ("\n  %u objects of %u bytes: kmalloc %9.3f ms, slab %7.3f ms", CHURN_OBJECT_COUNT,
+            UT_OBJECT_SIZE, (double)kmallocTime * 1000 / CLOCKS_PER_SEC,
+            (double)slabTime * 1000 / CLOCKS_PER_SEC);
+    END();
+}
+
+void yt_reset (void)
+{
+    panic_invoked        = false;
+    g_kstate.errorNumber = ERR_NONE;
+    g_kstate.phase       = KERNEL_PHASE_STATE_VMM_READY;
+
+    resetVMMFake();
+    reset_sallocFake();
+    resetStdLibFake();
+    kscalloc_fake.handler = kscalloc_handler;
+    k_memset_fake.handler = k_memset_handler;
+
+    kvmm_memmap_fake.ret           = (PTR)slab_buffer;
+    g_utmm.arch_mem_len_bytes_slab = sizeof (slab_buffer);
+    kslab_init();
+
+    cache = kmem_cache_create ("ut", UT_OBJECT_SIZE);
+}
+
+int main (void)
+{
+    YT_INIT();
+    create_invalidSize();
+    alloc_packedInPage();
+    alloc_newSlabWhenFull();
+    alloc_outOfMemory();
+    allocz_zeroFill();
+    free_reuse();
+    free_invalidObject();
+    free_doubleFree();
+    free_emptySlabReleased();
+    churn_benchmark();
+    RETURN_WITH_REPORT();
+}
@@ -0,0 +1,951 @@
+#define YUKTI_TEST_STRIP_PREFIX
+#define YUKTI_TEST_IMPLEMENTATION
+#include <unittest/yukti.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <utils.h>
+#include <types.h>
+#include <vmm.h>
+#include <vmm_struct.h>
+#include <kerror.h>
+#include <kernel.h>
+#include <mosunittest.h>
+#include <mock/kernel/kmalloc.h>
+#include <mock/kernel/salloc.h>
+#include <mock/kernel/paging.h>
+#include <mock/kernel/pmm.h>
+
+/*
+ * | TEST CASES                                                    | TEST FUNCTION               |
+ * |---------------------------------------------------------------|-----------------------------|
+ * | kvmm_memmap  - Thousands of address spaces added out of order.| memmap_lookup               |
+ * |                Every page is found in its address space.      |                             |
+ * | kvmm_memmap  - Overlapping address spaces are not added.      | memmap_overlap              |
+ * | kvmm_memmap  - Random memmap/free compared against first fit  | stress_compareWithFirstFit  |
+ * |                search over every page.                        |                             |
+ * | Lookup in thousands of address spaces. Prints time against    | lookup_benchmark            |
+ * | walking the sorted list.                                      |                             |
+ * | kvmm_commitPage - Pages of the window around the faulting     | commitPage_faultAround      |
+ * |                   page are committed. Window ends at the end  |                             |
+ * |                   of the address space.                       |                             |
+ * | kvmm_commitPage - Faulting page is committed even if memory   | commitPage_faultAround_     |
+ * |                   runs out before the end of the window.      | outOfMemory                 |
+ * | kvmm_commitPage - Write to a demand-zero page commits only    | commitPage_demandZeroWrite  |
+ * |                   that page. Window is used when the page     |                             |
+ * |                   before is mapped.                           |                             |
+ * | kvmm_setFaultAround - Window of one page and invalid inputs.  | setFaultAround              |
+ * | kvmm_memmap  - Populate flag commits every page at once.      | memmap_populate             |
+ * | Page faults when writing to a window buffer sequentially.     | faultAround_sequentialFill  |
+ * | kvmm_mapShare - Same page frames mapped in two VMMs. Freed    | share_mapInTwoVmms          |
+ * |                 with the last reference.                      |                             |
+ * | kvmm_newShare - Page frames are given back when memory runs   | share_newOutOfMemory        |
+ * |                 out.                                          |                             |
+ * | kvmm_unmapShare - Only address spaces of a share are freed.   | share_unmapOnlyShares       |
+ * | kvmm_clone - Same address spaces. Committed pages are shared, | clone_sharesPages           |
+ * |              shares are mapped again, null pages skipped.     |                             |
+ * | kvmm_clone - Kernel pages are not cloned. Clone is deleted    | clone_failure               |
+ * |              when pages cannot be shared.                     |                             |
+ * | kvmm_copyOnWrite - Page frame shared with another VMM is      | copyOnWrite_copiesShared    |
+ * |                    copied. Last owner keeps its page frame.   |                             |
+ * | kvmm_copyOnWrite - Pages which are never copied on write.     | copyOnWrite_notAllowed      |
+ * | kvmm_mapSharePrivate - Page frames mapped read-only and owned | sharePrivate_mapsReadOnly   |
+ * |                        by the VMM. No reference to the share. |                             |
+ * | kvmm_mapSharePrivate - Owners added are given up on failure.  | sharePrivate_failure        |
+ * | kvmm_mapZeroPage - Read maps the zero frame read-only. Write  | zeroPage_readThenWrite      |
+ * |                    replaces it with a zeroed page frame.      |                             |
+ * | kvmm_mapZeroPage - Pages which must be committed on access.   | zeroPage_notAllowed         |
+ * | kvmm_memmap  - Kernel mapping of given physical memory with a | memmap_largePagePlacement   |
+ * |                whole large page in it, is placed at the same  |                             |
+ * |                offset within a large page.                    |                             |
+ * | kvmm_free - Mapping with large pages is permanent once kernel  | free_largePageMapping       |
+ * |             page tables are shared.                           |                             |
+ * |---------------------------------------------------------------|-----------------------------|
+ */
+
+#define UT_VMM_START      0x10000000U
+#define UT_VMM_PAGE_COUNT 16384U
+#define UT_VMM_END        (UT_VMM_START + UT_VMM_PAGE_COUNT * CONFIG_PAGE_FRAME_SIZE_BYTES)
+#define UT_VAS_COUNT      4000U
+#define PAGE_VA(page)     (UT_VMM_START + (PTR)(page) * CONFIG_PAGE_FRAME_SIZE_BYTES)
+
+typedef struct UTAddressSpace {
+    UINT startPage;
+    UINT pageCount;
+} UTAddressSpace;
+
+static VMemoryManager* vmm;
+static UTAddressSpace vasList[UT_VAS_COUNT];
+static bool usedPages[UT_VMM_PAGE_COUNT];
+static bool committedPages[UT_VMM_PAGE_COUNT];
+static UINT frameCount;    // Page frames allocated so far.
+static UINT maxFrameCount; // Allocation fails after these many page frames.
+
+static void* kmalloc_handler (size_t bytes)
+{
+    return malloc (bytes);
+}
+
+static void* kmem_cache_allocz_handler (KMemCache* cache)
+{
+    (void)cache;
+    return calloc (1, sizeof (VMemoryAddressSpace));
+}
+
+static bool kmem_cache_free_handler (KMemCache* cache, void* obj)
+{
+    (void)cache;
+    free (obj);
+    return true;
+}
+
+static bool kpmm_allocZeroed_handler (Physical* address, KernelPhysicalMemoryRegions reg)
+{
+    (void)reg;
+    if (frameCount == maxFrameCount) {
+        g_kstate.errorNumber = ERR_OUT_OF_MEM;
+        return false;
+    }
+    address->val = PAGEFRAMES_TO_BYTES (++frameCount);
+    return true;
+}
+
+/* Works like the real one on a page table which is the 'committedPages' array. */
+static bool kpg_mapUnmappedPages_handler (PageDirectory pd, PTR vaStart, SIZE numPages,
+                                          Physical const* frames, SIZE count, PagingMapFlags flags,
+                                          SIZE* framesUsed)
+{
+    (void)pd;
+    (void)frames;
+    (void)flags;
+    UINT page   = (UINT)((vaStart - UT_VMM_START) / CONFIG_PAGE_FRAME_SIZE_BYTES);
+    *framesUsed = 0;
+    for (UINT i = 0; i < numPages && *framesUsed < count; i++) {
+        if (!committedPages[page + i]) {
+            committedPages[page + i] = true;
+            (*framesUsed)++;
+        }
+    }
+    return true;
+}
+
+static UINT committed_count (UINT startPage, UINT pageCount)
+{
+    UINT count = 0;
+    for (UINT page = startPage; page < startPage + pageCount; page++) {
+        count += committedPages[page];
+    }
+    return count;
+}
+
+/* Address spaces of 1 to 4 pages with 0 to 3 free pages between them. Returns the page after the
+ * last address space. */
+static UINT create_layout (void)
+{
+    UINT page = 0;
+    for (UINT i = 0; i < UT_VAS_COUNT; i++) {
+        page += (UINT)rand() % 4;
+        vasList[i].startPage = page;
+        vasList[i].pageCount = 1 + (UINT)rand() % 4;
+        page += vasList[i].pageCount;
+    }
+    return page;
+}
+
+/* Committed address spaces, so that kvmm_commitPage only looks up the address. */
+static void map_layout_shuffled (void)
+{
+    static UINT order[UT_VAS_COUNT];
+    for (UINT i = 0; i < UT_VAS_COUNT; i++) {
+        order[i] = i;
+    }
+    for (UINT i = UT_VAS_COUNT - 1; i > 0; i--) {
+        UINT j   = (UINT)rand() % (i + 1);
+        UINT t   = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    for (UINT i = 0; i < UT_VAS_COUNT; i++) {
+        UTAddressSpace* vas = &vasList[order[i]];
+        EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (vas->startPage), NULL, vas->pageCount,
+                                VMM_MEMMAP_FLAG_COMMITTED, NULL),
+                   PAGE_VA (vas->startPage));
+    }
+}
+
+/* Is the address within an address space. Uses kvmm_commitPage which fails with ERR_DOUBLE_ALLOC
+ * for committed address spaces. */
+static bool is_mapped (PTR va)
+{
+    EQ_SCALAR (kvmm_commitPage (vmm, va), false);
+    return g_kstate.errorNumber == ERR_DOUBLE_ALLOC;
+}
+
+/* Address space lookup as it was done before the tree: walk the sorted list. */
+static VMemoryAddressSpace* reference_findVas (PTR va)
+{
+    ListNode* node = NULL;
+    list_for_each (&vmm->head, node)
+    {
+        VMemoryAddressSpace* vas = LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
+        if (va >= vas->start_vm && va < vas->start_vm + vas->allocationSzBytes) {
+            return vas;
+        }
+    }
+    return NULL;
+}
+
+/* Lowest run of 'count' free pages. */
+static PTR reference_firstFit (UINT count)
+{
+    UINT run = 0;
+    for (UINT page = 0; page < UT_VMM_PAGE_COUNT; page++) {
+        run = usedPages[page] ? 0 : run + 1;
+        if (run == count) {
+            return PAGE_VA (page + 1 - count);
+        }
+    }
+    return 0;
+}
+
+TEST (vmm, memmap_lookup)
+{
+    UINT endPage = create_layout();
+    map_layout_shuffled();
+
+    UINT vasIndex = 0;
+    for (UINT page = 0; page < endPage + 4; page++) {
+        while (vasIndex < UT_VAS_COUNT &&
+               page >= vasList[vasIndex].startPage + vasList[vasIndex].pageCount) {
+            vasIndex++;
+        }
+        bool expected = (vasIndex < UT_VAS_COUNT && page >= vasList[vasIndex].startPage);
+
+        // First and last byte of the page.
+        EQ_SCALAR (is_mapped (PAGE_VA (page)), expected);
+        EQ_SCALAR (is_mapped (PAGE_VA (page + 1) - 1), expected);
+    }
+
+    // Address spaces are in the list in order.
+    ListNode* node = NULL;
+    UINT i         = 0;
+    list_for_each (&vmm->head, node)
+    {
+        VMemoryAddressSpace* vas = LIST_ITEM (node, VMemoryAddressSpace, adjMappingNode);
+        EQ_SCALAR (vas->start_vm, PAGE_VA (vasList[i++].startPage));
+    }
+    EQ_SCALAR (i, UT_VAS_COUNT);
+    END();
+}
+
+TEST (vmm, memmap_overlap)
+{
+    // Address spaces at pages [10, 14) and [20, 24)
+    EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (10), NULL, 4, VMM_MEMMAP_FLAG_NONE, NULL), PAGE_VA (10));
+    EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (20), NULL, 4, VMM_MEMMAP_FLAG_NONE, NULL), PAGE_VA (20));
+
+    UINT overlapping[][2] = {
+        { 10, 4 }, // Same
+        { 12, 1 }, // Within
+        { 8, 3 },  // End within
+        { 13, 3 }, // Start within
+        { 9, 6 },  // Covers it
+        { 12, 10 } // Start within one, end within the next
+    };
+
+    for (UINT i = 0; i < ARRAY_LENGTH (overlapping); i++) {
+        g_kstate.errorNumber = ERR_NONE;
+        EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (overlapping[i][0]), NULL, overlapping[i][1],
+                                VMM_MEMMAP_FLAG_NONE, NULL),
+                   (PTR)NULL);
+        EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_VMM_OVERLAPING_VAS);
+    }
+
+    // Fills the gap exactly.
+    EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (14), NULL, 6, VMM_MEMMAP_FLAG_NONE, NULL), PAGE_VA (14));
+    EQ_SCALAR (kvmm_findFree (vmm, 10), PAGE_VA (0));
+    EQ_SCALAR (kvmm_findFree (vmm, 11), PAGE_VA (24));
+    END();
+}
+
+TEST (vmm, stress_compareWithFirstFit)
+{
+    UINT liveCount = 0;
+
+    for (UINT iter = 0; iter < 20000; iter++) {
+        bool doFree = liveCount == UT_VAS_COUNT || (liveCount > 0 && (rand() % 100) < 45);
+
+        if (doFree) {
+            UINT i = (UINT)rand() % liveCount;
+            EQ_SCALAR (kvmm_free (vmm, PAGE_VA (vasList[i].startPage)), true);
+            memset (&usedPages[vasList[i].startPage], false, vasList[i].pageCount);
+            vasList[i] = vasList[--liveCount];
+        } else {
+            UINT count  = 1 + (UINT)rand() % 16;
+            PTR expected = reference_firstFit (count);
+            EQ_SCALAR (kvmm_findFree (vmm, count), expected);
+
+            PTR va = kvmm_memmap (vmm, (PTR)NULL, NULL, count, VMM_MEMMAP_FLAG_NONE, NULL);
+            EQ_SCALAR (va, expected);
+            if (va != 0) {
+                UINT startPage = (UINT)((va - UT_VMM_START) / CONFIG_PAGE_FRAME_SIZE_BYTES);
+                memset (&usedPages[startPage], true, count);
+                vasList[liveCount++] = (UTAddressSpace){ startPage, count };
+            }
+        }
+    }
+    END();
+}
+
+/**************************************************************************************************
+ * Looks up random addresses in a VMM with thousands of address spaces. Prints time taken by the
+ * tree lookup and by a walk over the sorted list.
+ **************************************************************************************************/
+TEST (vmm, lookup_benchmark)
+{
+#define LOOKUP_COUNT 50000
+    static PTR addresses[LOOKUP_COUNT];
+
+    UINT endPage = create_layout();
+    map_layout_shuffled();
+
+    for (UINT i = 0; i < LOOKUP_COUNT; i++) {
+        addresses[i] = UT_VMM_START + (PTR)rand() % PAGEFRAMES_TO_BYTES (endPage);
+    }
+
+    UINT foundInList = 0;
+    clock_t start    = clock();
+    for (UINT i = 0; i < LOOKUP_COUNT; i++) {
+        foundInList += (reference_findVas (addresses[i]) != NULL);
+    }
+    clock_t listTime = clock() - start;
+
+    UINT foundInTree = 0;
+    start            = clock();
+    for (UINT i = 0; i < LOOKUP_COUNT; i++) {
+        foundInTree += is_mapped (addresses[i]);
+    }
+    clock_t treeTime = clock() - start;
+
+    EQ_SCALAR (foundInTree, foundInList);
+    printf ("\n  %u lookups in %u address spaces: list %9.3f ms, tree %7.3f ms", LOOKUP_COUNT,
+            UT_VAS_COUNT, (double)listTime * 1000 / CLOCKS_PER_SEC,
+            (double)treeTime * 1000 / CLOCKS_PER_SEC);
+    END();
+}
+
+TEST (vmm, commitPage_faultAround)
+{
+    // Address space of 40 pages. Windows are pages [0, 16), [16, 32) and [32, 40).
+    EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (0), NULL, 40, VMM_MEMMAP_FLAG_KERNEL_PAGE, NULL),
+               PAGE_VA (0));
+
+    // Pages after the faulting page are committed first.
+    EQ_SCALAR (kvmm_commitPage (vmm, PAGE_VA (20) + 10), true);
+    EQ_SCALAR (committed_count (0, 16), 0U);
+    EQ_SCALAR (committed_count (16, 16), 16U);
+    EQ_SCALAR (kpmm_allocZeroed_fake.invokeCount, 16U);
+
+    // Window ends at the end of the address space.
+    EQ_SCALAR (kvmm_commitPage (vmm, PAGE_VA (39)), true);
+    EQ_SCALAR (committed_count (32, 8), 8U);
+    EQ_SCALAR (committed_count (40, 16), 0U);
+
+    EQ_SCALAR (kvmm_getPageFaultCount (vmm), 2U);
+    EQ_SCALAR (kpmm_freeZeroed_fake.invokeCount, 0U);
+    END();
+}
+
+TEST (vmm, commitPage_faultAround_outOfMemory)
+{
+    EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (0), NULL, 16, VMM_MEMMAP_FLAG_KERNEL_PAGE, NULL),
+               PAGE_VA (0));
+
+    maxFrameCount = 3;
+    EQ_SCALAR (kvmm_commitPage (vmm, PAGE_VA (5)), true);
+    EQ_SCALAR (committed_count (0, 16), 3U);
+    EQ_SCALAR (committed_count (5, 3), 3U);
+
+    EQ_SCALAR (kvmm_commitPage (vmm, PAGE_VA (1)), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_OUT_OF_MEM);
+    EQ_SCALAR (kvmm_getPageFaultCount (vmm), 1U);
+    END();
+}
+
+TEST (vmm, commitPage_demandZeroWrite)
+{
+    // Large address space which is not committed. A write anywhere in it commits only that page.
+    EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (0), NULL, 4096, VMM_MEMMAP_FLAG_NONE, NULL), PAGE_VA (0));
+    EQ_SCALAR (kvmm_commitPage (vmm, PAGE_VA (1000) + 10), true);
+    EQ_SCALAR (kpmm_allocZeroed_fake.invokeCount, 1U);
+    EQ_SCALAR (committed_count (0, 4096), 1U);
+    EQ_SCALAR (committedPages[1000], true);
+
+    // Write to the next page looks like filling in order. Rest of the window is committed.
+    EQ_SCALAR (kvmm_commitPage (vmm, PAGE_VA (1001)), true);
+    EQ_SCALAR (committed_count (992, 16), 16U);
+    EQ_SCALAR (committed_count (0, 4096), 16U);
+    EQ_SCALAR (kvmm_getPageFaultCount (vmm), 2U);
+    END();
+}
+
+TEST (vmm, setFaultAround)
+{
+    EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (0), NULL, 16, VMM_MEMMAP_FLAG_NONE, NULL), PAGE_VA (0));
+
+    EQ_SCALAR (kvmm_setFaultAround (vmm, PAGE_VA (3), 1), true);
+    EQ_SCALAR (kvmm_commitPage (vmm, PAGE_VA (5)), true);
+    EQ_SCALAR (committed_count (0, 16), 1U);
+    EQ_SCALAR (committedPages[5], true);
+
+    EQ_SCALAR (kvmm_setFaultAround (vmm, PAGE_VA (3), 0), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    EQ_SCALAR (kvmm_setFaultAround (vmm, PAGE_VA (16), 4), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_VMM_NOT_ALLOCATED);
+    END();
+}
+
+TEST (vmm, memmap_populate)
+{
+    EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (0), NULL, 40, VMM_MEMMAP_FLAG_POPULATE, NULL),
+               PAGE_VA (0));
+    EQ_SCALAR (committed_count (0, 40), 40U);
+    EQ_SCALAR (committed_count (40, 16), 0U);
+    EQ_SCALAR (kvmm_getPageFaultCount (vmm), 0U);
+
+    // Running out of memory is not an error. Remaining pages are committed on access.
+    maxFrameCount = frameCount + 10;
+    EQ_SCALAR (kvmm_memmap (vmm, PAGE_VA (40), NULL, 40, VMM_MEMMAP_FLAG_POPULATE, NULL),
+               PAGE_VA (40));
+    EQ_SCALAR (committed_count (40, 40), 10U);
+    END();
+}
+
+/**************************************************************************************************
+ * Counts page faults when every page of a buffer as large as a quarter screen window (800 x 600
+ * at 32 bpp) is written in order.
+ **************************************************************************************************/
+TEST (vmm, faultAround_sequentialFill)
+{
+    SIZE bufferPages         = BYTES_TO_PAGEFRAMES_CEILING (400 * 300 * 4);
+    SIZE windows[]           = { 1, CONFIG_VMM_FAULT_AROUND_PAGES };
+    // With fault around, first page of the buffer is committed alone. It is not known yet that the
+    // buffer is filled in order.
+    U32 expectedFaultCount[] = { (U32)bufferPages,
+                                 1U + (U32)((bufferPages + CONFIG_VMM_FAULT_AROUND_PAGES - 1) /
+                                            CONFIG_VMM_FAULT_AROUND_PAGES) };
+
+    for (UINT i = 0; i < ARRAY_LENGTH (windows); i++) {
+        memset (committedPages, false, sizeof (committedPages));
+        vmm->pageFaultCount = 0;
+
+        PTR buffer = kvmm_memmap (vmm, (PTR)NULL, NULL, bufferPages, VMM_MEMMAP_FLAG_NONE, NULL);
+        EQ_SCALAR (kvmm_setFaultAround (vmm, buffer, windows[i]), true);
+
+        for (SIZE page = 0; page < bufferPages; page++) {
+            PTR va = buffer + PAGEFRAMES_TO_BYTES (page);
+            if (!committedPages[(va - UT_VMM_START) / CONFIG_PAGE_FRAME_SIZE_BYTES]) {
+                EQ_SCALAR (kvmm_commitPage (vmm, va), true);
+            }
+        }
+
+        EQ_SCALAR (kvmm_getPageFaultCount (vmm), expectedFaultCount[i]);
+        printf ("\n  %u pages, fault around %u pages: %u faults", (UINT)bufferPages,
+                (UINT)windows[i], kvmm_getPageFaultCount (vmm));
+        EQ_SCALAR (kvmm_free (vmm, buffer), true);
+    }
+    END();
+}
+
+TEST (vmm, free_unmapsRangeOnce)
+{
+    PTR buffer = kvmm_memmap (vmm, (PTR)NULL, NULL, 40, VMM_MEMMAP_FLAG_NONE, NULL);
+    NEQ_SCALAR (buffer, (PTR)NULL);
+
+    // Whole address space is unmapped by one call, which also frees its page frames.
+    MUST_CALL_ANY_ORDER (kpg_unmapRange, _, V (buffer), V (40U), V (PG_UNMAP_FLAG_FREE_FRAMES));
+    EQ_SCALAR (kvmm_free (vmm, buffer), true);
+    EQ_SCALAR (kpg_unmapRange_fake.invokeCount, 1U);
+    END();
+}
+
+static Physical const* mappedFrames[2]; // Frames given to each kpg_mapUnmappedPages call.
+static PagingMapFlags mappedFlags;      // Flags given to the last kpg_mapUnmappedPages call.
+
+static bool kpg_mapUnmappedPages_share_handler (PageDirectory pd, PTR vaStart, SIZE numPages,
+                                                Physical const* frames, SIZE count,
+                                                PagingMapFlags flags, SIZE* framesUsed)
+{
+    (void)pd;
+    (void)vaStart;
+    mappedFrames[kpg_mapUnmappedPages_fake.invokeCount - 1] = frames;
+    mappedFlags                                             = flags;
+    *framesUsed = MIN (numPages, count);
+    return true;
+}
+
+TEST (vmm, share_mapInTwoVmms)
+{
+    kpg_mapUnmappedPages_fake.handler = kpg_mapUnmappedPages_share_handler;
+    kpmm_free_fake.ret                = true;
+
+    Physical pd          = PHYSICAL (2 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+    VMemoryManager* vmm2 = kvmm_new (UT_VMM_START, UT_VMM_END, pd, PMM_REGION_ANY);
+
+    VMemoryShare* share = kvmm_newShare (3, PMM_REGION_ANY);
+    NEQ_SCALAR ((PTR)share, (PTR)NULL);
+    EQ_SCALAR (kpmm_allocZeroed_fake.invokeCount, 3U);
+
+    PTR va1 = kvmm_mapShare (vmm, share, VMM_MEMMAP_FLAG_NONE);
+    PTR va2 = kvmm_mapShare (vmm2, share, VMM_MEMMAP_FLAG_READONLY);
+    NEQ_SCALAR (va1, (PTR)NULL);
+    NEQ_SCALAR (va2, (PTR)NULL);
+
+    // Both VMMs map the same page frames.
+    EQ_SCALAR (kpg_mapUnmappedPages_fake.invokeCount, 2U);
+    EQ_SCALAR ((PTR)mappedFrames[0], (PTR)mappedFrames[1]);
+
+    // Page frames are not committed on access.
+    EQ_SCALAR (kvmm_commitPage (vmm, va1), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_DOUBLE_ALLOC);
+
+    // Page frames stay till the last reference is released.
+    MUST_CALL_ANY_ORDER (kpg_unmapRange, _, V (va1), V (3U), V (0));
+    EQ_SCALAR (kvmm_unmapShare (vmm, va1), true);
+    kvmm_releaseShare (share);
+    EQ_SCALAR (kpmm_free_fake.invokeCount, 0U);
+
+    EQ_SCALAR (kvmm_free (vmm2, va2), true);
+    EQ_SCALAR (kpmm_free_fake.invokeCount, 3U);
+    END();
+}
+
+TEST (vmm, share_newOutOfMemory)
+{
+    kpmm_free_fake.ret = true;
+    maxFrameCount      = 2;
+
+    EQ_SCALAR ((PTR)kvmm_newShare (3, PMM_REGION_ANY), (PTR)NULL);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_OUT_OF_MEM);
+    EQ_SCALAR (kpmm_free_fake.invokeCount, 2U);
+
+    EQ_SCALAR ((PTR)kvmm_newShare (0, PMM_REGION_ANY), (PTR)NULL);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+    END();
+}
+
+TEST (vmm, share_unmapOnlyShares)
+{
+    PTR buffer = kvmm_memmap (vmm, (PTR)NULL, NULL, 2, VMM_MEMMAP_FLAG_NONE, NULL);
+
+    EQ_SCALAR (kvmm_unmapShare (vmm, buffer), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    EQ_SCALAR (kvmm_unmapShare (vmm, buffer + CONFIG_PAGE_FRAME_SIZE_BYTES), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_VMM_NOT_ALLOCATED);
+
+    EQ_SCALAR (kpg_unmapRange_fake.invokeCount, 0U);
+    END();
+}
+
+TEST (vmm, clone_sharesPages)
+{
+    kpg_mapUnmappedPages_fake.handler = kpg_mapUnmappedPages_share_handler;
+    kpg_shareMappings_fake.ret        = true;
+
+    PTR buffer  = kvmm_memmap (vmm, (PTR)NULL, NULL, 2, VMM_MEMMAP_FLAG_NONE, NULL);
+    PTR guarded = kvmm_allocGuarded (vmm, 3, VMM_MEMMAP_FLAG_READONLY);
+    kvmm_setFaultAround (vmm, buffer, 1);
+
+    VMemoryShare* share = kvmm_newShare (2, PMM_REGION_ANY);
+    PTR shareVA         = kvmm_mapShare (vmm, share, VMM_MEMMAP_FLAG_NONE);
+
+    MUST_CALL_ANY_ORDER (kpg_shareMappings, _, _, V (buffer), V (2U),
+                         V (PG_MAP_FLAG_DEFAULT | PG_MAP_FLAG_WRITABLE));
+    MUST_CALL_ANY_ORDER (kpg_shareMappings, _, _, V (guarded), V (3U), V (PG_MAP_FLAG_DEFAULT));
+
+    Physical pd           = PHYSICAL (2 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+    VMemoryManager* clone = kvmm_clone (vmm, pd);
+    NEQ_SCALAR ((PTR)clone, (PTR)NULL);
+    EQ_SCALAR (kvmm_getPageDirectory (clone).val, pd.val);
+
+    // Null pages have nothing to share. Page frames of the share are mapped as they are.
+    EQ_SCALAR (kpg_shareMappings_fake.invokeCount, 2U);
+    EQ_SCALAR (kpg_mapUnmappedPages_fake.invokeCount, 2U);
+    EQ_SCALAR ((PTR)mappedFrames[1], (PTR)share->pages);
+    EQ_SCALAR (share->refcount, 3U);
+
+    // Same address spaces are in the clone.
+    EQ_SCALAR (kvmm_setFaultAround (clone, buffer + CONFIG_PAGE_FRAME_SIZE_BYTES, 2), true);
+    EQ_SCALAR (kvmm_freeGuarded (clone, guarded, NULL), true);
+    EQ_SCALAR (kvmm_unmapShare (clone, shareVA), true);
+    EQ_SCALAR (share->refcount, 2U);
+    EQ_SCALAR (kvmm_free (clone, buffer), true);
+    EQ_SCALAR (kvmm_delete (&clone), true);
+    END();
+}
+
+static bool kpg_shareMappings_overflow_handler (PageDirectory srcPD, PageDirectory destPD,
+                                                PTR vaStart, SIZE numPages, PagingMapFlags flags)
+{
+    (void)srcPD;
+    (void)destPD;
+    (void)vaStart;
+    (void)numPages;
+    (void)flags;
+    g_kstate.errorNumber = ERR_OVERFLOW;
+    return false;
+}
+
+TEST (vmm, clone_failure)
+{
+    Physical pd = PHYSICAL (2 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    // Pages shared so far are given up with the clone.
+    kpg_shareMappings_fake.handler = kpg_shareMappings_overflow_handler;
+    PTR buffer = kvmm_memmap (vmm, (PTR)NULL, NULL, 2, VMM_MEMMAP_FLAG_NONE, NULL);
+    MUST_CALL_ANY_ORDER (kpg_unmapRange, _, V (buffer), V (2U), V (PG_UNMAP_FLAG_FREE_FRAMES));
+
+    EQ_SCALAR ((PTR)kvmm_clone (vmm, pd), (PTR)NULL);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_OVERFLOW);
+    EQ_SCALAR (kpg_unmapRange_fake.invokeCount, 1U);
+
+    // Kernel pages can be written when page faults are not allowed.
+    kvmm_memmap (vmm, (PTR)NULL, NULL, 1, VMM_MEMMAP_FLAG_KERNEL_PAGE, NULL);
+    EQ_SCALAR ((PTR)kvmm_clone (vmm, pd), (PTR)NULL);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+    EQ_SCALAR (kpg_shareMappings_fake.invokeCount, 1U);
+    END();
+}
+
+static Physical remappedFrame;
+
+static bool kpg_doesMappingExists_handler (PageDirectory pd, PTR va, Physical* pa)
+{
+    (void)pd;
+    UINT page = (UINT)((va - UT_VMM_START) / CONFIG_PAGE_FRAME_SIZE_BYTES);
+    pa->val   = PAGEFRAMES_TO_BYTES (page + 1);
+    return committedPages[page];
+}
+
+static bool kpmm_alloc_handler (Physical* address, UINT pageCount, KernelPhysicalMemoryRegions reg)
+{
+    (void)pageCount;
+    return kpmm_allocZeroed_handler (address, reg);
+}
+
+static bool kpg_remap_handler (PageDirectory pd, PTR va, Physical pa, PagingMapFlags flags)
+{
+    (void)pd;
+    (void)va;
+    (void)flags;
+    remappedFrame = pa;
+    return true;
+}
+
+TEST (vmm, copyOnWrite_copiesShared)
+{
+    kpg_doesMappingExists_fake.handler = kpg_doesMappingExists_handler;
+    kpmm_alloc_fake.handler            = kpmm_alloc_handler;
+    kpg_remap_fake.handler             = kpg_remap_handler;
+    kpg_copyPageFrame_fake.ret         = true;
+    kpmm_free_fake.ret                 = true;
+
+    PTR buffer  = kvmm_memmap (vmm, (PTR)NULL, NULL, 2, VMM_MEMMAP_FLAG_POPULATE, NULL);
+    Physical pa = createPhysical (0);
+    kpg_doesMappingExists_handler (NULL, buffer, &pa);
+
+    // Only one more page frame can be allocated.
+    frameCount    = 99;
+    maxFrameCount = 100;
+
+    // Page frame is still shared, so it is copied.
+    kpmm_getShareCount_fake.ret = 1;
+    EQ_SCALAR (kvmm_copyOnWrite (vmm, buffer + 10), true);
+    EQ_SCALAR (kpg_copyPageFrame_fake.invokeCount, 1U);
+    EQ_SCALAR (remappedFrame.val, PAGEFRAMES_TO_BYTES (100));
+    EQ_SCALAR (kpmm_free_fake.invokeCount, 1U);
+
+    // Memory ran out for the copy.
+    EQ_SCALAR (kvmm_copyOnWrite (vmm, buffer), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_OUT_OF_MEM);
+
+    // Other owners are gone, so the page frame is made writable as it is.
+    kpmm_getShareCount_fake.ret = 0;
+    EQ_SCALAR (kvmm_copyOnWrite (vmm, buffer), true);
+    EQ_SCALAR (remappedFrame.val, pa.val);
+    EQ_SCALAR (kpg_copyPageFrame_fake.invokeCount, 1U);
+    EQ_SCALAR (kpmm_free_fake.invokeCount, 1U);
+    EQ_SCALAR (kvmm_getPageFaultCount (vmm), 2U);
+    END();
+}
+
+TEST (vmm, copyOnWrite_notAllowed)
+{
+    kpg_doesMappingExists_fake.handler = kpg_doesMappingExists_handler;
+
+    PTR readonly = kvmm_memmap (vmm, (PTR)NULL, NULL, 1, VMM_MEMMAP_FLAG_READONLY, NULL);
+    EQ_SCALAR (kvmm_copyOnWrite (vmm, readonly), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    PTR guarded = kvmm_allocGuarded (vmm, 1, VMM_MEMMAP_FLAG_NONE);
+    EQ_SCALAR (kvmm_copyOnWrite (vmm, guarded - CONFIG_PAGE_FRAME_SIZE_BYTES), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    // Page was never committed.
+    EQ_SCALAR (kvmm_copyOnWrite (vmm, guarded), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_PAGE_WRONG_STATE);
+
+    EQ_SCALAR (kvmm_copyOnWrite (vmm, UT_VMM_END - 1), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_VMM_NOT_ALLOCATED);
+
+    EQ_SCALAR (kpg_remap_fake.invokeCount, 0U);
+    END();
+}
+
+TEST (vmm, sharePrivate_mapsReadOnly)
+{
+    kpg_mapUnmappedPages_fake.handler = kpg_mapUnmappedPages_share_handler;
+    kpmm_share_fake.ret               = true;
+
+    VMemoryShare* share = kvmm_newShare (2, PMM_REGION_ANY);
+    PTR va              = PAGE_VA (4);
+
+    EQ_SCALAR (kvmm_mapSharePrivate (vmm, va, share), va);
+    EQ_SCALAR ((PTR)mappedFrames[0], (PTR)share->pages);
+    EQ_SCALAR (mappedFlags, (PagingMapFlags)PG_MAP_FLAG_DEFAULT); // Not writable.
+    EQ_SCALAR (kpmm_share_fake.invokeCount, 2U);
+    EQ_SCALAR (share->refcount, 1U);
+
+    // Address space is not a share. Its page frames are freed (owners given up) with it.
+    EQ_SCALAR (kvmm_unmapShare (vmm, va), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+    EQ_SCALAR (kvmm_commitPage (vmm, va), false);
+
+    MUST_CALL_ANY_ORDER (kpg_unmapRange, _, V (va), V (2U), V (PG_UNMAP_FLAG_FREE_FRAMES));
+    EQ_SCALAR (kvmm_free (vmm, va), true);
+    EQ_SCALAR (share->refcount, 1U);
+    END();
+}
+
+static bool kpmm_share_overflow_handler (Physical pa)
+{
+    (void)pa;
+    if (kpmm_share_fake.invokeCount == 2) {
+        g_kstate.errorNumber = ERR_OVERFLOW;
+        return false;
+    }
+    return true;
+}
+
+TEST (vmm, sharePrivate_failure)
+{
+    kpmm_share_fake.handler = kpmm_share_overflow_handler;
+    kpmm_free_fake.ret      = true;
+
+    VMemoryShare* share = kvmm_newShare (3, PMM_REGION_ANY);
+    PTR va              = PAGE_VA (4);
+
+    EQ_SCALAR (kvmm_mapSharePrivate (vmm, va, share), 0U);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_OVERFLOW);
+    EQ_SCALAR (kpmm_free_fake.invokeCount, 1U);
+    EQ_SCALAR (kpg_mapUnmappedPages_fake.invokeCount, 0U);
+
+    // Address space is removed as well.
+    EQ_SCALAR (kvmm_memmap (vmm, va, NULL, 3, VMM_MEMMAP_FLAG_NONE, NULL), va);
+    END();
+}
+
+#define UT_ZERO_FRAME 0x50000
+
+static bool kpmm_getZeroFrame_handler (Physical* address)
+{
+    address->val = UT_ZERO_FRAME;
+    return true;
+}
+
+static bool kpg_doesMappingExists_zero_handler (PageDirectory pd, PTR va, Physical* pa)
+{
+    (void)pd;
+    (void)va;
+    pa->val = UT_ZERO_FRAME;
+    return true;
+}
+
+TEST (vmm, zeroPage_readThenWrite)
+{
+    kpmm_getZeroFrame_fake.handler    = kpmm_getZeroFrame_handler;
+    kpg_mapUnmappedPages_fake.handler = kpg_mapUnmappedPages_share_handler;
+
+    PTR buffer = kvmm_memmap (vmm, (PTR)NULL, NULL, 4, VMM_MEMMAP_FLAG_NONE, NULL);
+
+    // Read maps the zero frame. No page frame is allocated.
+    EQ_SCALAR (kvmm_mapZeroPage (vmm, buffer + CONFIG_PAGE_FRAME_SIZE_BYTES + 10), true);
+    EQ_SCALAR (mappedFrames[0]->val, (PTR)UT_ZERO_FRAME);
+    EQ_SCALAR (mappedFlags, (PagingMapFlags)PG_MAP_FLAG_DEFAULT); // Not writable.
+    EQ_SCALAR (kpmm_allocZeroed_fake.invokeCount, 0U);
+
+    // First write gets a zeroed page frame. Zero frame is not copied.
+    kpg_doesMappingExists_fake.handler = kpg_doesMappingExists_zero_handler;
+    kpg_remap_fake.handler             = kpg_remap_handler;
+    kpmm_isZeroFrame_fake.ret          = true;
+    kpmm_free_fake.ret                 = true;
+    EQ_SCALAR (kvmm_copyOnWrite (vmm, buffer + CONFIG_PAGE_FRAME_SIZE_BYTES), true);
+    EQ_SCALAR (kpmm_allocZeroed_fake.invokeCount, 1U);
+    EQ_SCALAR (remappedFrame.val, PAGEFRAMES_TO_BYTES (1));
+    EQ_SCALAR (kpg_copyPageFrame_fake.invokeCount, 0U);
+    EQ_SCALAR (kvmm_getPageFaultCount (vmm), 2U);
+    END();
+}
+
+TEST (vmm, zeroPage_notAllowed)
+{
+    PTR va = kvmm_memmap (vmm, (PTR)NULL, NULL, 1, VMM_MEMMAP_FLAG_KERNEL_PAGE, NULL);
+    EQ_SCALAR (kvmm_mapZeroPage (vmm, va), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    kpmm_alloc_fake.handler   = kpmm_alloc_handler;
+    kpg_mapContinous_fake.ret = true;
+    va = kvmm_memmap (vmm, (PTR)NULL, NULL, 1, VMM_MEMMAP_FLAG_IMMCOMMIT, NULL);
+    EQ_SCALAR (kvmm_mapZeroPage (vmm, va), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    va = kvmm_memmap (vmm, (PTR)NULL, NULL, 1, VMM_MEMMAP_FLAG_NULLPAGE, NULL);
+    EQ_SCALAR (kvmm_mapZeroPage (vmm, va), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+
+    EQ_SCALAR (kvmm_mapZeroPage (vmm, UT_VMM_END - 1), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_VMM_NOT_ALLOCATED);
+
+    EQ_SCALAR (kpmm_getZeroFrame_fake.invokeCount, 0U);
+    EQ_SCALAR (kpg_mapUnmappedPages_fake.invokeCount, 0U);
+    END();
+}
+
+#define UT_LARGE_PAGE_SIZE_BYTES 0x400000U
+
+static PagingMapFlags mappedContinousFlags;
+
+static bool kpg_mapContinous_flags_handler (PageDirectory pd, PTR vaStart, Physical paStart,
+                                            SIZE numPages, PagingMapFlags flags)
+{
+    (void)pd;
+    (void)vaStart;
+    (void)paStart;
+    (void)numPages;
+    mappedContinousFlags = flags;
+    return true;
+}
+
+TEST (vmm, memmap_largePagePlacement)
+{
+    kpg_getLargePageSizeBytes_fake.ret = UT_LARGE_PAGE_SIZE_BYTES;
+    kpg_mapContinous_fake.handler      = kpg_mapContinous_flags_handler;
+    VMemoryMemMapFlags flags           = VMM_MEMMAP_FLAG_IMMCOMMIT | VMM_MEMMAP_FLAG_KERNEL_PAGE;
+
+    EQ_SCALAR (kvmm_memmap (vmm, (PTR)NULL, NULL, 1, VMM_MEMMAP_FLAG_NONE, NULL), PAGE_VA (0));
+
+    // Physical range [0xC03000, 0x1403000) has the large page at 0x1000000.
+    Physical pa = PHYSICAL (0xC03000);
+    EQ_SCALAR (kvmm_memmap (vmm, (PTR)NULL, &pa, 2048, flags, NULL), PAGE_VA (3));
+    EQ_SCALAR (BIT_ISSET (mappedContinousFlags, PG_MAP_FLAG_LARGE_PAGES), 1U);
+
+    // Range with no whole large page takes the lowest free address.
+    Physical small = PHYSICAL (0xC03000);
+    EQ_SCALAR (kvmm_memmap (vmm, (PTR)NULL, &small, 2, flags, NULL), PAGE_VA (1));
+
+    // Page frames allocated by the VMM are not mapped with large pages.
+    kpmm_alloc_fake.handler = kpmm_alloc_handler;
+    EQ_SCALAR (kvmm_memmap (vmm, (PTR)NULL, NULL, 2, flags, NULL), PAGE_VA (2051));
+    EQ_SCALAR (BIT_ISSET (mappedContinousFlags, PG_MAP_FLAG_LARGE_PAGES), 0U);
+    END();
+}
+
+TEST (vmm, free_largePageMapping)
+{
+    kpg_getLargePageSizeBytes_fake.ret = UT_LARGE_PAGE_SIZE_BYTES;
+    kpg_mapContinous_fake.ret          = true;
+    VMemoryMemMapFlags flags           = VMM_MEMMAP_FLAG_IMMCOMMIT | VMM_MEMMAP_FLAG_KERNEL_PAGE;
+
+    Physical pa = PHYSICAL (UT_LARGE_PAGE_SIZE_BYTES);
+    PTR first   = kvmm_memmap (vmm, (PTR)NULL, &pa, 1024, flags, NULL);
+    PTR second  = kvmm_memmap (vmm, (PTR)NULL, &pa, 1024, flags, NULL);
+    NEQ_SCALAR (first, (PTR)NULL);
+    NEQ_SCALAR (second, (PTR)NULL);
+
+    // Large pages can be unmapped till kernel page tables are shared.
+    EQ_SCALAR (kvmm_free (vmm, first), true);
+
+    // After that the mapping is permanent.
+    kpg_getLargePageSizeBytes_fake.ret = 0;
+    EQ_SCALAR (kvmm_free (vmm, second), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_ARGUMENT);
+    EQ_SCALAR (kpg_unmapRange_fake.invokeCount, 1U);
+    EQ_SCALAR (is_mapped (second), true);
+    END();
+}
+
+void yt_reset (void)
+{
+    panic_invoked        = false;
+    g_kstate.errorNumber = ERR_NONE;
+    g_kstate.phase       = KERNEL_PHASE_STATE_KMALLOC_READY;
+
+    resetKmallocFake();
+    reset_sallocFake();
+    resetPagingFake();
+    resetPmm();
+
+    kmalloc_fake.handler               = kmalloc_handler;
+    kmem_cache_create_fake.ret         = (KMemCache*)&vmm; // Any address. Cache is not used.
+    kmem_cache_allocz_fake.handler     = kmem_cache_allocz_handler;
+    kmem_cache_free_fake.handler       = kmem_cache_free_handler;
+    kpmm_allocZeroed_fake.handler      = kpmm_allocZeroed_handler;
+    kpmm_freeZeroed_fake.ret           = true;
+    kpg_mapUnmappedPages_fake.handler  = kpg_mapUnmappedPages_handler;
+    kpg_doesMappingExists_fake.handler = kpg_doesMappingExists_handler;
+    kpg_unmapRange_fake.ret            = true;
+
+    // Address spaces of the previous test are not freed.
+    memset (usedPages, false, sizeof (usedPages));
+    memset (committedPages, false, sizeof (committedPages));
+    frameCount    = 0;
+    maxFrameCount = UINT_MAX;
+    Physical pd = PHYSICAL (CONFIG_PAGE_FRAME_SIZE_BYTES);
+    vmm         = kvmm_new (UT_VMM_START, UT_VMM_END, pd, PMM_REGION_ANY);
+}
+
+int main (void)
+{
+    YT_INIT();
+    srand (11);
+    memmap_lookup();
+    memmap_overlap();
+    stress_compareWithFirstFit();
+    lookup_benchmark();
+    commitPage_faultAround();
+    commitPage_faultAround_outOfMemory();
+    commitPage_demandZeroWrite();
+    setFaultAround();
+    memmap_populate();
+    faultAround_sequentialFill();
+    free_unmapsRangeOnce();
+    share_mapInTwoVmms();
+    share_newOutOfMemory();
+    share_unmapOnlyShares();
+    clone_sharesPages();
+    clone_failure();
+    copyOnWrite_copiesShared();
+    copyOnWrite_notAllowed();
+    sharePrivate_mapsReadOnly();
+    sharePrivate_failure();
+    zeroPage_readThenWrite();
+    zeroPage_notAllowed();
+    memmap_largePagePlacement();
+    free_largePageMapping();
+    RETURN_WITH_REPORT();
+}
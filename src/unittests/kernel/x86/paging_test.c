@@ -17,24 +17,49 @@
 // ------------------------------------------------------------------------------------------------
 // Test: Temporary map and unmap scenarios
 // ------------------------------------------------------------------------------------------------
+KmapCache s_kmap; // Kmap cache used by paging.c. Reset before every test.
+
+// One PTE for every kmap slot. Index is the PTE index of the slot.
+static ArchPageTableEntry s_kmapPtes[CONFIG_KMAP_SLOT_COUNT];
+
+static ArchPageTableEntry* s_getKmapPte_handler (UINT pdeIndex, UINT pteIndex)
+{
+    (void)pdeIndex;
+    return &s_kmapPtes[pteIndex];
+}
+
+static void* s_getKmapLinearAddress_handler (UINT pdeIndex, UINT pteIndex, UINT offset)
+{
+    return (void*)(PTR)((pdeIndex << PDE_SHIFT) | (pteIndex << PTE_SHIFT) | offset);
+}
+
+static void s_useKmapPtes(void)
+{
+    s_getPteFromCurrentPd_fake.handler = s_getKmapPte_handler;
+    s_getLinearAddress_fake.handler    = s_getKmapLinearAddress_handler;
+}
+
 TEST (paging, temporary_unmap_success)
 {
-    ArchPageTableEntry pte     = { .present = 1 };
+    ArchPageTableEntry pte     = { 0 };
     s_getPteFromCurrentPd_fake.ret = &pte;
 
+    Physical pa = PHYSICAL (0x12000);
+    kpg_temporaryMap (pa);
     kpg_temporaryUnmap();
-    EQ_SCALAR ((int)pte.present, 0);
+    EQ_SCALAR (panic_invoked, false);
+
+    // PTE stays until the slot is recycled.
+    EQ_SCALAR ((U32)pte.present, 1U);
+    EQ_SCALAR (s_kmap.depth, 0U);
+    EQ_SCALAR (s_kmap.slots[0].pinCount, 0U);
     END();
 }
 
 TEST (paging, temporary_unmap_failure_already_unmapped)
 {
-    ArchPageTableEntry pte     = { 0 };
-    s_getPteFromCurrentPd_fake.ret = &pte;
-
     kpg_temporaryUnmap();
     EQ_SCALAR (panic_invoked, true);
-    EQ_SCALAR ((int)pte.present, 0);
     END();
 }
 
@@ -54,16 +79,80 @@ TEST (paging, temporary_map_success)
     END();
 }
 
-TEST (paging, temporary_map_failure_already_mapped)
+TEST (paging, temporary_map_success_nested)
 {
-    ArchPageTableEntry pte     = { .present = 1 };
-    s_getPteFromCurrentPd_fake.ret = &pte;
+    s_useKmapPtes();
+
+    Physical pa1 = PHYSICAL (0x12000);
+    Physical pa2 = PHYSICAL (0x13000);
+    void* va1    = kpg_temporaryMap (pa1);
+    void* va2    = kpg_temporaryMap (pa2);
+
+    EQ_SCALAR (panic_invoked, false);
+    NEQ_SCALAR ((PTR)va1, (PTR)va2);
+    EQ_SCALAR ((U32)s_kmapPtes[0].pageFrame, PHYSICAL_TO_PAGEFRAME (pa1.val));
+    EQ_SCALAR ((U32)s_kmapPtes[1].pageFrame, PHYSICAL_TO_PAGEFRAME (pa2.val));
+
+    kpg_temporaryUnmap();
+    kpg_temporaryUnmap();
+    EQ_SCALAR (panic_invoked, false);
+    END();
+}
+
+TEST (paging, temporary_map_success_cache_hit)
+{
+    s_useKmapPtes();
 
     Physical pa = PHYSICAL (0x12000);
+    void* va    = kpg_temporaryMap (pa);
+    kpg_temporaryUnmap();
+
+    // Page is still in its slot, so the PTE is not written again.
+    EQ_SCALAR ((PTR)kpg_temporaryMap (pa), (PTR)va);
+    EQ_SCALAR (s_getPteFromCurrentPd_fake.invokeCount, 1U);
+    kpg_temporaryUnmap();
+    END();
+}
+
+TEST (paging, temporary_map_success_slots_recycled)
+{
+    s_useKmapPtes();
+
+    // First page stays mapped, so its slot is not recycled.
+    Physical pinned = PHYSICAL (0x10000);
+    kpg_temporaryMap (pinned);
+
+    for (UINT i = 1; i < CONFIG_KMAP_SLOT_COUNT; i++) {
+        kpg_temporaryMap (createPhysical (0x10000 + i * CONFIG_PAGE_FRAME_SIZE_BYTES));
+        kpg_temporaryUnmap();
+    }
+
+    // Every slot is in use or cached. New page recycles the cached ones.
+    Physical pa = PHYSICAL (0x40000);
     kpg_temporaryMap (pa);
+    EQ_SCALAR (panic_invoked, false);
+
+    EQ_SCALAR ((U32)s_kmapPtes[0].present, 1U);
+    EQ_SCALAR ((U32)s_kmapPtes[0].pageFrame, PHYSICAL_TO_PAGEFRAME (pinned.val));
+    EQ_SCALAR ((U32)s_kmapPtes[1].present, 1U);
+    EQ_SCALAR ((U32)s_kmapPtes[1].pageFrame, PHYSICAL_TO_PAGEFRAME (pa.val));
+    for (UINT i = 2; i < CONFIG_KMAP_SLOT_COUNT; i++) {
+        EQ_SCALAR ((U32)s_kmapPtes[i].present, 0U);
+    }
+    END();
+}
 
-    EQ_SCALAR (panic_invoked, true);
+TEST (paging, temporary_map_failure_nested_too_deep)
+{
+    s_useKmapPtes();
 
+    for (UINT i = 0; i < CONFIG_KMAP_SLOT_COUNT; i++) {
+        kpg_temporaryMap (createPhysical (0x10000 + i * CONFIG_PAGE_FRAME_SIZE_BYTES));
+    }
+    EQ_SCALAR (panic_invoked, false);
+
+    kpg_temporaryMap (createPhysical (0x40000));
+    EQ_SCALAR (panic_invoked, true);
     END();
 }
 
@@ -155,7 +244,7 @@ TEST (paging, map_failure_new_page_table_creation_failed)
     };
 
     // Physical address for the new page table
-    kpmm_alloc_fake.ret = false;
+    kpmm_allocZeroed_fake.ret = false;
 
     EQ_SCALAR (kpg_map (pd, va, pa, UNITTEST_PG_MAP_DONT_CARE), false);
     EQ_SCALAR (panic_invoked, true);
@@ -192,11 +281,10 @@ TEST (paging, map_failure_pa_not_aligned)
 // ------------------------------------------------------------------------------------------------
 // Test: Successful mapping scenarios
 // ------------------------------------------------------------------------------------------------
-bool kpmm_alloc_handler_map_success_page_table_not_present (Physical* address, UINT pageCount,
-                                                            KernelPhysicalMemoryRegions reg)
+bool kpmm_allocZeroed_handler_map_success_page_table_not_present (Physical* address,
+                                                                  KernelPhysicalMemoryRegions reg)
 {
     // Unused
-    (void)pageCount;
     (void)reg;
 
     address->val = 0x13000; // Can be Page aligned any  number.
@@ -229,7 +317,7 @@ TEST (paging, map_success_page_table_not_present)
     };
 
     // Physical address for the new page table
-    kpmm_alloc_fake.handler = kpmm_alloc_handler_map_success_page_table_not_present;
+    kpmm_allocZeroed_fake.handler = kpmm_allocZeroed_handler_map_success_page_table_not_present;
 
     // 1. We want the PTE entry at index 2 for temporary map, so we set it up as follows.
     // 1. Present bit is 0 (To indicate that nothing is already mapped).
@@ -425,6 +513,727 @@ TEST (paging, unmap_failure_va_not_aligned)
     END();
 }
 
+// ------------------------------------------------------------------------------------------------
+// Test: Mapping page frames to unmapped pages of a range
+// ------------------------------------------------------------------------------------------------
+
+TEST (paging, map_unmapped_pages_success)
+{
+    PTR va = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] to PT[4] will be used.
+    Physical frames[] = { PHYSICAL (0x12000), PHYSICAL (0x13000), PHYSICAL (0x14000) };
+
+    // Page Table requires at-least six entries.
+    __attribute__ ((aligned (4096))) ArchPageTableEntry pt[] = {
+        { .present = 0 }, // Not used.
+        { .present = 1 }, // Already mapped. Skipped.
+        { .present = 0 }, // Gets the first page frame.
+        { .present = 1 }, // Already mapped. Skipped.
+        { .present = 0 }, // Gets the second page frame.
+        { .present = 0 }  // PTE which is used for temporary map.
+    };
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 }, // Not used.
+        { .present = 1 }, // Page table exists
+    };
+
+    s_getPteFromCurrentPd_fake.ret = &pt[5];
+    s_getLinearAddress_fake.ret    = pt;
+
+    SIZE framesUsed = 0;
+    EQ_SCALAR (kpg_mapUnmappedPages (pd, va, 4, frames, ARRAY_LENGTH (frames),
+                                     PG_MAP_FLAG_WRITABLE, &framesUsed),
+               true);
+    EQ_SCALAR (framesUsed, 2U);
+
+    EQ_SCALAR ((U32)pt[2].present, 1U);
+    EQ_SCALAR ((U32)pt[2].pageFrame, PHYSICAL_TO_PAGEFRAME (frames[0].val));
+    EQ_SCALAR ((U32)pt[2].write_allowed, 1U);
+    EQ_SCALAR ((U32)pt[4].present, 1U);
+    EQ_SCALAR ((U32)pt[4].pageFrame, PHYSICAL_TO_PAGEFRAME (frames[1].val));
+    EQ_SCALAR ((U32)pt[0].present, 0U);
+
+    // Page table is temporarily mapped only once. Its kmap slot keeps the PTE.
+    EQ_SCALAR ((U32)pt[5].present, 1U);
+    EQ_SCALAR (s_getPteFromCurrentPd_fake.invokeCount, 1U);
+    END();
+}
+
+TEST (paging, map_unmapped_pages_frames_run_out)
+{
+    PTR va = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] to PT[3] will be used.
+    Physical frames[] = { PHYSICAL (0x12000) };
+
+    __attribute__ ((aligned (4096))) ArchPageTableEntry pt[] = {
+        { .present = 0 }, // Not used.
+        { .present = 0 }, // Gets the only page frame.
+        { .present = 0 }, // Not mapped. No page frame left.
+        { .present = 0 }, // Not mapped. No page frame left.
+        { .present = 0 }  // PTE which is used for temporary map.
+    };
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 }, // Not used.
+        { .present = 1 }, // Page table exists
+    };
+
+    s_getPteFromCurrentPd_fake.ret = &pt[4];
+    s_getLinearAddress_fake.ret    = pt;
+
+    SIZE framesUsed = 0;
+    EQ_SCALAR (kpg_mapUnmappedPages (pd, va, 3, frames, ARRAY_LENGTH (frames),
+                                     UNITTEST_PG_MAP_DONT_CARE, &framesUsed),
+               true);
+    EQ_SCALAR (framesUsed, 1U);
+    EQ_SCALAR ((U32)pt[1].present, 1U);
+    EQ_SCALAR ((U32)pt[2].present, 0U);
+    EQ_SCALAR ((U32)pt[3].present, 0U);
+    END();
+}
+
+TEST (paging, map_unmapped_pages_failure_va_not_aligned)
+{
+    PTR va                    = 0xC01FF001; // Any misaligned virtual address.
+    ArchPageDirectoryEntry pd = { 0 };
+    Physical frames[]         = { PHYSICAL (0x12000) };
+
+    SIZE framesUsed = 0;
+    EQ_SCALAR (kpg_mapUnmappedPages (&pd, va, 1, frames, 1, UNITTEST_PG_MAP_DONT_CARE,
+                                     &framesUsed),
+               false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_WRONG_ALIGNMENT);
+    END();
+}
+
+// ------------------------------------------------------------------------------------------------
+// Test: Mapping and unmapping a range of pages
+// ------------------------------------------------------------------------------------------------
+
+// Range operations can read every entry of a page table, so these tests use complete ones.
+static __attribute__ ((aligned (4096))) ArchPageTableEntry s_rangePT[1024];
+static ArchPageTableEntry s_rangeTempPte; // PTE which is used for temporary map.
+
+TEST (paging, map_continous_success)
+{
+    PTR va      = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] to PT[3] will be used.
+    Physical pa = PHYSICAL (0x12000);
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 }, // Not used.
+        { .present = 1 }, // Page table exists
+    };
+
+    s_getPteFromCurrentPd_fake.ret = &s_rangeTempPte;
+    s_getLinearAddress_fake.ret    = s_rangePT;
+
+    EQ_SCALAR (kpg_mapContinous (pd, va, pa, 3, PG_MAP_FLAG_WRITABLE), true);
+
+    for (UINT i = 1; i <= 3; i++) {
+        EQ_SCALAR ((U32)s_rangePT[i].present, 1U);
+        EQ_SCALAR ((U32)s_rangePT[i].write_allowed, 1U);
+        EQ_SCALAR ((U32)s_rangePT[i].pageFrame, PHYSICAL_TO_PAGEFRAME (pa.val) + i - 1);
+    }
+    EQ_SCALAR ((U32)s_rangePT[4].present, 0U);
+
+    // Page table is temporarily mapped only once. Its kmap slot keeps the PTE.
+    EQ_SCALAR ((U32)s_rangeTempPte.present, 1U);
+    EQ_SCALAR (s_getPteFromCurrentPd_fake.invokeCount, 1U);
+    END();
+}
+
+TEST (paging, map_continous_failure_double_allocate)
+{
+    PTR va      = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] to PT[3] will be used.
+    Physical pa = PHYSICAL (0x12000);
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 }, // Not used.
+        { .present = 1 }, // Page table exists
+    };
+
+    s_rangePT[2].present           = 1; // Already mapped.
+    s_getPteFromCurrentPd_fake.ret = &s_rangeTempPte;
+    s_getLinearAddress_fake.ret    = s_rangePT;
+
+    EQ_SCALAR (kpg_mapContinous (pd, va, pa, 3, UNITTEST_PG_MAP_DONT_CARE), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_DOUBLE_ALLOC);
+
+    // Pages before the one already mapped remain mapped.
+    EQ_SCALAR ((U32)s_rangePT[1].present, 1U);
+    EQ_SCALAR ((U32)s_rangePT[3].present, 0U);
+    END();
+}
+
+TEST (paging, unmap_range_success_page_table_freed)
+{
+    PTR va = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] to PT[3] will be used.
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 },                      // Not used.
+        { .present = 1, .pageTableFrame = 5 }, // Page table exists
+    };
+
+    s_rangePT[1] = (ArchPageTableEntry){ .present = 1, .pageFrame = 0x12 };
+    s_rangePT[2] = (ArchPageTableEntry){ .present = 1, .pageFrame = 0x13 };
+    // PT[3] is not mapped and is skipped.
+
+    SET_MACRO_MOCK (kernel_pde_index, 768);
+    s_getPteFromCurrentPd_fake.ret = &s_rangeTempPte;
+    s_getLinearAddress_fake.ret    = s_rangePT;
+    kpmm_free_fake.ret             = true;
+
+    EQ_SCALAR (kpg_unmapRange (pd, va, 3, PG_UNMAP_FLAG_FREE_FRAMES), true);
+
+    EQ_SCALAR ((U32)s_rangePT[1].present, 0U);
+    EQ_SCALAR ((U32)s_rangePT[2].present, 0U);
+
+    // Two page frames and the page table, which has no mapping left, are freed.
+    EQ_SCALAR (kpmm_free_fake.invokeCount, 3U);
+    EQ_SCALAR ((U32)pd[1].present, 0U);
+    END();
+}
+
+TEST (paging, unmap_range_success_page_table_in_use)
+{
+    PTR va = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] will be used.
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 }, // Not used.
+        { .present = 1 }, // Page table exists
+    };
+
+    s_rangePT[1] = (ArchPageTableEntry){ .present = 1, .pageFrame = 0x12 };
+    s_rangePT[9] = (ArchPageTableEntry){ .present = 1, .pageFrame = 0x13 }; // Outside the range.
+
+    SET_MACRO_MOCK (kernel_pde_index, 768);
+    s_getPteFromCurrentPd_fake.ret = &s_rangeTempPte;
+    s_getLinearAddress_fake.ret    = s_rangePT;
+
+    EQ_SCALAR (kpg_unmapRange (pd, va, 1, 0), true);
+
+    EQ_SCALAR ((U32)s_rangePT[1].present, 0U);
+    EQ_SCALAR ((U32)s_rangePT[9].present, 1U);
+    EQ_SCALAR (kpmm_free_fake.invokeCount, 0U);
+    EQ_SCALAR ((U32)pd[1].present, 1U);
+    END();
+}
+
+TEST (paging, unmap_range_success_kernel_page_table_kept)
+{
+    PTR va = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] will be used.
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 }, // Not used.
+        { .present = 1 }, // Page table exists
+    };
+
+    s_rangePT[1] = (ArchPageTableEntry){ .present = 1, .pageFrame = 0x12 };
+
+    // Page tables of the kernel address space are shared, so they are not freed even if empty.
+    SET_MACRO_MOCK (kernel_pde_index, 1);
+    s_getPteFromCurrentPd_fake.ret = &s_rangeTempPte;
+    s_getLinearAddress_fake.ret    = s_rangePT;
+
+    EQ_SCALAR (kpg_unmapRange (pd, va, 1, 0), true);
+
+    EQ_SCALAR ((U32)s_rangePT[1].present, 0U);
+    EQ_SCALAR (kpmm_free_fake.invokeCount, 0U);
+    EQ_SCALAR ((U32)pd[1].present, 1U);
+    END();
+}
+
+TEST (paging, unmap_range_failure_va_not_aligned)
+{
+    PTR va                    = 0xC01FF001; // Any misaligned virtual address.
+    ArchPageDirectoryEntry pd = { 0 };
+
+    EQ_SCALAR (kpg_unmapRange (&pd, va, 1, 0), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_WRONG_ALIGNMENT);
+    END();
+}
+
+// ------------------------------------------------------------------------------------------------
+// Test: Sharing and remapping pages
+// ------------------------------------------------------------------------------------------------
+
+static __attribute__ ((aligned (4096))) ArchPageTableEntry s_sharePT[1024]; // Destination PT.
+
+// Source page table is mapped in the first kmap slot, destination in the second one.
+static void* s_getSharePTLinearAddress_handler (UINT pdeIndex, UINT pteIndex, UINT offset)
+{
+    (void)pdeIndex;
+    (void)offset;
+    return (pteIndex == 0) ? s_rangePT : s_sharePT;
+}
+
+TEST (paging, share_mappings_success)
+{
+    PTR va = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] to PT[3] will be used.
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry srcPD[] = {
+        { .present = 0 },                      // Not used.
+        { .present = 1, .pageTableFrame = 5 }, // Page table exists
+        { .present = 1, .pageTableFrame = 7 }, // Recursive map.
+    };
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry destPD[] = {
+        { .present = 0 },                      // Not used.
+        { .present = 1, .pageTableFrame = 6 }, // Page table exists
+        { .present = 1, .pageTableFrame = 8 }, // Recursive map.
+    };
+
+    s_rangePT[1] = (ArchPageTableEntry){ .present = 1, .write_allowed = 1, .pageFrame = 0x12 };
+    s_rangePT[3] = (ArchPageTableEntry){ .present = 1, .write_allowed = 1, .pageFrame = 0x13 };
+    // PT[2] is not mapped and is skipped.
+
+    SET_MACRO_MOCK (recursive_pde_index, 2);
+    s_getPdeFromCurrentPd_fake.ret     = &srcPD[2]; // Source is the loaded page directory.
+    s_getPteFromCurrentPd_fake.handler = s_getKmapPte_handler;
+    s_getLinearAddress_fake.handler    = s_getSharePTLinearAddress_handler;
+    kpmm_share_fake.ret                = true;
+
+    EQ_SCALAR (kpg_shareMappings (srcPD, destPD, va, 3, PG_MAP_FLAG_WRITABLE), true);
+    EQ_SCALAR (kpmm_share_fake.invokeCount, 2U);
+
+    // Both sides map the same page frames, which are read-only until written.
+    for (UINT i = 1; i <= 3; i += 2) {
+        EQ_SCALAR ((U32)s_sharePT[i].present, 1U);
+        EQ_SCALAR ((U32)s_sharePT[i].pageFrame, (U32)s_rangePT[i].pageFrame);
+        EQ_SCALAR ((U32)s_sharePT[i].write_allowed, 0U);
+        EQ_SCALAR ((U32)s_rangePT[i].write_allowed, 0U);
+    }
+    EQ_SCALAR ((U32)s_sharePT[2].present, 0U);
+    END();
+}
+
+TEST (paging, share_mappings_failure_already_mapped)
+{
+    PTR va = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] to PT[2] will be used.
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry srcPD[] = {
+        { .present = 0 },                      // Not used.
+        { .present = 1, .pageTableFrame = 5 }, // Page table exists
+        { .present = 1, .pageTableFrame = 7 }, // Recursive map.
+    };
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry destPD[] = {
+        { .present = 0 },                      // Not used.
+        { .present = 1, .pageTableFrame = 6 }, // Page table exists
+        { .present = 1, .pageTableFrame = 8 }, // Recursive map.
+    };
+
+    s_rangePT[1] = (ArchPageTableEntry){ .present = 1, .write_allowed = 1, .pageFrame = 0x12 };
+    s_rangePT[2] = (ArchPageTableEntry){ .present = 1, .write_allowed = 1, .pageFrame = 0x13 };
+    s_sharePT[2] = (ArchPageTableEntry){ .present = 1, .pageFrame = 0x20 }; // Already mapped.
+
+    SET_MACRO_MOCK (recursive_pde_index, 2);
+    s_getPdeFromCurrentPd_fake.ret     = &destPD[2]; // Source is not the loaded page directory.
+    s_getPteFromCurrentPd_fake.handler = s_getKmapPte_handler;
+    s_getLinearAddress_fake.handler    = s_getSharePTLinearAddress_handler;
+    kpmm_share_fake.ret                = true;
+
+    EQ_SCALAR (kpg_shareMappings (srcPD, destPD, va, 2, UNITTEST_PG_MAP_DONT_CARE), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_DOUBLE_ALLOC);
+
+    // Page before the one already mapped is shared, rest is left as it was.
+    EQ_SCALAR (kpmm_share_fake.invokeCount, 1U);
+    EQ_SCALAR ((U32)s_rangePT[1].write_allowed, 0U);
+    EQ_SCALAR ((U32)s_rangePT[2].write_allowed, 1U);
+    EQ_SCALAR ((U32)s_sharePT[2].pageFrame, 0x20U);
+    END();
+}
+
+TEST (paging, remap_success)
+{
+    PTR va      = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] will be used.
+    Physical pa = PHYSICAL (0x20000);
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 }, // Not used.
+        { .present = 1 }, // Page table exists
+    };
+
+    s_rangePT[1] = (ArchPageTableEntry){ .present = 1, .pageFrame = 0x12 };
+
+    s_getPteFromCurrentPd_fake.ret = &s_rangeTempPte;
+    s_getLinearAddress_fake.ret    = s_rangePT;
+
+    EQ_SCALAR (kpg_remap (pd, va, pa, PG_MAP_FLAG_WRITABLE), true);
+    EQ_SCALAR ((U32)s_rangePT[1].present, 1U);
+    EQ_SCALAR ((U32)s_rangePT[1].write_allowed, 1U);
+    EQ_SCALAR ((U32)s_rangePT[1].pageFrame, PHYSICAL_TO_PAGEFRAME (pa.val));
+    END();
+}
+
+TEST (paging, remap_failure_not_mapped)
+{
+    PTR va      = (0x1 << PDE_SHIFT) | (0x1 << PTE_SHIFT); // PD[1] & PT[1] will be used.
+    Physical pa = PHYSICAL (0x20000);
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 }, // Not used.
+        { .present = 1 }, // Page table exists
+    };
+
+    s_getPteFromCurrentPd_fake.ret = &s_rangeTempPte;
+    s_getLinearAddress_fake.ret    = s_rangePT;
+
+    EQ_SCALAR (kpg_remap (pd, va, pa, PG_MAP_FLAG_WRITABLE), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_PAGE_WRONG_STATE);
+
+    // Page table does not exist for PD[0].
+    EQ_SCALAR (kpg_remap (pd, 0x0, pa, 0), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_PAGE_WRONG_STATE);
+    END();
+}
+
+// ------------------------------------------------------------------------------------------------
+// Test: Large pages
+// NOTE: Large pages cannot be turned off, so these tests must run after the other map tests.
+// ------------------------------------------------------------------------------------------------
+
+#define UT_LARGE_PAGE_FLAGS \
+    PG_MAP_FLAG_KERNEL | PG_MAP_FLAG_WRITABLE | PG_MAP_FLAG_CACHE_ENABLED | PG_MAP_FLAG_LARGE_PAGES
+
+static Physical s_largeFreedPA;
+static UINT s_largeFreedCount;
+
+static bool kpmm_free_handler_large (Physical pa, UINT count)
+{
+    s_largeFreedPA    = pa;
+    s_largeFreedCount = count;
+    return true;
+}
+
+static bool kpmm_allocZeroed_handler_large (Physical* pa, KernelPhysicalMemoryRegions reg)
+{
+    (void)reg;
+    pa->val = 0x20000;
+    return true;
+}
+
+TEST (paging, large_pages_not_supported)
+{
+    SET_MACRO_MOCK (is_large_pages_supported, 0);
+
+    EQ_SCALAR (kpg_enableLargePages(), false);
+    EQ_SCALAR (kpg_getLargePageSizeBytes(), 0U);
+    END();
+}
+
+TEST (paging, large_pages_map_continous_success)
+{
+    PTR va      = 0x1 << PDE_SHIFT; // PD[1] to PD[3] will be used.
+    Physical pa = PHYSICAL (LARGE_PAGE_SIZE_BYTES);
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 },                          // Not used.
+        { .present = 0 },                          // Large page is mapped here.
+        { .present = 1, .pageTableFrame = 0x100 }, // Page table with no mapping, replaced.
+        { .present = 0 },                          // Page table for the last pages.
+        { .present = 0 },                          // Recursive map.
+    };
+
+    SET_MACRO_MOCK (is_large_pages_supported, 1);
+    SET_MACRO_MOCK (kernel_pde_index, 1);
+    SET_MACRO_MOCK (recursive_pde_index, 4);
+    s_getPteFromCurrentPd_fake.ret = &s_rangeTempPte;
+    s_getLinearAddress_fake.ret    = s_rangePT;
+    kpmm_free_fake.handler         = kpmm_free_handler_large;
+    kpmm_allocZeroed_fake.handler  = kpmm_allocZeroed_handler_large;
+
+    EQ_SCALAR (kpg_enableLargePages(), true);
+    EQ_SCALAR (kpg_getLargePageSizeBytes(), LARGE_PAGE_SIZE_BYTES);
+
+    EQ_SCALAR (kpg_mapContinous (pd, va, pa, 2 * LARGE_PAGE_PAGE_COUNT + 2, UT_LARGE_PAGE_FLAGS),
+               true);
+
+    for (UINT i = 1; i <= 2; i++) {
+        EQ_SCALAR ((U32)pd[i].present, 1U);
+        EQ_SCALAR ((U32)pd[i].page_size, 1U);
+        EQ_SCALAR ((U32)pd[i].write_allowed, 1U);
+        EQ_SCALAR ((U32)pd[i].user_accessable, 0U);
+        EQ_SCALAR ((U32)pd[i].pageTableFrame, PHYSICAL_TO_PAGEFRAME (i * LARGE_PAGE_SIZE_BYTES));
+    }
+
+    // Page table which had no mapping is freed.
+    EQ_SCALAR (s_largeFreedPA.val, PAGEFRAME_TO_PHYSICAL (0x100));
+    EQ_SCALAR (s_largeFreedCount, 1U);
+
+    // Pages after the last whole large page are mapped in a page table.
+    EQ_SCALAR ((U32)pd[3].present, 1U);
+    EQ_SCALAR ((U32)pd[3].page_size, 0U);
+    EQ_SCALAR ((U32)s_rangePT[0].present, 1U);
+    EQ_SCALAR ((U32)s_rangePT[0].pageFrame, PHYSICAL_TO_PAGEFRAME (3 * LARGE_PAGE_SIZE_BYTES));
+    EQ_SCALAR ((U32)s_rangePT[1].present, 1U);
+    EQ_SCALAR ((U32)s_rangePT[2].present, 0U);
+    END();
+}
+
+TEST (paging, large_pages_map_continous_user_space)
+{
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 1 }, // Page table exists.
+        { .present = 0 }, // Not used.
+    };
+
+    SET_MACRO_MOCK (kernel_pde_index, 1);
+    SET_MACRO_MOCK (recursive_pde_index, 4);
+    s_getPteFromCurrentPd_fake.ret = &s_rangeTempPte;
+    s_getLinearAddress_fake.ret    = s_rangePT;
+
+    // Large pages are only used in the kernel address space.
+    EQ_SCALAR (kpg_mapContinous (pd, 0x0, createPhysical (0), LARGE_PAGE_PAGE_COUNT,
+                                 UT_LARGE_PAGE_FLAGS),
+               true);
+    EQ_SCALAR ((U32)pd[0].page_size, 0U);
+    EQ_SCALAR ((U32)s_rangePT[0].present, 1U);
+    EQ_SCALAR ((U32)s_rangePT[1023].present, 1U);
+    END();
+}
+
+TEST (paging, large_pages_lookup_and_unmap)
+{
+    PTR va = 0x1 << PDE_SHIFT; // PD[1] will be used.
+
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 }, // Not used.
+        { .present = 1, .page_size = 1, .pageTableFrame = LARGE_PAGE_PAGE_COUNT }, // Large page.
+    };
+
+    SET_MACRO_MOCK (kernel_pde_index, 1);
+    SET_MACRO_MOCK (recursive_pde_index, 4);
+    kpmm_free_fake.handler = kpmm_free_handler_large;
+
+    Physical pa = { 0 };
+    EQ_SCALAR (kpg_doesMappingExists (pd, va + 0x1234, &pa), true);
+    EQ_SCALAR (pa.val, LARGE_PAGE_SIZE_BYTES + 0x1234);
+
+    // Pages of a large page are already mapped, and are not removed one at a time.
+    EQ_SCALAR (kpg_map (pd, va + 0x1000, createPhysical (0x12000), UNITTEST_PG_MAP_DONT_CARE),
+               false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_DOUBLE_ALLOC);
+    EQ_SCALAR (kpg_unmap (pd, va), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_RANGE);
+    EQ_SCALAR (kpg_unmapRange (pd, va, 1, PG_UNMAP_FLAG_FREE_FRAMES), false);
+    EQ_SCALAR (g_kstate.errorNumber, (UINT)ERR_INVALID_RANGE);
+    EQ_SCALAR ((U32)pd[1].present, 1U);
+
+    // Large page stays mapped if its page frames cannot be freed.
+    kpmm_free_fake.handler = NULL;
+    kpmm_free_fake.ret     = false;
+    EQ_SCALAR (kpg_unmapRange (pd, va, LARGE_PAGE_PAGE_COUNT, PG_UNMAP_FLAG_FREE_FRAMES), false);
+    EQ_SCALAR ((U32)pd[1].present, 1U);
+    EQ_SCALAR ((U32)pd[1].page_size, 1U);
+
+    // Whole large page is removed and its page frames are freed.
+    kpmm_free_fake.handler = kpmm_free_handler_large;
+    EQ_SCALAR (kpg_unmapRange (pd, va, LARGE_PAGE_PAGE_COUNT, PG_UNMAP_FLAG_FREE_FRAMES), true);
+    EQ_SCALAR ((U32)pd[1].present, 0U);
+    EQ_SCALAR (s_largeFreedPA.val, LARGE_PAGE_SIZE_BYTES);
+    EQ_SCALAR (s_largeFreedCount, LARGE_PAGE_PAGE_COUNT);
+    END();
+}
+
+// ------------------------------------------------------------------------------------------------
+// Test: Direct map of physical memory
+// NOTE: Direct map cannot be removed once set up, so these tests must run last.
+// ------------------------------------------------------------------------------------------------
+
+#define UT_DIRECT_MAP_START (0x2U << PDE_SHIFT) // PD[2] is used for the direct map.
+
+TEST (paging, direct_map_setup_success)
+{
+    __attribute__ ((aligned (4096))) ArchPageDirectoryEntry pd[] = {
+        { .present = 0 }, // Not used.
+        { .present = 0 }, // Not used.
+        { .present = 1 }, // Page table exists
+    };
+
+    // Only installed memory is mapped.
+    SET_MACRO_MOCK (direct_map_start, UT_DIRECT_MAP_START);
+    SET_MACRO_MOCK (direct_map_len_bytes, 256 * MB);
+    kpmm_getUsableMemorySize_fake.ret = 3 * CONFIG_PAGE_FRAME_SIZE_BYTES;
+    s_getPdeFromCurrentPd_fake.ret    = pd;
+    s_getPteFromCurrentPd_fake.ret    = &s_rangeTempPte;
+    s_getLinearAddress_fake.ret       = s_rangePT;
+
+    EQ_SCALAR (kpg_setupDirectMap(), true);
+
+    for (UINT i = 0; i < 3; i++) {
+        EQ_SCALAR ((U32)s_rangePT[i].present, 1U);
+        EQ_SCALAR ((U32)s_rangePT[i].pageFrame, i);
+        EQ_SCALAR ((U32)s_rangePT[i].user_accessable, 0U);
+    }
+    EQ_SCALAR ((U32)s_rangePT[3].present, 0U);
+
+    Physical inside  = PHYSICAL (0x2345);
+    Physical outside = PHYSICAL (3 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+    EQ_SCALAR ((PTR)kpg_getDirectMapAddress (inside), (PTR)UT_DIRECT_MAP_START + 0x2345);
+    EQ_SCALAR ((PTR)kpg_getDirectMapAddress (outside), (PTR)NULL);
+    END();
+}
+
+TEST (paging, direct_map_temporary_map)
+{
+    SET_MACRO_MOCK (direct_map_start, UT_DIRECT_MAP_START);
+    s_getPteFromCurrentPd_fake.ret = &s_rangeTempPte;
+
+    // Page in the direct map is not mapped again.
+    Physical pa = PHYSICAL (0x2000);
+    EQ_SCALAR ((PTR)kpg_temporaryMap (pa), (PTR)UT_DIRECT_MAP_START + 0x2000);
+    EQ_SCALAR ((U32)s_rangeTempPte.present, 0U);
+
+    // Page beyond the direct map uses a kmap slot, nested in the direct map one.
+    Physical beyond = PHYSICAL (0x12000);
+    kpg_temporaryMap (beyond);
+    EQ_SCALAR ((U32)s_rangeTempPte.present, 1U);
+    EQ_SCALAR ((U32)s_rangeTempPte.pageFrame, PHYSICAL_TO_PAGEFRAME (beyond.val));
+
+    kpg_temporaryUnmap();
+    kpg_temporaryUnmap();
+    EQ_SCALAR (panic_invoked, false);
+    EQ_SCALAR (s_kmap.depth, 0U);
+    END();
+}
+
+// ------------------------------------------------------------------------------------------------
+// Test: Preallocation of kernel page tables
+// ------------------------------------------------------------------------------------------------
+// Note: Must run last. Kernel page tables must not be created after this.
+
+static __attribute__ ((aligned (4096))) ArchPageDirectoryEntry s_preallocPD[5];
+static UINT s_preallocNextFrame;
+
+static ArchPageDirectoryEntry* s_getPreallocPde_handler (UINT pdeIndex)
+{
+    return &s_preallocPD[pdeIndex];
+}
+
+static bool kpmm_allocZeroed_handler_prealloc (Physical* pa, KernelPhysicalMemoryRegions reg)
+{
+    (void)reg;
+    pa->val = 0x10000 + (s_preallocNextFrame++ * CONFIG_PAGE_FRAME_SIZE_BYTES);
+    return true;
+}
+
+TEST (paging, preallocate_kernel_page_tables)
+{
+    SET_MACRO_MOCK (kernel_pde_index, 1);
+    SET_MACRO_MOCK (recursive_pde_index, 4);
+    s_getPdeFromCurrentPd_fake.handler = s_getPreallocPde_handler;
+    kpmm_allocZeroed_fake.handler      = kpmm_allocZeroed_handler_prealloc;
+
+    s_preallocPD[2].present        = 1; // Kernel page table which already exists.
+    s_preallocPD[2].pageTableFrame = 0xBB;
+
+    kpg_preallocateKernelPageTables();
+
+    // Page tables are created from the kernel PDE index till the recursive PDE index.
+    EQ_SCALAR ((U32)s_preallocPD[0].present, 0U);
+    EQ_SCALAR ((U32)s_preallocPD[1].present, 1U);
+    EQ_SCALAR ((U32)s_preallocPD[1].pageTableFrame, PHYSICAL_TO_PAGEFRAME (0x10000));
+    EQ_SCALAR ((U32)s_preallocPD[1].user_accessable, 0U);
+    EQ_SCALAR ((U32)s_preallocPD[1].write_allowed, 1U);
+    EQ_SCALAR ((U32)s_preallocPD[2].pageTableFrame, 0xBBU);
+    EQ_SCALAR ((U32)s_preallocPD[3].present, 1U);
+    EQ_SCALAR ((U32)s_preallocPD[3].pageTableFrame, PHYSICAL_TO_PAGEFRAME (0x11000));
+    EQ_SCALAR ((U32)s_preallocPD[4].present, 0U);
+    EQ_SCALAR (kpmm_allocZeroed_fake.invokeCount, 2U);
+    END();
+}
+
+// ------------------------------------------------------------------------------------------------
+// Test: Global pages
+// ------------------------------------------------------------------------------------------------
+// Note: Must run after preallocate_kernel_page_tables. Global pages cannot be turned off.
+
+static __attribute__ ((aligned (4096))) ArchPageDirectoryEntry s_globalPD[3];
+static ArchPageTableEntry s_globalPT[3][1024];
+
+static ArchPageDirectoryEntry* s_getGlobalPde_handler (UINT pdeIndex)
+{
+    return &s_globalPD[pdeIndex];
+}
+
+static ArchPageTableEntry* s_getGlobalPte_handler (UINT pdeIndex, UINT pteIndex)
+{
+    return &s_globalPT[pdeIndex][pteIndex];
+}
+
+TEST (paging, global_pages_not_supported)
+{
+    SET_MACRO_MOCK (is_global_pages_supported, 0);
+    SET_MACRO_MOCK (kernel_pde_index, 1);
+    SET_MACRO_MOCK (recursive_pde_index, 3);
+    s_getPdeFromCurrentPd_fake.handler = s_getGlobalPde_handler;
+    s_getPteFromCurrentPd_fake.handler = s_getGlobalPte_handler;
+
+    s_globalPD[1].present    = 1;
+    s_globalPT[1][0].present = 1;
+
+    EQ_SCALAR (kpg_enableGlobalPages(), false);
+    EQ_SCALAR ((U32)s_globalPT[1][0].global_page, 0U);
+    END();
+}
+
+TEST (paging, global_pages_enable_success)
+{
+    SET_MACRO_MOCK (is_global_pages_supported, 1);
+    SET_MACRO_MOCK (kernel_pde_index, 1);
+    SET_MACRO_MOCK (recursive_pde_index, 3);
+    SET_MACRO_MOCK (kmap_first_pte_index, 2);
+    s_getPdeFromCurrentPd_fake.handler = s_getGlobalPde_handler;
+    s_getPteFromCurrentPd_fake.handler = s_getGlobalPte_handler;
+    s_getLinearAddress_fake.ret        = s_rangePT;
+
+    for (UINT i = 0; i < ARRAY_LENGTH (s_globalPD); i++) {
+        s_globalPD[i].present        = 1;
+        s_globalPD[i].pageTableFrame = 0x100; // Beyond the direct map, so uses a kmap slot.
+    }
+    s_globalPT[0][0].present = 1; // Below the kernel address space.
+    s_globalPT[1][0].present = 1; // Kernel mapping.
+    s_globalPT[1][2].present = 1; // Kmap slot.
+    s_globalPT[2][5].present = 1; // Kernel mapping.
+
+    EQ_SCALAR (kpg_enableGlobalPages(), true);
+    EQ_SCALAR ((U32)s_globalPT[0][0].global_page, 0U);
+    EQ_SCALAR ((U32)s_globalPT[1][0].global_page, 1U);
+    EQ_SCALAR ((U32)s_globalPT[1][2].global_page, 0U);
+    EQ_SCALAR ((U32)s_globalPT[2][5].global_page, 1U);
+
+    // New mappings in the kernel address space are global. Others and kmap slots are not.
+    PTR kernelVA = (0x2 << PDE_SHIFT) | (0x1 << PTE_SHIFT);
+    PTR userVA   = (0x0 << PDE_SHIFT) | (0x3 << PTE_SHIFT);
+    EQ_SCALAR (kpg_map (s_globalPD, kernelVA, createPhysical (0x12000), UNITTEST_PG_MAP_DONT_CARE),
+               true);
+    EQ_SCALAR (kpg_map (s_globalPD, userVA, createPhysical (0x13000), PG_MAP_FLAG_WRITABLE), true);
+
+    EQ_SCALAR ((U32)s_rangePT[1].present, 1U);
+    EQ_SCALAR ((U32)s_rangePT[1].global_page, 1U);
+    EQ_SCALAR ((U32)s_rangePT[3].present, 1U);
+    EQ_SCALAR ((U32)s_rangePT[3].global_page, 0U);
+    EQ_SCALAR ((U32)s_globalPT[1][2].present, 1U);
+    EQ_SCALAR ((U32)s_globalPT[1][2].global_page, 0U);
+    END();
+}
+
+TEST (paging, global_pages_large_page)
+{
+    SET_MACRO_MOCK (is_global_pages_supported, 1);
+    SET_MACRO_MOCK (kernel_pde_index, 1);
+    SET_MACRO_MOCK (recursive_pde_index, 3);
+    SET_MACRO_MOCK (kmap_first_pte_index, 2);
+    s_getPdeFromCurrentPd_fake.handler = s_getGlobalPde_handler;
+    s_getPteFromCurrentPd_fake.handler = s_getGlobalPte_handler;
+
+    s_globalPD[2]            = (ArchPageDirectoryEntry){ .present = 1, .page_size = 1 };
+    s_globalPT[2][7].present = 1; // Not a page table, so must not be changed.
+
+    EQ_SCALAR (kpg_enableGlobalPages(), true);
+    EQ_SCALAR ((U32)s_globalPD[2].global_page, 1U);
+    EQ_SCALAR ((U32)s_globalPT[2][7].global_page, 0U);
+    END();
+}
+
 // ------------------------------------------------------------------------------------------------
 
 void* k_memcpy_handler_fn (void* dest, const void* src, size_t n) { return memcpy (dest, src, n); }
@@ -436,6 +1245,13 @@ void yt_reset(void)
     resetStdLibFake();
     resetPmm();
 
+    memset (s_rangePT, 0, sizeof (s_rangePT));
+    memset (&s_rangeTempPte, 0, sizeof (s_rangeTempPte));
+    memset (s_sharePT, 0, sizeof (s_sharePT));
+    memset (&s_kmap, 0, sizeof (s_kmap));
+    memset (s_kmapPtes, 0, sizeof (s_kmapPtes));
+    SET_MACRO_MOCK (kernel_pde_index, 0);
+
     k_memcpy_fake.handler = k_memcpy_handler_fn;
 }
 
@@ -448,7 +1264,10 @@ int main(void)
 
     temporary_map_success();
     temporary_map_failure_input_not_aligned();
-    temporary_map_failure_already_mapped();
+    temporary_map_success_nested();
+    temporary_map_success_cache_hit();
+    temporary_map_success_slots_recycled();
+    temporary_map_failure_nested_too_deep();
 
     get_currentpd_success();
 
@@ -464,5 +1283,36 @@ int main(void)
     unmap_failure_double_unmap();
     unmap_failure_page_table_not_present();
 
+    map_unmapped_pages_success();
+    map_unmapped_pages_frames_run_out();
+    map_unmapped_pages_failure_va_not_aligned();
+
+    map_continous_success();
+    map_continous_failure_double_allocate();
+
+    unmap_range_success_page_table_freed();
+    unmap_range_success_page_table_in_use();
+    unmap_range_success_kernel_page_table_kept();
+    unmap_range_failure_va_not_aligned();
+
+    share_mappings_success();
+    share_mappings_failure_already_mapped();
+    remap_success();
+    remap_failure_not_mapped();
+
+    large_pages_not_supported();
+    large_pages_map_continous_success();
+    large_pages_map_continous_user_space();
+    large_pages_lookup_and_unmap();
+
+    direct_map_setup_success();
+    direct_map_temporary_map();
+
+    preallocate_kernel_page_tables();
+
+    global_pages_not_supported();
+    global_pages_enable_success();
+    global_pages_large_page();
+
     RETURN_WITH_REPORT();
 }
@@ -2,10 +2,71 @@
 #define YUKTI_TEST_IMPLEMENTATION
 #include <unittest/yukti.h>
 #include <mock/kernel/x86/boot.h>
+#include <mock/kernel/paging.h>
 #include <moslimits.h>
+#include <memloc.h>
 #include <pmm.h>
+#include <panic.h>
 #include <kerror.h>
 
+/*
+ * TEST CASES
+ * =================================================================================================
+ * kpmm_arch_getInstalledMemoryByteCount:
+ * 1. Sum of memory map items         | Installed RAM size            | actual_accessable_ram
+ *
+ * kpmm_arch_getPageFrameCount:
+ * 1. Free memory below 4 GB          | Till end of last free item    | pageFrameCount_lastFreeItem
+ * 2. Free memory beyond 4 GB         | Capped at 4 GB                | pageFrameCount_cappedAt4GB
+ *
+ * kpmm_arch_earlyAlloc:
+ * 1. Allocations after module files  | Consecutive pages and VA      | earlyAlloc_afterBootFiles
+ * 2. Early allocation region is full | panic                         | earlyAlloc_regionFull
+ * 3. No module files                 | After the kernel image        | earlyAlloc_noBootFiles
+ */
+
+#define EARLY_ALLOC_VA (0xC0200000U)
+
+typedef struct MemoryMapItem {
+    U64 baseAddr;
+    U64 length;
+    BootMemoryMapTypes type;
+} MemoryMapItem;
+
+static MemoryMapItem s_memoryMap[4];
+static Physical s_mappedPA;
+static SIZE s_mappedPageCount;
+
+static BootMemoryMapItem kboot_getBootMemoryMapItem_handler (INT index)
+{
+    return (BootMemoryMapItem){ s_memoryMap[index].baseAddr, s_memoryMap[index].length,
+                                s_memoryMap[index].type };
+}
+
+static BootFileItem kboot_getBootFileItem_handler (INT index)
+{
+    (void)index;
+    // Kernel and module files take 1 MB to 1 MB + 0x2800 bytes.
+    return (BootFileItem){ "KERNEL.FLT", 0x100000, 0x2800 };
+}
+
+static bool kpg_mapContinous_handler (PageDirectory pd, PTR vaStart, Physical paStart,
+                                      SIZE numPages, PagingMapFlags flags)
+{
+    (void)pd;
+    (void)vaStart;
+    (void)flags;
+    s_mappedPA        = paStart;
+    s_mappedPageCount = numPages;
+    return true;
+}
+
+static void set_memoryMap (UINT index, U64 baseAddr, U64 length, BootMemoryMapTypes type)
+{
+    s_memoryMap[index] = (MemoryMapItem){ baseAddr, length, type };
+    kboot_getBootMemoryMapItemCount_fake.ret = (U16)(index + 1);
+}
+
 TEST(PMM, actual_accessable_ram)
 {
     kboot_calculateInstalledMemory_fake.ret = 5 * MB;
@@ -19,14 +80,99 @@ TEST(PMM, actual_accessable_ram)
     END();
 }
 
+TEST (PMM, pageFrameCount_lastFreeItem)
+{
+    // QEMU memory map with 1 GB of RAM.
+    set_memoryMap (0, 0x0, 0x9FC00, MMTYPE_FREE);
+    set_memoryMap (1, 0x100000, 1 * GB - 0x120000, MMTYPE_FREE);
+    set_memoryMap (2, 1 * GB - 0x20000, 0x20000, MMTYPE_RESERVED);
+    set_memoryMap (3, 0xFFFC0000, 0x40000, MMTYPE_RESERVED);
+
+    EQ_SCALAR (kpmm_arch_getPageFrameCount(), (1 * GB - 0x20000) / CONFIG_PAGE_FRAME_SIZE_BYTES);
+    END();
+}
+
+TEST (PMM, pageFrameCount_cappedAt4GB)
+{
+    set_memoryMap (0, 0x0, 0x9FC00, MMTYPE_FREE);
+    set_memoryMap (1, 0x100000, 3 * (U64)GB - 0x100000, MMTYPE_FREE);
+    set_memoryMap (2, 4 * (U64)GB, 2 * (U64)GB, MMTYPE_FREE);
+
+    EQ_SCALAR (kpmm_arch_getPageFrameCount(), MAX_PAB_ADDRESSABLE_PAGE_COUNT);
+    END();
+}
+
+TEST (PMM, earlyAlloc_afterBootFiles)
+{
+    set_memoryMap (0, 0x0, 0x9FC00, MMTYPE_FREE);
+    set_memoryMap (1, 0x100000, 1 * MB, MMTYPE_FREE);
+
+    // Memory after the module files, rounded up to page boundary.
+    EQ_SCALAR (kpmm_arch_earlyAlloc (5000), EARLY_ALLOC_VA);
+    EQ_SCALAR (s_mappedPA.val, 0x103000U);
+    EQ_SCALAR (s_mappedPageCount, 2U);
+
+    // Next allocation follows the previous one, both physically and virtually.
+    EQ_SCALAR (kpmm_arch_earlyAlloc (4096), EARLY_ALLOC_VA + 0x2000);
+    EQ_SCALAR (s_mappedPA.val, 0x105000U);
+    EQ_SCALAR (s_mappedPageCount, 1U);
+
+    EQ_SCALAR (kpmm_arch_getEarlyAllocatedBytes(), 0x3000U);
+    END();
+}
+
+TEST (PMM, earlyAlloc_regionFull)
+{
+    set_memoryMap (0, 0x0, 0x9FC00, MMTYPE_FREE);
+    set_memoryMap (1, 0x100000, 16 * MB, MMTYPE_FREE);
+
+    // 3 pages are already allocated by the previous test.
+    SET_MACRO_MOCK (arch_mem_len_bytes_kernel_early_alloc, 0x4000);
+    kpmm_arch_earlyAlloc (2 * CONFIG_PAGE_FRAME_SIZE_BYTES);
+
+    EQ_SCALAR (panic_invoked, true);
+    EQ_SCALAR (kpg_mapContinous_fake.invokeCount, 0U);
+    END();
+}
+
+TEST (PMM, earlyAlloc_noBootFiles)
+{
+    set_memoryMap (0, 0x0, 0x9FC00, MMTYPE_FREE);
+    set_memoryMap (1, 0x100000, 1 * MB, MMTYPE_FREE);
+
+    // Kernel image ends after the pages allocated by the previous tests.
+    kboot_getBootFileItemCount_fake.ret = 0;
+    SET_MACRO_MOCK (arch_mem_end_physical_kernel_image, 0x180800);
+
+    EQ_SCALAR (kpmm_arch_earlyAlloc (4096), EARLY_ALLOC_VA + 0x3000);
+    EQ_SCALAR (s_mappedPA.val, 0x181000U);
+    END();
+}
+
 void yt_reset(void)
 {
     resetBootFake();
+    resetPagingFake();
+    panic_invoked = false;
+
+    SET_MACRO_MOCK (arch_mem_start_kernel_early_alloc, EARLY_ALLOC_VA);
+    SET_MACRO_MOCK (arch_mem_len_bytes_kernel_early_alloc, 2 * MB);
+    SET_MACRO_MOCK (arch_mem_end_physical_kernel_image, 0x100000);
+
+    kboot_getBootMemoryMapItem_fake.handler = kboot_getBootMemoryMapItem_handler;
+    kboot_getBootFileItemCount_fake.ret     = 1;
+    kboot_getBootFileItem_fake.handler      = kboot_getBootFileItem_handler;
+    kpg_mapContinous_fake.handler           = kpg_mapContinous_handler;
 }
 
 int main(void)
 {
     YT_INIT();
     actual_accessable_ram();
+    pageFrameCount_lastFreeItem();
+    pageFrameCount_cappedAt4GB();
+    earlyAlloc_afterBootFiles();
+    earlyAlloc_regionFull();
+    earlyAlloc_noBootFiles();
     RETURN_WITH_REPORT();
 }